@@ -0,0 +1,22 @@
+// SPDX-License-Identifier: MIT
+//
+// Shared harness for the bench/ programs: option parsing, a monotonic
+// clock and result output as a text table, JSON lines or CSV, so results
+// from several benchmarks can be concatenated and compared between runs.
+//
+// Common options: -n <iterations>  -f text|json|csv
+
+#pragma once
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Parse the common options; returns -1 after printing usage.
+int bench_init(int argc, char **argv, const char *bench, uint64_t default_iters);
+uint64_t bench_iters(void);
+uint64_t bench_now_ns(void);
+
+// Throughput result; bytes_per_op > 0 adds MB/s.
+void bench_report(const char *name, uint64_t ops, uint64_t elapsed_ns, size_t bytes_per_op);
+// Latency percentiles over n samples in ns; the array is sorted in place.
+void bench_report_latency(const char *name, uint64_t *samples_ns, size_t n);
@@ -0,0 +1,101 @@
+// SPDX-License-Identifier: MIT
+//
+// Micro-benchmark: per-send cost of a topology discovery CMDU via the
+// struct i1905_cmdu path, the streaming builder and the periodic template
+// cache. Sends go to an unbound port on the loopback transport, so no
+// syscall is involved and the numbers are build + pack + frame header only.
+
+#include "ieee1905.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERS 1000000
+#define BENCH_PORT    1
+#define SINK_PORT     9   // no endpoint, frames are discarded
+
+static const uint8_t iface_mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+// what every helper did before the builder: owning struct, TLV copies, pack
+static int send_struct(struct i1905_ctx *ctx) {
+    struct i1905_arena *arena = i1905_get_arena(ctx);
+    struct i1905_cmdu cmdu;
+    i1905_cmdu_init(&cmdu, arena, I1905_MSG_TOPOLOGY_DISCOVERY);
+    uint8_t al_mac[6];
+    i1905_get_al_mac(ctx, al_mac);
+    i1905_cmdu_add_mac(&cmdu, I1905_TLV_AL_MAC, al_mac);
+    i1905_cmdu_add_mac(&cmdu, I1905_TLV_MAC_ADDR, iface_mac);
+    int rv = i1905_send_cmdu(ctx, NULL, SINK_PORT, &cmdu);
+    i1905_arena_reset(arena);   // no event loop here to do it
+    return rv;
+}
+
+static int send_builder(struct i1905_ctx *ctx) {
+    uint8_t al_mac[6];
+    i1905_get_al_mac(ctx, al_mac);
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_TOPOLOGY_DISCOVERY);
+    i1905_builder_put_mac(&b, I1905_TLV_AL_MAC, al_mac);
+    i1905_builder_put_mac(&b, I1905_TLV_MAC_ADDR, iface_mac);
+    return i1905_builder_send(&b, ctx, NULL, SINK_PORT);
+}
+
+static int send_helper(struct i1905_ctx *ctx) {
+    return i1905_send_topology_discovery(ctx, NULL, SINK_PORT, iface_mac);
+}
+
+static struct i1905_peer *sink;
+
+static int send_peer(struct i1905_ctx *ctx) {
+    (void)ctx;
+    return i1905_peer_send_periodic(sink, I1905_MSG_TOPOLOGY_DISCOVERY, iface_mac);
+}
+
+static int build_only(struct i1905_ctx *ctx) {
+    static uint8_t buf[64];
+    uint8_t al_mac[6];
+    i1905_get_al_mac(ctx, al_mac);
+    struct i1905_builder b;
+    i1905_builder_begin_buf(&b, buf, sizeof(buf), I1905_MSG_TOPOLOGY_DISCOVERY);
+    i1905_builder_put_mac(&b, I1905_TLV_AL_MAC, al_mac);
+    i1905_builder_put_mac(&b, I1905_TLV_MAC_ADDR, iface_mac);
+    return i1905_builder_finish(&b);
+}
+
+static void run(const char *name, int (*fn)(struct i1905_ctx *), struct i1905_ctx *ctx) {
+    uint64_t iters = bench_iters();
+    for (uint64_t i = 0; i < iters / 10; i++) fn(ctx); // warm up
+    uint64_t t0 = bench_now_ns();
+    for (uint64_t i = 0; i < iters; i++) {
+        if (fn(ctx) < 0) {
+            fprintf(stderr, "%s failed\n", name);
+            exit(1);
+        }
+    }
+    bench_report(name, iters, bench_now_ns() - t0, 0);
+}
+
+int main(int argc, char **argv) {
+    if (bench_init(argc, argv, "builder", DEFAULT_ITERS) < 0) return 1;
+    struct i1905_opts opts = { .transport = I1905_TRANSPORT_LOOP };
+    struct i1905_ctx *ctx;
+    if (i1905_init_ex(&ctx, I1905_ROLE_AGENT, BENCH_PORT, NULL, NULL, NULL, &opts) < 0) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    sink = i1905_peer_open(ctx, NULL, SINK_PORT);
+    if (!sink) {
+        fprintf(stderr, "peer_open failed\n");
+        return 1;
+    }
+    run("discovery/struct_send", send_struct, ctx);
+    run("discovery/builder_send", send_builder, ctx);
+    run("discovery/template_helper", send_helper, ctx);
+    run("discovery/template_peer", send_peer, ctx);
+    run("discovery/builder_buffer", build_only, ctx);
+    i1905_peer_close(sink);
+    i1905_close(ctx);
+    return 0;
+}
@@ -0,0 +1,119 @@
+// SPDX-License-Identifier: MIT
+//
+// Codec throughput per message shape: encoding with the streaming builder,
+// zero-copy parsing (header + TLV walk), the schema check of
+// i1905_cmdu_view_validate() and the owning struct i1905_cmdu copy into an
+// arena reset per message. No transport is involved.
+
+#include "ieee1905.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERS 1000000
+#define MAX_TLV_LEN   4096
+
+struct shape {
+    const char *name;
+    uint16_t type;
+    uint8_t tlv_type;
+    unsigned n_tlvs;
+    uint16_t tlv_len;
+};
+
+static const struct shape shapes[] = {
+    { "discovery",       I1905_MSG_TOPOLOGY_DISCOVERY, I1905_TLV_MAC_ADDR, 2,  6 },
+    { "response_8x15",   I1905_MSG_TOPOLOGY_RESPONSE,  I1905_TLV_DEVICE_INFO, 8, 15 },
+    { "wsc_64",          I1905_MSG_AP_AUTOCONFIG_WSC,  I1905_TLV_WSC, 1, 64 },
+    { "wsc_512",         I1905_MSG_AP_AUTOCONFIG_WSC,  I1905_TLV_WSC, 1, 512 },
+    { "wsc_1024",        I1905_MSG_AP_AUTOCONFIG_WSC,  I1905_TLV_WSC, 1, 1024 },
+    { "vendor_16x64",    I1905_MSG_TOPOLOGY_RESPONSE,  I1905_TLV_VENDOR, 16, 64 },
+    { "vendor_16x1024",  I1905_MSG_TOPOLOGY_RESPONSE,  I1905_TLV_VENDOR, 16, 1024 },
+    { "response_64x15",  I1905_MSG_TOPOLOGY_RESPONSE,  I1905_TLV_DEVICE_INFO, 64, 15 },
+    { "wsc_4096",        I1905_MSG_AP_AUTOCONFIG_WSC,  I1905_TLV_WSC, 1, 4096 },
+};
+
+static uint8_t value[MAX_TLV_LEN];
+static uint8_t msg[I1905_MAX_MSG_SIZE];
+static struct i1905_arena *arena;
+static volatile size_t sink;    // keeps the parse loops from being optimised away
+
+static int encode(const struct shape *s) {
+    struct i1905_builder b;
+    i1905_builder_begin_buf(&b, msg, sizeof(msg), s->type);
+    for (unsigned i = 0; i < s->n_tlvs; i++) {
+        i1905_builder_put_tlv(&b, s->tlv_type, value, s->tlv_len);
+    }
+    return i1905_builder_finish(&b);
+}
+
+static void fail(const char *what, const struct shape *s) {
+    fprintf(stderr, "%s failed for %s\n", what, s->name);
+    exit(1);
+}
+
+static void run_shape(const struct shape *s) {
+    uint64_t iters = bench_iters();
+    char name[64];
+    int len = encode(s);
+    if (len < 0) fail("encode", s);
+
+    uint64_t t0 = bench_now_ns();
+    for (uint64_t i = 0; i < iters; i++) {
+        if (encode(s) < 0) fail("encode", s);
+    }
+    snprintf(name, sizeof(name), "encode/%s", s->name);
+    bench_report(name, iters, bench_now_ns() - t0, (size_t)len);
+
+    t0 = bench_now_ns();
+    for (uint64_t i = 0; i < iters; i++) {
+        struct i1905_cmdu_view view;
+        struct i1905_tlv_iter it;
+        struct i1905_tlv_view tlv;
+        if (i1905_cmdu_view_parse(&view, msg, (size_t)len) < 0) fail("parse", s);
+        size_t bytes = 0;
+        i1905_tlv_iter_init(&it, &view);
+        while (i1905_tlv_iter_next(&it, &tlv)) bytes += tlv.len;
+        sink = bytes;
+    }
+    snprintf(name, sizeof(name), "parse/%s", s->name);
+    bench_report(name, iters, bench_now_ns() - t0, (size_t)len);
+
+    // every TLV is checked before the required set is compared, so shapes
+    // missing a required TLV still cost a full pass
+    t0 = bench_now_ns();
+    for (uint64_t i = 0; i < iters; i++) {
+        struct i1905_cmdu_view view;
+        if (i1905_cmdu_view_parse(&view, msg, (size_t)len) < 0) fail("parse", s);
+        sink = (size_t)i1905_cmdu_view_validate(&view);
+    }
+    snprintf(name, sizeof(name), "validate/%s", s->name);
+    bench_report(name, iters, bench_now_ns() - t0, (size_t)len);
+
+    t0 = bench_now_ns();
+    for (uint64_t i = 0; i < iters; i++) {
+        struct i1905_cmdu_view view;
+        struct i1905_cmdu cmdu;
+        if (i1905_cmdu_view_parse(&view, msg, (size_t)len) < 0 ||
+            i1905_cmdu_from_view(&cmdu, arena, &view) < 0) {
+            fail("unpack", s);
+        }
+        sink = cmdu.tlv_count;
+        i1905_arena_reset(arena);
+    }
+    snprintf(name, sizeof(name), "unpack/%s", s->name);
+    bench_report(name, iters, bench_now_ns() - t0, (size_t)len);
+}
+
+int main(int argc, char **argv) {
+    if (bench_init(argc, argv, "codec", DEFAULT_ITERS) < 0) return 1;
+    arena = i1905_arena_new(0);
+    if (!arena) return 1;
+    for (size_t i = 0; i < sizeof(value); i++) value[i] = (uint8_t)i;
+    value[6] = 1;   // device info shapes: one interface after the AL MAC
+    for (size_t i = 0; i < sizeof(shapes) / sizeof(shapes[0]); i++) run_shape(&shapes[i]);
+    i1905_arena_free(arena);
+    return 0;
+}
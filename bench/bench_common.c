@@ -0,0 +1,164 @@
+// SPDX-License-Identifier: MIT
+//
+// Output and option handling shared by the bench/ programs, see bench.h.
+
+#define _GNU_SOURCE // clock_gettime, getopt
+#include "bench.h"
+
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+enum bench_format { FMT_TEXT, FMT_JSON, FMT_CSV };
+
+static const char *bench_name;
+static uint64_t iters;
+static enum bench_format format;
+static bool header_done;
+
+static void usage(const char *prog) {
+    fprintf(stderr, "usage: %s [-n iterations] [-f text|json|csv]\n", prog);
+}
+
+int bench_init(int argc, char **argv, const char *bench, uint64_t default_iters) {
+    bench_name = bench;
+    iters = default_iters;
+    int opt;
+    while ((opt = getopt(argc, argv, "n:f:h")) != -1) {
+        switch (opt) {
+        case 'n':
+            iters = strtoull(optarg, NULL, 10);
+            break;
+        case 'f':
+            if (strcmp(optarg, "json") == 0) {
+                format = FMT_JSON;
+            } else if (strcmp(optarg, "csv") == 0) {
+                format = FMT_CSV;
+            } else if (strcmp(optarg, "text") == 0) {
+                format = FMT_TEXT;
+            } else {
+                usage(argv[0]);
+                return -1;
+            }
+            break;
+        default:
+            usage(argv[0]);
+            return -1;
+        }
+    }
+    if (!iters) iters = 1;
+    return 0;
+}
+
+uint64_t bench_iters(void) {
+    return iters;
+}
+
+uint64_t bench_now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// One row per result. Columns not measured by a benchmark are left empty
+// (CSV) or omitted (JSON), so every program emits the same schema.
+struct row {
+    const char *name;
+    uint64_t ops;
+    double ns_per_op;
+    double ops_per_s;
+    double mb_per_s;      // < 0: n/a
+    const double *pct;    // p50, p90, p99, p99.9, max in ns, or NULL
+};
+
+static void emit(const struct row *r) {
+    switch (format) {
+    case FMT_TEXT:
+        if (!header_done) {
+            printf("# %s\n", bench_name);
+            header_done = true;
+        }
+        printf("%-32s %10.1f ns/op %12.0f op/s", r->name, r->ns_per_op, r->ops_per_s);
+        if (r->mb_per_s >= 0) printf(" %9.1f MB/s", r->mb_per_s);
+        if (r->pct) {
+            printf("  p50 %.0f p90 %.0f p99 %.0f p99.9 %.0f max %.0f ns",
+                   r->pct[0], r->pct[1], r->pct[2], r->pct[3], r->pct[4]);
+        }
+        printf("\n");
+        break;
+    case FMT_JSON:
+        printf("{\"bench\":\"%s\",\"case\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,"
+               "\"ops_per_s\":%.0f", bench_name, r->name, (unsigned long long)r->ops,
+               r->ns_per_op, r->ops_per_s);
+        if (r->mb_per_s >= 0) printf(",\"mb_per_s\":%.2f", r->mb_per_s);
+        if (r->pct) {
+            printf(",\"p50_ns\":%.0f,\"p90_ns\":%.0f,\"p99_ns\":%.0f,\"p999_ns\":%.0f,"
+                   "\"max_ns\":%.0f", r->pct[0], r->pct[1], r->pct[2], r->pct[3], r->pct[4]);
+        }
+        printf("}\n");
+        break;
+    case FMT_CSV:
+        if (!header_done) {
+            printf("#bench,case,ops,ns_per_op,ops_per_s,mb_per_s,p50_ns,p90_ns,p99_ns,p999_ns,max_ns\n");
+            header_done = true;
+        }
+        printf("%s,%s,%llu,%.2f,%.0f,", bench_name, r->name, (unsigned long long)r->ops,
+               r->ns_per_op, r->ops_per_s);
+        if (r->mb_per_s >= 0) printf("%.2f", r->mb_per_s);
+        if (r->pct) {
+            printf(",%.0f,%.0f,%.0f,%.0f,%.0f\n", r->pct[0], r->pct[1], r->pct[2], r->pct[3],
+                   r->pct[4]);
+        } else {
+            printf(",,,,,\n");
+        }
+        break;
+    }
+    fflush(stdout);
+}
+
+void bench_report(const char *name, uint64_t ops, uint64_t elapsed_ns, size_t bytes_per_op) {
+    if (!elapsed_ns) elapsed_ns = 1;
+    struct row r = {
+        .name = name,
+        .ops = ops,
+        .ns_per_op = (double)elapsed_ns / (double)(ops ? ops : 1),
+        .ops_per_s = (double)ops * 1e9 / (double)elapsed_ns,
+        .mb_per_s = bytes_per_op ? (double)ops * (double)bytes_per_op * 1e3 / (double)elapsed_ns
+                                 : -1.0,
+    };
+    emit(&r);
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static double percentile(const uint64_t *s, size_t n, double p) {
+    size_t i = (size_t)(p * (double)(n - 1) + 0.5);
+    return (double)s[i < n ? i : n - 1];
+}
+
+void bench_report_latency(const char *name, uint64_t *samples_ns, size_t n) {
+    if (!n) return;
+    qsort(samples_ns, n, sizeof(*samples_ns), cmp_u64);
+    uint64_t sum = 0;
+    for (size_t i = 0; i < n; i++) sum += samples_ns[i];
+    double pct[5] = {
+        percentile(samples_ns, n, 0.50), percentile(samples_ns, n, 0.90),
+        percentile(samples_ns, n, 0.99), percentile(samples_ns, n, 0.999),
+        (double)samples_ns[n - 1],
+    };
+    struct row r = {
+        .name = name,
+        .ops = n,
+        .ns_per_op = (double)sum / (double)n,
+        .ops_per_s = sum ? (double)n * 1e9 / (double)sum : 0,
+        .mb_per_s = -1.0,
+        .pct = pct,
+    };
+    emit(&r);
+}
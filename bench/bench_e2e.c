@@ -0,0 +1,87 @@
+// SPDX-License-Identifier: MIT
+//
+// End-to-end latency over UDP loopback between two contexts in one thread,
+// busy-polling with i1905_handle_readable(): send call to event callback on
+// the receiver, and topology query to the correlated reply (answered by the
+// peer library) for the round trip. Reported as percentiles.
+
+#include "ieee1905.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERS 20000
+#define PORT_A        29060
+#define PORT_B        29061
+#define SPIN_LIMIT    1000000  // polls before a sample counts as lost
+
+static uint64_t rx_at;
+static uint64_t reply_at;
+
+static void on_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                     void *user) {
+    (void)rx; (void)user;
+    if (cmdu->message_type == I1905_MSG_TOPOLOGY_DISCOVERY) rx_at = bench_now_ns();
+}
+
+static void on_reply(const struct i1905_cmdu_view *reply, const struct i1905_rx_info *rx,
+                     void *user) {
+    (void)rx; (void)user;
+    if (reply) reply_at = bench_now_ns();
+}
+
+static bool spin(struct i1905_ctx *a, struct i1905_ctx *b, const uint64_t *done) {
+    for (unsigned i = 0; i < SPIN_LIMIT && !*done; i++) {
+        i1905_handle_readable(b);
+        if (a) i1905_handle_readable(a);
+    }
+    return *done != 0;
+}
+
+int main(int argc, char **argv) {
+    if (bench_init(argc, argv, "e2e", DEFAULT_ITERS) < 0) return 1;
+    struct i1905_opts opts = { .transport = I1905_TRANSPORT_UDP };
+    struct i1905_ctx *a, *b;
+    if (i1905_init_ex(&a, I1905_ROLE_CONTROLLER, PORT_A, NULL, on_frame, NULL, &opts) < 0 ||
+        i1905_init_ex(&b, I1905_ROLE_AGENT, PORT_B, NULL, on_frame, NULL, &opts) < 0) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    uint64_t n = bench_iters();
+    uint64_t *samples = calloc(n, sizeof(*samples));
+    if (!samples) return 1;
+    static const uint8_t iface[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+
+    size_t got = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        rx_at = 0;
+        uint64_t t0 = bench_now_ns();
+        if (i1905_send_topology_discovery(a, "127.0.0.1", PORT_B, iface) < 0) break;
+        if (spin(NULL, b, &rx_at)) samples[got++] = rx_at - t0;
+    }
+    bench_report_latency("udp/send_to_callback", samples, got);
+    if (got != n) fprintf(stderr, "send_to_callback: %zu of %llu lost\n", (size_t)(n - got),
+                          (unsigned long long)n);
+
+    got = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        reply_at = 0;
+        uint64_t t0 = bench_now_ns();
+        int mid = i1905_send_topology_query(a, "127.0.0.1", PORT_B);
+        if (mid < 0 || i1905_expect_reply(a, (uint16_t)mid, I1905_MSG_TOPOLOGY_RESPONSE, 0, 0,
+                                          on_reply, NULL) < 0) {
+            break;
+        }
+        if (spin(a, b, &reply_at)) samples[got++] = reply_at - t0;
+    }
+    bench_report_latency("udp/query_round_trip", samples, got);
+    if (got != n) fprintf(stderr, "query_round_trip: %zu of %llu lost\n", (size_t)(n - got),
+                          (unsigned long long)n);
+
+    free(samples);
+    i1905_close(a);
+    i1905_close(b);
+    return 0;
+}
@@ -0,0 +1,309 @@
+// SPDX-License-Identifier: MIT
+//
+// ieee1905d's MQTT adapter (src/apps/mqtt_bridge.c) against the in-tree
+// broker (src/apps/mqtt_broker.c), everything in one thread over loopback
+// TCP. An agent context sends topology notifications over the loop
+// transport to the daemon context, whose bridge batches them onto its recv
+// topic; a second MQTT client stands in for the cloud and decodes them.
+// At most BURST CMDUs are between the agent and the cloud at any time.
+// - mqtt/recv_batched: CMDU throughput agent -> cloud
+// - mqtt/recv_unbatched: the same with one CMDU per publish, the baseline
+// - mqtt/send_round_trip: the cloud publishes a topology query on the send
+//   topic; latency until the agent's response arrives back on recv
+// - mqtt/recv_reconnect: the broker drops the daemon's connection KICKS
+//   times during the run. Every CMDU must still reach the cloud (QoS 1
+//   retransmission may duplicate some); the program fails otherwise.
+
+#include "ieee1905.h"
+#include "mqtt_bridge.h"
+#include "mqtt_broker.h"
+#include "bench.h"
+
+#include <poll.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERS   20000
+#define DAEMON_PORT     1905
+#define AGENT_PORT      1906
+#define BURST           128      // stays below the loop transport's queue
+#define PREFIX          "bench"
+#define KICKS           5
+#define RECONNECT_MAX   50000    // distinct mids tracked, below 65536
+#define STALL_NS        5000000000ull
+
+struct watch {
+    int fd;
+    bool want_write;
+};
+
+static struct mqtt_broker *broker;
+static struct i1905_ctx *daemon_ctx, *agent;
+static struct mqtt_bridge *bridge;
+static struct mqtt_client *cloud;
+static struct watch bridge_w = { .fd = -1 }, cloud_w = { .fd = -1 };
+
+static uint64_t got;             // records decoded by the cloud
+static uint64_t publishes;
+static uint64_t bad_batches;
+static uint64_t reply_at;
+static bool track;               // reconnect run: count distinct mids
+static uint8_t seen[65536];
+static uint64_t unique, dups;
+
+static void on_daemon_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                            void *user) {
+    (void)user;
+    mqtt_bridge_frame(bridge, cmdu, rx);
+}
+
+static void on_agent_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                           void *user) {
+    (void)cmdu; (void)rx; (void)user;
+}
+
+static void on_watch(struct mqtt_client *c, int fd, bool want_write, void *user) {
+    (void)c;
+    struct watch *w = user;
+    w->fd = fd;
+    w->want_write = want_write;
+}
+
+static void on_cloud(struct mqtt_client *c, const char *topic, size_t topic_len,
+                     const uint8_t *payload, size_t len, void *user) {
+    (void)c; (void)topic; (void)topic_len; (void)user;
+    struct mqtt_batch_iter it;
+    struct mqtt_batch_rec rec;
+    if (mqtt_batch_iter_init(&it, payload, len) < 0) {
+        bad_batches++;
+        return;
+    }
+    publishes++;
+    int rv;
+    while ((rv = mqtt_batch_next(&it, &rec)) > 0) {
+        got++;
+        if (rec.msg_type == I1905_MSG_TOPOLOGY_RESPONSE) reply_at = bench_now_ns();
+        if (!track) continue;
+        if (seen[rec.mid]) {
+            dups++;
+        } else {
+            seen[rec.mid] = 1;
+            unique++;
+        }
+    }
+    if (rv < 0) bad_batches++;
+}
+
+static short events_of(const struct watch *w) {
+    return (short)(POLLIN | (w->want_write ? POLLOUT : 0));
+}
+
+// One round of the event loop; negative fds are skipped by poll().
+static void pump(int timeout_ms) {
+    struct pollfd p[] = {
+        { .fd = broker_fd(broker), .events = POLLIN },
+        { .fd = i1905_get_fd(daemon_ctx), .events = POLLIN },
+        { .fd = i1905_get_timer_fd(daemon_ctx), .events = POLLIN },
+        { .fd = i1905_get_fd(agent), .events = POLLIN },
+        { .fd = bridge_w.fd, .events = events_of(&bridge_w) },
+        { .fd = cloud_w.fd, .events = events_of(&cloud_w) },
+    };
+    mqtt_tick(cloud);
+    if (poll(p, sizeof(p) / sizeof(p[0]), timeout_ms) <= 0) return;
+    if (p[0].revents) broker_run(broker, 0);
+    if (p[1].revents) {
+        i1905_handle_readable(daemon_ctx);
+        mqtt_bridge_flush(bridge);
+    }
+    if (p[2].revents) i1905_handle_timers(daemon_ctx);
+    if (p[3].revents) i1905_handle_readable(agent);
+    if (p[4].revents && bridge_w.fd == p[4].fd) {
+        mqtt_bridge_handle_io(bridge, p[4].revents & ~POLLOUT, p[4].revents & ~POLLIN);
+    }
+    if (p[5].revents && cloud_w.fd == p[5].fd) {
+        mqtt_handle_io(cloud, p[5].revents & ~POLLOUT, p[5].revents & ~POLLIN);
+    }
+}
+
+static int bridge_open(size_t batch_bytes) {
+    struct mqtt_bridge_opts o = {
+        .host = "127.0.0.1",
+        .port = broker_port(broker),
+        .prefix = PREFIX,
+        .batch_bytes = batch_bytes,
+    };
+    bridge = mqtt_bridge_new(daemon_ctx, &o, on_watch, &bridge_w);
+    if (!bridge) return -1;
+    uint64_t t0 = bench_now_ns();
+    while (!mqtt_bridge_is_up(bridge) || !mqtt_is_up(cloud)) {
+        if (bench_now_ns() - t0 > STALL_NS) {
+            fprintf(stderr, "broker connection failed\n");
+            return -1;
+        }
+        pump(10);
+    }
+    // let both subscriptions reach the broker before traffic starts
+    for (int i = 0; i < 20; i++) pump(1);
+    return 0;
+}
+
+static void bridge_close(void) {
+    mqtt_bridge_free(bridge);
+    bridge = NULL;
+    bridge_w.fd = -1;
+}
+
+// Agent -> daemon -> broker -> cloud until n CMDUs arrived (distinct ones
+// when tracking); calls kick(i) after each burst. -1 when traffic stalls.
+static int flow(uint64_t n, void (*kick)(uint64_t sent)) {
+    static const uint8_t iface[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x01};
+    const uint64_t *done = track ? &unique : &got;
+    uint64_t sent = 0, last = 0, last_at = bench_now_ns();
+    while (*done < n) {
+        while (sent < n && sent - *done < BURST) {
+            if (i1905_send_topology_notification(agent, NULL, DAEMON_PORT, iface) < 0) return -1;
+            sent++;
+            if (kick) kick(sent);
+        }
+        pump(10);
+        if (*done != last) {
+            last = *done;
+            last_at = bench_now_ns();
+        } else if (bench_now_ns() - last_at > STALL_NS) {
+            fprintf(stderr, "stalled: %llu of %llu CMDUs arrived\n",
+                    (unsigned long long)*done, (unsigned long long)n);
+            return -1;
+        }
+    }
+    return 0;
+}
+
+static int recv_run(const char *name, size_t batch_bytes) {
+    if (bridge_open(batch_bytes) < 0) return -1;
+    uint64_t n = bench_iters();
+    got = publishes = 0;
+    uint64_t t0 = bench_now_ns();
+    int rv = flow(n, NULL);
+    uint64_t elapsed = bench_now_ns() - t0;
+    if (rv == 0) {
+        bench_report(name, got, elapsed, 0);
+        fprintf(stderr, "%s: %.1f CMDUs per publish\n", name,
+                publishes ? (double)got / (double)publishes : 0.0);
+    }
+    bridge_close();
+    return rv;
+}
+
+static int round_trip(void) {
+    if (bridge_open(0) < 0) return -1;
+    uint8_t al[6];
+    char topic[64];
+    i1905_get_al_mac(daemon_ctx, al);
+    snprintf(topic, sizeof(topic), PREFIX "/%02x%02x%02x%02x%02x%02x/send",
+             al[0], al[1], al[2], al[3], al[4], al[5]);
+    uint8_t buf[64];
+    struct mqtt_batch_writer w;
+    struct mqtt_batch_rec rec = {
+        .msg_type = I1905_MSG_TOPOLOGY_QUERY,
+        .port = AGENT_PORT,
+    };
+    mqtt_batch_begin(&w, buf, sizeof(buf), MQTT_BATCH_SEND);
+    mqtt_batch_put(&w, &rec);
+    size_t len = mqtt_batch_finish(&w);
+
+    uint64_t n = bench_iters() / 10 + 1;
+    uint64_t *samples = malloc(n * sizeof(*samples));
+    if (!samples) return -1;
+    size_t k = 0;
+    for (uint64_t i = 0; i < n; i++) {
+        reply_at = 0;
+        uint64_t t0 = bench_now_ns();
+        if (mqtt_publish(cloud, topic, buf, len, 1) < 0) break;
+        while (!reply_at && bench_now_ns() - t0 < STALL_NS) pump(10);
+        if (!reply_at) break;
+        samples[k++] = reply_at - t0;
+    }
+    int rv = k == n ? 0 : -1;
+    if (rv < 0) fprintf(stderr, "send round trip: %zu of %llu replies\n", k, (unsigned long long)n);
+    bench_report_latency("mqtt/send_round_trip", samples, k);
+    free(samples);
+    bridge_close();
+    return rv;
+}
+
+static uint64_t kick_every;
+static char daemon_id[32];
+
+static void kick(uint64_t sent) {
+    if (sent % kick_every == 0) broker_kick(broker, daemon_id);
+}
+
+static int reconnect_run(void) {
+    if (bridge_open(0) < 0) return -1;
+    uint8_t al[6];
+    i1905_get_al_mac(daemon_ctx, al);
+    snprintf(daemon_id, sizeof(daemon_id), "ieee1905d-%02x%02x%02x%02x%02x%02x",
+             al[0], al[1], al[2], al[3], al[4], al[5]);
+    uint64_t n = bench_iters() < RECONNECT_MAX ? bench_iters() : RECONNECT_MAX;
+    kick_every = n / (KICKS + 1) + 1;
+    memset(seen, 0, sizeof(seen));
+    unique = dups = 0;
+    track = true;
+    uint64_t t0 = bench_now_ns();
+    int rv = flow(n, kick);
+    uint64_t elapsed = bench_now_ns() - t0;
+    track = false;
+
+    struct mqtt_bridge_stats st;
+    struct broker_stats bst;
+    mqtt_bridge_get_stats(bridge, &st);
+    broker_get_stats(broker, &bst);
+    bench_report("mqtt/recv_reconnect", unique, elapsed, 0);
+    fprintf(stderr, "mqtt/recv_reconnect: %llu kicks, %llu reconnects, %llu publishes resent, "
+            "%llu duplicate CMDUs, %llu dropped, %llu lost\n",
+            (unsigned long long)bst.kicked, (unsigned long long)st.mqtt.connects - 1,
+            (unsigned long long)st.mqtt.retransmits, (unsigned long long)dups,
+            (unsigned long long)st.drops, (unsigned long long)(n - unique));
+    if (st.drops || unique != n) rv = -1;
+    bridge_close();
+    return rv;
+}
+
+int main(int argc, char **argv) {
+    if (bench_init(argc, argv, "mqtt", DEFAULT_ITERS) < 0) return 1;
+    struct i1905_opts opts = { .transport = I1905_TRANSPORT_LOOP };
+    broker = broker_new("127.0.0.1", 0);
+    if (!broker ||
+        i1905_init_ex(&daemon_ctx, I1905_ROLE_CONTROLLER, DAEMON_PORT, NULL, on_daemon_frame,
+                      NULL, &opts) < 0 ||
+        i1905_init_ex(&agent, I1905_ROLE_AGENT, AGENT_PORT, NULL, on_agent_frame, NULL, &opts) < 0) {
+        fprintf(stderr, "setup failed\n");
+        return 1;
+    }
+    struct mqtt_opts co = {
+        .host = "127.0.0.1",
+        .port = broker_port(broker),
+        .client_id = "cloud",
+        .on_message = on_cloud,
+        .on_watch = on_watch,
+        .user = &cloud_w,
+    };
+    cloud = mqtt_new(&co);
+    if (!cloud || mqtt_subscribe(cloud, PREFIX "/+/recv", 1) < 0) return 1;
+
+    int rv = 0;
+    if (recv_run("mqtt/recv_batched", 0) < 0 || recv_run("mqtt/recv_unbatched", 1) < 0 ||
+        round_trip() < 0 || reconnect_run() < 0) {
+        rv = 1;
+    }
+    if (bad_batches) {
+        fprintf(stderr, "%llu malformed batches\n", (unsigned long long)bad_batches);
+        rv = 1;
+    }
+    mqtt_free(cloud);
+    i1905_close(agent);
+    i1905_close(daemon_ctx);
+    broker_free(broker);
+    return rv;
+}
@@ -0,0 +1,114 @@
+// SPDX-License-Identifier: MIT
+//
+// Receive path throughput: a synthetic sender queues bursts of prebuilt
+// topology discovery frames on a UDP loopback socket with sendmmsg(), and
+// only the time spent in i1905_handle_readable() draining them (recvmmsg,
+// parse, dispatch to the callback) is counted. Run for several rx_batch
+// sizes.
+
+#define _GNU_SOURCE // sendmmsg
+#include "ieee1905.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <sys/socket.h>
+
+#define DEFAULT_ITERS 200000  // frames per case
+#define RX_PORT       29050
+#define BURST         128     // fits the default loopback receive buffer
+
+static uint64_t delivered;
+
+static void on_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                     void *user) {
+    (void)cmdu; (void)rx; (void)user;
+    delivered++;
+}
+
+static size_t build_frame(uint8_t *frame, size_t cap) {
+    static const uint8_t mcast[6] = {0x01, 0x80, 0xc2, 0x00, 0x00, 0x13};
+    static const uint8_t src[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x42};
+    memcpy(frame, mcast, 6);
+    memcpy(frame + 6, src, 6);
+    frame[12] = (I1905_ETHERTYPE >> 8) & 0xFF;
+    frame[13] = I1905_ETHERTYPE & 0xFF;
+    struct i1905_builder b;
+    i1905_builder_begin_buf(&b, frame + I1905_ETH_HDR_LEN, cap - I1905_ETH_HDR_LEN,
+                            I1905_MSG_TOPOLOGY_DISCOVERY);
+    i1905_builder_put_mac(&b, I1905_TLV_AL_MAC, src);
+    i1905_builder_put_mac(&b, I1905_TLV_MAC_ADDR, src);
+    int len = i1905_builder_finish(&b);
+    return len < 0 ? 0 : I1905_ETH_HDR_LEN + (size_t)len;
+}
+
+static int run_case(unsigned rx_batch, int sock, const uint8_t *frame, size_t frame_len) {
+    struct i1905_opts opts = { .transport = I1905_TRANSPORT_UDP, .rx_batch = rx_batch };
+    struct i1905_ctx *ctx;
+    if (i1905_init_ex(&ctx, I1905_ROLE_CONTROLLER, RX_PORT, NULL, on_frame, NULL, &opts) < 0) {
+        fprintf(stderr, "init failed\n");
+        return -1;
+    }
+
+    struct sockaddr_in dst = {
+        .sin_family = AF_INET,
+        .sin_port = htons(RX_PORT),
+        .sin_addr.s_addr = htonl(INADDR_LOOPBACK),
+    };
+    struct mmsghdr msgs[BURST];
+    struct iovec iov = { (void *)frame, frame_len };
+    memset(msgs, 0, sizeof(msgs));
+    for (unsigned i = 0; i < BURST; i++) {
+        msgs[i].msg_hdr.msg_name = &dst;
+        msgs[i].msg_hdr.msg_namelen = sizeof(dst);
+        msgs[i].msg_hdr.msg_iov = &iov;
+        msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    uint64_t frames = bench_iters(), queued = 0, busy_ns = 0;
+    delivered = 0;
+    while (queued < frames) {
+        unsigned n = frames - queued < BURST ? (unsigned)(frames - queued) : BURST;
+        int sent = sendmmsg(sock, msgs, n, 0);
+        if (sent <= 0) {
+            perror("sendmmsg");
+            break;
+        }
+        queued += (uint64_t)sent;
+        uint64_t t0 = bench_now_ns();
+        i1905_handle_readable(ctx);
+        busy_ns += bench_now_ns() - t0;
+    }
+
+    char name[48];
+    snprintf(name, sizeof(name), "udp_rx/batch_%u", rx_batch);
+    bench_report(name, delivered, busy_ns, frame_len);
+    if (delivered != queued) {
+        fprintf(stderr, "%s: %llu of %llu frames lost\n", name,
+                (unsigned long long)(queued - delivered), (unsigned long long)queued);
+    }
+    i1905_close(ctx);
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    if (bench_init(argc, argv, "rx", DEFAULT_ITERS) < 0) return 1;
+    uint8_t frame[128];
+    size_t frame_len = build_frame(frame, sizeof(frame));
+    int sock = socket(AF_INET, SOCK_DGRAM | SOCK_CLOEXEC, 0);
+    if (!frame_len || sock < 0) {
+        perror("setup");
+        return 1;
+    }
+    static const unsigned batches[] = { 1, 8, I1905_DEFAULT_RX_BATCH, I1905_MAX_RX_BATCH };
+    int rv = 0;
+    for (size_t i = 0; i < sizeof(batches) / sizeof(batches[0]) && rv == 0; i++) {
+        rv = run_case(batches[i], sock, frame, frame_len);
+    }
+    close(sock);
+    return rv ? 1 : 0;
+}
@@ -0,0 +1,136 @@
+// SPDX-License-Identifier: MIT
+//
+// Micro-benchmark: ezz_controller's backhaul tree (src/apps/topo_graph.c)
+// on a generated mesh of a few hundred agents. Each case flaps one random
+// link per operation, either removing and restoring it or toggling its
+// cost, and reports per-update latency of the incremental repair; a full
+// Dijkstra rebuild of the same graph is the baseline. After the flap runs
+// the incrementally maintained tree is checked against a rebuild.
+
+#include "topo_graph.h"
+#include "bench.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DEFAULT_ITERS 20000
+#define MESH_NODES    500
+#define MAX_LINKS     (MESH_NODES * 3)
+
+struct link {
+    uint32_t a, b;
+    uint16_t cost;
+};
+
+static struct link links[MAX_LINKS];
+static unsigned n_links;
+static uint64_t rng = 0x9E3779B97F4A7C15ull;
+
+static uint32_t rnd(uint32_t n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return (uint32_t)(rng % n);
+}
+
+static void mac_of(uint32_t i, uint8_t mac[6]) {
+    uint8_t m[6] = {0x02, 0x19, 0x05, 0x00, (uint8_t)(i >> 8), (uint8_t)i};
+    memcpy(mac, m, 6);
+}
+
+// Every agent links to one to three of the twenty agents added before it,
+// giving a mesh several hops deep with redundant paths.
+static int build_mesh(struct topo_graph *g) {
+    uint8_t mac[6];
+    mac_of(0, mac);
+    if (graph_init(g, MESH_NODES, mac) < 0) return -1;
+    for (uint32_t i = 1; i < MESH_NODES; i++) {
+        mac_of(i, mac);
+        int32_t idx = graph_node(g, mac);
+        if (idx < 0) return -1;
+        unsigned k = 1 + rnd(3);
+        for (unsigned j = 0; j < k && n_links < MAX_LINKS; j++) {
+            uint32_t lo = i > 20 ? i - 20 : 0;
+            uint8_t peer_mac[6];
+            mac_of(lo + rnd(i - lo), peer_mac);
+            struct link *l = &links[n_links++];
+            l->a = (uint32_t)idx;
+            l->b = (uint32_t)graph_lookup(g, peer_mac);
+            l->cost = (uint16_t)(1 + rnd(5));
+            graph_report_link(g, l->a, l->b, l->cost);
+        }
+    }
+    return 0;
+}
+
+static void flap(const char *name, struct topo_graph *g, bool remove) {
+    uint64_t iters = bench_iters();
+    uint64_t *samples = malloc(iters * sizeof(*samples));
+    if (!samples) exit(1);
+    uint64_t touched = g->stats.touched;
+    // each pair of updates breaks a random link and restores it
+    for (uint64_t i = 0; i + 1 < iters; i += 2) {
+        const struct link *l = &links[rnd(n_links)];
+        uint64_t t0 = bench_now_ns();
+        graph_report_link(g, l->a, l->b, remove ? 0 : (uint16_t)(l->cost + 3));
+        uint64_t t1 = bench_now_ns();
+        graph_report_link(g, l->a, l->b, l->cost);
+        samples[i] = t1 - t0;
+        samples[i + 1] = bench_now_ns() - t1;
+    }
+    iters &= ~(uint64_t)1;
+    bench_report_latency(name, samples, iters);
+    fprintf(stderr, "%s: %.1f nodes touched per update\n", name,
+           (double)(g->stats.touched - touched) / (double)iters);
+    free(samples);
+}
+
+static void rebuild(struct topo_graph *g) {
+    uint64_t iters = bench_iters() / 100 + 1;
+    uint64_t *samples = malloc(iters * sizeof(*samples));
+    if (!samples) exit(1);
+    for (uint64_t i = 0; i < iters; i++) {
+        uint64_t t0 = bench_now_ns();
+        graph_rebuild(g);
+        samples[i] = bench_now_ns() - t0;
+    }
+    bench_report_latency("topo/full_rebuild", samples, iters);
+    free(samples);
+}
+
+// Costs and hops from incremental repair must equal a fresh Dijkstra;
+// parents may differ only between equally good paths.
+static int check(struct topo_graph *g) {
+    uint64_t *keys = malloc(g->cap * sizeof(*keys));
+    if (!keys) return -1;
+    for (uint32_t i = 0; i < g->cap; i++) keys[i] = g->nodes[i].key;
+    graph_rebuild(g);
+    int rv = 0;
+    for (uint32_t i = 0; i < g->cap; i++) {
+        if (g->nodes[i].used && keys[i] != g->nodes[i].key) {
+            fprintf(stderr, "node %u: incremental key %llx, rebuild %llx\n", i,
+                    (unsigned long long)keys[i], (unsigned long long)g->nodes[i].key);
+            rv = -1;
+        }
+    }
+    free(keys);
+    return rv;
+}
+
+int main(int argc, char **argv) {
+    if (bench_init(argc, argv, "topo", DEFAULT_ITERS) < 0) return 1;
+    struct topo_graph g;
+    if (build_mesh(&g) < 0) {
+        fprintf(stderr, "mesh setup failed\n");
+        return 1;
+    }
+    fprintf(stderr, "mesh: %u nodes, %u links\n", g.count, n_links);
+    flap("topo/link_flap", &g, true);
+    if (check(&g) < 0) return 1;
+    flap("topo/cost_flap", &g, false);
+    if (check(&g) < 0) return 1;
+    rebuild(&g);
+    graph_free(&g);
+    return 0;
+}
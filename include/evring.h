@@ -0,0 +1,113 @@
+// SPDX-License-Identifier: MIT
+//
+// Shared-memory event ring between ieee1905d and local consumers. The
+// daemon publishes every received CMDU into a memfd-backed ring of fixed
+// size slots (single producer) and kicks each consumer's eventfd once per
+// receive batch. Any number of consumers map the ring read-only and read at
+// their own pace; a consumer that falls a full ring behind loses the
+// overwritten records and is told how many. ubus remains the control
+// channel: consumers obtain the memfd with the ieee1905 "ring_open" method.
+//
+// Consumers do not need the ieee1905 library; records carry the CMDU header
+// fields and the raw TLV chain (type(1) + len(2) + value, no end-of-message).
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define EVRING_MAGIC        0x45563139u  // "EV19"
+#define EVRING_VERSION      1
+#define EVRING_HDR_SIZE     4096         // slots start at this offset
+#define EVRING_F_RELAY      0x01
+
+// Shared header at offset 0
+struct evring_shm {
+    uint32_t magic;
+    uint32_t version;
+    uint32_t slot_size;        // bytes per slot incl. struct evring_slot, power of two
+    uint32_t slot_count;       // power of two
+    uint64_t reserved[6];
+    uint64_t head;             // records published so far, written with release
+    uint64_t oversize;         // records not published for not fitting a slot
+};
+
+// Header of every slot, followed by tlv_len TLV bytes
+struct evring_slot {
+    uint64_t seq;              // record number + 1 once complete, 0 while rewritten
+    uint64_t ts_ns;            // CLOCK_MONOTONIC at publish
+    uint32_t tlv_len;
+    uint16_t msg_type;
+    uint16_t mid;
+    uint8_t  flags;            // EVRING_F_*
+    uint8_t  src_mac[6];
+    uint8_t  al_mac[6];
+    uint8_t  reserved[3];
+    uint8_t  tlv[];
+};
+
+// One record as published or read back
+struct evring_msg {
+    uint64_t seq;
+    uint64_t ts_ns;
+    uint16_t msg_type;
+    uint16_t mid;
+    uint8_t  flags;
+    uint8_t  src_mac[6];
+    uint8_t  al_mac[6];
+    const uint8_t *tlv;
+    size_t tlv_len;
+};
+
+// Producer (ieee1905d)
+struct evring_producer;
+struct evring_producer *evring_producer_new(uint32_t slot_count, uint32_t slot_size);
+void evring_producer_free(struct evring_producer *p);
+int evring_producer_fd(const struct evring_producer *p);  // read-only sealed memfd to hand out
+uint64_t evring_producer_head(const struct evring_producer *p);
+// 0, or -1 when the record does not fit a slot (counted in oversize)
+int evring_publish(struct evring_producer *p, const struct evring_msg *msg);
+
+// Consumer
+struct evring;
+// Map the ring behind memfd (closed on success) and take ownership of
+// efd, the eventfd the producer kicks. Reading starts at the current head.
+struct evring *evring_attach(int memfd, int efd);
+void evring_detach(struct evring *r);
+int evring_fd(const struct evring *r);
+// Clear the eventfd before draining with evring_next().
+void evring_ack(struct evring *r);
+// 1: *msg holds the next record, valid until the next call; 0: caught up
+int evring_next(struct evring *r, struct evring_msg *msg);
+uint64_t evring_lost(const struct evring *r);  // records overwritten before read
+
+// Walk a raw TLV chain as carried by records (and the ubus recv events):
+// print one "<tag>   tlv 0x.. len .." line per TLV, stopping at a truncated one
+void evring_print_tlvs(const char *tag, const uint8_t *tlv, size_t len);
+
+// ubus consumer, evring_ubus.c (needs libubus/libubox): the ieee1905
+// ring_open / ring_close handshake plus a uloop watch on the eventfd.
+struct ubus_context;
+
+struct evring_type {
+    const char *name;          // ieee1905 type name, as in ring_open and recv events
+    uint16_t type;             // CMDU message type of its records
+};
+
+// Runs per record of one of the requested types (the ring is shared, other
+// records are skipped). lost: records overwritten since the previous call.
+typedef void (*evring_consumer_cb)(const struct evring_msg *msg, const struct evring_type *type,
+                                   uint64_t lost, void *user);
+
+struct evring_consumer;
+// Register with the ieee1905 object `obj` for `types` (kept by reference)
+// and start reading on the uloop. mute: ieee1905d stops sending recv events
+// for these types, except for records too large for a slot. NULL on failure,
+// leaving nothing registered with the daemon.
+struct evring_consumer *evring_consumer_open(struct ubus_context *ubus, uint32_t obj,
+                                             const struct evring_type *types, size_t n_types,
+                                             bool mute, evring_consumer_cb cb, void *user);
+// Unregister from the daemon and free c
+void evring_consumer_close(struct evring_consumer *c);
+uint32_t evring_consumer_id(const struct evring_consumer *c);  // ring_open's id
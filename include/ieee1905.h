@@ -1,115 +1,646 @@
-// SPDX-License-Identifier: MIT
-//
-// Minimal IEEE 1905.1 CMDU helper inspired by prplMesh layering.
-// Provides lightweight TLV helpers, CMDU packing/unpacking, and a UDP
-// transport loop suitable for early prototyping of controller/agent roles.
-
-#pragma once
-
-#include <stdint.h>
-#include <stddef.h>
-#include <stdbool.h>
-
-#define I1905_MAX_TLVS          16
-#define I1905_MAX_TLV_VALUE     1024
-#define I1905_MAX_FRAME_SIZE    1600
-
-// Message types (subset)
-typedef enum {
-    I1905_MSG_TOPOLOGY_DISCOVERY     = 0x0000,
-    I1905_MSG_TOPOLOGY_NOTIFICATION  = 0x0001,
-    I1905_MSG_TOPOLOGY_QUERY         = 0x0002,
-    I1905_MSG_TOPOLOGY_RESPONSE      = 0x0003,
-    I1905_MSG_AP_AUTOCONFIG_SEARCH   = 0x0006,
-    I1905_MSG_AP_AUTOCONFIG_RESPONSE = 0x0007,
-    I1905_MSG_AP_AUTOCONFIG_WSC      = 0x0008,
-} i1905_message_type;
-
-// TLV types (minimal subset)
-typedef enum {
-    I1905_TLV_END_OF_MESSAGE   = 0x00,
-    I1905_TLV_AL_MAC           = 0x01,
-    I1905_TLV_MAC_ADDR         = 0x02,
-    I1905_TLV_DEVICE_INFO      = 0x09,
-    I1905_TLV_WSC              = 0x0A,  // carries raw WSC/WPS payload
-    I1905_TLV_VENDOR           = 0x0B,  // generic vendor blob for placeholders
-} i1905_tlv_type;
-
-typedef enum {
-    I1905_ROLE_CONTROLLER,
-    I1905_ROLE_AGENT,
-} i1905_role;
-
-struct i1905_tlv {
-    uint8_t  type;
-    uint16_t len;
-    uint8_t  value[I1905_MAX_TLV_VALUE];
-};
-
-struct i1905_cmdu {
-    uint16_t message_type;
-    uint16_t message_id;
-    uint8_t  fragment_id;
-    bool     last_fragment;
-    size_t   tlv_count;
-    struct i1905_tlv tlvs[I1905_MAX_TLVS];
-};
-
-struct i1905_ctx;
-
-typedef void (*i1905_event_cb)(const struct i1905_cmdu *cmdu,
-                               const uint8_t src_mac[6],
-                               void *user_ctx);
-
-// Context lifecycle
-int i1905_init(struct i1905_ctx **out,
-               i1905_role role,
-               uint16_t listen_port,
-               const uint8_t al_mac[6],
-               i1905_event_cb cb,
-               void *user_ctx);
-void i1905_close(struct i1905_ctx *ctx);
-
-// Event loop
-int i1905_poll(struct i1905_ctx *ctx, int timeout_ms);
-// Event-driven helpers
-int i1905_get_fd(const struct i1905_ctx *ctx);
-int i1905_handle_readable(struct i1905_ctx *ctx);
-
-// Convenience send helpers
-int i1905_send_topology_discovery(struct i1905_ctx *ctx,
-                                  const char *dst_ip,
-                                  uint16_t dst_port,
-                                  const uint8_t iface_mac[6]);
-int i1905_send_topology_query(struct i1905_ctx *ctx,
-                              const char *dst_ip,
-                              uint16_t dst_port);
-int i1905_send_topology_response(struct i1905_ctx *ctx,
-                                 const char *dst_ip,
-                                 uint16_t dst_port,
-                                 const uint8_t iface_mac[6]);
-int i1905_send_topology_notification(struct i1905_ctx *ctx,
-                                     const char *dst_ip,
-                                     uint16_t dst_port,
-                                     const uint8_t iface_mac[6]);
-int i1905_send_ap_autoconfig_search(struct i1905_ctx *ctx,
-                                    const char *dst_ip,
-                                    uint16_t dst_port,
-                                    const uint8_t radio_id[6]);
-int i1905_send_ap_autoconfig_response(struct i1905_ctx *ctx,
-                                      const char *dst_ip,
-                                      uint16_t dst_port,
-                                      const uint8_t radio_id[6]);
-int i1905_send_ap_autoconfig_wsc(struct i1905_ctx *ctx,
-                                 const char *dst_ip,
-                                 uint16_t dst_port,
-                                 const uint8_t *wsc, size_t wsc_len);
-
-// Low-level utilities
-int i1905_tlv_set_mac(struct i1905_tlv *tlv, uint8_t type, const uint8_t mac[6]);
-int i1905_tlv_set_wsc(struct i1905_tlv *tlv, const uint8_t *payload, size_t len);
-int i1905_tlv_set_device_info(struct i1905_tlv *tlv,
-                              const uint8_t al_mac[6],
-                              const uint8_t iface_mac[6]);
-
-
+// SPDX-License-Identifier: MIT
+//
+// Minimal IEEE 1905.1 CMDU helper inspired by prplMesh layering.
+// Provides lightweight TLV helpers, CMDU packing/unpacking, and an
+// epoll-driven send/receive loop over pluggable transports: L2 frames
+// tunnelled over UDP, AF_PACKET with TPACKET_V3 rings on real interfaces,
+// and an in-process loopback bus (see i1905_transport_type).
+
+#pragma once
+
+#include <stdint.h>
+#include <stddef.h>
+#include <stdbool.h>
+
+#define I1905_MAX_FRAME_SIZE    1600  // L2 frame incl. Ethernet header
+#define I1905_ETH_HDR_LEN       14
+#define I1905_ETHERTYPE         0x893A
+#define I1905_MTU               1500  // CMDU bytes per frame, larger messages fragment
+#define I1905_MAX_FRAGMENTS     64
+#define I1905_MAX_MSG_SIZE      65536 // reassembled CMDU
+#define I1905_DEFAULT_ARENA_CHUNK 16384 // see i1905_arena_new()
+#define I1905_DEFAULT_REASM_BUDGET     (64 * 1024)
+#define I1905_DEFAULT_REASM_TIMEOUT_MS 1000
+#define I1905_DEFAULT_DEDUP_SIZE       256
+#define I1905_DEFAULT_DEDUP_TTL_MS     5000
+#define I1905_MAX_NEIGHBORS            64
+#define I1905_MAX_INTERFACES    16    // endpoints per context, see i1905_add_interface()
+#define I1905_IFNAME_LEN        16    // IFNAMSIZ
+#define I1905_DEFAULT_RX_BATCH  32
+#define I1905_MAX_RX_BATCH      256
+#define I1905_MAX_RX_THREADS    16
+#define I1905_DEFAULT_RX_QUEUE  512   // threaded receive: parsed frames in flight
+#define I1905_DEFAULT_TX_QUEUE  1024  // frames held by the transmit scheduler
+#define I1905_DEFAULT_CAPTURE_RING (4u << 20) // bytes, see i1905_capture_start()
+#define I1905_BATCH_HIST_BUCKETS 9   // log2 buckets: 1, 2-3, 4-7, ... 256
+#define I1905_TIMER_TICK_MS     10    // timer wheel resolution
+#define I1905_DISCOVERY_INTERVAL_MS 60000
+#define I1905_NEIGHBOR_TTL_MS   (3 * I1905_DISCOVERY_INTERVAL_MS) // heard in discovery
+#define I1905_DEFAULT_REPLY_TIMEOUT_MS 1000
+#define I1905_MAX_PENDING       4096  // outstanding i1905_expect_reply() requests
+#define I1905_MAX_FRAME_TLVS    256   // received frames with more TLVs are dropped
+#define I1905_STATS_MSG_TYPES   16    // per-type counter slots, see I1905_STATS_TYPE_SLOT
+#define I1905_LAT_HIST_BUCKETS  32    // log2 ns buckets: [0,2), [2,4), ... [2^31, inf)
+
+// Counter slot of a message type; the last slot collects all higher types.
+#define I1905_STATS_TYPE_SLOT(type) \
+    ((type) < I1905_STATS_MSG_TYPES - 1 ? (unsigned)(type) : I1905_STATS_MSG_TYPES - 1)
+
+// Message and TLV types (subset), from ieee1905_schema.def
+typedef enum {
+#define I1905_MSG(ID, name, type, required, optional) I1905_MSG_##ID = type,
+#include "ieee1905_schema.def"
+} i1905_message_type;
+
+typedef enum {
+    I1905_TLV_END_OF_MESSAGE   = 0x00,
+#define I1905_TLV(ID, name, type, fields) I1905_TLV_##ID = type,
+#include "ieee1905_schema.def"
+} i1905_tlv_type;
+
+typedef enum {
+    I1905_ROLE_CONTROLLER,
+    I1905_ROLE_AGENT,
+} i1905_role;
+
+// Interface media types (IEEE 1905.1 table 6-12, subset), see i1905_set_if_media()
+#define I1905_MEDIA_ETH_100     0x0000  // IEEE 802.3u
+#define I1905_MEDIA_ETH_1000    0x0001  // IEEE 802.3ab
+#define I1905_MEDIA_WIFI_N_24   0x0103  // IEEE 802.11n, 2.4 GHz
+#define I1905_MEDIA_WIFI_N_5    0x0104  // IEEE 802.11n, 5 GHz
+#define I1905_MEDIA_WIFI_AC     0x0105  // IEEE 802.11ac, 5 GHz
+#define I1905_MEDIA_WIFI_AX     0x0108  // IEEE 802.11ax
+#define I1905_MEDIA_1901_FFT    0x0201  // IEEE 1901 FFT
+#define I1905_MEDIA_MOCA_11     0x0300  // MoCA v1.1
+#define I1905_MEDIA_UNKNOWN     0xFFFF
+
+// Bump allocator behind owning CMDUs. Nothing is freed individually;
+// i1905_arena_reset() releases everything at once and keeps the chunks for
+// reuse, so a steady message flow stops calling malloc after warm-up.
+struct i1905_arena;
+
+struct i1905_tlv {
+    uint8_t  type;
+    uint16_t len;
+    uint8_t *value;
+};
+
+// Owning CMDU: TLV descriptors plus one packed value area, both taken from
+// an arena and sized to the message. Fill it with i1905_cmdu_init() and
+// i1905_cmdu_add_tlv() (or i1905_cmdu_from_view()); descriptors may also
+// point value at caller memory. Valid until the arena is reset.
+struct i1905_cmdu {
+    uint16_t message_type;
+    uint16_t message_id;
+    uint8_t  fragment_id;
+    bool     last_fragment;
+    bool     relay;          // relayed multicast, forwarded by every AL entity
+    size_t   tlv_count;
+    struct i1905_tlv *tlvs;
+    // storage, managed by the i1905_cmdu_* functions
+    struct i1905_arena *arena;
+    size_t   tlv_cap;
+    uint8_t *payload;
+    size_t   payload_len;
+    size_t   payload_cap;
+};
+
+// Read-only view over a received CMDU. The TLV chain is validated once in
+// place; TLV values point into the receive buffer and are only valid for the
+// duration of the event callback. Use i1905_cmdu_from_view() to keep a copy.
+struct i1905_cmdu_view {
+    uint16_t       message_type;
+    uint16_t       message_id;
+    uint8_t        fragment_id;
+    bool           last_fragment;
+    bool           relay;
+    size_t         tlv_count;
+    const uint8_t *tlv_data;  // first TLV header
+    size_t         tlv_len;   // bytes of validated TLVs, excluding end-of-message
+};
+
+struct i1905_tlv_view {
+    uint8_t        type;
+    uint16_t       len;
+    const uint8_t *value;
+};
+
+struct i1905_tlv_iter {
+    const uint8_t *pos;
+    const uint8_t *end;
+};
+
+// Decoded TLVs, struct i1905_tlv_<name> per ieee1905_schema.def entry.
+// Byte fields point into the TLV value that was decoded; lists come from
+// the arena given to the decoder.
+#define I1905_F_MAC(f)          uint8_t f[6];
+#define I1905_F_U8(f)           uint8_t f;
+#define I1905_F_U16(f)          uint16_t f;
+#define I1905_F_BYTES(f)        const uint8_t *f; uint16_t f##_len;
+#define I1905_F_LIST8(f, rec)   struct i1905_##rec *f; size_t f##_count;
+#define I1905_F_LIST(f, rec)    struct i1905_##rec *f; size_t f##_count;
+#define I1905_REC(name, fields) struct i1905_##name { fields };
+#define I1905_TLV(ID, name, type, fields) struct i1905_tlv_##name { fields };
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST8
+#undef I1905_F_LIST
+
+typedef enum {
+    I1905_TRANSPORT_UDP,     // L2 frames tunnelled over UDP (default)
+    I1905_TRANSPORT_PACKET,  // AF_PACKET TPACKET_V3 rings on opts.ifname
+    I1905_TRANSPORT_LOOP,    // in-process loopback bus, for tests
+} i1905_transport_type;
+
+// Sockets passed from a running instance to its successor so that a
+// restart loses no frames, see i1905_handoff(). Carry all three arrays
+// over unchanged (the fds with SCM_RIGHTS, say).
+struct i1905_handoff {
+    unsigned n;
+    char names[I1905_MAX_INTERFACES][I1905_IFNAME_LEN];  // as i1905_get_if_stats()
+    int fds[I1905_MAX_INTERFACES];
+    uint32_t state[I1905_MAX_INTERFACES];  // transport position, e.g. ring slots
+};
+
+// Optional init-time tuning; zeroed fields select the defaults.
+struct i1905_opts {
+    unsigned rx_batch;   // frames per receive batch, default I1905_DEFAULT_RX_BATCH
+    i1905_transport_type transport;
+    // first interface: required by I1905_TRANSPORT_PACKET, binds the UDP
+    // socket to the device; see i1905_add_interface()
+    const char *ifname;
+    size_t reasm_budget;        // bytes buffered for partial messages
+    uint32_t reasm_timeout_ms;  // per message, from its first fragment
+    unsigned dedup_size;        // (AL MAC, message_id) cache slots
+    uint32_t dedup_ttl_ms;
+    // periodic topology discovery to every neighbor (to the 1905 multicast
+    // group on AF_PACKET), 0 disables; I1905_DISCOVERY_INTERVAL_MS per spec
+    uint32_t discovery_interval_ms;
+    // >0: receive on this many threads (up to I1905_MAX_RX_THREADS), each on
+    // its own socket (UDP SO_REUSEPORT / AF_PACKET fanout) getting the frames
+    // of a fixed subset of source MACs, so per-source order is kept. Workers
+    // only parse and validate; reassembly, relaying, replies and the event
+    // callback still run on the thread calling i1905_handle_readable(), which
+    // also owns all sends and timers. Not supported by the loop transport.
+    unsigned rx_threads;
+    unsigned rx_queue_len;      // threaded receive queue, default I1905_DEFAULT_RX_QUEUE
+    // Transmit shaping in L2 bytes per second, 0: unlimited. tx_rate caps
+    // each interface, peer_tx_rate each peer handle (neighbors included);
+    // a zero burst allows 100 ms worth. See i1905_set_tx_class().
+    uint32_t tx_rate;
+    uint32_t tx_burst;
+    uint32_t peer_tx_rate;
+    uint32_t peer_tx_burst;
+    unsigned tx_queue_len;      // frames, default I1905_DEFAULT_TX_QUEUE
+    // Drop complete messages that fail i1905_cmdu_view_validate() before
+    // relaying or delivering them
+    bool validate;
+    // Leave topology queries to the event callback instead of answering them
+    // with the local device information and, per interface, the neighbors
+    // heard in topology discovery within I1905_NEIGHBOR_TTL_MS
+    bool no_query_answer;
+    // Predecessor's sockets: an interface opened under one of these names
+    // (by init or i1905_add_interface()) takes its socket over instead of
+    // creating one, and frames queued on it meanwhile are received as
+    // usual. The context owns every fd listed from the call on and closes
+    // those no interface took in i1905_close(). UDP and AF_PACKET, not
+    // with rx_threads.
+    const struct i1905_handoff *handoff;
+    // continue message_ids after this one (see i1905_get_message_id()), 0: random
+    uint16_t message_id;
+};
+
+// Resolved peer address. UDP uses ip/port, AF_PACKET uses mac/ifindex,
+// the loopback transport uses port only.
+struct i1905_addr {
+    uint8_t  mac[6];
+    uint32_t ip;         // IPv4, network byte order
+    uint16_t port;
+    int      ifindex;
+};
+
+struct i1905_rx_info {
+    struct i1905_addr src;  // src.mac is the frame's source interface MAC
+    uint8_t dst_mac[6];
+    uint8_t al_mac[6];      // AL MAC TLV when present, else src.mac
+};
+
+// Why a received frame was discarded before reaching reassembly/dispatch
+enum i1905_drop_reason {
+    I1905_DROP_SHORT_FRAME,    // shorter than Ethernet + CMDU header
+    I1905_DROP_ETHERTYPE,
+    I1905_DROP_TLV_OVERFLOW,   // a TLV length runs past the frame
+    I1905_DROP_TOO_MANY_TLVS,  // more than I1905_MAX_FRAME_TLVS
+    I1905_DROP_OWN_RELAY,      // our own relayed multicast coming back
+    I1905_DROP_OVERSIZE,       // larger than the transport's buffer or I1905_MAX_FRAME_SIZE
+    I1905_DROP_SCHEMA,         // opts.validate: message breaks ieee1905_schema.def
+    I1905_DROP_REASONS,
+};
+
+// Transmit priority classes, served strictly in this order. Frames wait in
+// the scheduler while their socket is full or a token bucket is empty;
+// control frames are charged to the buckets but never wait for them.
+typedef enum {
+    I1905_TX_CONTROL,   // topology query/response, autoconfig search/response
+    I1905_TX_TOPOLOGY,  // discovery, notification
+    I1905_TX_BULK,      // WSC and everything else
+    I1905_TX_CLASSES,
+} i1905_tx_class;
+
+// All counters are uint64_t updated with relaxed atomics, so
+// i1905_get_stats() may be called from any thread.
+struct i1905_stats {
+    uint64_t rx_frames;
+    uint64_t rx_batches;       // recvmmsg() calls that returned frames
+    uint64_t rx_batch_max;     // deepest batch seen
+    uint64_t rx_batch_hist[I1905_BATCH_HIST_BUCKETS];
+    uint64_t tx_fragments;     // frames sent for messages above I1905_MTU
+    uint64_t reasm_complete;
+    uint64_t reasm_timeouts;
+    uint64_t reasm_evictions;  // partial messages dropped for budget
+    uint64_t reasm_drops;      // duplicate, out-of-range or invalid fragments
+    uint64_t dedup_hits;       // relayed duplicates dropped
+    uint64_t dedup_misses;     // first copies recorded
+    uint64_t dedup_evictions;  // live entries overwritten, cache too small
+    uint64_t fwd_messages;     // relayed messages forwarded
+    uint64_t fwd_frames;       // per-neighbor transmissions for them
+    uint64_t timers_fired;
+    uint64_t discovery_sent;   // periodic discovery transmissions
+    uint64_t queries_answered; // topology queries answered by the library
+    uint64_t req_replies;      // i1905_expect_reply() completed by a reply
+    uint64_t req_retransmits;
+    uint64_t req_timeouts;
+    uint64_t rx_type_frames[I1905_STATS_MSG_TYPES];  // valid frames, incl. fragments
+    uint64_t rx_type_bytes[I1905_STATS_MSG_TYPES];   // L2 frame bytes
+    uint64_t tx_type_frames[I1905_STATS_MSG_TYPES];
+    uint64_t tx_type_bytes[I1905_STATS_MSG_TYPES];
+    uint64_t rx_drops[I1905_DROP_REASONS];
+    uint64_t tx_errors;        // frames the transport did not accept
+    uint64_t parse_ns_hist[I1905_LAT_HIST_BUCKETS];  // per frame, averaged over each batch
+    uint64_t cb_ns_hist[I1905_LAT_HIST_BUCKETS];     // event callback duration
+    uint64_t rx_queue_waits;   // threaded receive: a worker found the queue full
+    uint64_t tx_queued;        // frames that waited in the transmit scheduler
+    uint64_t tx_queue_depth;   // frames waiting now
+    uint64_t tx_queue_max;
+    uint64_t tx_queue_drops[I1905_TX_CLASSES];  // scheduler full, by class dropped
+    uint64_t tx_write_waits;   // the transport ran out of buffer space
+    uint64_t capture_frames;   // frames copied into the capture ring
+    uint64_t capture_drops;    // frames not captured, ring full
+    uint64_t capture_errors;   // frames lost writing the capture file
+};
+
+// Per-peer counters, see i1905_peer_open()
+struct i1905_peer_stats {
+    uint64_t tx_msgs;
+    uint64_t tx_bytes;         // CMDU bytes, before fragmentation
+    uint64_t tx_errors;
+    uint64_t rx_msgs;
+    uint64_t rx_bytes;
+    uint64_t last_rx_ms;       // i1905_now_ms() of the last message, 0: never
+};
+
+// Per-interface counters, see i1905_get_if_stats()
+struct i1905_if_stats {
+    uint64_t rx_frames;        // as returned by the transport, before validation
+    uint64_t rx_bytes;         // L2 frame bytes
+    uint64_t tx_frames;
+    uint64_t tx_bytes;
+    uint64_t tx_errors;
+};
+
+struct i1905_ctx;
+struct i1905_peer;
+struct i1905_wheel;
+struct i1905_timer;
+
+typedef void (*i1905_timer_cb)(struct i1905_timer *t, void *user);
+
+// Timer on the context's hierarchical wheel. Embed it in the owning object,
+// initialise once, then arm/cancel freely; both are O(1). The callback runs
+// from i1905_poll() / i1905_handle_timers() and may re-arm the timer.
+struct i1905_timer {
+    struct i1905_timer *next, *prev;  // private
+    uint64_t expires;                 // private, in ticks
+    struct i1905_wheel *wheel;        // private, NULL when not armed
+    i1905_timer_cb cb;
+    void *user;
+};
+
+typedef void (*i1905_event_cb)(const struct i1905_cmdu_view *cmdu,
+                               const struct i1905_rx_info *rx,
+                               void *user_ctx);
+
+// Completion of i1905_expect_reply(); reply and rx are NULL on timeout.
+typedef void (*i1905_reply_cb)(const struct i1905_cmdu_view *reply,
+                               const struct i1905_rx_info *rx,
+                               void *user);
+
+// Context lifecycle
+int i1905_init(struct i1905_ctx **out,
+               i1905_role role,
+               uint16_t listen_port,
+               const uint8_t al_mac[6],
+               i1905_event_cb cb,
+               void *user_ctx);
+int i1905_init_ex(struct i1905_ctx **out,
+                  i1905_role role,
+                  uint16_t listen_port,
+                  const uint8_t al_mac[6],
+                  i1905_event_cb cb,
+                  void *user_ctx,
+                  const struct i1905_opts *opts);
+void i1905_close(struct i1905_ctx *ctx);
+void i1905_get_al_mac(const struct i1905_ctx *ctx, uint8_t al_mac[6]);
+// message_id of the last message sent
+uint16_t i1905_get_message_id(const struct i1905_ctx *ctx);
+uint64_t i1905_now_ms(void);  // CLOCK_MONOTONIC
+int i1905_get_stats(const struct i1905_ctx *ctx, struct i1905_stats *out);
+
+// Event loop
+int i1905_poll(struct i1905_ctx *ctx, int timeout_ms);
+// Event-driven helpers. The fd is an epoll fd over every interface's socket
+// (with opts.rx_threads, over the receive queue's eventfd) and stays the
+// same while interfaces come and go; it also turns readable while a socket
+// the transmit scheduler waits on has room again, so watching it for
+// reading is all a loop needs.
+int i1905_get_fd(const struct i1905_ctx *ctx);
+int i1905_handle_readable(struct i1905_ctx *ctx);
+// timerfd that becomes readable when the wheel needs i1905_handle_timers()
+int i1905_get_timer_fd(const struct i1905_ctx *ctx);
+int i1905_handle_timers(struct i1905_ctx *ctx);
+
+// Interfaces. A context starts with the one i1905_init_ex() opened
+// (opts.ifname; named "any" for UDP without one, by its port for the loop
+// transport) and listens on up to I1905_MAX_INTERFACES, each with its own
+// socket, transmit scheduler and counters on the context's port. ifname is
+// a network interface for UDP (SO_BINDTODEVICE) and AF_PACKET, a port for
+// the loop transport. Received frames carry the interface's ifindex in
+// src, so replies leave where the request came in; other destinations pick
+// an interface with a "dst%ifname" suffix to i1905_resolve() and friends
+// (AF_PACKET: "%ifname" alone is the multicast group there) and otherwise
+// use the first one. Not with opts.rx_threads. 0 when already added.
+int i1905_add_interface(struct i1905_ctx *ctx, const char *ifname);
+// Frames queued on the interface are dropped. Not for the first interface,
+// nor from within i1905_handle_readable().
+int i1905_del_interface(struct i1905_ctx *ctx, const char *ifname);
+// Interface i, 0 being the first, until -1; name (I1905_IFNAME_LEN bytes)
+// and out may be NULL
+int i1905_get_if_stats(const struct i1905_ctx *ctx, unsigned i, char *name,
+                       struct i1905_if_stats *out);
+// Media type the interface reports in topology responses (I1905_MEDIA_*),
+// ifname NULL for the first one. Wired network devices start as their
+// sysfs link speed tells, 802.3u below 1 Gb/s and 802.3ab from there;
+// wireless ones (sysfs has no 802.11 standard or band), devices without a
+// speed and transports without a network device start as
+// I1905_MEDIA_UNKNOWN.
+int i1905_set_if_media(struct i1905_ctx *ctx, const char *ifname, uint16_t media);
+// Hand every interface's socket to a successor (opts.handoff): sends still
+// queued go out as far as the shapers allow, the interfaces stop reading,
+// and out gets duplicates of the fds, which the caller owns. Frames from
+// now on wait in the sockets for the successor. Nothing may be sent
+// afterwards; i1905_close() is all that is left to call. Not for the loop
+// transport nor with opts.rx_threads. The number of sockets, or -1.
+int i1905_handoff(struct i1905_ctx *ctx, struct i1905_handoff *out);
+
+// Capture every frame received or sent to a pcapng file (Ethernet link
+// type, so Wireshark's 1905 dissector applies; the packet flags give the
+// direction). Frames are copied with their timestamp into a ring of
+// ring_size bytes (0: I1905_DEFAULT_CAPTURE_RING) allocated here, and a
+// writer thread empties it into the file, so receiving and sending never
+// wait for the disk; frames that find the ring full only count as
+// capture_drops. snaplen 0 keeps whole frames. Received frames are taken
+// before validation, with rx_threads only the valid ones. Replaces a
+// running capture. 0 or -1.
+int i1905_capture_start(struct i1905_ctx *ctx, const char *path, size_t ring_size,
+                        uint32_t snaplen);
+// write out what the ring holds and close the file
+int i1905_capture_stop(struct i1905_ctx *ctx);
+bool i1905_capture_active(const struct i1905_ctx *ctx);
+
+// Run one Ethernet frame through the receive path as if the transport had
+// returned it from src (NULL: no address), for replaying captures and
+// tests. Not captured. The arena is reset afterwards as for
+// i1905_handle_readable(). 0, or -1 when the frame was dropped.
+int i1905_inject_frame(struct i1905_ctx *ctx, const uint8_t *frame, size_t len,
+                       const struct i1905_addr *src);
+
+// Timers, resolution I1905_TIMER_TICK_MS
+void i1905_timer_init(struct i1905_timer *t, i1905_timer_cb cb, void *user);
+int i1905_timer_arm(struct i1905_ctx *ctx, struct i1905_timer *t, uint32_t delay_ms);
+void i1905_timer_cancel(struct i1905_timer *t);
+bool i1905_timer_pending(const struct i1905_timer *t);
+
+// Destination parsing: IPv4 for UDP, "aa:bb:cc:dd:ee:ff" (or NULL for the
+// 1905 multicast group) for AF_PACKET, port only for loopback; each may end
+// in "%ifname", see i1905_add_interface().
+int i1905_resolve(struct i1905_ctx *ctx, const char *dst, uint16_t port,
+                  struct i1905_addr *out);
+
+// Transmit scheduling. Classes are per message type (types from
+// I1905_STATS_MSG_TYPES - 1 up share one setting); rates as in opts.
+int i1905_set_tx_class(struct i1905_ctx *ctx, uint16_t message_type, i1905_tx_class cls);
+int i1905_set_tx_rate(struct i1905_ctx *ctx, uint32_t bytes_per_s, uint32_t burst);
+
+// Generic send; message_id is assigned by the library and returned (> 0),
+// -1 on error. Messages larger than I1905_MTU are fragmented at TLV
+// boundaries. A message held by the transmit scheduler counts as sent. The
+// i1905_send_* helpers below return the same way.
+int i1905_send_cmdu(struct i1905_ctx *ctx,
+                    const char *dst_ip,
+                    uint16_t dst_port,
+                    struct i1905_cmdu *cmdu);
+
+// Streaming CMDU builder: the header and TLVs are serialised straight into
+// the frame buffer, with no struct i1905_cmdu in between. Begin on a ctx to
+// build in place in its transmit buffer (valid until the next send on that
+// ctx), or on a caller buffer to keep a packed message around. A put that
+// does not fit marks the builder failed; finish()/send() then return -1, so
+// intermediate results need not be checked.
+struct i1905_builder {
+    uint8_t *buf;        // packed CMDU, header first
+    size_t cap;
+    size_t len;
+    size_t tlv_count;
+    bool error;
+    bool finished;
+};
+
+void i1905_builder_begin(struct i1905_builder *b, struct i1905_ctx *ctx,
+                         uint16_t message_type);
+void i1905_builder_begin_buf(struct i1905_builder *b, uint8_t *buf, size_t cap,
+                             uint16_t message_type);
+void i1905_builder_set_relay(struct i1905_builder *b, bool relay);
+int i1905_builder_put_tlv(struct i1905_builder *b, uint8_t type,
+                          const void *value, uint16_t len);
+int i1905_builder_put_mac(struct i1905_builder *b, uint8_t type, const uint8_t mac[6]);
+// Append a TLV header and return its value area for the caller to fill.
+uint8_t *i1905_builder_reserve(struct i1905_builder *b, uint8_t type, uint16_t len);
+// Append end-of-message; returns the CMDU length or -1. Idempotent.
+int i1905_builder_finish(struct i1905_builder *b);
+// Finish, assign message_id and send like i1905_send_cmdu().
+int i1905_builder_send(struct i1905_builder *b, struct i1905_ctx *ctx,
+                       const char *dst_ip, uint16_t dst_port);
+
+// Peer handles: a destination resolved once, shared by everyone that opens
+// the same address (reference counted). Traffic to and from an open peer is
+// counted per peer, whichever API sent it. Handles are invalid after
+// i1905_close().
+struct i1905_peer *i1905_peer_open(struct i1905_ctx *ctx, const char *dst, uint16_t port);
+void i1905_peer_close(struct i1905_peer *peer);
+const struct i1905_addr *i1905_peer_addr(const struct i1905_peer *peer);
+int i1905_peer_get_stats(const struct i1905_peer *peer, struct i1905_peer_stats *out);
+// Override opts.peer_tx_rate for this peer, 0 lifts the limit
+int i1905_peer_set_tx_rate(struct i1905_peer *peer, uint32_t bytes_per_s, uint32_t burst);
+int i1905_peer_send_cmdu(struct i1905_peer *peer, struct i1905_cmdu *cmdu);
+int i1905_builder_send_peer(struct i1905_builder *b, struct i1905_peer *peer);
+// Topology discovery or notification for iface_mac. These are kept packed
+// per (message type, interface) and only message_id is patched on each
+// send; they cannot be used with i1905_expect_reply().
+int i1905_peer_send_periodic(struct i1905_peer *peer, uint16_t message_type,
+                             const uint8_t iface_mac[6]);
+
+// Use message_id `mid` for the next send only, e.g. to answer a request
+// with the id it carried.
+void i1905_set_reply_mid(struct i1905_ctx *ctx, uint16_t mid);
+
+// Send the next message to dsts[0..n) instead of its own destination, which
+// is then ignored: it is packed once, carries one message_id and goes to the
+// transport as a single batch (sendmmsg() / one TX ring kick). The send
+// returns the mid when at least one destination accepted it; *sent, if not
+// NULL, receives how many did. dsts must stay valid until that send. Only a
+// fan-out to a single destination (n == 1) may be followed by
+// i1905_expect_reply(), which makes it a send to a known address without
+// going through i1905_resolve(). Peer handles provide
+// their address through i1905_peer_addr().
+int i1905_set_fanout(struct i1905_ctx *ctx, const struct i1905_addr *dsts, unsigned n,
+                     unsigned *sent);
+
+// Correlate the message just sent (its send returned `mid`) with the reply
+// of type reply_type carrying the same message_id from the same peer. The
+// message is retransmitted up to `retries` times, the timeout doubling each
+// time (0 selects I1905_DEFAULT_REPLY_TIMEOUT_MS); cb runs exactly once. Must
+// follow the send directly, before anything else is sent on ctx. A reply
+// consumed this way goes to cb only, not to the event callback. Topology
+// queries are answered by the library itself with the query's message_id
+// unless opts.no_query_answer is set.
+int i1905_expect_reply(struct i1905_ctx *ctx, uint16_t mid, uint16_t reply_type,
+                       uint32_t timeout_ms, unsigned retries,
+                       i1905_reply_cb cb, void *user);
+
+// Neighbors receive relayed multicast forwarded by this AL entity. A relayed
+// message is passed to every neighbor except the one it arrived from.
+int i1905_add_neighbor(struct i1905_ctx *ctx, const char *dst, uint16_t port);
+int i1905_del_neighbor(struct i1905_ctx *ctx, const char *dst, uint16_t port);
+
+// Convenience send helpers, built with i1905_builder. Discovery and
+// notification are served from the periodic template cache.
+int i1905_send_topology_discovery(struct i1905_ctx *ctx,
+                                  const char *dst_ip,
+                                  uint16_t dst_port,
+                                  const uint8_t iface_mac[6]);
+int i1905_send_topology_query(struct i1905_ctx *ctx,
+                              const char *dst_ip,
+                              uint16_t dst_port);
+int i1905_send_topology_response(struct i1905_ctx *ctx,
+                                 const char *dst_ip,
+                                 uint16_t dst_port,
+                                 const uint8_t iface_mac[6]);
+int i1905_send_topology_notification(struct i1905_ctx *ctx,
+                                     const char *dst_ip,
+                                     uint16_t dst_port,
+                                     const uint8_t iface_mac[6]);
+int i1905_send_ap_autoconfig_search(struct i1905_ctx *ctx,
+                                    const char *dst_ip,
+                                    uint16_t dst_port,
+                                    const uint8_t radio_id[6]);
+int i1905_send_ap_autoconfig_response(struct i1905_ctx *ctx,
+                                      const char *dst_ip,
+                                      uint16_t dst_port,
+                                      const uint8_t radio_id[6]);
+int i1905_send_ap_autoconfig_wsc(struct i1905_ctx *ctx,
+                                 const char *dst_ip,
+                                 uint16_t dst_port,
+                                 const uint8_t *wsc, size_t wsc_len);
+
+// Zero-copy parsing
+int i1905_cmdu_view_parse(struct i1905_cmdu_view *view,
+                          const uint8_t *buf, size_t len);
+void i1905_tlv_iter_init(struct i1905_tlv_iter *it,
+                         const struct i1905_cmdu_view *view);
+bool i1905_tlv_iter_next(struct i1905_tlv_iter *it, struct i1905_tlv_view *tlv);
+int i1905_cmdu_view_find(const struct i1905_cmdu_view *view, uint8_t type,
+                         struct i1905_tlv_view *out);
+// Owning copy allocated from arena, exactly the size of the message
+int i1905_cmdu_from_view(struct i1905_cmdu *out, struct i1905_arena *arena,
+                         const struct i1905_cmdu_view *view);
+
+// Arenas; chunk_size 0 selects I1905_DEFAULT_ARENA_CHUNK, larger requests
+// get a chunk of their own
+struct i1905_arena *i1905_arena_new(size_t chunk_size);
+void i1905_arena_free(struct i1905_arena *a);
+void *i1905_arena_alloc(struct i1905_arena *a, size_t size);
+void i1905_arena_reset(struct i1905_arena *a);
+// The context's arena for CMDUs built or copied in the event callback and
+// other handlers; it is reset when i1905_handle_readable() and
+// i1905_handle_timers() return. Reset it yourself when using it elsewhere.
+struct i1905_arena *i1905_get_arena(struct i1905_ctx *ctx);
+
+// Owning CMDU construction. add_tlv copies len bytes of value (zeroes
+// when value is NULL) and returns the TLV's value area, NULL when out of
+// memory.
+void i1905_cmdu_init(struct i1905_cmdu *cmdu, struct i1905_arena *arena,
+                     uint16_t message_type);
+uint8_t *i1905_cmdu_add_tlv(struct i1905_cmdu *cmdu, uint8_t type,
+                            const void *value, uint16_t len);
+
+const char *i1905_drop_reason_name(enum i1905_drop_reason reason);
+const char *i1905_tx_class_name(i1905_tx_class cls);
+
+// Message type names as used on the ubus API ("topology_query", ...);
+// NULL / -1 for types outside this subset
+const char *i1905_msg_type_name(uint16_t type);
+int i1905_msg_type_from_name(const char *name, uint16_t *type);
+
+// Common TLVs for owning CMDUs, 0 or -1
+int i1905_cmdu_add_mac(struct i1905_cmdu *cmdu, uint8_t type, const uint8_t mac[6]);
+int i1905_cmdu_add_wsc(struct i1905_cmdu *cmdu, const uint8_t *payload, size_t len);
+int i1905_cmdu_add_device_info(struct i1905_cmdu *cmdu,
+                               const uint8_t al_mac[6],
+                               const uint8_t iface_mac[6]);
+
+// Schema-generated TLV codecs, for every I1905_TLV() entry <name>:
+//   int i1905_tlv_<name>_decode(struct i1905_tlv_<name> *out,
+//                               const struct i1905_tlv_view *tlv,
+//                               struct i1905_arena *arena);
+//   int i1905_tlv_<name>_encode(struct i1905_cmdu *cmdu,
+//                               const struct i1905_tlv_<name> *in);
+//   int i1905_tlv_<name>_put(struct i1905_builder *b,
+//                            const struct i1905_tlv_<name> *in);
+// decode checks the length the way validation does and needs the arena
+// only for lists; encode appends to an owning CMDU, put to a builder.
+// 0 or -1.
+#define I1905_TLV(ID, name, type, fields)                                     \
+    int i1905_tlv_##name##_decode(struct i1905_tlv_##name *out,               \
+                                  const struct i1905_tlv_view *tlv,           \
+                                  struct i1905_arena *arena);                 \
+    int i1905_tlv_##name##_encode(struct i1905_cmdu *cmdu,                    \
+                                  const struct i1905_tlv_##name *in);         \
+    int i1905_tlv_##name##_put(struct i1905_builder *b,                       \
+                               const struct i1905_tlv_##name *in);
+#include "ieee1905_schema.def"
+
+// Check a message against ieee1905_schema.def in one pass over its TLVs:
+// known TLVs must be well formed, and a known message type must carry its
+// required TLVs and no known TLV outside its lists. 0 or -1.
+int i1905_cmdu_view_validate(const struct i1905_cmdu_view *view);
+int i1905_cmdu_validate(const struct i1905_cmdu *cmdu);
+
+// TLV type names from the schema ("device_info", ...); NULL / -1 for
+// types it does not describe
+const char *i1905_tlv_type_name(uint8_t type);
+int i1905_tlv_type_from_name(const char *name, uint8_t *type);
+
+
@@ -1,68 +1,130 @@
-// SPDX-License-Identifier: MIT
-// ezz_agent: Agent 进程示例。仅通过 ubus 调用 ieee1905d，不直接链接 ieee1905 库。
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <libubus.h>
-#include <libubox/uloop.h>
-
-static struct ubus_context *ctx;
-static uint32_t ieee1905_id;
-
-static void evt_handler(struct ubus_context *ctx, struct ubus_event_handler *ev,
-                        const char *type, struct blob_attr *msg) {
-    (void)ctx; (void)ev;
-    char *json = blobmsg_format_json(msg, true);
-    printf("[agent] event %s: %s\n", type, json ? json : "{}");
-    free(json);
-}
-
-static int send_cmd(const char *type, const char *dst_ip, uint32_t dst_port) {
-    struct blob_buf bb;
-    blob_buf_init(&bb, 0);
-    blobmsg_add_string(&bb, "type", type);
-    blobmsg_add_string(&bb, "dst_ip", dst_ip);
-    blobmsg_add_u32(&bb, "dst_port", dst_port);
-    int rv = ubus_invoke(ctx, ieee1905_id, "send", bb.head, NULL, NULL, 2000);
-    blob_buf_free(&bb);
-    return rv;
-}
-
-static void usage(const char *prog) {
-    fprintf(stderr, "Usage: %s <data_port>\n", prog);
-}
-
-int main(int argc, char **argv) {
-    if (argc < 2) {
-        usage(argv[0]);
-        return 1;
-    }
-    uint32_t data_port = (uint32_t)atoi(argv[1]);
-
-    uloop_init();
-    ctx = ubus_connect(NULL);
-    if (!ctx) {
-        fprintf(stderr, "ubus connect failed\n");
-        return 1;
-    }
-    ubus_add_uloop(ctx);
-    if (ubus_lookup_id(ctx, "ieee1905", &ieee1905_id)) {
-        fprintf(stderr, "cannot find ubus object 'ieee1905'\n");
-        return 1;
-    }
-
-    struct ubus_event_handler ev = { .cb = evt_handler };
-    ubus_register_event_handler(ctx, &ev, "ieee1905.recv");
-
-    // Agent 启动后上报拓扑发现
-    printf("[agent] send topology_discovery\n");
-    send_cmd("topology_discovery", "127.0.0.1", data_port);
-
-    uloop_run();
-    ubus_free(ctx);
-    uloop_done();
-    return 0;
-}
-
+// SPDX-License-Identifier: MIT
+// ezz_agent: Agent 进程示例。仅通过 ubus 调用 ieee1905d，不直接链接 ieee1905 库。
+
+#define _GNU_SOURCE // getopt
+#include "evring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <libubus.h>
+#include <libubox/uloop.h>
+#include <libubox/blobmsg_json.h>
+
+static struct ubus_context *ctx;
+static uint32_t ieee1905_id;
+
+// 关心的消息类型：名字用于 ubus 事件名和 ring_open，数值用于过滤事件环记录
+static const struct evring_type recv_types[] = {
+    { "topology_query", 0x0002 },
+    { "ap_search", 0x0006 },
+    { "ap_wsc", 0x0008 },
+};
+static struct ubus_event_handler recv_handlers[ARRAY_SIZE(recv_types)];
+
+// 事件环快速通道（-r）：ieee1905d 把这些类型写进共享内存，只用 eventfd 通知
+static struct evring_consumer *ring;
+
+enum {
+    RECV_TLV,
+    __RECV_MAX,
+};
+
+static const struct blobmsg_policy recv_policy[__RECV_MAX] = {
+    [RECV_TLV] = { .name = "tlv", .type = BLOBMSG_TYPE_UNSPEC },
+};
+
+static void evt_handler(struct ubus_context *ctx, struct ubus_event_handler *ev,
+                        const char *type, struct blob_attr *msg) {
+    (void)ctx; (void)ev;
+    char *json = blobmsg_format_json(msg, true);
+    printf("[agent] event %s: %s\n", type, json ? json : "{}");
+    free(json);
+
+    // 事件自带原始 TLV 链（type(1) + len(2) + value），直接遍历即可
+    struct blob_attr *tb[__RECV_MAX];
+    blobmsg_parse(recv_policy, __RECV_MAX, tb, blob_data(msg), blob_len(msg));
+    if (!tb[RECV_TLV]) return;
+    evring_print_tlvs("[agent]", blobmsg_data(tb[RECV_TLV]), blobmsg_data_len(tb[RECV_TLV]));
+}
+
+static void ring_cb(const struct evring_msg *m, const struct evring_type *t, uint64_t lost,
+                    void *user) {
+    (void)user;
+    if (lost) printf("[agent] ring: %llu records overwritten before read\n", (unsigned long long)lost);
+    printf("[agent] ring %s: mid %u src %02x:%02x:%02x:%02x:%02x:%02x tlv_len %zu\n",
+           t->name, m->mid, m->src_mac[0], m->src_mac[1], m->src_mac[2],
+           m->src_mac[3], m->src_mac[4], m->src_mac[5], m->tlv_len);
+    evring_print_tlvs("[agent]", m->tlv, m->tlv_len);
+}
+
+static int send_cmd(const char *type, const char *dst_ip, uint32_t dst_port) {
+    struct blob_buf bb;
+    blob_buf_init(&bb, 0);
+    blobmsg_add_string(&bb, "type", type);
+    blobmsg_add_string(&bb, "dst_ip", dst_ip);
+    blobmsg_add_u32(&bb, "dst_port", dst_port);
+    int rv = ubus_invoke(ctx, ieee1905_id, "send", bb.head, NULL, NULL, 2000);
+    blob_buf_free(&bb);
+    return rv;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r] <data_port>\n"
+                    "  -r  经共享内存事件环接收（ieee1905d ring_open），失败时回退 ubus 事件\n", prog);
+}
+
+int main(int argc, char **argv) {
+    bool use_ring = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "rh")) != -1) {
+        if (opt != 'r') {
+            usage(argv[0]);
+            return 1;
+        }
+        use_ring = true;
+    }
+    if (argc - optind < 1) {
+        usage(argv[0]);
+        return 1;
+    }
+    uint32_t data_port = (uint32_t)atoi(argv[optind]);
+
+    uloop_init();
+    ctx = ubus_connect(NULL);
+    if (!ctx) {
+        fprintf(stderr, "ubus connect failed\n");
+        return 1;
+    }
+    ubus_add_uloop(ctx);
+    if (ubus_lookup_id(ctx, "ieee1905", &ieee1905_id)) {
+        fprintf(stderr, "cannot find ubus object 'ieee1905'\n");
+        return 1;
+    }
+
+    // 只订阅 Agent 需要处理的消息类型
+    for (size_t i = 0; i < ARRAY_SIZE(recv_types); i++) {
+        char event[64];
+        snprintf(event, sizeof(event), "ieee1905.recv.%s", recv_types[i].name);
+        recv_handlers[i].cb = evt_handler;
+        ubus_register_event_handler(ctx, &recv_handlers[i], event);
+    }
+    // mute：这些类型不再发 ubus 事件，但放不进槽位的超大消息仍走事件，所以事件订阅保持不变
+    if (use_ring) {
+        ring = evring_consumer_open(ctx, ieee1905_id, recv_types, ARRAY_SIZE(recv_types), true,
+                                    ring_cb, NULL);
+        if (!ring) printf("[agent] ring_open failed, using ubus events only\n");
+        else printf("[agent] ring %u attached\n", evring_consumer_id(ring));
+    }
+
+    // Agent 启动后上报拓扑发现
+    printf("[agent] send topology_discovery\n");
+    send_cmd("topology_discovery", "127.0.0.1", data_port);
+
+    uloop_run();
+    evring_consumer_close(ring);
+    ubus_free(ctx);
+    uloop_done();
+    return 0;
+}
+
@@ -0,0 +1,94 @@
+// SPDX-License-Identifier: MIT
+// ezz_broker: 最小的 MQTT broker（mqtt_broker.c），ieee1905d -m 联调时代替真实 broker，
+// 无需任何外部服务。-k 周期性断开所有客户端，用来看适配器的重连与 QoS 1 重发；
+// -s 周期打印计数。Ctrl-C 退出时打印最终计数。
+
+#define _GNU_SOURCE // getopt
+#include "mqtt_broker.h"
+
+#include <signal.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+
+static volatile sig_atomic_t stop;
+
+static void on_signal(int sig) {
+    (void)sig;
+    stop = 1;
+}
+
+static uint64_t now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static void print_stats(const struct mqtt_broker *b) {
+    struct broker_stats st;
+    broker_get_stats(b, &st);
+    printf("[broker] clients %llu connects %llu publish in %llu out %llu bytes in %llu out %llu"
+           " kicked %llu slow %llu errors %llu\n",
+           (unsigned long long)st.clients, (unsigned long long)st.connects,
+           (unsigned long long)st.publishes_in, (unsigned long long)st.publishes_out,
+           (unsigned long long)st.bytes_in, (unsigned long long)st.bytes_out,
+           (unsigned long long)st.kicked, (unsigned long long)st.slow,
+           (unsigned long long)st.errors);
+    fflush(stdout);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-a addr] [-p port] [-k kick_ms] [-s stats_s]\n"
+            "  -a  监听地址（默认全部）\n"
+            "  -p  监听端口（默认 1883）\n"
+            "  -k  每隔 kick_ms 断开所有客户端，模拟网络故障（默认 0 关闭）\n"
+            "  -s  每隔 stats_s 秒打印计数（默认 0 只在退出时）\n", prog);
+}
+
+int main(int argc, char **argv) {
+    const char *addr = NULL;
+    uint16_t port = 1883;
+    unsigned kick_ms = 0, stats_s = 0;
+    int opt;
+    while ((opt = getopt(argc, argv, "a:p:k:s:h")) != -1) {
+        switch (opt) {
+        case 'a': addr = optarg; break;
+        case 'p': port = (uint16_t)atoi(optarg); break;
+        case 'k': kick_ms = (unsigned)atoi(optarg); break;
+        case 's': stats_s = (unsigned)atoi(optarg); break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    struct mqtt_broker *b = broker_new(addr, port);
+    if (!b) return 1;
+    signal(SIGINT, on_signal);
+    signal(SIGTERM, on_signal);
+    printf("[broker] listening on %s:%u\n", addr ? addr : "*", broker_port(b));
+    fflush(stdout);
+
+    uint64_t next_kick = kick_ms ? now_ms() + kick_ms : UINT64_MAX;
+    uint64_t next_stats = stats_s ? now_ms() + stats_s * 1000ull : UINT64_MAX;
+    while (!stop) {
+        uint64_t now = now_ms();
+        uint64_t next = next_kick < next_stats ? next_kick : next_stats;
+        int timeout = next == UINT64_MAX ? 1000 : next > now ? (int)(next - now) : 0;
+        if (broker_run(b, timeout > 1000 ? 1000 : timeout) < 0) break;
+        now = now_ms();
+        if (now >= next_kick) {
+            unsigned n = broker_kick(b, NULL);
+            if (n) printf("[broker] kicked %u clients\n", n);
+            next_kick = now + kick_ms;
+        }
+        if (now >= next_stats) {
+            print_stats(b);
+            next_stats = now + stats_s * 1000ull;
+        }
+    }
+    print_stats(b);
+    broker_free(b);
+    return 0;
+}
@@ -1,72 +1,436 @@
-// SPDX-License-Identifier: MIT
-// ezz_controller: 控制进程示例。只通过 ubus 调用 ieee1905d 的 send 方法，
-// 订阅 ieee1905d 的 recv 事件，不直接接触 ieee1905 库。
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <unistd.h>
-#include <libubus.h>
-#include <libubox/uloop.h>
-
-static struct ubus_context *ctx;
-static uint32_t ieee1905_id;
-
-static void evt_handler(struct ubus_context *ctx, struct ubus_event_handler *ev,
-                        const char *type, struct blob_attr *msg) {
-    (void)ctx; (void)ev;
-    char *json = blobmsg_format_json(msg, true);
-    printf("[controller] event %s: %s\n", type, json ? json : "{}");
-    free(json);
-}
-
-static int send_cmd(const char *type, const char *dst_ip, uint32_t dst_port) {
-    struct blob_buf bb;
-    blob_buf_init(&bb, 0);
-    blobmsg_add_string(&bb, "type", type);
-    blobmsg_add_string(&bb, "dst_ip", dst_ip);
-    blobmsg_add_u32(&bb, "dst_port", dst_port);
-    int rv = ubus_invoke(ctx, ieee1905_id, "send", bb.head, NULL, NULL, 2000);
-    blob_buf_free(&bb);
-    return rv;
-}
-
-static void usage(const char *prog) {
-    fprintf(stderr, "Usage: %s <agent_ip> <agent_data_port>\n", prog);
-}
-
-int main(int argc, char **argv) {
-    if (argc < 3) {
-        usage(argv[0]);
-        return 1;
-    }
-    const char *agent_ip = argv[1];
-    uint32_t agent_port = (uint32_t)atoi(argv[2]);
-
-    uloop_init();
-    ctx = ubus_connect(NULL);
-    if (!ctx) {
-        fprintf(stderr, "ubus connect failed\n");
-        return 1;
-    }
-    ubus_add_uloop(ctx);
-    if (ubus_lookup_id(ctx, "ieee1905", &ieee1905_id)) {
-        fprintf(stderr, "cannot find ubus object 'ieee1905'\n");
-        return 1;
-    }
-
-    struct ubus_event_handler ev = { .cb = evt_handler };
-    ubus_register_event_handler(ctx, &ev, "ieee1905.recv");
-
-    printf("[controller] send topology_query\n");
-    send_cmd("topology_query", agent_ip, agent_port);
-
-    printf("[controller] send ap_search\n");
-    send_cmd("ap_search", agent_ip, agent_port);
-
-    uloop_run();
-    ubus_free(ctx);
-    uloop_done();
-    return 0;
-}
-
+// SPDX-License-Identifier: MIT
+// ezz_controller: 控制进程示例。只通过 ubus 调用 ieee1905d 的 send 方法，
+// 订阅 ieee1905d 的 recv 事件，ieee1905 库只用来解码 TLV。-r 时经共享内存事件环收包。
+// 由各设备的 topology response 维护全网拓扑图和以本机为根的回程树（topo_graph），
+// 经 ubus 对象 ezz_controller 的 backhaul 方法输出。
+
+#define _GNU_SOURCE // getopt
+#include "evring.h"
+#include "ieee1905.h"
+#include "topo_graph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <libubus.h>
+#include <libubox/uloop.h>
+#include <libubox/blobmsg_json.h>
+
+static struct ubus_context *ctx;
+static uint32_t ieee1905_id;
+
+// 关心的消息类型：名字用于 ubus 事件名和 ring_open，数值用于过滤事件环记录
+static const struct evring_type recv_types[] = {
+    { "topology_response", 0x0003 },
+    { "topology_notification", 0x0001 },
+    { "ap_response", 0x0007 },
+};
+static struct ubus_event_handler recv_handlers[ARRAY_SIZE(recv_types)];
+
+// 事件环快速通道（-r）：ieee1905d 把这些类型写进共享内存，只用 eventfd 通知
+static struct evring_consumer *ring;
+
+enum {
+    RECV_TYPE,
+    RECV_TLV,
+    RECV_AL_MAC,
+    __RECV_MAX,
+};
+
+static const struct blobmsg_policy recv_policy[__RECV_MAX] = {
+    [RECV_TYPE] = { .name = "type", .type = BLOBMSG_TYPE_INT32 },
+    [RECV_TLV] = { .name = "tlv", .type = BLOBMSG_TYPE_UNSPEC },
+    [RECV_AL_MAC] = { .name = "al_mac", .type = BLOBMSG_TYPE_STRING },
+};
+
+// 拓扑图：根是本机 AL MAC，启动时从 ieee1905d 的 topology 方法取得
+#define GRAPH_MAX_NODES   1024
+#define GRAPH_TTL_MS      (3 * 60 * 1000)
+#define GRAPH_AGE_MS      10000
+// 经邻居的报告进图、自己还没回过 response 的设备要主动查询，否则它身后的链路
+// 永远进不了树。同一设备 QUERY_RETRY_MS 内只查一次；没查到的由 age_cb 巡检补上，
+// 每轮至多 QUERY_SWEEP_MAX 个
+#define QUERY_RETRY_MS    30000
+#define QUERY_SWEEP_MAX   64
+
+static struct topo_graph graph;
+static bool graph_ready;
+static struct i1905_arena *tlv_arena;     // TLV 解码出的列表，每个 response 后清空
+static struct uloop_timeout age_timer;
+static const char *agent_ip;
+static uint32_t agent_port;
+static uint64_t queried_ms[GRAPH_MAX_NODES];  // 按图槽位；槽位被复用时至多推迟一次查询
+
+// 每个 response 从解码到回程树修复完成的耗时
+static struct {
+    uint64_t responses;
+    uint64_t changed;          // 有链路变化的 response 数
+    uint64_t last_ns;
+    uint64_t max_ns;
+    uint64_t total_ns;
+} upd;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void mac_str(const uint8_t mac[6], char buf[18]) {
+    snprintf(buf, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static int send_query(const char *type, const char *dst_ip, uint32_t dst_port, const uint8_t *al);
+
+// 查询图里槽位 i 上还没回过 response 的设备，按上面的间隔去重；返回是否发出
+static bool query_unreported(uint32_t i, uint64_t now_ms) {
+    const struct graph_node *n = &graph.nodes[i];
+    if (!n->used || i == graph.root || n->last_report_ms ||
+        (queried_ms[i] && now_ms - queried_ms[i] < QUERY_RETRY_MS)) {
+        return false;
+    }
+    queried_ms[i] = now_ms;
+    return send_query("topology_query", NULL, 0, n->al_mac) == 0;
+}
+
+// topology response 的解码与回程树修复都在 graph_feed_response 里，这里只计时，
+// 之后查询上报者报告的邻居里还没回过 response 的
+static void graph_feed(const uint8_t *tlv, size_t len) {
+    if (!graph_ready) return;
+    uint64_t t0 = now_ns();
+    i1905_arena_reset(tlv_arena);
+    uint8_t from[6];
+    int changed = graph_feed_response(&graph, tlv, len, tlv_arena, now_ns() / 1000000, from);
+    if (changed < 0) return;
+
+    uint64_t dt = now_ns() - t0;
+    upd.responses++;
+    upd.changed += changed != 0;
+    upd.last_ns = dt;
+    upd.total_ns += dt;
+    if (dt > upd.max_ns) upd.max_ns = dt;
+    if (changed) {
+        char mac[18];
+        mac_str(from, mac);
+        printf("[controller] graph: %s %d links changed, %u nodes, %llu ns\n",
+               mac, changed, graph.count, (unsigned long long)dt);
+    }
+    int32_t idx = graph_lookup(&graph, from);
+    if (idx < 0) return;
+    const struct graph_node *n = &graph.nodes[idx];
+    uint64_t now_ms = now_ns() / 1000000;
+    for (uint32_t k = 0; k < n->n_adj; k++) query_unreported(n->adj[k].peer, now_ms);
+}
+
+static void age_cb(struct uloop_timeout *t) {
+    uint64_t now_ms = now_ns() / 1000000;
+    unsigned removed = graph_age(&graph, now_ms, GRAPH_TTL_MS);
+    if (removed) printf("[controller] graph: %u devices aged out\n", removed);
+    unsigned sent = 0;
+    for (uint32_t i = 0; i < graph.cap && sent < QUERY_SWEEP_MAX; i++) sent += query_unreported(i, now_ms);
+    uloop_timeout_set(t, GRAPH_AGE_MS);
+}
+
+// 收到的 response 与带 wait 的 send 应答走同一路径；notification 说明发出者拓扑
+// 有变，按它的 AL MAC 重新查询它。只查已在图里的设备，图外的会经邻居的 response
+// 进图，再由 graph_feed 查询，不为每个路过的 notification 发查询
+static void handle_frame(uint16_t type, const uint8_t *al, const uint8_t *tlv, size_t len) {
+    int32_t idx;
+    if (type == I1905_MSG_TOPOLOGY_RESPONSE) {
+        graph_feed(tlv, len);
+    } else if (type == I1905_MSG_TOPOLOGY_NOTIFICATION && al && graph_ready &&
+               (idx = graph_lookup(&graph, al)) >= 0) {
+        queried_ms[idx] = now_ns() / 1000000;
+        send_query("topology_query", NULL, 0, al);
+    }
+}
+
+static bool parse_mac(const char *s, uint8_t mac[6]) {
+    return sscanf(s, "%hhx:%hhx:%hhx:%hhx:%hhx:%hhx", &mac[0], &mac[1], &mac[2],
+                  &mac[3], &mac[4], &mac[5]) == 6;
+}
+
+static void evt_handler(struct ubus_context *ctx, struct ubus_event_handler *ev,
+                        const char *type, struct blob_attr *msg) {
+    (void)ctx; (void)ev;
+    char *json = blobmsg_format_json(msg, true);
+    printf("[controller] event %s: %s\n", type, json ? json : "{}");
+    free(json);
+
+    // 事件自带原始 TLV 链（type(1) + len(2) + value），直接遍历即可
+    struct blob_attr *tb[__RECV_MAX];
+    blobmsg_parse(recv_policy, __RECV_MAX, tb, blob_data(msg), blob_len(msg));
+    if (!tb[RECV_TLV]) return;
+    evring_print_tlvs("[controller]", blobmsg_data(tb[RECV_TLV]), blobmsg_data_len(tb[RECV_TLV]));
+    uint8_t al[6];
+    bool has_al = tb[RECV_AL_MAC] && parse_mac(blobmsg_get_string(tb[RECV_AL_MAC]), al);
+    if (tb[RECV_TYPE]) {
+        handle_frame((uint16_t)blobmsg_get_u32(tb[RECV_TYPE]), has_al ? al : NULL,
+                     blobmsg_data(tb[RECV_TLV]), blobmsg_data_len(tb[RECV_TLV]));
+    }
+}
+
+static void ring_cb(const struct evring_msg *m, const struct evring_type *t, uint64_t lost,
+                    void *user) {
+    (void)user;
+    if (lost) {
+        printf("[controller] ring: %llu records overwritten before read\n", (unsigned long long)lost);
+    }
+    printf("[controller] ring %s: mid %u src %02x:%02x:%02x:%02x:%02x:%02x tlv_len %zu\n",
+           t->name, m->mid, m->src_mac[0], m->src_mac[1], m->src_mac[2],
+           m->src_mac[3], m->src_mac[4], m->src_mac[5], m->tlv_len);
+    evring_print_tlvs("[controller]", m->tlv, m->tlv_len);
+    handle_frame(m->msg_type, m->al_mac, m->tlv, m->tlv_len);
+}
+
+// 带 wait 的异步 send：ieee1905d 按 (对端, mid, 应答类型) 关联并负责重传，
+// 应答到达或超时才完成调用，因此可同时挂起任意多个请求
+struct query {
+    struct ubus_request req;
+    const char *type;
+};
+
+static void query_data_cb(struct ubus_request *req, int type, struct blob_attr *msg) {
+    (void)type;
+    struct query *q = container_of(req, struct query, req);
+    char *json = blobmsg_format_json(msg, true);
+    printf("[controller] %s reply: %s\n", q->type, json ? json : "{}");
+    free(json);
+
+    struct blob_attr *tb[__RECV_MAX];
+    blobmsg_parse(recv_policy, __RECV_MAX, tb, blob_data(msg), blob_len(msg));
+    if (tb[RECV_TYPE] && tb[RECV_TLV]) {
+        handle_frame((uint16_t)blobmsg_get_u32(tb[RECV_TYPE]), NULL, blobmsg_data(tb[RECV_TLV]),
+                     blobmsg_data_len(tb[RECV_TLV]));
+    }
+}
+
+static void query_complete_cb(struct ubus_request *req, int ret) {
+    struct query *q = container_of(req, struct query, req);
+    if (ret) printf("[controller] %s failed: %d\n", q->type, ret);
+    free(q);
+}
+
+// al 非 NULL 时按 AL MAC 发（ieee1905d 从拓扑库取地址），dst_ip/dst_port 不用；
+// 此时不带 wait，不占 ieee1905d 的挂起表，response 照常经 recv 事件或事件环回来，
+// 丢了由巡检重查
+static int send_query(const char *type, const char *dst_ip, uint32_t dst_port, const uint8_t *al) {
+    struct query *q = calloc(1, sizeof(*q));
+    if (!q) return -1;
+    struct blob_buf bb;
+    memset(&bb, 0, sizeof(bb));
+    blob_buf_init(&bb, 0);
+    blobmsg_add_string(&bb, "type", type);
+    if (al) {
+        char mac[18];
+        mac_str(al, mac);
+        blobmsg_add_string(&bb, "al_mac", mac);
+    } else {
+        blobmsg_add_string(&bb, "dst_ip", dst_ip);
+        blobmsg_add_u32(&bb, "dst_port", dst_port);
+        blobmsg_add_u8(&bb, "wait", 1);
+    }
+    int rv = ubus_invoke_async(ctx, ieee1905_id, "send", bb.head, &q->req);
+    blob_buf_free(&bb);
+    if (rv) {
+        free(q);
+        return rv;
+    }
+    q->type = type;
+    q->req.data_cb = query_data_cb;
+    q->req.complete_cb = query_complete_cb;
+    ubus_complete_request_async(ctx, &q->req);
+    return 0;
+}
+
+// ---- ubus 对象 ezz_controller ----
+
+static struct blob_buf reply_bb;
+
+static void add_node(struct blob_buf *bb, const struct graph_node *n) {
+    char mac[18];
+    void *tbl = blobmsg_open_table(bb, NULL);
+    mac_str(n->al_mac, mac);
+    blobmsg_add_string(bb, "al_mac", mac);
+    mac_str(graph.nodes[n->parent].al_mac, mac);
+    blobmsg_add_string(bb, "parent", mac);
+    blobmsg_add_u32(bb, "hops", graph_hops(n));
+    blobmsg_add_u32(bb, "cost", graph_cost(n));
+    blobmsg_close_table(bb, tbl);
+}
+
+// 回程树按先序输出（父节点总在子节点之前），沿子节点链表走，不需要额外栈
+static int ubus_backhaul(struct ubus_context *ctx, struct ubus_object *obj,
+                         struct ubus_request_data *req, const char *method,
+                         struct blob_attr *msg) {
+    (void)obj; (void)method; (void)msg;
+    if (!graph_ready) return UBUS_STATUS_NO_DATA;
+    char mac[18];
+    blob_buf_init(&reply_bb, 0);
+    mac_str(graph.nodes[graph.root].al_mac, mac);
+    blobmsg_add_string(&reply_bb, "root", mac);
+    blobmsg_add_u32(&reply_bb, "gen", graph.tree_gen);
+
+    void *arr = blobmsg_open_array(&reply_bb, "tree");
+    int32_t x = graph.nodes[graph.root].first_child;
+    while (x >= 0) {
+        const struct graph_node *n = &graph.nodes[x];
+        add_node(&reply_bb, n);
+        if (n->first_child >= 0) {
+            x = n->first_child;
+            continue;
+        }
+        while (x >= 0 && graph.nodes[x].next_sib < 0) x = graph.nodes[x].parent;
+        if (x >= 0) x = graph.nodes[x].next_sib;
+    }
+    blobmsg_close_array(&reply_bb, arr);
+
+    arr = blobmsg_open_array(&reply_bb, "unreachable");
+    for (uint32_t i = 0; i < graph.cap; i++) {
+        if (!graph.nodes[i].used || graph_reachable(&graph.nodes[i])) continue;
+        mac_str(graph.nodes[i].al_mac, mac);
+        blobmsg_add_string(&reply_bb, NULL, mac);
+    }
+    blobmsg_close_array(&reply_bb, arr);
+
+    void *tbl = blobmsg_open_table(&reply_bb, "stats");
+    blobmsg_add_u32(&reply_bb, "nodes", graph.count);
+    blobmsg_add_u64(&reply_bb, "responses", upd.responses);
+    blobmsg_add_u64(&reply_bb, "changed", upd.changed);
+    blobmsg_add_u64(&reply_bb, "link_updates", graph.stats.updates);
+    blobmsg_add_u64(&reply_bb, "touched", graph.stats.touched);
+    blobmsg_add_u64(&reply_bb, "update_ns_last", upd.last_ns);
+    blobmsg_add_u64(&reply_bb, "update_ns_max", upd.max_ns);
+    blobmsg_add_u64(&reply_bb, "update_ns_avg", upd.responses ? upd.total_ns / upd.responses : 0);
+    blobmsg_close_table(&reply_bb, tbl);
+
+    ubus_send_reply(ctx, req, reply_bb.head);
+    return 0;
+}
+
+static const struct ubus_method controller_methods[] = {
+    UBUS_METHOD_NOARG("backhaul", ubus_backhaul),
+};
+
+static struct ubus_object_type controller_obj_type =
+    UBUS_OBJECT_TYPE("ezz_controller", controller_methods);
+
+static struct ubus_object controller_obj = {
+    .name = "ezz_controller",
+    .type = &controller_obj_type,
+    .methods = controller_methods,
+    .n_methods = ARRAY_SIZE(controller_methods),
+};
+
+// ieee1905d topology 方法里 local 为真的设备就是本机，作为回程树的根
+static void root_data_cb(struct ubus_request *req, int type, struct blob_attr *msg) {
+    (void)type;
+    uint8_t *root = req->priv;
+    struct blob_attr *devs = NULL, *dev, *cur;
+    size_t rem, rem2;
+    blobmsg_for_each_attr(cur, msg, rem) {
+        if (strcmp(blobmsg_name(cur), "devices") == 0) devs = cur;
+    }
+    if (!devs) return;
+    blobmsg_for_each_attr(dev, devs, rem) {
+        const char *al = NULL;
+        bool local = false;
+        blobmsg_for_each_attr(cur, dev, rem2) {
+            if (strcmp(blobmsg_name(cur), "al_mac") == 0) al = blobmsg_get_string(cur);
+            else if (strcmp(blobmsg_name(cur), "local") == 0) local = blobmsg_get_bool(cur);
+        }
+        if (local && al && parse_mac(al, root)) root[6] = 1;
+    }
+}
+
+static int graph_open(void) {
+    uint8_t root[7] = { 0 };          // 第 7 字节标记已找到
+    blob_buf_init(&reply_bb, 0);
+    if (ubus_invoke(ctx, ieee1905_id, "topology", reply_bb.head, root_data_cb, root, 2000) ||
+        !root[6]) {
+        return -1;
+    }
+    if (!(tlv_arena = i1905_arena_new(0))) return -1;
+    if (graph_init(&graph, GRAPH_MAX_NODES, root) < 0) {
+        i1905_arena_free(tlv_arena);
+        return -1;
+    }
+    graph_ready = true;
+    age_timer.cb = age_cb;
+    uloop_timeout_set(&age_timer, GRAPH_AGE_MS);
+    return 0;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-r] <agent_ip> <agent_data_port>\n"
+                    "  -r  经共享内存事件环接收（ieee1905d ring_open），失败时回退 ubus 事件\n", prog);
+}
+
+int main(int argc, char **argv) {
+    bool use_ring = false;
+    int opt;
+    while ((opt = getopt(argc, argv, "rh")) != -1) {
+        if (opt != 'r') {
+            usage(argv[0]);
+            return 1;
+        }
+        use_ring = true;
+    }
+    if (argc - optind < 2) {
+        usage(argv[0]);
+        return 1;
+    }
+    agent_ip = argv[optind];
+    agent_port = (uint32_t)atoi(argv[optind + 1]);
+
+    uloop_init();
+    ctx = ubus_connect(NULL);
+    if (!ctx) {
+        fprintf(stderr, "ubus connect failed\n");
+        return 1;
+    }
+    ubus_add_uloop(ctx);
+    if (ubus_lookup_id(ctx, "ieee1905", &ieee1905_id)) {
+        fprintf(stderr, "cannot find ubus object 'ieee1905'\n");
+        return 1;
+    }
+
+    if (graph_open() < 0) printf("[controller] no local AL MAC from ieee1905d, backhaul tree disabled\n");
+    if (ubus_add_object(ctx, &controller_obj)) fprintf(stderr, "cannot add ubus object 'ezz_controller'\n");
+
+    // 只订阅控制器关心的消息类型，其余类型 ubusd 不会投递过来
+    for (size_t i = 0; i < ARRAY_SIZE(recv_types); i++) {
+        char event[64];
+        snprintf(event, sizeof(event), "ieee1905.recv.%s", recv_types[i].name);
+        recv_handlers[i].cb = evt_handler;
+        ubus_register_event_handler(ctx, &recv_handlers[i], event);
+    }
+    // mute：这些类型不再发 ubus 事件，但放不进槽位的超大消息仍走事件，所以事件订阅保持不变
+    if (use_ring) {
+        ring = evring_consumer_open(ctx, ieee1905_id, recv_types, ARRAY_SIZE(recv_types), true,
+                                    ring_cb, NULL);
+        if (!ring) printf("[controller] ring_open failed, using ubus events only\n");
+        else printf("[controller] ring %u attached\n", evring_consumer_id(ring));
+    }
+
+    printf("[controller] send topology_query\n");
+    send_query("topology_query", agent_ip, agent_port, NULL);
+
+    printf("[controller] send ap_search\n");
+    send_query("ap_search", agent_ip, agent_port, NULL);
+
+    uloop_run();
+    evring_consumer_close(ring);
+    if (graph_ready) {
+        graph_free(&graph);
+        i1905_arena_free(tlv_arena);
+    }
+    blob_buf_free(&reply_bb);
+    ubus_free(ctx);
+    uloop_done();
+    return 0;
+}
+
@@ -0,0 +1,377 @@
+// SPDX-License-Identifier: MIT
+// ezz_replay: 把抓包文件里的 1905 帧重新送进库的收包路径，用于复现现场流量和性能回归。
+// 读 pcapng（ieee1905d -w / ubus capture 的输出，或 Wireshark/tcpdump 保存的）和经典 pcap，
+// 只取以太网链路类型、以太类型 0x893A 的帧；pcapng 带方向标记时默认只回放收到的帧。
+//
+// 回放对象是一个 loop 传输上的 i1905_ctx，帧经 i1905_inject_frame() 走与
+// i1905_handle_readable() 相同的解析、校验、重组、去重和应答路径；库产生的应答发往
+// 不存在的 loop 端口即被丢弃，但组帧和发送开销都算在内。-s 0（默认）尽快回放，
+// -s 1 按原始时间间隔，-s 2 两倍速，依此类推；按时回放时报告落后于时间表的最大值。
+// -j 输出一行与 bench 相同格式的 JSON，便于回归脚本比较。
+
+#define _GNU_SOURCE // getopt, nanosleep
+#include "ieee1905.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define REPLAY_PORT     1905           // 回放 ctx 的 loop 端口
+#define SINK_PORT       1906           // 帧的来源端口，无人监听，应答在此丢弃
+#define LINKTYPE_ETH    1
+#define MAX_IFACES      64
+#define TIMER_EVERY     1024           // 尽快回放时每隔多少帧跑一次时间轮
+#define SPIN_NS         200000         // 按时回放：离目标时间不足此值时忙等
+
+enum { DIR_ANY, DIR_IN, DIR_OUT };     // pcapng epb_flags 低两位
+
+struct rframe {
+    const uint8_t *data;
+    uint32_t len;
+    uint8_t dir;
+    uint64_t ts_ns;
+};
+
+static struct {
+    double speed;
+    unsigned loops;
+    bool all_dirs;
+    bool validate;
+    bool json;
+    i1905_role role;
+    const char *path;
+} cfg = { .loops = 1, .role = I1905_ROLE_CONTROLLER };
+
+static struct rframe *frames;
+static size_t n_frames, cap_frames;
+static uint64_t n_skipped;             // 非以太网或非 1905 的帧
+static uint64_t msgs[I1905_STATS_MSG_TYPES];
+static uint64_t n_msgs;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+// ---- 读抓包文件 ----
+
+static uint16_t get16(const uint8_t *p, bool swap) {
+    uint16_t v;
+    memcpy(&v, p, 2);
+    return swap ? (uint16_t)((v >> 8) | (v << 8)) : v;
+}
+
+static uint32_t get32(const uint8_t *p, bool swap) {
+    uint32_t v;
+    memcpy(&v, p, 4);
+    return swap ? __builtin_bswap32(v) : v;
+}
+
+static int add_frame(const uint8_t *data, uint32_t len, uint8_t dir, uint64_t ts_ns) {
+    if (len < I1905_ETH_HDR_LEN || ((data[12] << 8) | data[13]) != I1905_ETHERTYPE) {
+        n_skipped++;
+        return 0;
+    }
+    if (n_frames == cap_frames) {
+        size_t cap = cap_frames ? cap_frames * 2 : 4096;
+        struct rframe *p = realloc(frames, cap * sizeof(*p));
+        if (!p) return -1;
+        frames = p;
+        cap_frames = cap;
+    }
+    frames[n_frames++] = (struct rframe){ data, len, dir, ts_ns };
+    return 0;
+}
+
+// if_tsresol：最高位为 0 时单位是 10^-v 秒，为 1 时是 2^-v 秒
+static uint64_t ts_to_ns(uint64_t ts, uint8_t resol) {
+    unsigned v = resol & 0x7F;
+    if (resol & 0x80) {
+        if (v >= 64) return 0;
+        uint64_t frac = ts & ((1ull << v) - 1);
+        return (ts >> v) * 1000000000ull + (uint64_t)((double)frac * 1e9 / (double)(1ull << v));
+    }
+    uint64_t ns = ts;
+    for (; v < 9; v++) ns *= 10;
+    for (; v > 9; v--) ns /= 10;
+    return ns;
+}
+
+static int load_pcap(const uint8_t *p, size_t size) {
+    uint32_t magic;
+    memcpy(&magic, p, 4);
+    bool swap = magic == 0xd4c3b2a1 || magic == 0x4d3cb2a1;
+    bool nsec = magic == 0xa1b23c4d || magic == 0x4d3cb2a1;
+    if (get32(p + 20, swap) != LINKTYPE_ETH) {
+        fprintf(stderr, "%s: link type %u, want Ethernet\n", cfg.path, get32(p + 20, swap));
+        return -1;
+    }
+    size_t off = 24;
+    while (size - off >= 16) {
+        const uint8_t *r = p + off;
+        uint64_t sec = get32(r, swap), sub = get32(r + 4, swap);
+        uint32_t caplen = get32(r + 8, swap);
+        if (caplen > size - off - 16) break;
+        uint64_t ts = sec * 1000000000ull + (nsec ? sub : sub * 1000);
+        if (add_frame(r + 16, caplen, DIR_ANY, ts) < 0) return -1;
+        off += 16 + caplen;
+    }
+    if (off != size) fprintf(stderr, "%s: truncated at byte %zu\n", cfg.path, off);
+    return 0;
+}
+
+struct ng_iface {
+    uint16_t linktype;
+    uint8_t tsresol;
+};
+
+static int load_pcapng(const uint8_t *p, size_t size) {
+    struct ng_iface ifaces[MAX_IFACES];
+    unsigned n_ifaces = 0;
+    bool swap = false;
+    size_t off = 0;
+    while (size - off >= 12) {
+        const uint8_t *b = p + off;
+        uint32_t type = get32(b, false);
+        if (type == 0x0A0D0D0A) {
+            // 新的 section：字节序和接口表都重新开始
+            if (size - off < 28) break;
+            swap = get32(b + 8, false) != 0x1A2B3C4D;
+            if (get32(b + 8, swap) != 0x1A2B3C4D) break;
+            n_ifaces = 0;
+        } else {
+            type = get32(b, swap);
+        }
+        uint32_t len = get32(b + 4, swap);
+        if (len < 12 || len % 4 || len > size - off) break;
+        const uint8_t *end = b + len - 4;
+
+        if (type == 1 && len >= 20) {
+            if (n_ifaces == MAX_IFACES) {
+                fprintf(stderr, "%s: more than %d interfaces\n", cfg.path, MAX_IFACES);
+                return -1;
+            }
+            struct ng_iface *i = &ifaces[n_ifaces++];
+            i->linktype = get16(b + 8, swap);
+            i->tsresol = 6;
+            for (const uint8_t *o = b + 16; end - o >= 4;) {
+                uint16_t code = get16(o, swap), olen = get16(o + 2, swap);
+                if (code == 0 || olen > end - o - 4) break;
+                if (code == 9 && olen >= 1) i->tsresol = o[4];
+                o += 4 + ((olen + 3u) & ~3u);
+            }
+        } else if (type == 6 && len >= 32) {
+            uint32_t id = get32(b + 8, swap);
+            uint64_t ts = (uint64_t)get32(b + 12, swap) << 32 | get32(b + 16, swap);
+            uint32_t caplen = get32(b + 20, swap);
+            if (caplen > (size_t)(end - (b + 28))) break;
+            uint8_t dir = DIR_ANY;
+            for (const uint8_t *o = b + 28 + ((caplen + 3u) & ~3u); end - o >= 4;) {
+                uint16_t code = get16(o, swap), olen = get16(o + 2, swap);
+                if (code == 0 || olen > end - o - 4) break;
+                if (code == 2 && olen == 4) dir = get32(o + 4, swap) & 3;
+                o += 4 + ((olen + 3u) & ~3u);
+            }
+            if (id >= n_ifaces || ifaces[id].linktype != LINKTYPE_ETH) {
+                n_skipped++;
+            } else if (add_frame(b + 28, caplen, dir, ts_to_ns(ts, ifaces[id].tsresol)) < 0) {
+                return -1;
+            }
+        }
+        // 其余块（统计、名字解析、旧式包块等）跳过
+        off += len;
+    }
+    if (off != size) fprintf(stderr, "%s: bad block at byte %zu, rest ignored\n", cfg.path, off);
+    return 0;
+}
+
+static int load(const uint8_t *p, size_t size) {
+    uint32_t magic = size >= 4 ? get32(p, false) : 0;
+    if (magic == 0x0A0D0D0A) return load_pcapng(p, size);
+    if (size >= 24 && (magic == 0xa1b2c3d4 || magic == 0xd4c3b2a1 ||
+                       magic == 0xa1b23c4d || magic == 0x4d3cb2a1)) {
+        return load_pcap(p, size);
+    }
+    fprintf(stderr, "%s: neither pcap nor pcapng\n", cfg.path);
+    return -1;
+}
+
+// ---- 回放 ----
+
+static void on_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                     void *user) {
+    (void)rx; (void)user;
+    msgs[I1905_STATS_TYPE_SLOT(cmdu->message_type)]++;
+    n_msgs++;
+}
+
+// 按时回放：睡到目标前 SPIN_NS，再忙等，期间照常跑时间轮
+static void wait_until(struct i1905_ctx *ctx, uint64_t target) {
+    uint64_t now = now_ns();
+    while (now < target) {
+        if (target - now > SPIN_NS) {
+            uint64_t d = target - now - SPIN_NS / 2;
+            struct timespec ts = { (time_t)(d / 1000000000ull), (long)(d % 1000000000ull) };
+            nanosleep(&ts, NULL);
+            i1905_handle_timers(ctx);
+        }
+        now = now_ns();
+    }
+}
+
+static bool wanted(const struct rframe *f) {
+    return cfg.all_dirs || f->dir != DIR_OUT;
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-s speed] [-l loops] [-a] [-A] [-V] [-j] capture.pcapng\n"
+            "  -s  0 尽快回放（默认），1 按原始间隔，n 为 n 倍速\n"
+            "  -l  整个文件回放次数（默认 1）\n"
+            "  -a  发出方向的帧也回放（默认只回放收到的帧；经典 pcap 无方向，全部回放）\n"
+            "  -A  以 agent 角色回放（默认 controller）\n"
+            "  -V  打开 TLV schema 校验（opts.validate）\n"
+            "  -j  结果输出为一行 JSON（与 bench -f json 同格式）\n", prog);
+}
+
+static int parse_args(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "s:l:aAVjh")) != -1) {
+        switch (opt) {
+        case 's': cfg.speed = atof(optarg); break;
+        case 'l': cfg.loops = (unsigned)atoi(optarg); break;
+        case 'a': cfg.all_dirs = true; break;
+        case 'A': cfg.role = I1905_ROLE_AGENT; break;
+        case 'V': cfg.validate = true; break;
+        case 'j': cfg.json = true; break;
+        default: return -1;
+        }
+    }
+    if (optind != argc - 1 || cfg.speed < 0 || !cfg.loops) return -1;
+    cfg.path = argv[optind];
+    return 0;
+}
+
+static void report(const struct i1905_stats *st, uint64_t n, uint64_t bytes,
+                   uint64_t elapsed_ns, uint64_t max_lag_ns) {
+    double ns_per = n ? (double)elapsed_ns / (double)n : 0;
+    double per_s = elapsed_ns ? (double)n * 1e9 / (double)elapsed_ns : 0;
+    uint64_t drops = 0;
+    for (unsigned r = 0; r < I1905_DROP_REASONS; r++) drops += st->rx_drops[r];
+    if (cfg.json) {
+        const char *name = strrchr(cfg.path, '/');
+        printf("{\"bench\":\"replay\",\"case\":\"%s\",\"ops\":%llu,\"ns_per_op\":%.2f,"
+               "\"ops_per_s\":%.0f,\"mb_per_s\":%.2f,\"messages\":%llu,\"drops\":%llu}\n",
+               name ? name + 1 : cfg.path, (unsigned long long)n, ns_per, per_s,
+               elapsed_ns ? (double)bytes * 1e3 / (double)elapsed_ns : 0,
+               (unsigned long long)n_msgs, (unsigned long long)drops);
+        return;
+    }
+    printf("replayed %llu frames in %.3f s: %.0f frames/s, %.1f ns/frame\n",
+           (unsigned long long)n, (double)elapsed_ns / 1e9, per_s, ns_per);
+    if (cfg.speed > 0) printf("  max lag behind schedule      %.3f ms\n", (double)max_lag_ns / 1e6);
+    printf("  messages delivered           %llu\n", (unsigned long long)n_msgs);
+    for (unsigned slot = 0; slot < I1905_STATS_MSG_TYPES; slot++) {
+        if (!msgs[slot]) continue;
+        const char *type = slot == I1905_STATS_MSG_TYPES - 1 ? "other"
+                                                              : i1905_msg_type_name((uint16_t)slot);
+        char buf[8];
+        if (!type) {
+            snprintf(buf, sizeof(buf), "0x%04x", slot);
+            type = buf;
+        }
+        printf("    %-26s %llu\n", type, (unsigned long long)msgs[slot]);
+    }
+    if (st->reasm_complete || st->reasm_timeouts) {
+        printf("  reassembled / timed out      %llu / %llu\n",
+               (unsigned long long)st->reasm_complete, (unsigned long long)st->reasm_timeouts);
+    }
+    if (st->dedup_hits) printf("  relayed duplicates           %llu\n", (unsigned long long)st->dedup_hits);
+    for (unsigned r = 0; r < I1905_DROP_REASONS; r++) {
+        if (st->rx_drops[r]) {
+            printf("  drop %-23s %llu\n", i1905_drop_reason_name((enum i1905_drop_reason)r),
+                   (unsigned long long)st->rx_drops[r]);
+        }
+    }
+}
+
+int main(int argc, char **argv) {
+    if (parse_args(argc, argv) < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    int fd = open(cfg.path, O_RDONLY | O_CLOEXEC);
+    struct stat sb;
+    if (fd < 0 || fstat(fd, &sb) < 0 || sb.st_size == 0) {
+        perror(cfg.path);
+        return 1;
+    }
+    size_t size = (size_t)sb.st_size;
+    const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) {
+        perror(cfg.path);
+        return 1;
+    }
+    if (load(map, size) < 0) return 1;
+
+    uint64_t n_in = 0, bytes = 0;
+    for (size_t i = 0; i < n_frames; i++) {
+        if (!wanted(&frames[i])) continue;
+        n_in++;
+        bytes += frames[i].len;
+    }
+    fprintf(stderr, "%s: %zu 1905 frames, %llu to replay, %llu other frames skipped\n",
+            cfg.path, n_frames, (unsigned long long)n_in, (unsigned long long)n_skipped);
+    if (!n_in) return 1;
+
+    struct i1905_opts opts = {
+        .transport = I1905_TRANSPORT_LOOP,
+        .validate = cfg.validate,
+    };
+    struct i1905_ctx *ctx;
+    if (i1905_init_ex(&ctx, cfg.role, REPLAY_PORT, NULL, on_frame, NULL, &opts) < 0) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    const struct i1905_addr src = { .port = SINK_PORT };
+
+    uint64_t max_lag = 0, n = 0;
+    uint64_t t0 = now_ns();
+    for (unsigned loop = 0; loop < cfg.loops; loop++) {
+        uint64_t start = now_ns(), first_ts = 0;
+        bool first = true;
+        for (size_t i = 0; i < n_frames; i++) {
+            const struct rframe *f = &frames[i];
+            if (!wanted(f)) continue;
+            if (cfg.speed > 0) {
+                if (first) first_ts = f->ts_ns;
+                first = false;
+                // 乱序的时间戳（多接口合并的抓包）按不等待处理
+                uint64_t rel = f->ts_ns > first_ts ? f->ts_ns - first_ts : 0;
+                uint64_t target = start + (uint64_t)((double)rel / cfg.speed);
+                wait_until(ctx, target);
+                uint64_t lag = now_ns() - target;
+                if (lag > max_lag) max_lag = lag;
+            } else if (++n % TIMER_EVERY == 0) {
+                i1905_handle_timers(ctx);
+            }
+            i1905_inject_frame(ctx, f->data, f->len, &src);
+        }
+    }
+    uint64_t elapsed = now_ns() - t0;
+
+    struct i1905_stats st;
+    i1905_get_stats(ctx, &st);
+    report(&st, n_in * cfg.loops, bytes * cfg.loops, elapsed, max_lag);
+    i1905_close(ctx);
+    free(frames);
+    munmap((void *)map, size);
+    return 0;
+}
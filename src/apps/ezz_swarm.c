@@ -0,0 +1,738 @@
+// SPDX-License-Identifier: MIT
+// ezz_swarm: 控制器规模测试用的虚拟代理群。一个进程里跑成百上千个虚拟代理，
+// 每个是一个独立的 i1905_ctx（各自的 AL MAC 和端口），由库自动应答 topology query，
+// 入网时做 autoconfig search 和 WSC 交换，周期发 topology notification；churn 让一部分
+// 代理每秒掉线（不再收发，积压的帧由传输层丢弃）或重新入网。
+//
+// 不指定 -c 时控制器也在进程内（无需 ubus）：应答 search/WSC，按周期查询每个代理，
+// 收到 notification 立即查询该代理。代理入网的 discovery 由控制器回一个，双方互为邻居，
+// 代理的 topology response 因此带上控制器这条链路；应答喂进 ezz_controller 的拓扑图
+// （topo_graph），结束时回程树上一个代理都没有即以失败退出，作为端到端检查。-c 把代理指向外部 ieee1905d 的 UDP 数据口，
+// 此时控制器一侧由 ieee1905d + ezz_controller 负责；以 SWARM_UBUS=1 编译并加 -u，
+// 运行前后读取 ieee1905.stats，输出收发、丢弃与超时计数的增量。
+//
+// -w 把进程内控制器收发的帧抓成 pcapng，可交给 ezz_replay 回放。
+//
+// 所有实体在同一线程上，用 epoll 等待各 ctx 的 fd（库内的 epoll，含发送可写）与定时器 fd。
+
+#define _GNU_SOURCE // getopt
+#include "ieee1905.h"
+#include "topo_graph.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/epoll.h>
+#include <sys/resource.h>
+#ifdef SWARM_UBUS
+#include <libubus.h>
+#endif
+
+#define CTRL_ID        0u              // epoll 标识：0 为控制器，k 为第 k-1 个代理
+#define WSC_LEN        64              // 模拟 M1/M2 的长度
+#define REPLY_RETRIES  1
+#define MAX_EVENTS     256
+
+struct lat {
+    uint64_t *v;
+    size_t n, cap;
+    uint64_t timeouts;
+};
+
+struct endpoint {
+    struct i1905_ctx *ctx;
+    uint32_t id;
+    bool attached;             // fd 已在 epoll 中
+};
+
+struct vagent {
+    struct endpoint ep;
+    uint32_t idx;
+    uint16_t port;
+    bool online;
+    bool configured;           // 完成 search + WSC
+    bool search_pending;
+    bool wsc_pending;
+    bool query_pending;        // 控制器一侧
+    uint64_t search_t0, wsc_t0, query_t0, notify_t0;
+    struct i1905_timer join_timer;
+    struct i1905_timer notify_timer;
+    struct i1905_timer query_timer;    // 挂在控制器 ctx 上
+};
+
+static struct {
+    unsigned n_agents;
+    i1905_transport_type transport;
+    uint16_t base_port;
+    unsigned duration_s;
+    unsigned ramp_ms;
+    unsigned query_ms;
+    unsigned notify_ms;
+    unsigned churn_pct;
+    const char *ctrl_ip;       // NULL：进程内控制器
+    uint16_t ctrl_port;
+    bool use_ubus;
+    const char *capture;       // -w：进程内控制器的抓包文件
+} cfg = {
+    .n_agents = 200,
+    .transport = I1905_TRANSPORT_LOOP,
+    .base_port = 30000,
+    .duration_s = 10,
+    .ramp_ms = 1000,
+    .query_ms = 5000,
+    .notify_ms = 10000,
+};
+
+static int epfd = -1;
+static struct endpoint ctrl;
+static struct vagent *agents;
+static uint64_t rng = 0x2545F4914F6CDD1Dull;
+static const uint8_t wsc_blob[WSC_LEN];
+
+// 控制器一侧（进程内）
+static struct lat query_lat;
+static uint64_t ctrl_rx[I1905_STATS_MSG_TYPES];
+static uint64_t reactions;         // 因 notification 触发的查询
+static struct topo_graph graph;    // 以控制器为根
+// 代理一侧
+static struct lat search_lat, wsc_lat, react_lat;
+static uint64_t queries_seen;
+static uint64_t joins, leaves;
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static uint32_t rnd(uint32_t n) {
+    rng ^= rng << 13;
+    rng ^= rng >> 7;
+    rng ^= rng << 17;
+    return n ? (uint32_t)(rng % n) : 0;
+}
+
+static void lat_add(struct lat *l, uint64_t ns) {
+    if (l->n == l->cap) {
+        size_t cap = l->cap ? l->cap * 2 : 1024;
+        uint64_t *v = realloc(l->v, cap * sizeof(*v));
+        if (!v) return;
+        l->v = v;
+        l->cap = cap;
+    }
+    l->v[l->n++] = ns;
+}
+
+static int cmp_u64(const void *a, const void *b) {
+    uint64_t x = *(const uint64_t *)a, y = *(const uint64_t *)b;
+    return x < y ? -1 : x > y;
+}
+
+static void lat_print(const char *name, struct lat *l) {
+    printf("  %-28s n %-8zu", name, l->n);
+    if (l->n) {
+        qsort(l->v, l->n, sizeof(*l->v), cmp_u64);
+        const double pct[] = { 0.50, 0.90, 0.99, 0.999 };
+        const char *label[] = { "p50", "p90", "p99", "p99.9" };
+        for (int i = 0; i < 4; i++) {
+            size_t k = (size_t)(pct[i] * (double)(l->n - 1));
+            printf(" %s %.0f", label[i], (double)l->v[k] / 1000.0);
+        }
+        printf(" max %.0f us", (double)l->v[l->n - 1] / 1000.0);
+    }
+    printf("  timeouts %llu\n", (unsigned long long)l->timeouts);
+}
+
+// ---- epoll ----
+
+static struct endpoint *ep_of(uint32_t id) {
+    return id == CTRL_ID ? &ctrl : &agents[id - 1].ep;
+}
+
+static int ep_attach(struct endpoint *ep) {
+    struct epoll_event ev = { .events = EPOLLIN, .data.u64 = (uint64_t)ep->id << 1 };
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, i1905_get_fd(ep->ctx), &ev) < 0) return -1;
+    ev.data.u64 |= 1;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, i1905_get_timer_fd(ep->ctx), &ev) < 0) {
+        epoll_ctl(epfd, EPOLL_CTL_DEL, i1905_get_fd(ep->ctx), NULL);
+        return -1;
+    }
+    ep->attached = true;
+    return 0;
+}
+
+static void ep_detach(struct endpoint *ep) {
+    if (!ep->attached) return;
+    epoll_ctl(epfd, EPOLL_CTL_DEL, i1905_get_fd(ep->ctx), NULL);
+    epoll_ctl(epfd, EPOLL_CTL_DEL, i1905_get_timer_fd(ep->ctx), NULL);
+    ep->attached = false;
+}
+
+// ---- 虚拟代理 ----
+
+static const char *agent_ip(void) {
+    return cfg.transport == I1905_TRANSPORT_UDP ? "127.0.0.1" : NULL;
+}
+
+static const char *ctrl_ip(void) {
+    return cfg.ctrl_ip ? cfg.ctrl_ip : agent_ip();
+}
+
+static uint16_t ctrl_port(void) {
+    return cfg.ctrl_ip ? cfg.ctrl_port : cfg.base_port;
+}
+
+static void on_wsc_reply(const struct i1905_cmdu_view *reply, const struct i1905_rx_info *rx,
+                         void *user) {
+    (void)rx;
+    struct vagent *a = user;
+    a->wsc_pending = false;
+    if (!reply) {
+        wsc_lat.timeouts++;
+        return;
+    }
+    lat_add(&wsc_lat, now_ns() - a->wsc_t0);
+    a->configured = true;
+}
+
+static void on_search_reply(const struct i1905_cmdu_view *reply, const struct i1905_rx_info *rx,
+                            void *user) {
+    (void)rx;
+    struct vagent *a = user;
+    a->search_pending = false;
+    if (!reply) {
+        search_lat.timeouts++;
+        return;
+    }
+    lat_add(&search_lat, now_ns() - a->search_t0);
+    // 找到控制器后发 M1，等 M2
+    a->wsc_t0 = now_ns();
+    int mid = i1905_send_ap_autoconfig_wsc(a->ep.ctx, ctrl_ip(), ctrl_port(), wsc_blob, WSC_LEN);
+    if (mid > 0 && i1905_expect_reply(a->ep.ctx, (uint16_t)mid, I1905_MSG_AP_AUTOCONFIG_WSC, 0,
+                                      REPLY_RETRIES, on_wsc_reply, a) == 0) {
+        a->wsc_pending = true;
+    }
+}
+
+static void agent_notify(struct i1905_timer *t, void *user) {
+    struct vagent *a = user;
+    uint8_t iface[6];
+    i1905_get_al_mac(a->ep.ctx, iface);
+    if (i1905_send_topology_notification(a->ep.ctx, ctrl_ip(), ctrl_port(), iface) > 0 &&
+        !a->notify_t0) {
+        a->notify_t0 = now_ns();
+    }
+    // 周期上下浮动 10%，避免整群同相
+    i1905_timer_arm(a->ep.ctx, t, cfg.notify_ms - cfg.notify_ms / 10 + rnd(cfg.notify_ms / 5 + 1));
+}
+
+// 入网：discovery 宣告自己，search 找控制器，应答后做 WSC
+static void agent_join(struct i1905_timer *t, void *user) {
+    (void)t;
+    struct vagent *a = user;
+    uint8_t iface[6];
+    i1905_get_al_mac(a->ep.ctx, iface);
+    a->online = true;
+    a->configured = false;
+    a->notify_t0 = 0;
+    joins++;
+    i1905_send_topology_discovery(a->ep.ctx, ctrl_ip(), ctrl_port(), iface);
+    if (!a->search_pending && !a->wsc_pending) {
+        a->search_t0 = now_ns();
+        int mid = i1905_send_ap_autoconfig_search(a->ep.ctx, ctrl_ip(), ctrl_port(), iface);
+        if (mid > 0 && i1905_expect_reply(a->ep.ctx, (uint16_t)mid, I1905_MSG_AP_AUTOCONFIG_RESPONSE,
+                                          0, REPLY_RETRIES, on_search_reply, a) == 0) {
+            a->search_pending = true;
+        }
+    }
+    if (cfg.notify_ms) i1905_timer_arm(a->ep.ctx, &a->notify_timer, rnd(cfg.notify_ms) + 1);
+}
+
+// 收到的 topology query 已由库应答；notification 之后的第一个查询算作控制器的反应
+static void on_agent_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                           void *user) {
+    (void)rx;
+    struct vagent *a = user;
+    if (cmdu->message_type != I1905_MSG_TOPOLOGY_QUERY) return;
+    queries_seen++;
+    if (a->notify_t0) {
+        lat_add(&react_lat, now_ns() - a->notify_t0);
+        a->notify_t0 = 0;
+    }
+}
+
+static void agent_leave(struct vagent *a) {
+    a->online = false;
+    leaves++;
+    i1905_timer_cancel(&a->join_timer);
+    i1905_timer_cancel(&a->notify_timer);
+    ep_detach(&a->ep);
+}
+
+static void agent_rejoin(struct vagent *a) {
+    if (ep_attach(&a->ep) < 0) return;
+    agent_join(&a->join_timer, a);
+}
+
+// 每秒翻转 churn% 个代理的在线状态
+static void churn(void) {
+    unsigned n = (cfg.n_agents * cfg.churn_pct + 99) / 100;
+    for (unsigned k = 0; k < n; k++) {
+        struct vagent *a = &agents[rnd(cfg.n_agents)];
+        if (a->online) agent_leave(a);
+        else if (!i1905_timer_pending(&a->join_timer)) agent_rejoin(a);
+    }
+}
+
+// ---- 进程内控制器 ----
+
+static void on_query_reply(const struct i1905_cmdu_view *reply, const struct i1905_rx_info *rx,
+                           void *user) {
+    (void)rx;
+    struct vagent *a = user;
+    a->query_pending = false;
+    if (reply) {
+        // 等到的应答只交给这里，不再进 on_ctrl_frame
+        ctrl_rx[I1905_STATS_TYPE_SLOT(reply->message_type)]++;
+        lat_add(&query_lat, now_ns() - a->query_t0);
+        graph_feed_response(&graph, reply->tlv_data, reply->tlv_len, i1905_get_arena(ctrl.ctx),
+                            now_ns() / 1000000, NULL);
+    } else {
+        query_lat.timeouts++;
+    }
+}
+
+static void ctrl_query(struct vagent *a) {
+    if (a->query_pending) return;
+    a->query_t0 = now_ns();
+    int mid = i1905_send_topology_query(ctrl.ctx, agent_ip(), a->port);
+    if (mid > 0 && i1905_expect_reply(ctrl.ctx, (uint16_t)mid, I1905_MSG_TOPOLOGY_RESPONSE, 0,
+                                      REPLY_RETRIES, on_query_reply, a) == 0) {
+        a->query_pending = true;
+    }
+}
+
+static void ctrl_query_timer(struct i1905_timer *t, void *user) {
+    ctrl_query(user);
+    i1905_timer_arm(ctrl.ctx, t, cfg.query_ms);
+}
+
+static struct vagent *agent_by_src(const struct i1905_rx_info *rx) {
+    uint32_t k = (uint32_t)rx->src.port - cfg.base_port;
+    return rx->src.port > cfg.base_port && k <= cfg.n_agents ? &agents[k - 1] : NULL;
+}
+
+// search 回 response，M1 回 M2，都沿用请求的 message_id；notification 立即查询
+static void on_ctrl_frame(const struct i1905_cmdu_view *cmdu, const struct i1905_rx_info *rx,
+                          void *user) {
+    (void)user;
+    ctrl_rx[I1905_STATS_TYPE_SLOT(cmdu->message_type)]++;
+    struct vagent *a = agent_by_src(rx);
+    if (!a) return;
+    switch (cmdu->message_type) {
+    case I1905_MSG_TOPOLOGY_DISCOVERY: {
+        uint8_t iface[6];
+        i1905_get_al_mac(ctrl.ctx, iface);
+        i1905_send_topology_discovery(ctrl.ctx, agent_ip(), a->port, iface);
+        break;
+    }
+    case I1905_MSG_AP_AUTOCONFIG_SEARCH:
+        i1905_set_reply_mid(ctrl.ctx, cmdu->message_id);
+        i1905_send_ap_autoconfig_response(ctrl.ctx, agent_ip(), a->port, rx->al_mac);
+        break;
+    case I1905_MSG_AP_AUTOCONFIG_WSC:
+        i1905_set_reply_mid(ctrl.ctx, cmdu->message_id);
+        i1905_send_ap_autoconfig_wsc(ctrl.ctx, agent_ip(), a->port, wsc_blob, WSC_LEN);
+        break;
+    case I1905_MSG_TOPOLOGY_NOTIFICATION:
+        if (!a->query_pending) reactions++;
+        ctrl_query(a);
+        break;
+    default:
+        break;
+    }
+}
+
+// ---- ieee1905d 计数（-u）----
+
+#ifdef SWARM_UBUS
+static struct ubus_context *ubus;
+static uint32_t ieee1905_id;
+
+static void stats_cb(struct ubus_request *req, int type, struct blob_attr *msg) {
+    (void)type;
+    *(struct blob_attr **)req->priv = blob_memdup(msg);
+}
+
+static struct blob_attr *daemon_stats(void) {
+    struct blob_attr *out = NULL;
+    struct blob_buf bb;
+    memset(&bb, 0, sizeof(bb));
+    blob_buf_init(&bb, 0);
+    ubus_invoke(ubus, ieee1905_id, "stats", bb.head, stats_cb, &out, 2000);
+    blob_buf_free(&bb);
+    return out;
+}
+
+static struct blob_attr *find_attr(struct blob_attr *tbl, const char *name) {
+    struct blob_attr *cur;
+    size_t rem;
+    if (!tbl) return NULL;
+    blobmsg_for_each_attr(cur, tbl, rem) {
+        if (strcmp(blobmsg_name(cur), name) == 0) return cur;
+    }
+    return NULL;
+}
+
+// 计数输出非零增量，表（rx/tx 按类型、drops 等）逐层展开；直方图数组略过
+static void print_delta(struct blob_attr *before, struct blob_attr *after, const char *prefix) {
+    struct blob_attr *cur;
+    size_t rem;
+    blobmsg_for_each_attr(cur, after, rem) {
+        char name[96];
+        struct blob_attr *prev = find_attr(before, blobmsg_name(cur));
+        if (prefix) snprintf(name, sizeof(name), "%s.%s", prefix, blobmsg_name(cur));
+        else snprintf(name, sizeof(name), "%s", blobmsg_name(cur));
+        if (blobmsg_type(cur) == BLOBMSG_TYPE_TABLE) {
+            print_delta(prev, cur, name);
+        } else if (blobmsg_type(cur) == BLOBMSG_TYPE_INT64) {
+            uint64_t d = blobmsg_get_u64(cur) - (prev ? blobmsg_get_u64(prev) : 0);
+            if (d) printf("  %-36s %llu\n", name, (unsigned long long)d);
+        }
+    }
+}
+#endif
+
+// ---- 主流程 ----
+
+static void usage(const char *prog) {
+    fprintf(stderr,
+            "Usage: %s [-n agents] [-t loop|udp] [-p base_port] [-d seconds] [-r ramp_ms]\n"
+            "          [-q query_ms] [-N notify_ms] [-C churn_pct] [-c ctrl_ip:port [-u]] [-w file]\n"
+            "  -n  虚拟代理个数（默认 200），端口 base_port+1 起\n"
+            "  -t  传输：loop 进程内总线（默认）或 udp 回环\n"
+            "  -p  进程内控制器端口（默认 30000）\n"
+            "  -d  运行秒数（默认 10），-r 入网在这段时间内摊开（默认 1000 ms）\n"
+            "  -q  控制器查询每个代理的周期（默认 5000 ms，0 关闭）\n"
+            "  -N  代理发 notification 的周期（默认 10000 ms，0 关闭）\n"
+            "  -C  每秒掉线/重新入网的代理百分比（默认 0）\n"
+            "  -c  外部控制器（ieee1905d 数据口），仅 udp；不启动进程内控制器\n"
+            "  -u  运行前后读取 ieee1905.stats（需以 SWARM_UBUS=1 编译）\n"
+            "  -w  进程内控制器收发的帧写入 pcapng 文件\n", prog);
+}
+
+static int parse_args(int argc, char **argv) {
+    int opt;
+    while ((opt = getopt(argc, argv, "n:t:p:d:r:q:N:C:c:uw:h")) != -1) {
+        switch (opt) {
+        case 'n': cfg.n_agents = (unsigned)atoi(optarg); break;
+        case 'p': cfg.base_port = (uint16_t)atoi(optarg); break;
+        case 'd': cfg.duration_s = (unsigned)atoi(optarg); break;
+        case 'r': cfg.ramp_ms = (unsigned)atoi(optarg); break;
+        case 'q': cfg.query_ms = (unsigned)atoi(optarg); break;
+        case 'N': cfg.notify_ms = (unsigned)atoi(optarg); break;
+        case 'C': cfg.churn_pct = (unsigned)atoi(optarg); break;
+        case 'u': cfg.use_ubus = true; break;
+        case 'w': cfg.capture = optarg; break;
+        case 't':
+            if (strcmp(optarg, "udp") == 0) cfg.transport = I1905_TRANSPORT_UDP;
+            else if (strcmp(optarg, "loop") == 0) cfg.transport = I1905_TRANSPORT_LOOP;
+            else return -1;
+            break;
+        case 'c': {
+            char *colon = strrchr(optarg, ':');
+            if (!colon) return -1;
+            *colon = '\0';
+            cfg.ctrl_ip = optarg;
+            cfg.ctrl_port = (uint16_t)atoi(colon + 1);
+            break;
+        }
+        default:
+            return -1;
+        }
+    }
+    if (!cfg.n_agents || (uint32_t)cfg.base_port + cfg.n_agents > 65535) {
+        fprintf(stderr, "agent ports %u..%u out of range\n", cfg.base_port + 1,
+                cfg.base_port + cfg.n_agents);
+        return -1;
+    }
+    if (cfg.ctrl_ip && cfg.capture) {
+        fprintf(stderr, "-w captures the in-process controller, not with -c\n");
+        return -1;
+    }
+    if (cfg.ctrl_ip && cfg.transport != I1905_TRANSPORT_UDP) {
+        fprintf(stderr, "-c needs -t udp\n");
+        return -1;
+    }
+#ifndef SWARM_UBUS
+    if (cfg.use_ubus) {
+        fprintf(stderr, "-u: built without SWARM_UBUS\n");
+        return -1;
+    }
+#else
+    if (cfg.use_ubus && !cfg.ctrl_ip) {
+        fprintf(stderr, "-u needs -c\n");
+        return -1;
+    }
+#endif
+    return 0;
+}
+
+// 每个 ctx 一个收包 fd 和一个 timerfd，几千个代理会超过默认的 1024
+static void raise_nofile(void) {
+    struct rlimit rl;
+    if (getrlimit(RLIMIT_NOFILE, &rl) == 0 && rl.rlim_cur < rl.rlim_max) {
+        rl.rlim_cur = rl.rlim_max;
+        setrlimit(RLIMIT_NOFILE, &rl);
+    }
+}
+
+static int setup(void) {
+    // 每个代理只收发少量小消息，缩小各缓存，几千个 ctx 也只占几百 MB
+    struct i1905_opts opts = {
+        .transport = cfg.transport,
+        .rx_batch = 8,
+        .dedup_size = 64,
+        .reasm_budget = 16384,
+        .tx_queue_len = 32,
+    };
+    agents = calloc(cfg.n_agents, sizeof(*agents));
+    epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (!agents || epfd < 0) return -1;
+
+    if (!cfg.ctrl_ip) {
+        struct i1905_opts copts = { .transport = cfg.transport };
+        const uint8_t al[6] = {0x02, 0x19, 0x05, 0xff, 0x00, 0x00};
+        ctrl.id = CTRL_ID;
+        if (i1905_init_ex(&ctrl.ctx, I1905_ROLE_CONTROLLER, cfg.base_port, al, on_ctrl_frame, NULL,
+                          &copts) < 0 || ep_attach(&ctrl) < 0 ||
+            graph_init(&graph, cfg.n_agents + 1, al) < 0) {
+            fprintf(stderr, "controller init failed\n");
+            return -1;
+        }
+        if (cfg.capture && i1905_capture_start(ctrl.ctx, cfg.capture, 0, 0) < 0) {
+            fprintf(stderr, "capture to %s failed\n", cfg.capture);
+            return -1;
+        }
+    }
+    for (uint32_t i = 0; i < cfg.n_agents; i++) {
+        struct vagent *a = &agents[i];
+        uint8_t al[6] = {0x02, 0x19, 0x05, (uint8_t)(i >> 16), (uint8_t)(i >> 8), (uint8_t)i};
+        a->idx = i;
+        a->port = (uint16_t)(cfg.base_port + 1 + i);
+        a->ep.id = i + 1;
+        if (i1905_init_ex(&a->ep.ctx, I1905_ROLE_AGENT, a->port, al, on_agent_frame, a,
+                          &opts) < 0 || ep_attach(&a->ep) < 0) {
+            fprintf(stderr, "agent %u init failed\n", i);
+            return -1;
+        }
+        i1905_timer_init(&a->join_timer, agent_join, a);
+        i1905_timer_init(&a->notify_timer, agent_notify, a);
+        i1905_timer_arm(a->ep.ctx, &a->join_timer,
+                        (uint32_t)((uint64_t)cfg.ramp_ms * i / cfg.n_agents) + 1);
+        if (ctrl.ctx && cfg.query_ms) {
+            i1905_timer_init(&a->query_timer, ctrl_query_timer, a);
+            i1905_timer_arm(ctrl.ctx, &a->query_timer, cfg.ramp_ms + rnd(cfg.query_ms) + 1);
+        }
+    }
+    return 0;
+}
+
+static void teardown(void) {
+    for (uint32_t i = 0; agents && i < cfg.n_agents; i++) {
+        if (!agents[i].ep.ctx) continue;
+        i1905_timer_cancel(&agents[i].query_timer);
+        i1905_close(agents[i].ep.ctx);
+    }
+    if (ctrl.ctx) i1905_close(ctrl.ctx);
+    graph_free(&graph);
+    free(agents);
+    if (epfd >= 0) close(epfd);
+    free(query_lat.v);
+    free(search_lat.v);
+    free(wsc_lat.v);
+    free(react_lat.v);
+}
+
+// 回程树上的代理数（根除外）与最大跳数
+static unsigned tree_size(uint16_t *max_hops) {
+    unsigned n = 0;
+    *max_hops = 0;
+    for (uint32_t i = 0; i < graph.cap; i++) {
+        const struct graph_node *nd = &graph.nodes[i];
+        if (!nd->used || i == graph.root || !graph_reachable(nd)) continue;
+        n++;
+        if (graph_hops(nd) > *max_hops) *max_hops = graph_hops(nd);
+    }
+    return n;
+}
+
+static unsigned online_count(void) {
+    unsigned n = 0;
+    for (uint32_t i = 0; i < cfg.n_agents; i++) n += agents[i].online;
+    return n;
+}
+
+static void run(void) {
+    struct epoll_event evs[MAX_EVENTS];
+    uint64_t start = now_ns(), next_tick = start + 1000000000ull;
+    uint64_t end = start + (uint64_t)cfg.duration_s * 1000000000ull;
+    uint64_t last_rx = 0;
+    for (uint64_t now = start; now < end; now = now_ns()) {
+        int n = epoll_wait(epfd, evs, MAX_EVENTS, 100);
+        for (int i = 0; i < n; i++) {
+            struct endpoint *ep = ep_of((uint32_t)(evs[i].data.u64 >> 1));
+            if (!ep->attached) continue;   // 本轮里刚掉线
+            if (evs[i].data.u64 & 1) i1905_handle_timers(ep->ctx);
+            else i1905_handle_readable(ep->ctx);
+            // loop 每端只有 256 帧的队列，一轮 epoll 事件里的代理就能把控制器灌满，
+            // 因此每处理一个代理就收一次；UDP 有套接字缓冲，照常等事件
+            if (ep != &ctrl && ctrl.ctx && cfg.transport == I1905_TRANSPORT_LOOP) {
+                i1905_handle_readable(ctrl.ctx);
+            }
+        }
+        if (now_ns() < next_tick) continue;
+        next_tick += 1000000000ull;
+        if (cfg.churn_pct) churn();
+        uint64_t rx = 0;
+        for (unsigned k = 0; k < I1905_STATS_MSG_TYPES; k++) rx += ctrl_rx[k];
+        printf("[swarm] %3llus online %u/%u", (unsigned long long)((now_ns() - start) / 1000000000ull),
+               online_count(), cfg.n_agents);
+        if (ctrl.ctx) printf(" controller rx %llu msg/s", (unsigned long long)(rx - last_rx));
+        printf(" queries answered %llu\n", (unsigned long long)queries_seen);
+        last_rx = rx;
+    }
+}
+
+static void report(double secs) {
+    struct i1905_stats st, sum;
+    memset(&sum, 0, sizeof(sum));
+    for (uint32_t i = 0; i < cfg.n_agents; i++) {
+        if (i1905_get_stats(agents[i].ep.ctx, &st) < 0) continue;
+        for (unsigned k = 0; k < I1905_STATS_MSG_TYPES; k++) sum.tx_type_frames[k] += st.tx_type_frames[k];
+        for (unsigned r = 0; r < I1905_DROP_REASONS; r++) sum.rx_drops[r] += st.rx_drops[r];
+        sum.tx_errors += st.tx_errors;
+        sum.rx_frames += st.rx_frames;
+        for (unsigned c = 0; c < I1905_TX_CLASSES; c++) sum.tx_queue_drops[c] += st.tx_queue_drops[c];
+    }
+
+    printf("swarm: %u agents over %s, %.1f s, %llu joins, %llu leaves\n", cfg.n_agents,
+           cfg.transport == I1905_TRANSPORT_UDP ? "udp" : "loop", secs,
+           (unsigned long long)joins, (unsigned long long)leaves);
+    if (ctrl.ctx) {
+        uint64_t total = 0;
+        for (unsigned k = 0; k < I1905_STATS_MSG_TYPES; k++) total += ctrl_rx[k];
+        printf("controller: %llu messages, %.0f msg/s, %llu notification-triggered queries\n",
+               (unsigned long long)total, (double)total / secs, (unsigned long long)reactions);
+        for (unsigned k = 0; k < I1905_STATS_MSG_TYPES; k++) {
+            if (!ctrl_rx[k]) continue;
+            const char *name = i1905_msg_type_name((uint16_t)k);
+            printf("  rx %-26s %llu\n", name ? name : "other", (unsigned long long)ctrl_rx[k]);
+        }
+        lat_print("topology_query rtt", &query_lat);
+        uint16_t hops;
+        unsigned reachable = tree_size(&hops);
+        printf("  backhaul tree                %u of %u devices, max %u hops\n", reachable,
+               graph.count ? graph.count - 1 : 0, hops);
+    }
+    printf("agents (controller response latency):\n");
+    lat_print("ap_search -> ap_response", &search_lat);
+    lat_print("ap_wsc M1 -> M2", &wsc_lat);
+    lat_print("notification -> query", &react_lat);
+    printf("  topology queries answered    %llu\n", (unsigned long long)queries_seen);
+
+    // 代理发出而控制器没有收到的帧：传输层队列满（loop 每端 256 帧、UDP 套接字缓冲）
+    // 或对方已掉线；离线代理积压的帧同理
+    printf("drops:\n");
+    if (ctrl.ctx && i1905_get_stats(ctrl.ctx, &st) == 0) {
+        uint64_t sent = 0, got = 0;
+        for (unsigned k = 0; k < I1905_STATS_MSG_TYPES; k++) {
+            sent += sum.tx_type_frames[k];
+            got += st.rx_type_frames[k];
+        }
+        printf("  agents -> controller lost    %llu of %llu frames\n",
+               (unsigned long long)(sent > got ? sent - got : 0), (unsigned long long)sent);
+        uint64_t to_agents = 0;
+        for (unsigned k = 0; k < I1905_STATS_MSG_TYPES; k++) to_agents += st.tx_type_frames[k];
+        printf("  controller -> agents lost    %llu of %llu frames\n",
+               (unsigned long long)(to_agents > sum.rx_frames ? to_agents - sum.rx_frames : 0),
+               (unsigned long long)to_agents);
+        for (unsigned r = 0; r < I1905_DROP_REASONS; r++) {
+            if (st.rx_drops[r]) {
+                printf("  controller rx drop %-12s %llu\n", i1905_drop_reason_name((enum i1905_drop_reason)r),
+                       (unsigned long long)st.rx_drops[r]);
+            }
+        }
+        for (unsigned c = 0; c < I1905_TX_CLASSES; c++) {
+            if (st.tx_queue_drops[c]) {
+                printf("  controller tx queue %-11s %llu\n", i1905_tx_class_name((i1905_tx_class)c),
+                       (unsigned long long)st.tx_queue_drops[c]);
+            }
+        }
+        if (st.tx_errors) printf("  controller tx errors         %llu\n", (unsigned long long)st.tx_errors);
+        if (cfg.capture) {
+            printf("  controller captured / lost   %llu / %llu\n", (unsigned long long)st.capture_frames,
+                   (unsigned long long)(st.capture_drops + st.capture_errors));
+        }
+    }
+    for (unsigned r = 0; r < I1905_DROP_REASONS; r++) {
+        if (sum.rx_drops[r]) {
+            printf("  agents rx drop %-16s %llu\n", i1905_drop_reason_name((enum i1905_drop_reason)r),
+                   (unsigned long long)sum.rx_drops[r]);
+        }
+    }
+    for (unsigned c = 0; c < I1905_TX_CLASSES; c++) {
+        if (sum.tx_queue_drops[c]) {
+            printf("  agents tx queue %-15s %llu\n", i1905_tx_class_name((i1905_tx_class)c),
+                   (unsigned long long)sum.tx_queue_drops[c]);
+        }
+    }
+    if (sum.tx_errors) printf("  agents tx errors             %llu\n", (unsigned long long)sum.tx_errors);
+}
+
+int main(int argc, char **argv) {
+    if (parse_args(argc, argv) < 0) {
+        usage(argv[0]);
+        return 1;
+    }
+    raise_nofile();
+#ifdef SWARM_UBUS
+    struct blob_attr *before = NULL;
+    if (cfg.use_ubus) {
+        ubus = ubus_connect(NULL);
+        if (!ubus || ubus_lookup_id(ubus, "ieee1905", &ieee1905_id)) {
+            fprintf(stderr, "cannot reach ubus object 'ieee1905'\n");
+            return 1;
+        }
+        before = daemon_stats();
+    }
+#endif
+    int rv = setup();
+    if (rv == 0) {
+        uint64_t t0 = now_ns();
+        run();
+        report((double)(now_ns() - t0) / 1e9);
+        // 有应答却没有一条链路：topology response 没带邻居，控制器建不出树
+        uint16_t hops;
+        if (ctrl.ctx && query_lat.n && !tree_size(&hops)) {
+            fprintf(stderr, "swarm: %zu topology responses but an empty backhaul tree\n", query_lat.n);
+            rv = -1;
+        }
+    }
+#ifdef SWARM_UBUS
+    if (cfg.use_ubus) {
+        struct blob_attr *after = rv == 0 ? daemon_stats() : NULL;
+        if (after) {
+            printf("ieee1905d (delta over the run):\n");
+            print_delta(before, after, NULL);
+        }
+        free(before);
+        free(after);
+        ubus_free(ubus);
+    }
+#endif
+    teardown();
+    return rv == 0 ? 0 : 1;
+}
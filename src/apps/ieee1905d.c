@@ -1,158 +1,1307 @@
-// SPDX-License-Identifier: MIT
-// ieee1905d: 独立通信进程示例
-// - 暴露 ubus 对象 ieee1905: method send，event recv
-// - 调用 ieee1905 库组帧/收帧；收到帧后通过 ubus_notify 广播解析结果
-// 说明：底层仍用 UDP 占位收发，便于后续替换为 L2/raw；ubus 接口保持稳定
-
-#include "ieee1905.h"
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <sys/socket.h>
-#include <libubus.h>
-#include <libubox/uloop.h>
-#include <libubox/blobmsg.h>
-
-#define DATA_PORT 19050
-
-struct daemon_ctx {
-    struct i1905_ctx *i1905;
-    struct ubus_context *ubus;
-    struct ubus_object obj;
-    struct blob_buf bb;
-    struct uloop_fd fd;
-};
-
-enum {
-    SEND_TYPE,
-    SEND_DST_IP,
-    SEND_DST_PORT,
-    __SEND_MAX,
-};
-
-static const struct blobmsg_policy send_policy[__SEND_MAX] = {
-    [SEND_TYPE]    = { .name = "type",     .type = BLOBMSG_TYPE_STRING },
-    [SEND_DST_IP]  = { .name = "dst_ip",   .type = BLOBMSG_TYPE_STRING },
-    [SEND_DST_PORT]= { .name = "dst_port", .type = BLOBMSG_TYPE_INT32  },
-};
-
-static void notify_frame(struct daemon_ctx *d,
-                         const struct i1905_cmdu *cmdu,
-                         const uint8_t src_mac[6]) {
-    blob_buf_init(&d->bb, 0);
-    blobmsg_add_u32(&d->bb, "type", cmdu->message_type);
-    blobmsg_add_u32(&d->bb, "mid", cmdu->message_id);
-    blobmsg_add_u32(&d->bb, "tlv_count", cmdu->tlv_count);
-
-    char mac_str[18];
-    snprintf(mac_str, sizeof(mac_str), "%02x:%02x:%02x:%02x:%02x:%02x",
-             src_mac[0], src_mac[1], src_mac[2], src_mac[3], src_mac[4], src_mac[5]);
-    blobmsg_add_string(&d->bb, "src", mac_str);
-
-    ubus_notify(d->ubus, &d->obj, "recv", d->bb.head, -1);
-}
-
-static void on_frame(const struct i1905_cmdu *cmdu,
-                     const uint8_t src_mac[6],
-                     void *user_ctx) {
-    struct daemon_ctx *d = user_ctx;
-    notify_frame(d, cmdu, src_mac);
-}
-
-static int ubus_send(struct ubus_context *ctx, struct ubus_object *obj,
-                     struct ubus_request_data *req, const char *method,
-                     struct blob_attr *msg) {
-    (void)method;
-    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
-    struct blob_attr *tb[__SEND_MAX];
-    blobmsg_parse(send_policy, __SEND_MAX, tb, blob_data(msg), blob_len(msg));
-
-    if (!tb[SEND_TYPE] || !tb[SEND_DST_IP] || !tb[SEND_DST_PORT]) {
-        return UBUS_STATUS_INVALID_ARGUMENT;
-    }
-    const char *type = blobmsg_get_string(tb[SEND_TYPE]);
-    const char *dst_ip = blobmsg_get_string(tb[SEND_DST_IP]);
-    uint16_t dst_port = (uint16_t)blobmsg_get_u32(tb[SEND_DST_PORT]);
-
-    uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x10}; // placeholder iface/radio id
-    int rv = 0;
-    if (strcmp(type, "topology_query") == 0) {
-        rv = i1905_send_topology_query(d->i1905, dst_ip, dst_port);
-    } else if (strcmp(type, "topology_discovery") == 0) {
-        rv = i1905_send_topology_discovery(d->i1905, dst_ip, dst_port, mac);
-    } else if (strcmp(type, "topology_notification") == 0) {
-        rv = i1905_send_topology_notification(d->i1905, dst_ip, dst_port, mac);
-    } else if (strcmp(type, "ap_search") == 0) {
-        rv = i1905_send_ap_autoconfig_search(d->i1905, dst_ip, dst_port, mac);
-    } else if (strcmp(type, "ap_response") == 0) {
-        rv = i1905_send_ap_autoconfig_response(d->i1905, dst_ip, dst_port, mac);
-    } else {
-        return UBUS_STATUS_INVALID_ARGUMENT;
-    }
-
-    if (rv < 0) return UBUS_STATUS_UNKNOWN_ERROR;
-    return 0;
-}
-
-static const struct ubus_method ieee1905_methods[] = {
-    UBUS_METHOD("send", ubus_send, send_policy),
-};
-
-static struct ubus_object_type ieee1905_obj_type =
-    UBUS_OBJECT_TYPE("ieee1905", ieee1905_methods);
-
-static void fd_cb(struct uloop_fd *u, unsigned int events) {
-    struct daemon_ctx *d = container_of(u, struct daemon_ctx, fd);
-    if (events & ULOOP_READ) {
-        i1905_handle_readable(d->i1905);
-    }
-}
-
-int main(int argc, char **argv) {
-    (void)argc; (void)argv;
-    srand((unsigned)time(NULL));
-    uloop_init();
-
-    struct daemon_ctx d = {0};
-    if (i1905_init(&d.i1905, I1905_ROLE_CONTROLLER, DATA_PORT, NULL, on_frame, &d) < 0) {
-        fprintf(stderr, "[ieee1905d] init failed\n");
-        return 1;
-    }
-
-    d.ubus = ubus_connect(NULL);
-    if (!d.ubus) {
-        fprintf(stderr, "[ieee1905d] ubus connect failed\n");
-        return 1;
-    }
-    ubus_add_uloop(d.ubus);
-    blob_buf_init(&d.bb, 0);
-
-    d.obj.type = &ieee1905_obj_type;
-    d.obj.methods = ieee1905_methods;
-    d.obj.n_methods = ARRAY_SIZE(ieee1905_methods);
-    d.obj.name = "ieee1905";
-
-    if (ubus_add_object(d.ubus, &d.obj)) {
-        fprintf(stderr, "[ieee1905d] add ubus object failed\n");
-        return 1;
-    }
-
-    d.fd.fd = i1905_get_fd(d.i1905);
-    d.fd.cb = fd_cb;
-    d.fd.events = ULOOP_READ;
-    uloop_fd_add(&d.fd, ULOOP_READ);
-
-    printf("[ieee1905d] running: ubus object 'ieee1905', data_port=%d (event-driven)\n", DATA_PORT);
-    uloop_run();
-
-    uloop_done();
-    i1905_close(d.i1905);
-    ubus_free(d.ubus);
-    return 0;
-}
-
-
+// SPDX-License-Identifier: MIT
+// ieee1905d: 独立通信进程示例
+// - 暴露 ubus 对象 ieee1905: method send，event ieee1905.recv.<消息类型>
+// - 调用 ieee1905 库组帧/收帧；收到帧后按消息类型发 ubus 事件，携带完整 TLV
+// - 可选快速通道：本地消费者经 ring_open 取得共享内存事件环（memfd + eventfd），
+//   大流量消息不再经 ubusd 转发和序列化，ubus 只做控制面和回退
+// - 可选抓包：capture 方法或 -w 把收发的原始帧写成 pcapng，Wireshark 可直接解析
+// - 可选 MQTT 适配器（-m）：recv 攒批发到 <prefix>/<al_mac>/recv，订阅 .../send 代发，
+//   编码见 mqtt_bridge.h；断线自动重连，未确认的批重发
+// - 可选快速重启：-S 周期与退出时把 AL MAC、message id、拓扑库写成快照，启动时直接载入；
+//   -H 让新进程经 UNIX socket 接过旧进程的收发 socket，换进程期间不丢帧，见 restart.h
+// 说明：底层默认用 UDP 承载完整 1905 L2 帧，-i 指定接口时走 AF_PACKET；ubus 接口保持稳定
+
+#define _GNU_SOURCE // getopt
+#include "ieee1905.h"
+#include "topo_db.h"
+#include "evring.h"
+#include "mqtt_bridge.h"
+#include "restart.h"
+
+#include <stddef.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <sys/socket.h>
+#include <libubus.h>
+#include <libubox/uloop.h>
+#include <libubox/blobmsg.h>
+
+#define DATA_PORT 19050
+#define MAX_CLI_NEIGHBORS 16
+#define TOPO_MAX_DEVICES  1024
+#define TOPO_AGE_INTERVAL_MS 10000
+#define TOPO_TTL_MS       (3 * 60000)  // 连续 3 个 discovery 周期未见即老化
+#define SEND_WAIT_RETRIES 2
+#define MAX_SEND_DSTS     256          // send 的 dsts 数组上限
+#define RING_SLOTS        512          // 事件环：512 x 2 KB，约 1 MB 共享内存
+#define RING_SLOT_SIZE    2048
+#define MAX_RING_CONSUMERS 8
+#define DECODE_HEX_MAX    1024         // -D 时更长的 TLV 不附带十六进制值
+#define CAPTURE_PATH      "/tmp/ieee1905.pcapng"  // capture 未给 path 时
+#define SNAPSHOT_INTERVAL_MS 30000     // -S 的周期快照，崩溃时最多丢这么久的拓扑变化
+
+// 事件环消费者：ring_open 时登记，ring_close 时释放；ubus 不感知客户端退出，
+// 消费者须自行 ring_close，否则槽位一直占用到 ieee1905d 重启
+struct ring_consumer {
+    int efd;                       // 客户端传来的 eventfd，-1 表示空闲
+    uint32_t types;                // 按 I1905_STATS_TYPE_SLOT 的类型位图
+    bool mute;                     // 这些类型不再发 ubus 事件
+    bool pending;                  // 本批收包有它关心的记录，待唤醒
+};
+
+struct daemon_ctx {
+    struct i1905_ctx *i1905;
+    struct ubus_context *ubus;
+    struct ubus_object obj;
+    struct blob_buf bb;
+    struct uloop_fd fd;            // 库的 epoll fd：所有接口的收包与等待可写的发送
+    struct uloop_fd timer_fd;
+    struct topo_db topo;
+    struct i1905_timer topo_age;   // 挂在库的时间轮上，不再占用 uloop_timeout
+    bool decode_tlvs;              // -D：事件里额外附带解码后的 tlvs 数组
+    bool l2;                       // -i：目的地是 MAC 而不是 IPv4
+    char capture_path[256];        // 正在写的抓包文件，未抓包时为空
+    struct i1905_addr dsts[MAX_SEND_DSTS];
+    struct evring_producer *ring;  // 首次 ring_open 时创建
+    struct ring_consumer consumers[MAX_RING_CONSUMERS];
+    uint32_t ring_types;           // 所有消费者类型位图的并集
+    uint32_t ring_mute;            // 其中要求静默 ubus 事件的类型
+    struct mqtt_bridge *mqtt;      // -m 时创建
+    struct uloop_fd mqtt_fd;       // broker 连接，随重连换 fd
+    const char *snapshot_path;     // -S
+    struct i1905_timer snapshot;
+    struct uloop_fd handoff_fd;    // -H 的监听 socket，等下一个进程来接班
+    bool handed_off;               // socket 已交出，退出时不再写快照、不删 -H 路径
+};
+
+// send 带 wait 时挂起的 ubus 调用，等库回调应答或超时后完成
+struct pending_call {
+    struct daemon_ctx *d;
+    struct ubus_request_data req;
+};
+
+enum {
+    SEND_TYPE,
+    SEND_DST_IP,
+    SEND_DST_PORT,
+    SEND_MID,
+    SEND_WAIT,
+    SEND_TIMEOUT,
+    SEND_RETRIES,
+    SEND_DSTS,
+    SEND_TLVS,
+    SEND_RELAY,
+    SEND_AL_MAC,
+    __SEND_MAX,
+};
+
+static const struct blobmsg_policy send_policy[__SEND_MAX] = {
+    [SEND_TYPE]    = { .name = "type",     .type = BLOBMSG_TYPE_STRING },
+    [SEND_DST_IP]  = { .name = "dst_ip",   .type = BLOBMSG_TYPE_STRING },
+    [SEND_DST_PORT]= { .name = "dst_port", .type = BLOBMSG_TYPE_INT32  },
+    [SEND_MID]     = { .name = "mid",      .type = BLOBMSG_TYPE_INT32  }, // 应答时沿用请求的 mid
+    [SEND_WAIT]    = { .name = "wait",     .type = BLOBMSG_TYPE_BOOL   }, // 等对端应答再返回
+    [SEND_TIMEOUT] = { .name = "timeout",  .type = BLOBMSG_TYPE_INT32  }, // 首次超时 ms，逐次翻倍
+    [SEND_RETRIES] = { .name = "retries",  .type = BLOBMSG_TYPE_INT32  },
+    [SEND_DSTS]    = { .name = "dsts",     .type = BLOBMSG_TYPE_ARRAY  }, // 多目的地，代替 dst_ip
+    [SEND_TLVS]    = { .name = "tlvs",     .type = BLOBMSG_TYPE_ARRAY  }, // 按 schema 自带 TLV
+    [SEND_RELAY]   = { .name = "relay",    .type = BLOBMSG_TYPE_BOOL   }, // 仅 tlvs：中继组播
+    [SEND_AL_MAC]  = { .name = "al_mac",   .type = BLOBMSG_TYPE_STRING }, // 代替 dst_ip：拓扑库里该设备的地址
+};
+
+enum {
+    TOPO_SINCE,
+    __TOPO_MAX,
+};
+
+static const struct blobmsg_policy topo_policy[__TOPO_MAX] = {
+    [TOPO_SINCE] = { .name = "since", .type = BLOBMSG_TYPE_INT32 },
+};
+
+enum {
+    RING_TYPES,
+    RING_MUTE,
+    __RING_MAX,
+};
+
+static const struct blobmsg_policy ring_policy[__RING_MAX] = {
+    [RING_TYPES] = { .name = "types", .type = BLOBMSG_TYPE_ARRAY }, // 消息类型名，缺省为全部
+    [RING_MUTE]  = { .name = "mute",  .type = BLOBMSG_TYPE_BOOL  }, // 这些类型不再发 ubus 事件
+};
+
+enum {
+    RING_ID,
+    __RING_CLOSE_MAX,
+};
+
+static const struct blobmsg_policy ring_close_policy[__RING_CLOSE_MAX] = {
+    [RING_ID] = { .name = "id", .type = BLOBMSG_TYPE_INT32 },
+};
+
+enum {
+    CAPTURE_ENABLE,
+    CAPTURE_PATH_ARG,
+    CAPTURE_RING_KB,
+    CAPTURE_SNAPLEN,
+    __CAPTURE_MAX,
+};
+
+static const struct blobmsg_policy capture_policy[__CAPTURE_MAX] = {
+    [CAPTURE_ENABLE]   = { .name = "enable",  .type = BLOBMSG_TYPE_BOOL   }, // 不给则只查询状态
+    [CAPTURE_PATH_ARG] = { .name = "path",    .type = BLOBMSG_TYPE_STRING },
+    [CAPTURE_RING_KB]  = { .name = "ring_kb", .type = BLOBMSG_TYPE_INT32  }, // 内存环大小，满了丢帧计数
+    [CAPTURE_SNAPLEN]  = { .name = "snaplen", .type = BLOBMSG_TYPE_INT32  }, // 每帧保留字节，0 为整帧
+};
+
+enum {
+    IFACE_ADD,
+    IFACE_DEL,
+    __IFACE_MAX,
+};
+
+static const struct blobmsg_policy iface_policy[__IFACE_MAX] = {
+    [IFACE_ADD] = { .name = "add", .type = BLOBMSG_TYPE_STRING }, // 都不给则只列出
+    [IFACE_DEL] = { .name = "del", .type = BLOBMSG_TYPE_STRING }, // 第一个接口不能删
+};
+
+static void mac_str(const uint8_t mac[6], char out[18]) {
+    snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+static void hex_str(const uint8_t *p, size_t len, char *out) {
+    static const char digits[] = "0123456789abcdef";
+    for (size_t i = 0; i < len; i++) {
+        out[2 * i] = digits[p[i] >> 4];
+        out[2 * i + 1] = digits[p[i] & 0x0F];
+    }
+    out[2 * len] = '\0';
+}
+
+static int hex_val(char c) {
+    if (c >= '0' && c <= '9') return c - '0';
+    if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+    if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+    return -1;
+}
+
+// 十六进制字符串解到 arena 上
+static int hex_parse(const char *s, struct i1905_arena *arena, const uint8_t **out,
+                     uint16_t *len) {
+    size_t n = strlen(s);
+    if (n % 2 || n / 2 > UINT16_MAX) return -1;
+    uint8_t *p = i1905_arena_alloc(arena, n / 2);
+    if (!p) return -1;
+    for (size_t i = 0; i < n / 2; i++) {
+        int hi = hex_val(s[2 * i]);
+        int lo = hex_val(s[2 * i + 1]);
+        if (hi < 0 || lo < 0) return -1;
+        p[i] = (uint8_t)((hi << 4) | lo);
+    }
+    *out = p;
+    *len = (uint16_t)(n / 2);
+    return 0;
+}
+
+static int parse_mac(const char *s, uint8_t mac[6]) {
+    unsigned v[6];
+    char tail;
+    if (sscanf(s, "%x:%x:%x:%x:%x:%x%c", &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &tail) != 6) {
+        return -1;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (v[i] > 0xFF) return -1;
+        mac[i] = (uint8_t)v[i];
+    }
+    return 0;
+}
+
+static void add_hex(struct blob_buf *bb, const char *name, const uint8_t *p, size_t len) {
+    char hex[2 * DECODE_HEX_MAX + 1];
+    if (len > DECODE_HEX_MAX) return;
+    hex_str(p, len, hex);
+    blobmsg_add_string(bb, name, hex);
+}
+
+// TLV 与 blobmsg 互转，均由 ieee1905_schema.def 展开生成：字段名即键名，MAC 为
+// "xx:xx:xx:xx:xx:xx"，整数为 u32，字节串为十六进制字符串，列表为表的数组。
+// 新增 TLV 只需在 schema 里加一行，这里无需改动
+
+// TLV -> blobmsg：先用库生成的解码函数解到结构体，再逐字段输出
+#define I1905_F_MAC(f)   mac_str(o->f, mac); blobmsg_add_string(bb, #f, mac);
+#define I1905_F_U8(f)    blobmsg_add_u32(bb, #f, o->f);
+#define I1905_F_U16(f)   blobmsg_add_u32(bb, #f, o->f);
+#define I1905_F_BYTES(f) add_hex(bb, #f, o->f, o->f##_len);
+#define I1905_F_LIST(f, rec)                                                    \
+    {                                                                           \
+        void *arr_ = blobmsg_open_array(bb, #f);                                \
+        for (size_t i_ = 0; i_ < o->f##_count; i_++) {                          \
+            void *tbl_ = blobmsg_open_table(bb, NULL);                          \
+            rec_##rec##_to_blob(bb, &o->f[i_]);                                 \
+            blobmsg_close_table(bb, tbl_);                                      \
+        }                                                                       \
+        blobmsg_close_array(bb, arr_);                                          \
+    }
+#define I1905_F_LIST8(f, rec) I1905_F_LIST(f, rec)
+#define I1905_REC(name, fields)                                                 \
+    static void rec_##name##_to_blob(struct blob_buf *bb, const struct i1905_##name *o) { \
+        char mac[18];                                                           \
+        (void)mac;                                                              \
+        fields                                                                  \
+    }
+#define I1905_TLV(ID, name, type, fields)                                       \
+    static int tlv_##name##_to_blob(struct blob_buf *bb, const struct i1905_tlv_view *t, \
+                                    struct i1905_arena *arena) {                \
+        struct i1905_tlv_##name v;                                              \
+        const struct i1905_tlv_##name *o = &v;                                  \
+        char mac[18];                                                           \
+        (void)mac;                                                              \
+        if (i1905_tlv_##name##_decode(&v, t, arena) < 0) return -1;            \
+        fields                                                                  \
+        return 0;                                                               \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST
+#undef I1905_F_LIST8
+
+// blobmsg -> TLV：每个 TLV/记录一张按字段顺序排列的 policy，解析后依次填结构体，
+// 再交给库生成的编码函数。MAC 必填，整数缺省为 0，字节串和列表缺省为空
+#define I1905_F_MAC(f)        { .name = #f, .type = BLOBMSG_TYPE_STRING },
+#define I1905_F_U8(f)         { .name = #f, .type = BLOBMSG_TYPE_INT32 },
+#define I1905_F_U16(f)        { .name = #f, .type = BLOBMSG_TYPE_INT32 },
+#define I1905_F_BYTES(f)      { .name = #f, .type = BLOBMSG_TYPE_STRING },
+#define I1905_F_LIST(f, rec)  { .name = #f, .type = BLOBMSG_TYPE_ARRAY },
+#define I1905_F_LIST8(f, rec) { .name = #f, .type = BLOBMSG_TYPE_ARRAY },
+#define I1905_REC(name, fields) \
+    static const struct blobmsg_policy rec_##name##_policy[] = { fields };
+#define I1905_TLV(ID, name, type, fields) \
+    static const struct blobmsg_policy tlv_##name##_policy[] = { fields };
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST
+#undef I1905_F_LIST8
+
+#define I1905_F_MAC(f)                                                          \
+    if (!tb[k_] || parse_mac(blobmsg_get_string(tb[k_]), o->f) < 0) return -1;  \
+    k_++;
+#define I1905_F_U8(f)    o->f = tb[k_] ? (uint8_t)blobmsg_get_u32(tb[k_]) : 0; k_++;
+#define I1905_F_U16(f)   o->f = tb[k_] ? (uint16_t)blobmsg_get_u32(tb[k_]) : 0; k_++;
+#define I1905_F_BYTES(f)                                                        \
+    if (tb[k_] && hex_parse(blobmsg_get_string(tb[k_]), arena, &o->f, &o->f##_len) < 0) { \
+        return -1;                                                              \
+    }                                                                           \
+    k_++;
+#define I1905_F_LIST(f, rec)                                                    \
+    if (tb[k_]) {                                                               \
+        int n_ = blobmsg_check_array(tb[k_], BLOBMSG_TYPE_TABLE);               \
+        if (n_ < 0) return -1;                                                  \
+        o->f = i1905_arena_alloc(arena, (size_t)n_ * sizeof(*o->f));            \
+        if (!o->f) return -1;                                                   \
+        o->f##_count = 0;                                                       \
+        struct blob_attr *cur_;                                                 \
+        size_t rem_;                                                            \
+        blobmsg_for_each_attr(cur_, tb[k_], rem_) {                             \
+            if (rec_##rec##_from_blob(cur_, &o->f[o->f##_count++], arena) < 0) return -1; \
+        }                                                                       \
+    }                                                                           \
+    k_++;
+#define I1905_F_LIST8(f, rec) I1905_F_LIST(f, rec)
+#define I1905_REC(name, fields)                                                 \
+    static int rec_##name##_from_blob(struct blob_attr *attr, struct i1905_##name *o, \
+                                      struct i1905_arena *arena) {              \
+        struct blob_attr *tb[ARRAY_SIZE(rec_##name##_policy)];                  \
+        unsigned k_ = 0;                                                        \
+        (void)arena;                                                            \
+        blobmsg_parse(rec_##name##_policy, ARRAY_SIZE(rec_##name##_policy), tb, \
+                      blobmsg_data(attr), blobmsg_data_len(attr));              \
+        fields                                                                  \
+        return 0;                                                               \
+    }
+#define I1905_TLV(ID, name, type, fields)                                       \
+    static int tlv_##name##_from_blob(struct blob_attr *attr, struct i1905_cmdu *cmdu, \
+                                      struct i1905_arena *arena) {              \
+        struct blob_attr *tb[ARRAY_SIZE(tlv_##name##_policy)];                  \
+        struct i1905_tlv_##name v;                                              \
+        struct i1905_tlv_##name *o = &v;                                        \
+        unsigned k_ = 0;                                                        \
+        (void)arena;                                                            \
+        memset(&v, 0, sizeof(v));                                               \
+        blobmsg_parse(tlv_##name##_policy, ARRAY_SIZE(tlv_##name##_policy), tb, \
+                      blobmsg_data(attr), blobmsg_data_len(attr));              \
+        fields                                                                  \
+        return i1905_tlv_##name##_encode(cmdu, o);                              \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST
+#undef I1905_F_LIST8
+
+// 可读形式，仅供调试/脚本：schema 里有的 TLV 按字段解码，其余或解码失败的给十六进制
+static void add_decoded_tlvs(struct daemon_ctx *d, const struct i1905_cmdu_view *cmdu) {
+    struct blob_buf *bb = &d->bb;
+    struct i1905_arena *arena = i1905_get_arena(d->i1905);
+    struct i1905_tlv_iter it;
+    struct i1905_tlv_view t;
+    void *arr = blobmsg_open_array(bb, "tlvs");
+    i1905_tlv_iter_init(&it, cmdu);
+    while (i1905_tlv_iter_next(&it, &t)) {
+        void *tbl = blobmsg_open_table(bb, NULL);
+        blobmsg_add_u32(bb, "type", t.type);
+        blobmsg_add_u32(bb, "len", t.len);
+        const char *name = i1905_tlv_type_name(t.type);
+        if (name) blobmsg_add_string(bb, "name", name);
+        int rv = -1;
+        switch (t.type) {
+#define I1905_TLV(ID, name, type, fields) \
+        case I1905_TLV_##ID: rv = tlv_##name##_to_blob(bb, &t, arena); break;
+#include "ieee1905_schema.def"
+        }
+        if (rv < 0) add_hex(bb, "value", t.value, t.len);
+        blobmsg_close_table(bb, tbl);
+    }
+    blobmsg_close_array(bb, arr);
+}
+
+// send 的 tlvs 数组：每项是带 "type"（TLV 名）的表，按 schema 组成 CMDU 并校验
+static int tlv_from_blob(struct blob_attr *attr, struct i1905_cmdu *cmdu,
+                         struct i1905_arena *arena) {
+    static const struct blobmsg_policy type_policy = {
+        .name = "type", .type = BLOBMSG_TYPE_STRING,
+    };
+    struct blob_attr *type_attr;
+    uint8_t type;
+    if (blobmsg_type(attr) != BLOBMSG_TYPE_TABLE) return -1;
+    blobmsg_parse(&type_policy, 1, &type_attr, blobmsg_data(attr), blobmsg_data_len(attr));
+    if (!type_attr || i1905_tlv_type_from_name(blobmsg_get_string(type_attr), &type) < 0) {
+        return -1;
+    }
+    switch (type) {
+#define I1905_TLV(ID, name, tlv_type, fields) \
+    case I1905_TLV_##ID: return tlv_##name##_from_blob(attr, cmdu, arena);
+#include "ieee1905_schema.def"
+    }
+    return -1;
+}
+
+static int build_cmdu(struct daemon_ctx *d, uint16_t msg_type, bool relay,
+                      struct blob_attr *arr, struct i1905_cmdu *cmdu) {
+    struct i1905_arena *arena = i1905_get_arena(d->i1905);
+    i1905_arena_reset(arena); // 库回调之外 arena 上没有别人的数据
+    i1905_cmdu_init(cmdu, arena, msg_type);
+    cmdu->relay = relay;
+    struct blob_attr *cur;
+    size_t rem;
+    blobmsg_for_each_attr(cur, arr, rem) {
+        if (tlv_from_blob(cur, cmdu, arena) < 0) return -1;
+    }
+    return i1905_cmdu_validate(cmdu);
+}
+
+// recv 事件与 send wait 应答共用的消息内容
+static void add_frame(struct daemon_ctx *d,
+                      const struct i1905_cmdu_view *cmdu,
+                      const struct i1905_rx_info *rx) {
+    blobmsg_add_u32(&d->bb, "type", cmdu->message_type);
+    blobmsg_add_u32(&d->bb, "mid", cmdu->message_id);
+    blobmsg_add_u8(&d->bb, "relay", cmdu->relay);
+    blobmsg_add_u32(&d->bb, "tlv_count", cmdu->tlv_count);
+
+    char mac[18];
+    mac_str(rx->src.mac, mac);
+    blobmsg_add_string(&d->bb, "src", mac);
+    mac_str(rx->al_mac, mac);
+    blobmsg_add_string(&d->bb, "al_mac", mac);
+    blobmsg_add_field(&d->bb, BLOBMSG_TYPE_UNSPEC, "tlv", cmdu->tlv_data,
+                      (unsigned int)cmdu->tlv_len);
+    if (d->decode_tlvs) add_decoded_tlvs(d, cmdu);
+}
+
+// 事件名按消息类型拆分（ieee1905.recv.topology_response 等），订阅方只注册
+// 关心的类型，ubusd 不会为不匹配的进程唤醒和序列化；需要全部类型可注册
+// ieee1905.recv.*。TLV 链以原始字节放在 "tlv" 字段（type/len/value，不含
+// end-of-message），消费方直接遍历，无需再回查。
+static void notify_frame(struct daemon_ctx *d,
+                         const struct i1905_cmdu_view *cmdu,
+                         const struct i1905_rx_info *rx) {
+    char event[64];
+    const char *name = i1905_msg_type_name(cmdu->message_type);
+    if (name) snprintf(event, sizeof(event), "ieee1905.recv.%s", name);
+    else snprintf(event, sizeof(event), "ieee1905.recv.0x%04x", cmdu->message_type);
+
+    blob_buf_init(&d->bb, 0);
+    add_frame(d, cmdu, rx);
+    ubus_send_event(d->ubus, event, d->bb.head);
+    // 兼容订阅 ieee1905 对象 recv 通知的旧客户端；无订阅者时不发
+    if (d->obj.has_subscribers) ubus_notify(d->ubus, &d->obj, "recv", d->bb.head, -1);
+}
+
+// 写入事件环并标记待唤醒的消费者；放不进一个槽位的记录返回 -1，走 ubus
+static int ring_publish(struct daemon_ctx *d, const struct i1905_cmdu_view *cmdu,
+                        const struct i1905_rx_info *rx, uint32_t bit) {
+    struct evring_msg m = {
+        .msg_type = cmdu->message_type,
+        .mid = cmdu->message_id,
+        .flags = cmdu->relay ? EVRING_F_RELAY : 0,
+        .tlv = cmdu->tlv_data,
+        .tlv_len = cmdu->tlv_len,
+    };
+    memcpy(m.src_mac, rx->src.mac, 6);
+    memcpy(m.al_mac, rx->al_mac, 6);
+    if (evring_publish(d->ring, &m) < 0) return -1;
+    for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+        if (d->consumers[i].efd >= 0 && (d->consumers[i].types & bit)) d->consumers[i].pending = true;
+    }
+    return 0;
+}
+
+// 一批收包处理完再唤醒，每个消费者每批最多一次 eventfd 写
+static void ring_wake(struct daemon_ctx *d) {
+    static const uint64_t one = 1;
+    for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+        struct ring_consumer *c = &d->consumers[i];
+        if (!c->pending) continue;
+        c->pending = false;
+        ssize_t rv = write(c->efd, &one, sizeof(one)); // 非阻塞；计数满了说明对方早已有未读通知
+        (void)rv;
+    }
+}
+
+static void on_frame(const struct i1905_cmdu_view *cmdu,
+                     const struct i1905_rx_info *rx,
+                     void *user_ctx) {
+    struct daemon_ctx *d = user_ctx;
+    topo_update(&d->topo, cmdu, rx, i1905_get_arena(d->i1905), i1905_now_ms());
+    if (d->mqtt) mqtt_bridge_frame(d->mqtt, cmdu, rx);
+    uint32_t bit = 1u << I1905_STATS_TYPE_SLOT(cmdu->message_type);
+    if ((d->ring_types & bit) && ring_publish(d, cmdu, rx, bit) == 0 && (d->ring_mute & bit)) {
+        // 静默的类型只给仍订阅 recv 通知的旧客户端
+        if (d->obj.has_subscribers) {
+            blob_buf_init(&d->bb, 0);
+            add_frame(d, cmdu, rx);
+            ubus_notify(d->ubus, &d->obj, "recv", d->bb.head, -1);
+        }
+        return;
+    }
+    notify_frame(d, cmdu, rx);
+}
+
+static void on_reply(const struct i1905_cmdu_view *reply,
+                     const struct i1905_rx_info *rx,
+                     void *user) {
+    struct pending_call *pc = user;
+    struct daemon_ctx *d = pc->d;
+    if (reply) {
+        // 等到的应答不再经过 on_frame，拓扑库和 MQTT 在这里更新
+        topo_update(&d->topo, reply, rx, i1905_get_arena(d->i1905), i1905_now_ms());
+        if (d->mqtt) mqtt_bridge_frame(d->mqtt, reply, rx);
+        blob_buf_init(&d->bb, 0);
+        add_frame(d, reply, rx);
+        ubus_send_reply(d->ubus, &pc->req, d->bb.head);
+    }
+    ubus_complete_deferred_request(d->ubus, &pc->req, reply ? UBUS_STATUS_OK : UBUS_STATUS_TIMEOUT);
+    free(pc);
+}
+
+// send 方法支持的类型表：按名字的 FNV-1a 哈希开放寻址索引，
+// 一次探测加一次 strcmp 定位，取代逐个比较的 if/else 链
+typedef int (*send_fn)(struct i1905_ctx *ctx, const char *dst_ip, uint16_t dst_port,
+                       const uint8_t mac[6]);
+
+static int send_topology_query(struct i1905_ctx *ctx, const char *dst_ip, uint16_t dst_port,
+                               const uint8_t mac[6]) {
+    (void)mac;
+    return i1905_send_topology_query(ctx, dst_ip, dst_port);
+}
+
+struct send_type {
+    const char *name;
+    send_fn send;
+    bool has_reply;            // 可用 wait 等待应答
+    uint16_t reply_type;
+};
+
+static const struct send_type send_types[] = {
+    { "topology_query",        send_topology_query,               true,  I1905_MSG_TOPOLOGY_RESPONSE },
+    { "topology_discovery",    i1905_send_topology_discovery,     false, 0 },
+    { "topology_notification", i1905_send_topology_notification,  false, 0 },
+    { "ap_search",             i1905_send_ap_autoconfig_search,   true,  I1905_MSG_AP_AUTOCONFIG_RESPONSE },
+    { "ap_response",           i1905_send_ap_autoconfig_response, false, 0 },
+};
+
+#define N_SEND_TYPES    (sizeof(send_types) / sizeof(send_types[0]))
+#define SEND_TYPE_SLOTS 16     // 2 的幂，至少为类型数的两倍
+
+static int8_t send_type_index[SEND_TYPE_SLOTS];
+
+static uint32_t name_hash(const char *s) {
+    uint32_t h = 2166136261u;
+    while (*s) h = (h ^ (uint8_t)*s++) * 16777619u;
+    return h;
+}
+
+static void send_types_init(void) {
+    memset(send_type_index, -1, sizeof(send_type_index));
+    for (size_t k = 0; k < N_SEND_TYPES; k++) {
+        uint32_t i = name_hash(send_types[k].name) & (SEND_TYPE_SLOTS - 1);
+        while (send_type_index[i] >= 0) i = (i + 1) & (SEND_TYPE_SLOTS - 1);
+        send_type_index[i] = (int8_t)k;
+    }
+}
+
+static const struct send_type *send_type_find(const char *name) {
+    uint32_t i = name_hash(name) & (SEND_TYPE_SLOTS - 1);
+    while (send_type_index[i] >= 0) {
+        const struct send_type *t = &send_types[send_type_index[i]];
+        if (strcmp(t->name, name) == 0) return t;
+        i = (i + 1) & (SEND_TYPE_SLOTS - 1);
+    }
+    return NULL;
+}
+
+// "ip[:port]"，无端口时用 def_port；L2 目的地是 MAC，本身带冒号，不拆
+static uint16_t split_port(char *dst, bool l2, uint16_t def_port) {
+    char *port = strrchr(dst, ':');
+    if (l2 || !port) return def_port;
+    *port++ = '\0';
+    return (uint16_t)atoi(port);
+}
+
+// 把 dsts 数组解析进 d->dsts，返回个数，格式错误返回 -1
+static int parse_dsts(struct daemon_ctx *d, struct blob_attr *arr, uint16_t def_port) {
+    struct blob_attr *cur;
+    size_t rem;
+    int n = 0;
+    blobmsg_for_each_attr(cur, arr, rem) {
+        if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING || n == MAX_SEND_DSTS) return -1;
+        char buf[64];
+        snprintf(buf, sizeof(buf), "%s", blobmsg_get_string(cur));
+        uint16_t port = split_port(buf, d->l2, def_port);
+        if (i1905_resolve(d->i1905, buf, port, &d->dsts[n]) < 0) return -1;
+        n++;
+    }
+    return n;
+}
+
+static int ubus_send(struct ubus_context *ctx, struct ubus_object *obj,
+                     struct ubus_request_data *req, const char *method,
+                     struct blob_attr *msg) {
+    (void)method;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct blob_attr *tb[__SEND_MAX];
+    blobmsg_parse(send_policy, __SEND_MAX, tb, blob_data(msg), blob_len(msg));
+
+    bool by_al = tb[SEND_AL_MAC] != NULL;
+    if (!tb[SEND_TYPE] || (!by_al && ((!tb[SEND_DST_IP] && !tb[SEND_DSTS]) || !tb[SEND_DST_PORT]))) {
+        return UBUS_STATUS_INVALID_ARGUMENT;
+    }
+    // 带 tlvs 时任何 schema 里的消息类型都可发，TLV 由调用方给出；
+    // 否则只能用 send_types 里的类型，由库的发送函数组包
+    const char *type_name = blobmsg_get_string(tb[SEND_TYPE]);
+    const struct send_type *type = send_type_find(type_name);
+    struct i1905_cmdu cmdu;
+    if (tb[SEND_TLVS]) {
+        uint16_t msg_type;
+        bool relay = tb[SEND_RELAY] && blobmsg_get_bool(tb[SEND_RELAY]);
+        if (i1905_msg_type_from_name(type_name, &msg_type) < 0 ||
+            build_cmdu(d, msg_type, relay, tb[SEND_TLVS], &cmdu) < 0) {
+            return UBUS_STATUS_INVALID_ARGUMENT;
+        }
+    } else if (!type) {
+        return UBUS_STATUS_INVALID_ARGUMENT;
+    }
+    const char *dst_ip = tb[SEND_DST_IP] ? blobmsg_get_string(tb[SEND_DST_IP]) : NULL;
+    uint16_t dst_port = tb[SEND_DST_PORT] ? (uint16_t)blobmsg_get_u32(tb[SEND_DST_PORT]) : 0;
+
+    // wait 只对有应答的请求类型有意义，先确认再发，免得发出去才报错；
+    // 多目的地的应答各自经 recv 事件上报，不支持 wait
+    bool wait = tb[SEND_WAIT] && blobmsg_get_bool(tb[SEND_WAIT]);
+    if (wait && (!type || !type->has_reply || tb[SEND_DSTS])) return UBUS_STATUS_NOT_SUPPORTED;
+
+    // dsts：同一报文只组一次包，由库一次批量（sendmmsg / TX 环）发往全部目的地
+    unsigned sent = 0;
+    if (tb[SEND_DSTS]) {
+        int n = parse_dsts(d, tb[SEND_DSTS], dst_port);
+        if (n <= 0) return UBUS_STATUS_INVALID_ARGUMENT;
+        i1905_set_fanout(d->i1905, d->dsts, (unsigned)n, &sent);
+    } else if (by_al) {
+        // 按 AL MAC 发：取拓扑库记下的、最近一次直接收到它的帧时的地址，
+        // 作为单目的地的 fanout 发出，仍可 wait。多跳外的设备没有这样的地址：
+        // -i 时像 1905 本来那样以它的 AL MAC 为目的 MAC 经桥接网络送达（应答来自
+        // 它的接口 MAC，关联不上，不支持 wait），UDP 下无从得知它的 IP
+        const char *al_str = blobmsg_get_string(tb[SEND_AL_MAC]);
+        uint8_t al[6];
+        const struct i1905_addr *a;
+        if (parse_mac(al_str, al) < 0) return UBUS_STATUS_INVALID_ARGUMENT;
+        if ((a = topo_addr(&d->topo, al))) {
+            d->dsts[0] = *a;
+        } else if (!d->l2 || wait) {
+            return UBUS_STATUS_NOT_FOUND;
+        } else if (i1905_resolve(d->i1905, al_str, 0, &d->dsts[0]) < 0) {
+            return UBUS_STATUS_INVALID_ARGUMENT;
+        }
+        i1905_set_fanout(d->i1905, d->dsts, 1, NULL);
+    }
+    if (tb[SEND_MID]) i1905_set_reply_mid(d->i1905, (uint16_t)blobmsg_get_u32(tb[SEND_MID]));
+
+    uint8_t mac[6] = {0x02, 0x00, 0x00, 0x00, 0x00, 0x10}; // placeholder iface/radio id
+    int rv = tb[SEND_TLVS] ? i1905_send_cmdu(d->i1905, dst_ip, dst_port, &cmdu)
+                           : type->send(d->i1905, dst_ip, dst_port, mac);
+    if (rv < 0) return UBUS_STATUS_UNKNOWN_ERROR;
+    uint16_t mid = (uint16_t)rv;
+
+    if (wait) {
+        // 延迟应答：登记到库的关联表（对端 + mid + 应答类型），按退避重传，
+        // 收到应答或最终超时时在 on_reply 里完成这次 ubus 调用
+        struct pending_call *pc = calloc(1, sizeof(*pc));
+        uint32_t timeout = tb[SEND_TIMEOUT] ? blobmsg_get_u32(tb[SEND_TIMEOUT]) : 0;
+        unsigned retries = tb[SEND_RETRIES] ? blobmsg_get_u32(tb[SEND_RETRIES]) : SEND_WAIT_RETRIES;
+        if (!pc) return UBUS_STATUS_UNKNOWN_ERROR;
+        pc->d = d;
+        if (i1905_expect_reply(d->i1905, mid, type->reply_type, timeout, retries, on_reply, pc) < 0) {
+            free(pc);
+            return UBUS_STATUS_UNKNOWN_ERROR;
+        }
+        ubus_defer_request(ctx, req, &pc->req);
+        return 0;
+    }
+
+    blob_buf_init(&d->bb, 0);
+    blobmsg_add_u32(&d->bb, "mid", mid);
+    if (tb[SEND_DSTS]) blobmsg_add_u32(&d->bb, "sent", sent);
+    ubus_send_reply(ctx, req, d->bb.head);
+    return 0;
+}
+
+static int ubus_topology(struct ubus_context *ctx, struct ubus_object *obj,
+                         struct ubus_request_data *req, const char *method,
+                         struct blob_attr *msg) {
+    (void)method;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct blob_attr *tb[__TOPO_MAX];
+    blobmsg_parse(topo_policy, __TOPO_MAX, tb, blob_data(msg), blob_len(msg));
+    uint32_t since = tb[TOPO_SINCE] ? blobmsg_get_u32(tb[TOPO_SINCE]) : 0;
+
+    blob_buf_init(&d->bb, 0);
+    topo_dump(&d->topo, &d->bb, since, i1905_now_ms());
+    ubus_send_reply(ctx, req, d->bb.head);
+    return 0;
+}
+
+// stats 方法里的标量计数器，按字段名原样输出
+#define STAT_FIELD(f) { #f, offsetof(struct i1905_stats, f) }
+static const struct {
+    const char *name;
+    size_t off;
+} stat_fields[] = {
+    STAT_FIELD(rx_frames), STAT_FIELD(rx_batches), STAT_FIELD(rx_batch_max),
+    STAT_FIELD(tx_fragments), STAT_FIELD(tx_errors),
+    STAT_FIELD(reasm_complete), STAT_FIELD(reasm_timeouts), STAT_FIELD(reasm_evictions),
+    STAT_FIELD(reasm_drops), STAT_FIELD(dedup_hits), STAT_FIELD(dedup_misses),
+    STAT_FIELD(dedup_evictions), STAT_FIELD(fwd_messages), STAT_FIELD(fwd_frames),
+    STAT_FIELD(timers_fired), STAT_FIELD(discovery_sent), STAT_FIELD(queries_answered),
+    STAT_FIELD(req_replies), STAT_FIELD(req_retransmits), STAT_FIELD(req_timeouts),
+    STAT_FIELD(rx_queue_waits), STAT_FIELD(tx_queued), STAT_FIELD(tx_queue_depth),
+    STAT_FIELD(tx_queue_max), STAT_FIELD(tx_write_waits),
+    STAT_FIELD(capture_frames), STAT_FIELD(capture_drops), STAT_FIELD(capture_errors),
+};
+
+static void add_hist(struct blob_buf *bb, const char *name, const uint64_t *hist, unsigned n) {
+    void *arr = blobmsg_open_array(bb, name);
+    for (unsigned i = 0; i < n; i++) blobmsg_add_u64(bb, NULL, hist[i]);
+    blobmsg_close_array(bb, arr);
+}
+
+// 按类型的收发计数，只列出非零项；最后一个槽位汇总其余类型
+static void add_per_type(struct blob_buf *bb, const char *name, const uint64_t *frames,
+                         const uint64_t *bytes) {
+    void *tbl = blobmsg_open_table(bb, name);
+    for (unsigned slot = 0; slot < I1905_STATS_MSG_TYPES; slot++) {
+        if (!frames[slot]) continue;
+        char buf[8];
+        const char *type = i1905_msg_type_name((uint16_t)slot);
+        if (slot == I1905_STATS_MSG_TYPES - 1) {
+            type = "other";
+        } else if (!type) {
+            snprintf(buf, sizeof(buf), "0x%04x", slot);
+            type = buf;
+        }
+        void *t = blobmsg_open_table(bb, type);
+        blobmsg_add_u64(bb, "frames", frames[slot]);
+        blobmsg_add_u64(bb, "bytes", bytes[slot]);
+        blobmsg_close_table(bb, t);
+    }
+    blobmsg_close_table(bb, tbl);
+}
+
+static int ubus_stats(struct ubus_context *ctx, struct ubus_object *obj,
+                      struct ubus_request_data *req, const char *method,
+                      struct blob_attr *msg) {
+    (void)method; (void)msg;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct i1905_stats st;
+    if (i1905_get_stats(d->i1905, &st) < 0) return UBUS_STATUS_UNKNOWN_ERROR;
+
+    blob_buf_init(&d->bb, 0);
+    for (size_t i = 0; i < sizeof(stat_fields) / sizeof(stat_fields[0]); i++) {
+        const uint64_t *v = (const uint64_t *)((const char *)&st + stat_fields[i].off);
+        blobmsg_add_u64(&d->bb, stat_fields[i].name, *v);
+    }
+    add_per_type(&d->bb, "rx", st.rx_type_frames, st.rx_type_bytes);
+    add_per_type(&d->bb, "tx", st.tx_type_frames, st.tx_type_bytes);
+    void *drops = blobmsg_open_table(&d->bb, "drops");
+    for (unsigned r = 0; r < I1905_DROP_REASONS; r++) {
+        blobmsg_add_u64(&d->bb, i1905_drop_reason_name((enum i1905_drop_reason)r), st.rx_drops[r]);
+    }
+    blobmsg_close_table(&d->bb, drops);
+    void *qdrops = blobmsg_open_table(&d->bb, "tx_queue_drops");
+    for (unsigned c = 0; c < I1905_TX_CLASSES; c++) {
+        blobmsg_add_u64(&d->bb, i1905_tx_class_name((i1905_tx_class)c), st.tx_queue_drops[c]);
+    }
+    blobmsg_close_table(&d->bb, qdrops);
+    // 直方图按 log2 分桶：第 i 桶为 [2^i, 2^(i+1))，第 0 桶从 0 起；耗时单位 ns
+    add_hist(&d->bb, "rx_batch_hist", st.rx_batch_hist, I1905_BATCH_HIST_BUCKETS);
+    add_hist(&d->bb, "parse_ns_hist", st.parse_ns_hist, I1905_LAT_HIST_BUCKETS);
+    add_hist(&d->bb, "cb_ns_hist", st.cb_ns_hist, I1905_LAT_HIST_BUCKETS);
+    ubus_send_reply(ctx, req, d->bb.head);
+    return 0;
+}
+
+static void ring_recalc(struct daemon_ctx *d) {
+    d->ring_types = d->ring_mute = 0;
+    for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+        const struct ring_consumer *c = &d->consumers[i];
+        if (c->efd < 0) continue;
+        d->ring_types |= c->types;
+        if (c->mute) d->ring_mute |= c->types;
+    }
+}
+
+// 消费者随请求传来自己的 eventfd，应答带回只读映射用的 memfd（O_RDONLY 打开，已封口，不能改大小和写入）
+static int ubus_ring_open(struct ubus_context *ctx, struct ubus_object *obj,
+                          struct ubus_request_data *req, const char *method,
+                          struct blob_attr *msg) {
+    (void)method;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct blob_attr *tb[__RING_MAX];
+    blobmsg_parse(ring_policy, __RING_MAX, tb, blob_data(msg), blob_len(msg));
+    if (req->req_fd < 0) return UBUS_STATUS_INVALID_ARGUMENT;
+
+    uint32_t types = 0;
+    if (tb[RING_TYPES]) {
+        struct blob_attr *cur;
+        size_t rem;
+        blobmsg_for_each_attr(cur, tb[RING_TYPES], rem) {
+            uint16_t type;
+            if (blobmsg_type(cur) != BLOBMSG_TYPE_STRING ||
+                i1905_msg_type_from_name(blobmsg_get_string(cur), &type) < 0) {
+                return UBUS_STATUS_INVALID_ARGUMENT;
+            }
+            types |= 1u << I1905_STATS_TYPE_SLOT(type);
+        }
+    }
+    if (!types) types = UINT32_MAX;
+
+    int id = 0;
+    while (id < MAX_RING_CONSUMERS && d->consumers[id].efd >= 0) id++;
+    if (id == MAX_RING_CONSUMERS) return UBUS_STATUS_NO_DATA;
+    if (!d->ring && !(d->ring = evring_producer_new(RING_SLOTS, RING_SLOT_SIZE))) {
+        return UBUS_STATUS_UNKNOWN_ERROR;
+    }
+    int memfd = dup(evring_producer_fd(d->ring));  // libubus 发送后会关闭
+    if (memfd < 0) return UBUS_STATUS_UNKNOWN_ERROR;
+
+    struct ring_consumer *c = &d->consumers[id];
+    c->efd = req->req_fd;          // 接管，libubus 不再关闭
+    req->req_fd = -1;
+    c->types = types;
+    c->mute = tb[RING_MUTE] && blobmsg_get_bool(tb[RING_MUTE]);
+    c->pending = false;
+    ring_recalc(d);
+
+    blob_buf_init(&d->bb, 0);
+    blobmsg_add_u32(&d->bb, "id", (uint32_t)id);
+    blobmsg_add_u32(&d->bb, "slots", RING_SLOTS);
+    blobmsg_add_u32(&d->bb, "slot_size", RING_SLOT_SIZE);
+    ubus_send_reply(ctx, req, d->bb.head);
+    ubus_request_set_fd(ctx, req, memfd);
+    return 0;
+}
+
+static int ubus_ring_close(struct ubus_context *ctx, struct ubus_object *obj,
+                           struct ubus_request_data *req, const char *method,
+                           struct blob_attr *msg) {
+    (void)ctx; (void)req; (void)method;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct blob_attr *tb[__RING_CLOSE_MAX];
+    blobmsg_parse(ring_close_policy, __RING_CLOSE_MAX, tb, blob_data(msg), blob_len(msg));
+    if (!tb[RING_ID]) return UBUS_STATUS_INVALID_ARGUMENT;
+    uint32_t id = blobmsg_get_u32(tb[RING_ID]);
+    if (id >= MAX_RING_CONSUMERS || d->consumers[id].efd < 0) return UBUS_STATUS_NOT_FOUND;
+    close(d->consumers[id].efd);
+    d->consumers[id].efd = -1;
+    d->consumers[id].pending = false;
+    ring_recalc(d);
+    return 0;
+}
+
+static int capture_start(struct daemon_ctx *d, const char *path, size_t ring_size,
+                         uint32_t snaplen) {
+    if (strlen(path) >= sizeof(d->capture_path)) return -1;
+    if (i1905_capture_start(d->i1905, path, ring_size, snaplen) < 0) return -1;
+    strcpy(d->capture_path, path);
+    return 0;
+}
+
+// 开关抓包；应答总是当前状态。抓包计数也在 stats 里，这里便于看一眼
+static int ubus_capture(struct ubus_context *ctx, struct ubus_object *obj,
+                        struct ubus_request_data *req, const char *method,
+                        struct blob_attr *msg) {
+    (void)method;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct blob_attr *tb[__CAPTURE_MAX];
+    blobmsg_parse(capture_policy, __CAPTURE_MAX, tb, blob_data(msg), blob_len(msg));
+    if (tb[CAPTURE_ENABLE] && blobmsg_get_bool(tb[CAPTURE_ENABLE])) {
+        const char *path = tb[CAPTURE_PATH_ARG] ? blobmsg_get_string(tb[CAPTURE_PATH_ARG])
+                                                : CAPTURE_PATH;
+        size_t ring = tb[CAPTURE_RING_KB] ? (size_t)blobmsg_get_u32(tb[CAPTURE_RING_KB]) * 1024 : 0;
+        uint32_t snaplen = tb[CAPTURE_SNAPLEN] ? blobmsg_get_u32(tb[CAPTURE_SNAPLEN]) : 0;
+        if (capture_start(d, path, ring, snaplen) < 0) return UBUS_STATUS_UNKNOWN_ERROR;
+    } else if (tb[CAPTURE_ENABLE]) {
+        i1905_capture_stop(d->i1905);
+        d->capture_path[0] = '\0';
+    }
+
+    struct i1905_stats st;
+    if (i1905_get_stats(d->i1905, &st) < 0) return UBUS_STATUS_UNKNOWN_ERROR;
+    blob_buf_init(&d->bb, 0);
+    blobmsg_add_u8(&d->bb, "active", i1905_capture_active(d->i1905));
+    if (d->capture_path[0]) blobmsg_add_string(&d->bb, "path", d->capture_path);
+    blobmsg_add_u64(&d->bb, "frames", st.capture_frames);
+    blobmsg_add_u64(&d->bb, "drops", st.capture_drops);
+    blobmsg_add_u64(&d->bb, "errors", st.capture_errors);
+    ubus_send_reply(ctx, req, d->bb.head);
+    return 0;
+}
+
+// 运行中增删接口；应答总是当前的接口列表与各自的收发计数
+static int ubus_interfaces(struct ubus_context *ctx, struct ubus_object *obj,
+                           struct ubus_request_data *req, const char *method,
+                           struct blob_attr *msg) {
+    (void)method;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    struct blob_attr *tb[__IFACE_MAX];
+    blobmsg_parse(iface_policy, __IFACE_MAX, tb, blob_data(msg), blob_len(msg));
+    if (tb[IFACE_ADD] && i1905_add_interface(d->i1905, blobmsg_get_string(tb[IFACE_ADD])) < 0) {
+        return UBUS_STATUS_UNKNOWN_ERROR;
+    }
+    if (tb[IFACE_DEL] && i1905_del_interface(d->i1905, blobmsg_get_string(tb[IFACE_DEL])) < 0) {
+        return UBUS_STATUS_NOT_FOUND;
+    }
+
+    blob_buf_init(&d->bb, 0);
+    void *arr = blobmsg_open_array(&d->bb, "interfaces");
+    char name[I1905_IFNAME_LEN];
+    struct i1905_if_stats st;
+    for (unsigned i = 0; i1905_get_if_stats(d->i1905, i, name, &st) == 0; i++) {
+        void *t = blobmsg_open_table(&d->bb, NULL);
+        blobmsg_add_string(&d->bb, "name", name);
+        blobmsg_add_u64(&d->bb, "rx_frames", st.rx_frames);
+        blobmsg_add_u64(&d->bb, "rx_bytes", st.rx_bytes);
+        blobmsg_add_u64(&d->bb, "tx_frames", st.tx_frames);
+        blobmsg_add_u64(&d->bb, "tx_bytes", st.tx_bytes);
+        blobmsg_add_u64(&d->bb, "tx_errors", st.tx_errors);
+        blobmsg_close_table(&d->bb, t);
+    }
+    blobmsg_close_array(&d->bb, arr);
+    ubus_send_reply(ctx, req, d->bb.head);
+    return 0;
+}
+
+static int ubus_mqtt(struct ubus_context *ctx, struct ubus_object *obj,
+                     struct ubus_request_data *req, const char *method,
+                     struct blob_attr *msg) {
+    (void)method; (void)msg;
+    struct daemon_ctx *d = container_of(obj, struct daemon_ctx, obj);
+    if (!d->mqtt) return UBUS_STATUS_NOT_SUPPORTED;
+    struct mqtt_bridge_stats st;
+    mqtt_bridge_get_stats(d->mqtt, &st);
+
+    blob_buf_init(&d->bb, 0);
+    blobmsg_add_u8(&d->bb, "up", mqtt_bridge_is_up(d->mqtt));
+    blobmsg_add_u64(&d->bb, "frames", st.frames);
+    blobmsg_add_u64(&d->bb, "batches", st.batches);
+    blobmsg_add_u64(&d->bb, "drops", st.drops);
+    blobmsg_add_u64(&d->bb, "sent", st.sent);
+    blobmsg_add_u64(&d->bb, "send_errors", st.send_errors);
+    blobmsg_add_u64(&d->bb, "pending", st.pending);
+    blobmsg_add_u64(&d->bb, "connects", st.mqtt.connects);
+    blobmsg_add_u64(&d->bb, "disconnects", st.mqtt.disconnects);
+    blobmsg_add_u64(&d->bb, "published", st.mqtt.published);
+    blobmsg_add_u64(&d->bb, "acked", st.mqtt.acked);
+    blobmsg_add_u64(&d->bb, "retransmits", st.mqtt.retransmits);
+    blobmsg_add_u64(&d->bb, "received", st.mqtt.received);
+    blobmsg_add_u64(&d->bb, "rejected", st.mqtt.rejected);
+    blobmsg_add_u32(&d->bb, "in_flight", st.mqtt.in_flight);
+    ubus_send_reply(ctx, req, d->bb.head);
+    return 0;
+}
+
+static void topo_age_cb(struct i1905_timer *t, void *user) {
+    struct daemon_ctx *d = user;
+    topo_age(&d->topo, i1905_now_ms(), TOPO_TTL_MS);
+    i1905_timer_arm(d->i1905, t, TOPO_AGE_INTERVAL_MS);
+}
+
+static void snapshot_write(struct daemon_ctx *d, bool clean) {
+    uint8_t al_mac[6];
+    i1905_get_al_mac(d->i1905, al_mac);
+    if (snapshot_save(d->snapshot_path, &d->topo, al_mac, i1905_get_message_id(d->i1905),
+                      clean) < 0) {
+        fprintf(stderr, "[ieee1905d] snapshot %s failed\n", d->snapshot_path);
+    }
+}
+
+static void snapshot_cb(struct i1905_timer *t, void *user) {
+    struct daemon_ctx *d = user;
+    snapshot_write(d, false);
+    i1905_timer_arm(d->i1905, t, SNAPSHOT_INTERVAL_MS);
+}
+
+// 新进程连上来：库停收并尽量发完排队的帧，摘掉 ubus 对象让新进程注册，写 clean 快照，
+// 最后交出 socket 退出。库拒绝交接时照常运行，新进程收到 EOF 自行退出
+static void handoff_cb(struct uloop_fd *u, unsigned int events) {
+    struct daemon_ctx *d = container_of(u, struct daemon_ctx, handoff_fd);
+    (void)events;
+    int c = accept4(u->fd, NULL, NULL, SOCK_CLOEXEC);
+    if (c < 0) return;
+    struct i1905_handoff h;
+    if (i1905_handoff(d->i1905, &h) < 0) {
+        fprintf(stderr, "[ieee1905d] handoff refused\n");
+        close(c);
+        return;
+    }
+    // 交出之后库不能再发送，凡是可能触发收发的回调都摘掉
+    uloop_fd_delete(&d->fd);
+    uloop_fd_delete(&d->timer_fd);
+    if (d->mqtt_fd.registered) uloop_fd_delete(&d->mqtt_fd);
+    uloop_fd_delete(u);
+    ubus_remove_object(d->ubus, &d->obj);
+    if (d->snapshot_path) snapshot_write(d, true);
+    if (handoff_send(c, &h) < 0) {
+        fprintf(stderr, "[ieee1905d] handoff send failed, exiting\n");
+    } else {
+        printf("[ieee1905d] handed %u sockets over, exiting\n", h.n);
+    }
+    close(c);
+    for (unsigned i = 0; i < h.n; i++) close(h.fds[i]);
+    d->handed_off = true;
+    uloop_end();
+}
+
+static const struct ubus_method ieee1905_methods[] = {
+    UBUS_METHOD("send", ubus_send, send_policy),
+    UBUS_METHOD("topology", ubus_topology, topo_policy),
+    UBUS_METHOD_NOARG("stats", ubus_stats),
+    UBUS_METHOD("ring_open", ubus_ring_open, ring_policy),
+    UBUS_METHOD("ring_close", ubus_ring_close, ring_close_policy),
+    UBUS_METHOD("capture", ubus_capture, capture_policy),
+    UBUS_METHOD("interfaces", ubus_interfaces, iface_policy),
+    UBUS_METHOD_NOARG("mqtt", ubus_mqtt),
+};
+
+static struct ubus_object_type ieee1905_obj_type =
+    UBUS_OBJECT_TYPE("ieee1905", ieee1905_methods);
+
+// 发送调度在 socket 写满时排队，可写后由 handle_readable 冲刷，同一个 fd 报告
+static void fd_cb(struct uloop_fd *u, unsigned int events) {
+    struct daemon_ctx *d = container_of(u, struct daemon_ctx, fd);
+    if (events & ULOOP_READ) {
+        i1905_handle_readable(d->i1905);
+        ring_wake(d);
+        if (d->mqtt) mqtt_bridge_flush(d->mqtt);
+    }
+}
+
+static void timer_fd_cb(struct uloop_fd *u, unsigned int events) {
+    struct daemon_ctx *d = container_of(u, struct daemon_ctx, timer_fd);
+    if (events & ULOOP_READ) {
+        i1905_handle_timers(d->i1905);
+    }
+}
+
+// broker 连接的 fd 由适配器告知：重连会换 fd，有待发数据时才关心可写
+static void mqtt_watch(struct mqtt_client *c, int fd, bool want_write, void *user) {
+    (void)c;
+    struct daemon_ctx *d = user;
+    if (d->mqtt_fd.registered && d->mqtt_fd.fd != fd) uloop_fd_delete(&d->mqtt_fd);
+    if (fd < 0) return;
+    d->mqtt_fd.fd = fd;
+    uloop_fd_add(&d->mqtt_fd, ULOOP_READ | ULOOP_ERROR_CB | (want_write ? ULOOP_WRITE : 0));
+}
+
+// 出错时交给读写路径，由它们发现连接断开并安排重连
+static void mqtt_fd_cb(struct uloop_fd *u, unsigned int events) {
+    struct daemon_ctx *d = container_of(u, struct daemon_ctx, mqtt_fd);
+    mqtt_bridge_handle_io(d->mqtt, (events & ULOOP_READ) || u->error,
+                          (events & ULOOP_WRITE) || u->error);
+}
+
+static void usage(const char *prog) {
+    fprintf(stderr, "Usage: %s [-p data_port] [-i ifname]... [-n neighbor[:port]]... [-t threads]\n"
+                    "          [-r bytes_per_s] [-R bytes_per_s] [-w file] [-m host[:port]] [-M prefix]\n"
+                    "          [-S file] [-H path] [-D] [-V]\n"
+                    "  -i ifname  收发真实 1905 L2 帧 (AF_PACKET)，此时 send 的 dst_ip 填目的 MAC；\n"
+                    "             可重复，同时监听多个接口，dst_ip 加 %%ifname 指定出口\n"
+                    "  -n addr    中继组播转发邻居（UDP 为 ip[:port]，可重复）\n"
+                    "  -t threads 多线程收包：各线程独立 socket 解析校验，经无锁队列交给主线程（默认单线程）\n"
+                    "  -r rate    每个接口的发送限速（L2 字节/秒），控制类报文优先且不受限速延迟（默认不限）\n"
+                    "  -R rate    对每个邻居的发送限速（L2 字节/秒，默认不限）\n"
+                    "  -w file    启动即抓包写入 pcapng 文件（运行中用 ubus capture 开关）\n"
+                    "  -m broker  同时把 recv/send 接到 MQTT broker（默认端口 1883）\n"
+                    "  -M prefix  MQTT 主题前缀（默认 ieee1905）\n"
+                    "  -S file    状态快照：启动时载入，每 30 秒及退出时写入（AL MAC、message id、拓扑库）\n"
+                    "  -H path    交接 socket：启动时先向 path 上的旧进程要收发 socket，再在 path 上\n"
+                    "             等下一个进程；与 -S 同用时新进程连拓扑一起接上（不支持 -t）\n"
+                    "  -D         recv 事件附带解码后的 tlvs（默认只给原始 tlv 字节）\n"
+                    "  -V         丢弃不合 TLV schema 的报文（缺必选 TLV、TLV 长度不对）\n",
+            prog);
+}
+
+int main(int argc, char **argv) {
+    struct i1905_opts opts = {
+        .transport = I1905_TRANSPORT_UDP,
+        .discovery_interval_ms = I1905_DISCOVERY_INTERVAL_MS,
+    };
+    uint16_t data_port = DATA_PORT;
+    char *neighbors[MAX_CLI_NEIGHBORS];
+    int n_neighbors = 0;
+    char *ifnames[I1905_MAX_INTERFACES];
+    int n_ifnames = 0;
+    bool decode_tlvs = false;
+    const char *capture = NULL;
+    char *mqtt_host = NULL;
+    const char *mqtt_prefix = NULL;
+    const char *snapshot_path = NULL;
+    const char *handoff_path = NULL;
+    int opt;
+    while ((opt = getopt(argc, argv, "p:i:n:t:r:R:w:m:M:S:H:DVh")) != -1) {
+        switch (opt) {
+        case 'p':
+            data_port = (uint16_t)atoi(optarg);
+            break;
+        case 'i':
+            opts.transport = I1905_TRANSPORT_PACKET;
+            if (n_ifnames < I1905_MAX_INTERFACES) ifnames[n_ifnames++] = optarg;
+            break;
+        case 'n':
+            if (n_neighbors < MAX_CLI_NEIGHBORS) neighbors[n_neighbors++] = optarg;
+            break;
+        case 't':
+            opts.rx_threads = (unsigned)atoi(optarg);
+            break;
+        case 'r':
+            opts.tx_rate = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'R':
+            opts.peer_tx_rate = (uint32_t)strtoul(optarg, NULL, 0);
+            break;
+        case 'w':
+            capture = optarg;
+            break;
+        case 'm':
+            mqtt_host = optarg;
+            break;
+        case 'M':
+            mqtt_prefix = optarg;
+            break;
+        case 'S':
+            snapshot_path = optarg;
+            break;
+        case 'H':
+            handoff_path = optarg;
+            break;
+        case 'D':
+            decode_tlvs = true;
+            break;
+        case 'V':
+            opts.validate = true;
+            break;
+        default:
+            usage(argv[0]);
+            return 1;
+        }
+    }
+    if (handoff_path && opts.rx_threads) {
+        fprintf(stderr, "[ieee1905d] -H does not work with -t\n");
+        return 1;
+    }
+    srand((unsigned)time(NULL));
+    send_types_init();
+    uloop_init();
+
+    struct daemon_ctx d = {0};
+    d.decode_tlvs = decode_tlvs;
+    d.snapshot_path = snapshot_path;
+    d.handoff_fd.fd = -1;
+    opts.ifname = n_ifnames ? ifnames[0] : NULL;
+    d.l2 = opts.ifname != NULL;
+    for (int i = 0; i < MAX_RING_CONSUMERS; i++) d.consumers[i].efd = -1;
+
+    // 先接旧进程的 socket（它随即停收、写快照），再读快照，两者都没有就是冷启动
+    uint64_t start_ms = i1905_now_ms();
+    struct i1905_handoff handoff;
+    if (handoff_path) {
+        int rv = handoff_fetch(handoff_path, &handoff);
+        if (rv < 0) {
+            fprintf(stderr, "[ieee1905d] handoff from %s failed\n", handoff_path);
+            return 1;
+        }
+        if (rv == 0) opts.handoff = &handoff;
+    }
+    struct snapshot_info snap;
+    int restored = snapshot_path ? snapshot_load(snapshot_path, &d.topo, TOPO_MAX_DEVICES, &snap) : 1;
+    if (restored < 0) fprintf(stderr, "[ieee1905d] snapshot %s unusable, ignored\n", snapshot_path);
+    if (restored == 0) {
+        uint16_t mid = (uint16_t)(snap.message_id + (snap.clean ? 0 : SNAPSHOT_MID_SKIP));
+        opts.message_id = mid ? mid : UINT16_MAX;
+    }
+    if (i1905_init_ex(&d.i1905, I1905_ROLE_CONTROLLER, data_port, restored == 0 ? snap.al_mac : NULL,
+                      on_frame, &d, &opts) < 0) {
+        fprintf(stderr, "[ieee1905d] init failed\n");
+        return 1;
+    }
+    for (int i = 1; i < n_ifnames; i++) {
+        if (i1905_add_interface(d.i1905, ifnames[i]) < 0) {
+            fprintf(stderr, "[ieee1905d] interface %s failed\n", ifnames[i]);
+            return 1;
+        }
+    }
+    uint8_t al_mac[6];
+    i1905_get_al_mac(d.i1905, al_mac);
+    if (restored != 0 && topo_init(&d.topo, TOPO_MAX_DEVICES, al_mac) < 0) {
+        fprintf(stderr, "[ieee1905d] topology db init failed\n");
+        return 1;
+    }
+    if (opts.handoff || restored == 0) {
+        printf("[ieee1905d] restarted in %llu ms:", (unsigned long long)(i1905_now_ms() - start_ms));
+        if (opts.handoff) printf(" %u sockets handed over", handoff.n);
+        if (restored == 0) {
+            printf("%s %u devices %u links from a %s snapshot %llu ms old",
+                   opts.handoff ? "," : "", d.topo.count, d.topo.n_links,
+                   snap.clean ? "clean" : "periodic", (unsigned long long)snap.age_ms);
+        }
+        printf("\n");
+    }
+    if (capture && capture_start(&d, capture, 0, 0) < 0) {
+        fprintf(stderr, "[ieee1905d] capture to %s failed\n", capture);
+        return 1;
+    }
+    i1905_timer_init(&d.topo_age, topo_age_cb, &d);
+    i1905_timer_arm(d.i1905, &d.topo_age, TOPO_AGE_INTERVAL_MS);
+    if (snapshot_path) {
+        i1905_timer_init(&d.snapshot, snapshot_cb, &d);
+        i1905_timer_arm(d.i1905, &d.snapshot, SNAPSHOT_INTERVAL_MS);
+    }
+
+    for (int i = 0; i < n_neighbors; i++) {
+        uint16_t nport = split_port(neighbors[i], d.l2, data_port);
+        if (i1905_add_neighbor(d.i1905, neighbors[i], nport) < 0) {
+            fprintf(stderr, "[ieee1905d] bad neighbor %s\n", neighbors[i]);
+        }
+    }
+
+    d.ubus = ubus_connect(NULL);
+    if (!d.ubus) {
+        fprintf(stderr, "[ieee1905d] ubus connect failed\n");
+        return 1;
+    }
+    ubus_add_uloop(d.ubus);
+    blob_buf_init(&d.bb, 0);
+
+    d.obj.type = &ieee1905_obj_type;
+    d.obj.methods = ieee1905_methods;
+    d.obj.n_methods = ARRAY_SIZE(ieee1905_methods);
+    d.obj.name = "ieee1905";
+
+    if (ubus_add_object(d.ubus, &d.obj)) {
+        fprintf(stderr, "[ieee1905d] add ubus object failed\n");
+        return 1;
+    }
+
+    d.fd.fd = i1905_get_fd(d.i1905);
+    d.fd.cb = fd_cb;
+    d.fd.events = ULOOP_READ;
+    uloop_fd_add(&d.fd, ULOOP_READ);
+
+    // 周期 discovery、分片重组超时、拓扑老化都在库的时间轮上，由 timerfd 驱动
+    d.timer_fd.fd = i1905_get_timer_fd(d.i1905);
+    d.timer_fd.cb = timer_fd_cb;
+    uloop_fd_add(&d.timer_fd, ULOOP_READ);
+
+    // 对象注册上之后才接受下一个进程，此前它连上来会当作没有前任
+    if (handoff_path) {
+        d.handoff_fd.fd = handoff_listen(handoff_path);
+        if (d.handoff_fd.fd < 0) {
+            fprintf(stderr, "[ieee1905d] handoff listen on %s failed\n", handoff_path);
+            return 1;
+        }
+        d.handoff_fd.cb = handoff_cb;
+        uloop_fd_add(&d.handoff_fd, ULOOP_READ);
+    }
+
+    if (mqtt_host) {
+        struct mqtt_bridge_opts mo = {
+            .host = mqtt_host,
+            .port = split_port(mqtt_host, false, MQTT_DEFAULT_PORT),
+            .prefix = mqtt_prefix,
+        };
+        d.mqtt_fd.cb = mqtt_fd_cb;
+        d.mqtt = mqtt_bridge_new(d.i1905, &mo, mqtt_watch, &d);
+        if (!d.mqtt) {
+            fprintf(stderr, "[ieee1905d] mqtt %s failed\n", mqtt_host);
+            return 1;
+        }
+    }
+
+    if (opts.ifname) {
+        printf("[ieee1905d] running: ubus object 'ieee1905', ifname=%s", opts.ifname);
+        for (int i = 1; i < n_ifnames; i++) printf(",%s", ifnames[i]);
+        printf(" (AF_PACKET)\n");
+    } else {
+        printf("[ieee1905d] running: ubus object 'ieee1905', data_port=%d (event-driven)\n", data_port);
+    }
+    if (opts.rx_threads) printf("[ieee1905d] %u receive threads\n", opts.rx_threads);
+    uloop_run();
+
+    uloop_done();
+    if (snapshot_path && !d.handed_off) snapshot_write(&d, true);
+    if (d.handoff_fd.fd >= 0) {
+        close(d.handoff_fd.fd);
+        if (!d.handed_off) unlink(handoff_path);
+    }
+    topo_free(&d.topo);
+    for (int i = 0; i < MAX_RING_CONSUMERS; i++) {
+        if (d.consumers[i].efd >= 0) close(d.consumers[i].efd);
+    }
+    evring_producer_free(d.ring);
+    mqtt_bridge_free(d.mqtt);
+    i1905_close(d.i1905);
+    ubus_free(d.ubus);
+    return 0;
+}
+
+
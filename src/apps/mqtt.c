@@ -0,0 +1,617 @@
+// SPDX-License-Identifier: MIT
+// mqtt: MQTT 3.1.1 客户端子集，见 mqtt.h。
+
+#define _GNU_SOURCE // SOCK_NONBLOCK, SOCK_CLOEXEC
+#include "mqtt.h"
+#include "ieee1905.h"
+
+#include <errno.h>
+#include <netdb.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/socket.h>
+
+#define PKT_CONNECT    0x10
+#define PKT_CONNACK    0x20
+#define PKT_PUBLISH    0x30
+#define PKT_PUBACK     0x40
+#define PKT_SUBSCRIBE  0x82            // 固定头低 4 位必须为 0010
+#define PKT_SUBACK     0x90
+#define PKT_PINGREQ    0xC0
+#define PKT_PINGRESP   0xD0
+#define PUBLISH_DUP    0x08
+#define MAX_REMAINING  268435455u      // 剩余长度 4 字节变长编码的上限
+#define SUB_ID         0xFFFF          // SUBSCRIBE 专用包 ID，发布不分配
+#define IN_INITIAL     16384
+#define IN_MAX         (MQTT_MAX_PACKET + 5)
+#define READS_PER_CALL 16              // 每次就绪最多读几回，其余留给下一轮
+
+enum conn_state {
+    ST_WAIT,                   // 未连接，deadline 到了重连
+    ST_CONNECTING,             // 非阻塞 connect 进行中
+    ST_CONNACK,                // CONNECT 已发，等 CONNACK
+    ST_UP,
+};
+
+// 窗口里的一条 QoS 1 发布，保留整包以便重连后重发
+struct inflight {
+    uint16_t id;
+    bool sent;                 // 发出过，重发时置 DUP
+    bool acked;                // 乱序确认，等前面的确认后一并出窗口
+    uint8_t *pkt;
+    size_t len;
+    size_t cap;
+};
+
+struct mqtt_client {
+    struct mqtt_opts o;
+    char *client_id;
+    struct sockaddr_in addr;
+    int fd;
+    enum conn_state st;
+    unsigned gen;              // 每断开一次加一，回调返回后据此判断连接是否还在
+
+    uint8_t *out;              // 待写字节，[out_off, out_len)
+    size_t out_off;
+    size_t out_len;
+    size_t out_cap;
+    uint8_t *in;               // 已读未解析的字节
+    size_t in_len;
+    size_t in_cap;
+
+    struct inflight *win;      // 环，按发布顺序
+    unsigned win_head;
+    unsigned win_count;
+    bool acked_pending;        // 本轮读到的 PUBACK 腾出了位置，读完再通知
+    uint16_t next_id;
+
+    struct {
+        char *filter;
+        uint8_t qos;
+    } subs[MQTT_MAX_SUBS];
+    unsigned n_subs;
+
+    uint64_t deadline_ms;      // ST_WAIT：重连时间；ST_CONNECTING/ST_CONNACK：超时
+    uint32_t backoff_ms;
+    uint64_t last_tx_ms;
+    uint64_t last_rx_ms;
+    bool ping_out;
+
+    int watch_fd;              // 上次通知调用方的状态
+    bool watch_write;
+    struct mqtt_stats stats;
+};
+
+static size_t varlen_size(size_t n) {
+    return n < 128 ? 1 : n < 16384 ? 2 : n < 2097152 ? 3 : 4;
+}
+
+static size_t put_varlen(uint8_t *p, size_t n) {
+    size_t i = 0;
+    do {
+        uint8_t b = n & 0x7F;
+        n >>= 7;
+        p[i++] = n ? (uint8_t)(b | 0x80) : b;
+    } while (n);
+    return i;
+}
+
+static uint8_t *put_str(uint8_t *p, const char *s, size_t len) {
+    p[0] = (uint8_t)(len >> 8);
+    p[1] = (uint8_t)len;
+    memcpy(p + 2, s, len);
+    return p + 2 + len;
+}
+
+static void watch_update(struct mqtt_client *c) {
+    int fd = c->st == ST_WAIT ? -1 : c->fd;
+    bool want_write = c->st == ST_CONNECTING || c->out_off < c->out_len;
+    if (fd == c->watch_fd && want_write == c->watch_write) return;
+    c->watch_fd = fd;
+    c->watch_write = want_write;
+    if (c->o.on_watch) c->o.on_watch(c, fd, want_write, c->o.user);
+}
+
+// 追加 n 字节待写，先挪掉已写出的部分，不够再扩容
+static uint8_t *out_reserve(struct mqtt_client *c, size_t n) {
+    if (c->out_len + n > c->out_cap && c->out_off) {
+        memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+        c->out_len -= c->out_off;
+        c->out_off = 0;
+    }
+    if (c->out_len + n > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + n) cap *= 2;
+        uint8_t *p = realloc(c->out, cap);
+        if (!p) return NULL;
+        c->out = p;
+        c->out_cap = cap;
+    }
+    uint8_t *p = c->out + c->out_len;
+    c->out_len += n;
+    return p;
+}
+
+static void conn_lost(struct mqtt_client *c, const char *why) {
+    if (c->fd < 0) return;
+    int fd = c->fd;
+    bool was_up = c->st == ST_UP;
+    // 一串失败的重连只报第一次
+    if (was_up || c->backoff_ms == MQTT_BACKOFF_MIN_MS) {
+        fprintf(stderr, "[mqtt] %s:%u: %s\n", c->o.host, c->o.port, why);
+    }
+    c->fd = -1;
+    c->st = ST_WAIT;
+    c->gen++;
+    c->out_off = c->out_len = 0;   // QoS 1 的发布还在窗口里，QoS 0 的丢弃
+    c->in_len = 0;
+    c->ping_out = false;
+    c->deadline_ms = i1905_now_ms() + c->backoff_ms;
+    c->backoff_ms = c->backoff_ms * 2 < MQTT_BACKOFF_MAX_MS ? c->backoff_ms * 2 : MQTT_BACKOFF_MAX_MS;
+    watch_update(c);               // 调用方先摘掉旧 fd 再关闭
+    close(fd);
+    if (was_up) {
+        c->stats.disconnects++;
+        if (c->o.on_event) c->o.on_event(c, MQTT_EV_DOWN, c->o.user);
+    }
+}
+
+static void conn_flush(struct mqtt_client *c) {
+    if (c->fd < 0 || c->st < ST_CONNACK) return;
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno != EAGAIN && errno != EWOULDBLOCK) conn_lost(c, strerror(errno));
+            break;
+        }
+        c->out_off += (size_t)n;
+        c->last_tx_ms = i1905_now_ms();
+    }
+    if (c->out_off == c->out_len) c->out_off = c->out_len = 0;
+    watch_update(c);
+}
+
+static void conn_established(struct mqtt_client *c) {
+    size_t id_len = strlen(c->client_id);
+    size_t rem = 10 + 2 + id_len;
+    uint8_t *p = out_reserve(c, 1 + varlen_size(rem) + rem);
+    if (!p) {
+        conn_lost(c, "out of memory");
+        return;
+    }
+    *p++ = PKT_CONNECT;
+    p += put_varlen(p, rem);
+    p = put_str(p, "MQTT", 4);
+    *p++ = 4;                      // 协议级别 3.1.1
+    *p++ = 0x02;                   // clean session，订阅每次重发
+    *p++ = (uint8_t)(c->o.keepalive_s >> 8);
+    *p++ = (uint8_t)c->o.keepalive_s;
+    put_str(p, c->client_id, id_len);
+    c->st = ST_CONNACK;
+    c->last_rx_ms = i1905_now_ms();
+    conn_flush(c);
+}
+
+static void conn_start(struct mqtt_client *c) {
+    int fd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) {
+        fprintf(stderr, "[mqtt] socket: %s\n", strerror(errno));
+        c->deadline_ms = i1905_now_ms() + c->backoff_ms;
+        return;
+    }
+    int one = 1;
+    setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+    c->fd = fd;
+    c->deadline_ms = i1905_now_ms() + MQTT_CONNECT_TIMEOUT_MS;
+    if (connect(fd, (const struct sockaddr *)&c->addr, sizeof(c->addr)) == 0) {
+        c->st = ST_CONNACK;        // 本机回环可能立即连上
+        conn_established(c);
+    } else if (errno == EINPROGRESS) {
+        c->st = ST_CONNECTING;
+        watch_update(c);
+    } else {
+        c->st = ST_CONNECTING;
+        conn_lost(c, strerror(errno));
+    }
+}
+
+static void send_subscribe(struct mqtt_client *c) {
+    if (!c->n_subs) return;
+    size_t rem = 2;
+    for (unsigned i = 0; i < c->n_subs; i++) rem += 2 + strlen(c->subs[i].filter) + 1;
+    uint8_t *p = out_reserve(c, 1 + varlen_size(rem) + rem);
+    if (!p) return;
+    *p++ = PKT_SUBSCRIBE;
+    p += put_varlen(p, rem);
+    *p++ = SUB_ID >> 8;
+    *p++ = SUB_ID & 0xFF;
+    for (unsigned i = 0; i < c->n_subs; i++) {
+        p = put_str(p, c->subs[i].filter, strlen(c->subs[i].filter));
+        *p++ = c->subs[i].qos;
+    }
+}
+
+static struct inflight *win_at(const struct mqtt_client *c, unsigned i) {
+    return &c->win[(c->win_head + i) % c->o.window];
+}
+
+static void on_connack(struct mqtt_client *c, const uint8_t *body, size_t len) {
+    if (c->st != ST_CONNACK || len != 2) {
+        conn_lost(c, "unexpected CONNACK");
+        return;
+    }
+    if (body[1] != 0) {
+        char why[48];
+        snprintf(why, sizeof(why), "connection refused (%u)", body[1]);
+        conn_lost(c, why);
+        return;
+    }
+    c->st = ST_UP;
+    c->backoff_ms = MQTT_BACKOFF_MIN_MS;
+    c->stats.connects++;
+    send_subscribe(c);
+    // 断线前未确认的和断线期间新进窗口的，按原顺序发出
+    for (unsigned i = 0; i < c->win_count; i++) {
+        struct inflight *e = win_at(c, i);
+        if (e->acked) continue;
+        uint8_t *p = out_reserve(c, e->len);
+        if (!p) break;
+        if (e->sent) {
+            e->pkt[0] |= PUBLISH_DUP;
+            c->stats.retransmits++;
+        }
+        memcpy(p, e->pkt, e->len);
+        e->sent = true;
+    }
+    conn_flush(c);
+    if (c->st == ST_UP && c->o.on_event) c->o.on_event(c, MQTT_EV_UP, c->o.user);
+}
+
+static void on_puback(struct mqtt_client *c, uint16_t id) {
+    for (unsigned i = 0; i < c->win_count; i++) {
+        struct inflight *e = win_at(c, i);
+        if (e->id != id || e->acked) continue;
+        e->acked = true;
+        c->stats.acked++;
+        break;
+    }
+    while (c->win_count && c->win[c->win_head].acked) {
+        c->win_head = (c->win_head + 1) % c->o.window;
+        c->win_count--;
+        c->acked_pending = true;
+    }
+}
+
+static void on_publish(struct mqtt_client *c, uint8_t flags, const uint8_t *body, size_t len) {
+    uint8_t qos = (flags >> 1) & 3;
+    size_t tlen = len >= 2 ? (size_t)(body[0] << 8 | body[1]) : 0;
+    size_t hdr = 2 + tlen + (qos ? 2 : 0);
+    if (qos > 1 || len < hdr) {
+        conn_lost(c, qos > 1 ? "QoS 2 not supported" : "bad PUBLISH");
+        return;
+    }
+    if (qos) {
+        uint8_t *p = out_reserve(c, 4);
+        if (!p) {
+            conn_lost(c, "out of memory");
+            return;
+        }
+        p[0] = PKT_PUBACK;
+        p[1] = 2;
+        p[2] = body[hdr - 2];
+        p[3] = body[hdr - 1];
+    }
+    c->stats.received++;
+    if (c->o.on_message) {
+        c->o.on_message(c, (const char *)body + 2, tlen, body + hdr, len - hdr, c->o.user);
+    }
+}
+
+static void on_packet(struct mqtt_client *c, uint8_t type, const uint8_t *body, size_t len) {
+    switch (type & 0xF0) {
+    case PKT_CONNACK:
+        on_connack(c, body, len);
+        break;
+    case PKT_PUBLISH:
+        if (c->st == ST_UP) on_publish(c, type & 0x0F, body, len);
+        break;
+    case PKT_PUBACK:
+        if (len == 2) on_puback(c, (uint16_t)(body[0] << 8 | body[1]));
+        break;
+    case PKT_SUBACK:
+        for (size_t i = 2; i < len; i++) {
+            if (body[i] == 0x80) fprintf(stderr, "[mqtt] subscription %s refused\n",
+                                         i - 2 < c->n_subs ? c->subs[i - 2].filter : "?");
+        }
+        break;
+    case PKT_PINGRESP:
+        c->ping_out = false;
+        break;
+    default:
+        break;
+    }
+}
+
+// 解析缓冲里所有完整的包；连接在回调里断开时返回 -1
+static int conn_parse(struct mqtt_client *c) {
+    unsigned gen = c->gen;
+    size_t off = 0;
+    while (c->in_len - off >= 2) {
+        const uint8_t *p = c->in + off;
+        size_t avail = c->in_len - off;
+        size_t rem = 0;
+        size_t hdr = 1;
+        bool done = false;
+        while (!done && hdr < avail) {
+            if (hdr == 5) {
+                conn_lost(c, "bad remaining length");
+                return -1;
+            }
+            uint8_t b = p[hdr];
+            rem |= (size_t)(b & 0x7F) << (7 * (hdr - 1));
+            done = !(b & 0x80);
+            hdr++;
+        }
+        if (!done) break;
+        if (rem > MQTT_MAX_PACKET) {
+            conn_lost(c, "packet too large");
+            return -1;
+        }
+        if (avail - hdr < rem) break;
+        on_packet(c, p[0], p + hdr, rem);
+        if (c->gen != gen) return -1;
+        off += hdr + rem;
+    }
+    if (off) {
+        memmove(c->in, c->in + off, c->in_len - off);
+        c->in_len -= off;
+    }
+    return 0;
+}
+
+static int conn_read(struct mqtt_client *c) {
+    for (int i = 0; i < READS_PER_CALL; i++) {
+        if (c->in_len == c->in_cap) {
+            // 缓冲里总放得下一个最大的包，满了只会是还没到 IN_MAX
+            size_t cap = c->in_cap ? c->in_cap * 2 : IN_INITIAL;
+            if (cap > IN_MAX) cap = IN_MAX;
+            uint8_t *p = realloc(c->in, cap);
+            if (!p) {
+                conn_lost(c, "out of memory");
+                return -1;
+            }
+            c->in = p;
+            c->in_cap = cap;
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n == 0) {
+            conn_lost(c, "closed by broker");
+            return -1;
+        }
+        if (n < 0) {
+            if (errno == EINTR) continue;
+            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+            conn_lost(c, strerror(errno));
+            return -1;
+        }
+        c->in_len += (size_t)n;
+        c->last_rx_ms = i1905_now_ms();
+        if (conn_parse(c) < 0) return -1;
+    }
+    return 0;
+}
+
+struct mqtt_client *mqtt_new(const struct mqtt_opts *opts) {
+    if (!opts || !opts->host || !opts->client_id) return NULL;
+    struct mqtt_client *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->o = *opts;
+    if (!c->o.port) c->o.port = MQTT_DEFAULT_PORT;
+    if (!c->o.keepalive_s) c->o.keepalive_s = MQTT_DEFAULT_KEEPALIVE;
+    if (!c->o.window) c->o.window = MQTT_DEFAULT_WINDOW;
+    if (c->o.window > MQTT_MAX_WINDOW) c->o.window = MQTT_MAX_WINDOW;
+    if (!c->o.max_out) c->o.max_out = MQTT_DEFAULT_MAX_OUT;
+    c->fd = c->watch_fd = -1;
+    c->backoff_ms = MQTT_BACKOFF_MIN_MS;
+    c->next_id = 1;
+
+    // 只在这里解析一次，重连不再查 DNS，免得阻塞调用方的事件循环
+    struct addrinfo hints = { .ai_family = AF_INET, .ai_socktype = SOCK_STREAM };
+    struct addrinfo *ai = NULL;
+    int err = getaddrinfo(opts->host, NULL, &hints, &ai);
+    if (err) {
+        fprintf(stderr, "[mqtt] %s: %s\n", opts->host, gai_strerror(err));
+        free(c);
+        return NULL;
+    }
+    memcpy(&c->addr, ai->ai_addr, sizeof(c->addr));
+    c->addr.sin_port = htons(c->o.port);
+    freeaddrinfo(ai);
+
+    c->client_id = strdup(opts->client_id);
+    c->o.host = strdup(opts->host);
+    c->win = calloc(c->o.window, sizeof(*c->win));
+    if (!c->client_id || !c->o.host || !c->win) {
+        mqtt_free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void mqtt_free(struct mqtt_client *c) {
+    if (!c) return;
+    if (c->fd >= 0) close(c->fd);
+    for (unsigned i = 0; c->win && i < c->o.window; i++) free(c->win[i].pkt);
+    for (unsigned i = 0; i < c->n_subs; i++) free(c->subs[i].filter);
+    free(c->win);
+    free(c->out);
+    free(c->in);
+    free(c->client_id);
+    free((char *)c->o.host);
+    free(c);
+}
+
+int mqtt_subscribe(struct mqtt_client *c, const char *filter, uint8_t qos) {
+    if (!c || !filter || qos > 1 || c->n_subs == MQTT_MAX_SUBS || strlen(filter) > UINT16_MAX) {
+        return -1;
+    }
+    char *f = strdup(filter);
+    if (!f) return -1;
+    c->subs[c->n_subs].filter = f;
+    c->subs[c->n_subs].qos = qos;
+    c->n_subs++;
+    if (c->st == ST_UP) {
+        // 已连上：重发全部订阅，重复订阅对 broker 无副作用
+        send_subscribe(c);
+        conn_flush(c);
+    }
+    return 0;
+}
+
+bool mqtt_can_publish(const struct mqtt_client *c, uint8_t qos) {
+    if (qos) return c->win_count < c->o.window;
+    return c->st == ST_UP && c->out_len - c->out_off < c->o.max_out;
+}
+
+bool mqtt_is_up(const struct mqtt_client *c) {
+    return c->st == ST_UP;
+}
+
+// 包 ID 依次分配，跳过 0 与 SUB_ID；窗口里的 ID 总是最近分配的不超过 window 个，不会撞
+static uint16_t next_packet_id(struct mqtt_client *c) {
+    uint16_t id = c->next_id++;
+    if (c->next_id == SUB_ID) c->next_id = 1;
+    return id;
+}
+
+static void put_publish(uint8_t *p, const char *topic, size_t tlen, const void *payload,
+                        size_t len, uint8_t qos, uint16_t id, size_t rem) {
+    *p++ = (uint8_t)(PKT_PUBLISH | qos << 1);
+    p += put_varlen(p, rem);
+    p = put_str(p, topic, tlen);
+    if (qos) {
+        *p++ = (uint8_t)(id >> 8);
+        *p++ = (uint8_t)id;
+    }
+    if (len) memcpy(p, payload, len);
+}
+
+int mqtt_publish(struct mqtt_client *c, const char *topic, const void *payload, size_t len,
+                 uint8_t qos) {
+    if (!c || !topic || qos > 1) return -1;
+    size_t tlen = strlen(topic);
+    size_t rem = 2 + tlen + (qos ? 2 : 0) + len;
+    if (tlen > UINT16_MAX || rem > MAX_REMAINING) return -1;
+    size_t size = 1 + varlen_size(rem) + rem;
+    if (!mqtt_can_publish(c, qos)) {
+        c->stats.rejected++;
+        return -1;
+    }
+    if (!qos) {
+        uint8_t *p = out_reserve(c, size);
+        if (!p) return -1;
+        put_publish(p, topic, tlen, payload, len, 0, 0, rem);
+        c->stats.published++;
+        conn_flush(c);
+        return 0;
+    }
+
+    struct inflight *e = win_at(c, c->win_count);
+    if (e->cap < size) {
+        uint8_t *p = realloc(e->pkt, size);
+        if (!p) return -1;
+        e->pkt = p;
+        e->cap = size;
+    }
+    e->id = next_packet_id(c);
+    e->sent = e->acked = false;
+    e->len = size;
+    put_publish(e->pkt, topic, tlen, payload, len, 1, e->id, rem);
+    c->win_count++;
+    c->stats.published++;
+    if (c->st == ST_UP) {
+        // 不等前面的 PUBACK，直接跟在后面写出
+        uint8_t *p = out_reserve(c, size);
+        if (!p) {
+            conn_lost(c, "out of memory");
+            return 0;
+        }
+        memcpy(p, e->pkt, size);
+        e->sent = true;
+        conn_flush(c);
+    }
+    return 0;
+}
+
+void mqtt_handle_io(struct mqtt_client *c, bool readable, bool writable) {
+    if (!c || c->fd < 0) return;
+    if (c->st == ST_CONNECTING) {
+        if (!readable && !writable) return;
+        int err = 0;
+        socklen_t len = sizeof(err);
+        if (getsockopt(c->fd, SOL_SOCKET, SO_ERROR, &err, &len) < 0) err = errno;
+        if (err) {
+            conn_lost(c, strerror(err));
+            return;
+        }
+        conn_established(c);
+        return;
+    }
+    if (readable && conn_read(c) < 0) return;
+    if (c->acked_pending) {
+        // 一批 PUBACK 处理完只通知一次，调用方借机攒更大的批
+        c->acked_pending = false;
+        if (c->o.on_event) c->o.on_event(c, MQTT_EV_ACKED, c->o.user);
+    }
+    conn_flush(c);                 // 可写，或刚排了 PUBACK
+}
+
+uint32_t mqtt_next_tick(const struct mqtt_client *c) {
+    uint64_t now = i1905_now_ms();
+    uint64_t at = c->deadline_ms;
+    if (c->st == ST_UP) {
+        uint64_t ka = (uint64_t)c->o.keepalive_s * 1000;
+        at = c->last_rx_ms + ka + ka / 2;
+        if (!c->ping_out && c->last_tx_ms + ka < at) at = c->last_tx_ms + ka;
+    }
+    return at > now ? (uint32_t)(at - now) : 1;
+}
+
+uint32_t mqtt_tick(struct mqtt_client *c) {
+    uint64_t now = i1905_now_ms();
+    switch (c->st) {
+    case ST_WAIT:
+        if (now >= c->deadline_ms) conn_start(c);
+        break;
+    case ST_CONNECTING:
+    case ST_CONNACK:
+        if (now >= c->deadline_ms) conn_lost(c, "connect timeout");
+        break;
+    case ST_UP: {
+        uint64_t ka = (uint64_t)c->o.keepalive_s * 1000;
+        if (now - c->last_rx_ms >= ka + ka / 2) {
+            conn_lost(c, "keepalive timeout");
+        } else if (!c->ping_out && now - c->last_tx_ms >= ka) {
+            uint8_t *p = out_reserve(c, 2);
+            if (p) {
+                p[0] = PKT_PINGREQ;
+                p[1] = 0;
+                c->ping_out = true;
+                conn_flush(c);
+            }
+        }
+        break;
+    }
+    }
+    return mqtt_next_tick(c);
+}
+
+void mqtt_get_stats(const struct mqtt_client *c, struct mqtt_stats *out) {
+    *out = c->stats;
+    out->in_flight = c->win_count;
+}
@@ -0,0 +1,84 @@
+// SPDX-License-Identifier: MIT
+// mqtt: ieee1905d 的 MQTT 3.1.1 客户端，只实现适配器用到的子集：CONNECT、
+// SUBSCRIBE、QoS 0/1 的 PUBLISH/PUBACK 与 PINGREQ。
+// 全程非阻塞，不依赖 uloop：调用方按 on_watch 给出的 fd 与写意愿去监听，就绪时调
+// mqtt_handle_io()，并按 mqtt_tick() 的返回值定时回来；主机名只在 mqtt_new() 时解析一次。
+// - 连接：非阻塞 connect，断线按指数退避重连（MQTT_BACKOFF_MIN_MS 起翻倍，封顶
+//   MQTT_BACKOFF_MAX_MS），连上后重发订阅
+// - QoS 1：发布按窗口流水，最多 window 条未确认同时在途，不逐条等 PUBACK；断线期间
+//   在途的和新发布的都留在窗口里，重连后按原包 ID 带 DUP 依次重发，对端可能收到重复
+// - 写不完的字节留在发送缓冲等可写；QoS 0 在断线或缓冲超过 max_out 时直接拒绝
+// 不依赖 ubus，bench_mqtt 直接链接本模块。
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define MQTT_DEFAULT_PORT      1883
+#define MQTT_DEFAULT_WINDOW    16
+#define MQTT_MAX_WINDOW        256
+#define MQTT_MAX_SUBS          4
+#define MQTT_DEFAULT_KEEPALIVE 30            // 秒
+#define MQTT_DEFAULT_MAX_OUT   (1024 * 1024)
+#define MQTT_MAX_PACKET        (256 * 1024)  // 收到更大的包按协议错误断开
+#define MQTT_BACKOFF_MIN_MS    100
+#define MQTT_BACKOFF_MAX_MS    10000
+#define MQTT_CONNECT_TIMEOUT_MS 5000         // TCP 连接加 CONNACK
+
+enum mqtt_event {
+    MQTT_EV_UP,                // CONNACK 成功，订阅已发出
+    MQTT_EV_DOWN,              // 已连上的连接断开，随后自动重连
+    MQTT_EV_ACKED,             // 窗口腾出了位置
+};
+
+struct mqtt_client;
+
+// topic 不以 '\0' 结尾；两者都只在回调期间有效
+typedef void (*mqtt_message_cb)(struct mqtt_client *c, const char *topic, size_t topic_len,
+                                const uint8_t *payload, size_t len, void *user);
+typedef void (*mqtt_event_cb)(struct mqtt_client *c, enum mqtt_event ev, void *user);
+// fd 或写意愿变化时调用，fd 为 -1 表示等待重连；旧 fd 在回调返回后才关闭
+typedef void (*mqtt_watch_cb)(struct mqtt_client *c, int fd, bool want_write, void *user);
+
+struct mqtt_opts {
+    const char *host;          // IPv4 地址或主机名
+    uint16_t port;             // 0 为 MQTT_DEFAULT_PORT
+    const char *client_id;
+    uint16_t keepalive_s;      // 0 为 MQTT_DEFAULT_KEEPALIVE
+    unsigned window;           // QoS 1 在途上限，0 为 MQTT_DEFAULT_WINDOW
+    size_t max_out;            // 0 为 MQTT_DEFAULT_MAX_OUT
+    mqtt_message_cb on_message;
+    mqtt_event_cb on_event;
+    mqtt_watch_cb on_watch;
+    void *user;
+};
+
+struct mqtt_stats {
+    uint64_t connects;         // 成功的 CONNACK
+    uint64_t disconnects;      // 已连上后断开
+    uint64_t published;        // 接受的发布
+    uint64_t acked;            // 收到 PUBACK 的 QoS 1 发布
+    uint64_t retransmits;      // 重连后重发的在途发布
+    uint64_t received;         // 收到的 PUBLISH
+    uint64_t rejected;         // 窗口或发送缓冲满，发布被拒
+    uint32_t in_flight;        // 当前占用的窗口位置
+};
+
+// 第一次 mqtt_tick() 时开始连接；主机名解析失败返回 NULL
+struct mqtt_client *mqtt_new(const struct mqtt_opts *opts);
+void mqtt_free(struct mqtt_client *c);
+// 记下订阅，每次连上时发出；最多 MQTT_MAX_SUBS 条，qos 0 或 1
+int mqtt_subscribe(struct mqtt_client *c, const char *filter, uint8_t qos);
+// 0 为已接受（QoS 1 进窗口），-1 为窗口满、未连接（仅 QoS 0）或缓冲满
+int mqtt_publish(struct mqtt_client *c, const char *topic, const void *payload, size_t len,
+                 uint8_t qos);
+bool mqtt_can_publish(const struct mqtt_client *c, uint8_t qos);
+bool mqtt_is_up(const struct mqtt_client *c);
+void mqtt_handle_io(struct mqtt_client *c, bool readable, bool writable);
+// 重连与保活，返回距下次需要调用的毫秒数。连接断开或开始重连时 on_watch 必被调用，
+// 定时器挂在别处的调用方可在其中用 mqtt_next_tick() 重排
+uint32_t mqtt_tick(struct mqtt_client *c);
+uint32_t mqtt_next_tick(const struct mqtt_client *c);
+void mqtt_get_stats(const struct mqtt_client *c, struct mqtt_stats *out);
@@ -0,0 +1,344 @@
+// SPDX-License-Identifier: MIT
+// mqtt_bridge: ieee1905d 的 MQTT 适配器，见 mqtt_bridge.h。
+
+#include "mqtt_bridge.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define RECV_FIXED 17              // recv 记录长之后、TLV 链之前的字节
+#define SEND_FIXED 8               // send 同上，不含目的地
+#define TOPIC_MAX  128
+
+struct mqtt_bridge {
+    struct i1905_ctx *ctx;
+    struct mqtt_client *mqtt;
+    struct i1905_timer tick;
+    mqtt_watch_cb on_watch;
+    void *user;
+    char recv_topic[TOPIC_MAX];
+    char send_topic[TOPIC_MAX];
+    size_t batch_bytes;
+    size_t max_pending;
+
+    // 待发的 recv 记录首尾相接，前面空出一个批头：发布时批头写在本批第一条记录
+    // 之前，占用的是上一批的尾巴，那一批已经拷进 MQTT 的窗口，可以覆盖
+    uint8_t *pend;
+    size_t pend_len;               // 记录字节，不含前面的批头
+    size_t pend_cap;
+    struct mqtt_bridge_stats stats;
+};
+
+static void put16(uint8_t *p, uint16_t v) {
+    p[0] = (uint8_t)(v >> 8);
+    p[1] = (uint8_t)v;
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    put16(p, (uint16_t)(v >> 16));
+    put16(p + 2, (uint16_t)v);
+}
+
+static uint16_t get16(const uint8_t *p) {
+    return (uint16_t)(p[0] << 8 | p[1]);
+}
+
+static uint32_t get32(const uint8_t *p) {
+    return (uint32_t)get16(p) << 16 | get16(p + 2);
+}
+
+static size_t rec_size(uint8_t kind, const struct mqtt_batch_rec *rec) {
+    size_t fixed = kind == MQTT_BATCH_RECV ? RECV_FIXED : SEND_FIXED + rec->dst_len;
+    return 4 + fixed + rec->tlv_len;
+}
+
+static void rec_write(uint8_t *p, uint8_t kind, const struct mqtt_batch_rec *rec) {
+    put32(p, (uint32_t)(rec_size(kind, rec) - 4));
+    put16(p + 4, rec->msg_type);
+    put16(p + 6, rec->mid);
+    p[8] = rec->flags;
+    p += 9;
+    if (kind == MQTT_BATCH_RECV) {
+        memcpy(p, rec->src_mac, 6);
+        memcpy(p + 6, rec->al_mac, 6);
+        p += 12;
+    } else {
+        put16(p, rec->port);
+        p[2] = rec->dst_len;
+        if (rec->dst_len) memcpy(p + 3, rec->dst, rec->dst_len);
+        p += 3 + rec->dst_len;
+    }
+    if (rec->tlv_len) memcpy(p, rec->tlv, rec->tlv_len);
+}
+
+int mqtt_batch_iter_init(struct mqtt_batch_iter *it, const uint8_t *buf, size_t len) {
+    if (len < MQTT_BATCH_HDR || buf[0] != MQTT_BATCH_VERSION ||
+        (buf[1] != MQTT_BATCH_RECV && buf[1] != MQTT_BATCH_SEND)) {
+        return -1;
+    }
+    it->pos = buf + MQTT_BATCH_HDR;
+    it->end = buf + len;
+    it->kind = buf[1];
+    it->left = get16(buf + 2);
+    return (int)it->left;
+}
+
+int mqtt_batch_next(struct mqtt_batch_iter *it, struct mqtt_batch_rec *rec) {
+    if (!it->left) return it->pos == it->end ? 0 : -1;
+    size_t avail = (size_t)(it->end - it->pos);
+    if (avail < 4 || get32(it->pos) > avail - 4) return -1;
+    const uint8_t *p = it->pos + 4;
+    const uint8_t *end = p + get32(it->pos);
+    size_t fixed = it->kind == MQTT_BATCH_RECV ? RECV_FIXED : SEND_FIXED;
+    if ((size_t)(end - p) < fixed) return -1;
+    memset(rec, 0, sizeof(*rec));
+    rec->msg_type = get16(p);
+    rec->mid = get16(p + 2);
+    rec->flags = p[4];
+    p += 5;
+    if (it->kind == MQTT_BATCH_RECV) {
+        rec->src_mac = p;
+        rec->al_mac = p + 6;
+        p += 12;
+    } else {
+        rec->port = get16(p);
+        rec->dst_len = p[2];
+        rec->dst = (const char *)p + 3;
+        p += 3;
+        if ((size_t)(end - p) < rec->dst_len) return -1;
+        p += rec->dst_len;
+    }
+    rec->tlv = p;
+    rec->tlv_len = (size_t)(end - p);
+    it->pos = end;
+    it->left--;
+    return 1;
+}
+
+void mqtt_batch_begin(struct mqtt_batch_writer *w, uint8_t *buf, size_t cap, uint8_t kind) {
+    w->buf = buf;
+    w->cap = cap;
+    w->len = MQTT_BATCH_HDR;
+    w->count = 0;
+    w->kind = kind;
+    w->error = cap < MQTT_BATCH_HDR;
+}
+
+void mqtt_batch_put(struct mqtt_batch_writer *w, const struct mqtt_batch_rec *rec) {
+    size_t n = rec_size(w->kind, rec);
+    if (w->error || n > w->cap - w->len || w->count == UINT16_MAX) {
+        w->error = true;
+        return;
+    }
+    rec_write(w->buf + w->len, w->kind, rec);
+    w->len += n;
+    w->count++;
+}
+
+size_t mqtt_batch_finish(struct mqtt_batch_writer *w) {
+    if (w->error) return 0;
+    w->buf[0] = MQTT_BATCH_VERSION;
+    w->buf[1] = w->kind;
+    put16(w->buf + 2, (uint16_t)w->count);
+    return w->len;
+}
+
+void mqtt_bridge_frame(struct mqtt_bridge *b, const struct i1905_cmdu_view *cmdu,
+                       const struct i1905_rx_info *rx) {
+    struct mqtt_batch_rec rec = {
+        .msg_type = cmdu->message_type,
+        .mid = cmdu->message_id,
+        .flags = cmdu->relay ? MQTT_BATCH_F_RELAY : 0,
+        .src_mac = rx->src.mac,
+        .al_mac = rx->al_mac,
+        .tlv = cmdu->tlv_data,
+        .tlv_len = cmdu->tlv_len,
+    };
+    size_t n = rec_size(MQTT_BATCH_RECV, &rec);
+    if (b->pend_len + n > b->max_pending) {
+        b->stats.drops++;
+        return;
+    }
+    if (MQTT_BATCH_HDR + b->pend_len + n > b->pend_cap) {
+        size_t cap = b->pend_cap ? b->pend_cap * 2 : 4096;
+        while (cap < MQTT_BATCH_HDR + b->pend_len + n) cap *= 2;
+        uint8_t *p = realloc(b->pend, cap);
+        if (!p) {
+            b->stats.drops++;
+            return;
+        }
+        b->pend = p;
+        b->pend_cap = cap;
+    }
+    rec_write(b->pend + MQTT_BATCH_HDR + b->pend_len, MQTT_BATCH_RECV, &rec);
+    b->pend_len += n;
+    b->stats.frames++;
+}
+
+void mqtt_bridge_flush(struct mqtt_bridge *b) {
+    uint8_t *base = b->pend + MQTT_BATCH_HDR;
+    size_t off = 0;
+    while (off < b->pend_len && mqtt_can_publish(b->mqtt, 1)) {
+        // 从 off 起取整条记录，至多 batch_bytes，至少一条
+        size_t end = off;
+        unsigned n = 0;
+        while (end < b->pend_len && n < UINT16_MAX) {
+            size_t len = 4 + get32(base + end);
+            if (n && end + len - off > b->batch_bytes) break;
+            end += len;
+            n++;
+        }
+        uint8_t *h = base + off - MQTT_BATCH_HDR;
+        h[0] = MQTT_BATCH_VERSION;
+        h[1] = MQTT_BATCH_RECV;
+        put16(h + 2, (uint16_t)n);
+        if (mqtt_publish(b->mqtt, b->recv_topic, h, MQTT_BATCH_HDR + end - off, 1) < 0) break;
+        b->stats.batches++;
+        off = end;
+    }
+    if (off) {
+        memmove(base, base + off, b->pend_len - off);
+        b->pend_len -= off;
+    }
+}
+
+// send 记录 -> CMDU：TLV 链先查边界再按 schema 校验，经库的 builder 直接组进发送缓冲
+static int send_rec(struct mqtt_bridge *b, const struct mqtt_batch_rec *rec) {
+    struct i1905_cmdu_view view = {
+        .message_type = rec->msg_type,
+        .relay = rec->flags & MQTT_BATCH_F_RELAY,
+        .tlv_data = rec->tlv,
+        .tlv_len = rec->tlv_len,
+    };
+    for (size_t off = 0; off < rec->tlv_len; view.tlv_count++) {
+        if (rec->tlv_len - off < 3) return -1;
+        size_t len = get16(rec->tlv + off + 1);
+        if (rec->tlv_len - off - 3 < len) return -1;
+        off += 3 + len;
+    }
+    if (i1905_cmdu_view_validate(&view) < 0) return -1;
+
+    struct i1905_builder bld;
+    struct i1905_tlv_iter it;
+    struct i1905_tlv_view t;
+    i1905_builder_begin(&bld, b->ctx, rec->msg_type);
+    i1905_builder_set_relay(&bld, view.relay);
+    i1905_tlv_iter_init(&it, &view);
+    while (i1905_tlv_iter_next(&it, &t)) i1905_builder_put_tlv(&bld, t.type, t.value, t.len);
+
+    char dst[256];
+    memcpy(dst, rec->dst, rec->dst_len);
+    dst[rec->dst_len] = '\0';
+    if (rec->mid) i1905_set_reply_mid(b->ctx, rec->mid);
+    return i1905_builder_send(&bld, b->ctx, rec->dst_len ? dst : NULL, rec->port);
+}
+
+static void on_message(struct mqtt_client *c, const char *topic, size_t topic_len,
+                       const uint8_t *payload, size_t len, void *user) {
+    (void)c;
+    struct mqtt_bridge *b = user;
+    if (topic_len != strlen(b->send_topic) || memcmp(topic, b->send_topic, topic_len) != 0) return;
+    struct mqtt_batch_iter it;
+    struct mqtt_batch_rec rec;
+    int rv;
+    if (mqtt_batch_iter_init(&it, payload, len) < 0 || it.kind != MQTT_BATCH_SEND) {
+        b->stats.send_errors++;
+        return;
+    }
+    while ((rv = mqtt_batch_next(&it, &rec)) > 0) {
+        if (send_rec(b, &rec) < 0) b->stats.send_errors++;
+        else b->stats.sent++;
+    }
+    if (rv < 0) b->stats.send_errors++;
+}
+
+static void on_event(struct mqtt_client *c, enum mqtt_event ev, void *user) {
+    (void)c;
+    struct mqtt_bridge *b = user;
+    if (ev == MQTT_EV_UP) fprintf(stderr, "[mqtt] connected, publishing %s\n", b->recv_topic);
+    // 连上或窗口腾出位置：断线和等确认期间攒下的现在发
+    if (ev != MQTT_EV_DOWN) mqtt_bridge_flush(b);
+}
+
+static void on_watch(struct mqtt_client *c, int fd, bool want_write, void *user) {
+    struct mqtt_bridge *b = user;
+    // 断开后按退避时间重连，保活定时此时不再适用
+    i1905_timer_arm(b->ctx, &b->tick, mqtt_next_tick(c));
+    if (b->on_watch) b->on_watch(c, fd, want_write, b->user);
+}
+
+static void tick_cb(struct i1905_timer *t, void *user) {
+    struct mqtt_bridge *b = user;
+    i1905_timer_arm(b->ctx, t, mqtt_tick(b->mqtt));
+}
+
+struct mqtt_bridge *mqtt_bridge_new(struct i1905_ctx *ctx, const struct mqtt_bridge_opts *opts,
+                                    mqtt_watch_cb watch, void *user) {
+    if (!ctx || !opts || !opts->host) return NULL;
+    struct mqtt_bridge *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    b->ctx = ctx;
+    b->on_watch = watch;
+    b->user = user;
+    b->batch_bytes = opts->batch_bytes ? opts->batch_bytes : MQTT_BRIDGE_BATCH_BYTES;
+    b->max_pending = opts->max_pending ? opts->max_pending : MQTT_BRIDGE_MAX_PENDING;
+
+    uint8_t al[6];
+    char id[32];
+    i1905_get_al_mac(ctx, al);
+    const char *prefix = opts->prefix ? opts->prefix : MQTT_BRIDGE_PREFIX;
+    snprintf(id, sizeof(id), "%02x%02x%02x%02x%02x%02x", al[0], al[1], al[2], al[3], al[4], al[5]);
+    if (snprintf(b->recv_topic, TOPIC_MAX, "%s/%s/recv", prefix, id) >= TOPIC_MAX ||
+        snprintf(b->send_topic, TOPIC_MAX, "%s/%s/send", prefix, id) >= TOPIC_MAX) {
+        free(b);
+        return NULL;
+    }
+    snprintf(id, sizeof(id), "ieee1905d-%02x%02x%02x%02x%02x%02x",
+             al[0], al[1], al[2], al[3], al[4], al[5]);
+
+    struct mqtt_opts mo = {
+        .host = opts->host,
+        .port = opts->port,
+        .client_id = id,
+        .window = opts->window,
+        .on_message = on_message,
+        .on_event = on_event,
+        .on_watch = on_watch,
+        .user = b,
+    };
+    b->pend = malloc(MQTT_BATCH_HDR);
+    b->pend_cap = MQTT_BATCH_HDR;
+    b->mqtt = b->pend ? mqtt_new(&mo) : NULL;
+    if (!b->mqtt || mqtt_subscribe(b->mqtt, b->send_topic, 1) < 0) {
+        mqtt_free(b->mqtt);
+        free(b->pend);
+        free(b);
+        return NULL;
+    }
+    i1905_timer_init(&b->tick, tick_cb, b);
+    i1905_timer_arm(ctx, &b->tick, 0);
+    return b;
+}
+
+void mqtt_bridge_free(struct mqtt_bridge *b) {
+    if (!b) return;
+    i1905_timer_cancel(&b->tick);
+    mqtt_free(b->mqtt);
+    free(b->pend);
+    free(b);
+}
+
+void mqtt_bridge_handle_io(struct mqtt_bridge *b, bool readable, bool writable) {
+    mqtt_handle_io(b->mqtt, readable, writable);
+}
+
+bool mqtt_bridge_is_up(const struct mqtt_bridge *b) {
+    return mqtt_is_up(b->mqtt);
+}
+
+void mqtt_bridge_get_stats(const struct mqtt_bridge *b, struct mqtt_bridge_stats *out) {
+    *out = b->stats;
+    out->pending = b->pend_len;
+    mqtt_get_stats(b->mqtt, &out->mqtt);
+}
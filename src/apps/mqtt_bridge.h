@@ -0,0 +1,105 @@
+// SPDX-License-Identifier: MIT
+// mqtt_bridge: ieee1905d 的 MQTT 适配器，在 MQTT 上镜像 ubus 的 recv 事件与 send 方法。
+// - <prefix>/<al_mac>/recv：收到的 CMDU 攒成批，每批一条 QoS 1 发布
+// - <prefix>/<al_mac>/send：订阅（QoS 1），每条消息是一批要发出的 CMDU
+// al_mac 为 12 位小写十六进制，prefix 缺省 "ieee1905"。
+// 攒批不额外等待：每轮收包结束调 mqtt_bridge_flush()，窗口有空位就把攒下的发出去，
+// 每条发布至多 batch_bytes；窗口满（确认跟不上，或断线重连中）时继续攒，超过
+// max_pending 后新收到的丢弃并计数。确认越慢，单条发布里的 CMDU 越多。
+// 重连与保活的定时挂在库的时间轮上，连接 fd 经 on_watch 交给调用方的事件循环。
+// 不依赖 ubus，bench_mqtt 直接链接本模块。
+//
+// 批的编码，多字节字段均为网络字节序：
+//   批头  u8 版本 | u8 种类 | u16 记录数
+//   recv  u32 记录长 | u16 类型 | u16 mid | u8 标志 | src_mac[6] | al_mac[6] | TLV 链
+//   send  u32 记录长 | u16 类型 | u16 mid | u8 标志 | u16 端口 | u8 目的地长 | 目的地 | TLV 链
+// 记录长不含自身 4 字节；TLV 链同 ubus 的 "tlv" 字段（type/len/value，不含
+// end-of-message）。send 的 mid 为 0 时由库分配，否则沿用（应答请求时）；目的地同
+// ubus send 的 dst_ip，可带 %ifname，为空时发组播。标志 bit0 为 relay。
+
+#pragma once
+
+#include "ieee1905.h"
+#include "mqtt.h"
+
+#define MQTT_BATCH_VERSION      1
+#define MQTT_BATCH_RECV         1
+#define MQTT_BATCH_SEND         2
+#define MQTT_BATCH_HDR          4
+#define MQTT_BATCH_F_RELAY      0x01
+#define MQTT_BRIDGE_PREFIX      "ieee1905"
+#define MQTT_BRIDGE_BATCH_BYTES (32 * 1024)
+#define MQTT_BRIDGE_MAX_PENDING (1024 * 1024)
+
+struct mqtt_bridge_opts {
+    const char *host;
+    uint16_t port;             // 0 为 MQTT_DEFAULT_PORT
+    const char *prefix;        // NULL 为 MQTT_BRIDGE_PREFIX
+    unsigned window;           // QoS 1 在途批数，0 为 MQTT_DEFAULT_WINDOW
+    size_t batch_bytes;        // 单条发布的上限（至少一条记录），0 为默认
+    size_t max_pending;        // 攒着未发的上限，0 为默认
+};
+
+struct mqtt_bridge_stats {
+    uint64_t frames;           // 攒进批的 CMDU
+    uint64_t batches;          // recv 发布
+    uint64_t drops;            // 超过 max_pending 丢弃的 CMDU
+    uint64_t sent;             // 经 send 主题发出的 CMDU
+    uint64_t send_errors;      // 批格式错误、TLV 校验不过或库发送失败
+    uint64_t pending;          // 攒着未发的字节
+    struct mqtt_stats mqtt;
+};
+
+// 一条记录；recv 用 src_mac/al_mac，send 用 port/dst
+struct mqtt_batch_rec {
+    uint16_t msg_type;
+    uint16_t mid;
+    uint8_t flags;
+    const uint8_t *src_mac;
+    const uint8_t *al_mac;
+    uint16_t port;
+    const char *dst;           // 不以 '\0' 结尾
+    uint8_t dst_len;
+    const uint8_t *tlv;
+    size_t tlv_len;
+};
+
+struct mqtt_batch_iter {
+    const uint8_t *pos;
+    const uint8_t *end;
+    uint8_t kind;
+    unsigned left;
+};
+
+// 往调用方的缓冲里编码一批，放不下时 error 置位，finish 返回 0
+struct mqtt_batch_writer {
+    uint8_t *buf;
+    size_t cap;
+    size_t len;
+    unsigned count;
+    uint8_t kind;
+    bool error;
+};
+
+struct mqtt_bridge;
+
+// 连接在库的下一个时间轮刻度开始；on_watch 同 mqtt_opts
+struct mqtt_bridge *mqtt_bridge_new(struct i1905_ctx *ctx, const struct mqtt_bridge_opts *opts,
+                                    mqtt_watch_cb on_watch, void *user);
+void mqtt_bridge_free(struct mqtt_bridge *b);
+// 在库的事件回调里调用，只拷进待发缓冲
+void mqtt_bridge_frame(struct mqtt_bridge *b, const struct i1905_cmdu_view *cmdu,
+                       const struct i1905_rx_info *rx);
+// 一轮收包结束后调用
+void mqtt_bridge_flush(struct mqtt_bridge *b);
+void mqtt_bridge_handle_io(struct mqtt_bridge *b, bool readable, bool writable);
+bool mqtt_bridge_is_up(const struct mqtt_bridge *b);
+void mqtt_bridge_get_stats(const struct mqtt_bridge *b, struct mqtt_bridge_stats *out);
+
+// 批的编解码，供云端或测试一侧使用。init 返回记录数，批头不对返回 -1；
+// next 取到一条返回 1，取完返回 0，格式错误返回 -1
+int mqtt_batch_iter_init(struct mqtt_batch_iter *it, const uint8_t *buf, size_t len);
+int mqtt_batch_next(struct mqtt_batch_iter *it, struct mqtt_batch_rec *rec);
+void mqtt_batch_begin(struct mqtt_batch_writer *w, uint8_t *buf, size_t cap, uint8_t kind);
+void mqtt_batch_put(struct mqtt_batch_writer *w, const struct mqtt_batch_rec *rec);
+size_t mqtt_batch_finish(struct mqtt_batch_writer *w);
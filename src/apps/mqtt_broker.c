@@ -0,0 +1,515 @@
+// SPDX-License-Identifier: MIT
+// mqtt_broker: 自测用的最小 MQTT broker，见 mqtt_broker.h。
+
+#define _GNU_SOURCE // accept4
+#include "mqtt_broker.h"
+
+#include <errno.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <sys/epoll.h>
+#include <sys/socket.h>
+
+#define MAX_EVENTS     64
+#define MAX_PACKET     (1024 * 1024)
+#define ID_MAX         64
+#define READS_PER_CALL 16
+
+struct bsub {
+    char *filter;
+    uint8_t qos;
+};
+
+struct bclient {
+    int fd;
+    bool connected;            // 收到了 CONNECT
+    bool dead;                 // 本轮结束时关闭，免得在遍历中途释放
+    bool want_out;             // 已登记 EPOLLOUT
+    char id[ID_MAX];
+    uint8_t *in;
+    size_t in_len;
+    size_t in_cap;
+    uint8_t *out;
+    size_t out_off;
+    size_t out_len;
+    size_t out_cap;
+    struct bsub *subs;
+    unsigned n_subs;
+    uint16_t next_id;          // 转发 QoS 1 用的包 ID
+};
+
+struct mqtt_broker {
+    int lfd;
+    int epfd;
+    uint16_t port;
+    struct bclient **clients;
+    unsigned n_clients;
+    unsigned cap;
+    unsigned anon;             // 空 client id 的编号
+    struct broker_stats stats;
+};
+
+static size_t varlen_size(size_t n) {
+    return n < 128 ? 1 : n < 16384 ? 2 : n < 2097152 ? 3 : 4;
+}
+
+static size_t put_varlen(uint8_t *p, size_t n) {
+    size_t i = 0;
+    do {
+        uint8_t v = n & 0x7F;
+        n >>= 7;
+        p[i++] = n ? (uint8_t)(v | 0x80) : v;
+    } while (n);
+    return i;
+}
+
+static void kill_client(struct bclient *c, uint64_t *counter) {
+    if (c->dead) return;
+    c->dead = true;
+    if (counter) (*counter)++;
+}
+
+static uint8_t *out_reserve(struct mqtt_broker *b, struct bclient *c, size_t n) {
+    if (c->dead) return NULL;
+    if (c->out_len - c->out_off + n > BROKER_MAX_OUT) {
+        kill_client(c, &b->stats.slow);
+        return NULL;
+    }
+    if (c->out_len + n > c->out_cap && c->out_off) {
+        memmove(c->out, c->out + c->out_off, c->out_len - c->out_off);
+        c->out_len -= c->out_off;
+        c->out_off = 0;
+    }
+    if (c->out_len + n > c->out_cap) {
+        size_t cap = c->out_cap ? c->out_cap : 4096;
+        while (cap < c->out_len + n) cap *= 2;
+        uint8_t *p = realloc(c->out, cap);
+        if (!p) {
+            kill_client(c, &b->stats.errors);
+            return NULL;
+        }
+        c->out = p;
+        c->out_cap = cap;
+    }
+    uint8_t *p = c->out + c->out_len;
+    c->out_len += n;
+    return p;
+}
+
+static void send_short(struct mqtt_broker *b, struct bclient *c, uint8_t type, uint16_t id,
+                       bool with_id) {
+    uint8_t *p = out_reserve(b, c, with_id ? 4 : 2);
+    if (!p) return;
+    p[0] = type;
+    p[1] = with_id ? 2 : 0;
+    if (with_id) {
+        p[2] = (uint8_t)(id >> 8);
+        p[3] = (uint8_t)id;
+    }
+}
+
+// '+' 匹配一层，'#' 匹配其余各层（含父层本身，"a/#" 匹配 "a"）
+static bool topic_match(const char *f, const char *t, size_t tlen) {
+    const char *tend = t + tlen;
+    while (*f) {
+        if (*f == '#') return true;
+        if (*f == '+') {
+            while (t < tend && *t != '/') t++;
+            f++;
+        } else {
+            while (*f && *f != '/') {
+                if (t == tend || *t != *f) return false;
+                t++;
+                f++;
+            }
+        }
+        if (!*f) break;
+        // 过滤器在 '/' 上
+        if (t == tend) return f[1] == '#' && !f[2];
+        if (*t != '/') return false;
+        f++;
+        t++;
+    }
+    return t == tend;
+}
+
+// 读 u16 长度前缀的字符串，越界返回 NULL
+static const uint8_t *get_str(const uint8_t *p, const uint8_t *end, const uint8_t **s,
+                              size_t *len) {
+    if (end - p < 2) return NULL;
+    *len = (size_t)(p[0] << 8 | p[1]);
+    if ((size_t)(end - p - 2) < *len) return NULL;
+    *s = p + 2;
+    return p + 2 + *len;
+}
+
+static int on_connect(struct mqtt_broker *b, struct bclient *c, const uint8_t *p, size_t len) {
+    const uint8_t *end = p + len;
+    const uint8_t *s;
+    size_t n;
+    if (!(p = get_str(p, end, &s, &n)) || end - p < 4) return -1;
+    uint8_t flags = p[1];
+    p += 4;                        // 协议级别、标志、keepalive
+    if (!(p = get_str(p, end, &s, &n))) return -1;
+    if (n) {
+        snprintf(c->id, sizeof(c->id), "%.*s", (int)(n < ID_MAX ? n : ID_MAX - 1), (const char *)s);
+    } else {
+        snprintf(c->id, sizeof(c->id), "anon-%u", ++b->anon);
+    }
+    if (flags & 0x04) {            // 遗嘱：主题与内容，不用
+        if (!(p = get_str(p, end, &s, &n)) || !(p = get_str(p, end, &s, &n))) return -1;
+    }
+    if ((flags & 0x80) && !(p = get_str(p, end, &s, &n))) return -1;
+    if ((flags & 0x40) && !get_str(p, end, &s, &n)) return -1;
+
+    // 同一 client id 再次连接时顶掉旧连接
+    for (unsigned i = 0; i < b->n_clients; i++) {
+        struct bclient *o = b->clients[i];
+        if (o != c && o->connected && !o->dead && strcmp(o->id, c->id) == 0) kill_client(o, NULL);
+    }
+    c->connected = true;
+    b->stats.connects++;
+    uint8_t *r = out_reserve(b, c, 4);
+    if (r) {
+        r[0] = 0x20;
+        r[1] = 2;
+        r[2] = 0;
+        r[3] = 0;                  // 接受
+    }
+    return 0;
+}
+
+static void deliver(struct mqtt_broker *b, struct bclient *c, const uint8_t *topic, size_t tlen,
+                    const uint8_t *payload, size_t len, uint8_t qos) {
+    size_t rem = 2 + tlen + (qos ? 2 : 0) + len;
+    uint8_t *p = out_reserve(b, c, 1 + varlen_size(rem) + rem);
+    if (!p) return;
+    *p++ = (uint8_t)(0x30 | qos << 1);
+    p += put_varlen(p, rem);
+    *p++ = (uint8_t)(tlen >> 8);
+    *p++ = (uint8_t)tlen;
+    memcpy(p, topic, tlen);
+    p += tlen;
+    if (qos) {
+        if (!++c->next_id) c->next_id = 1;
+        *p++ = (uint8_t)(c->next_id >> 8);
+        *p++ = (uint8_t)c->next_id;
+    }
+    memcpy(p, payload, len);
+    b->stats.publishes_out++;
+}
+
+static int on_publish(struct mqtt_broker *b, struct bclient *c, uint8_t flags, const uint8_t *p,
+                      size_t len) {
+    const uint8_t *end = p + len;
+    const uint8_t *topic;
+    size_t tlen;
+    uint8_t qos = (flags >> 1) & 3;
+    if (qos > 1 || !(p = get_str(p, end, &topic, &tlen)) || !tlen) return -1;
+    if (qos) {
+        if (end - p < 2) return -1;
+        send_short(b, c, 0x40, (uint16_t)(p[0] << 8 | p[1]), true);
+        p += 2;
+    }
+    b->stats.publishes_in++;
+    for (unsigned i = 0; i < b->n_clients; i++) {
+        struct bclient *o = b->clients[i];
+        if (!o->connected || o->dead) continue;
+        int best = -1;
+        for (unsigned k = 0; k < o->n_subs; k++) {
+            if (o->subs[k].qos > best && topic_match(o->subs[k].filter, (const char *)topic, tlen)) {
+                best = o->subs[k].qos;
+            }
+        }
+        if (best >= 0) deliver(b, o, topic, tlen, p, (size_t)(end - p), qos < best ? qos : (uint8_t)best);
+    }
+    return 0;
+}
+
+static int on_subscribe(struct mqtt_broker *b, struct bclient *c, const uint8_t *p, size_t len,
+                        bool unsub) {
+    const uint8_t *end = p + len;
+    if (len < 2) return -1;
+    uint16_t id = (uint16_t)(p[0] << 8 | p[1]);
+    p += 2;
+    uint8_t granted[64];
+    unsigned n = 0;
+    while (p < end) {
+        const uint8_t *f;
+        size_t flen;
+        if (!(p = get_str(p, end, &f, &flen)) || !flen || (!unsub && p == end)) return -1;
+        uint8_t qos = unsub ? 0 : *p++;
+        unsigned k = 0;
+        while (k < c->n_subs && (strlen(c->subs[k].filter) != flen ||
+                                 memcmp(c->subs[k].filter, f, flen) != 0)) {
+            k++;
+        }
+        if (unsub) {
+            if (k < c->n_subs) {
+                free(c->subs[k].filter);
+                c->subs[k] = c->subs[--c->n_subs];
+            }
+            continue;
+        }
+        if (n == sizeof(granted)) return -1;
+        if (k == c->n_subs) {
+            struct bsub *s = realloc(c->subs, (c->n_subs + 1) * sizeof(*s));
+            char *copy = s ? strndup((const char *)f, flen) : NULL;
+            if (s) c->subs = s;
+            if (!copy) return -1;
+            c->subs[c->n_subs].filter = copy;
+            c->n_subs++;
+        }
+        c->subs[k].qos = qos > 1 ? 1 : qos;
+        granted[n++] = c->subs[k].qos;
+    }
+    if (unsub) {
+        send_short(b, c, 0xB0, id, true);
+        return 0;
+    }
+    if (!n) return -1;
+    uint8_t *r = out_reserve(b, c, 4 + n);
+    if (r) {
+        r[0] = 0x90;
+        r[1] = (uint8_t)(2 + n);
+        r[2] = (uint8_t)(id >> 8);
+        r[3] = (uint8_t)id;
+        memcpy(r + 4, granted, n);
+    }
+    return 0;
+}
+
+static int on_packet(struct mqtt_broker *b, struct bclient *c, uint8_t type, const uint8_t *p,
+                     size_t len) {
+    if (!c->connected) return (type & 0xF0) == 0x10 ? on_connect(b, c, p, len) : -1;
+    switch (type & 0xF0) {
+    case 0x30:
+        return on_publish(b, c, type & 0x0F, p, len);
+    case 0x40:                     // 转发出去的 QoS 1 不重传，确认无需处理
+        return 0;
+    case 0x80:
+        return on_subscribe(b, c, p, len, false);
+    case 0xA0:
+        return on_subscribe(b, c, p, len, true);
+    case 0xC0:
+        send_short(b, c, 0xD0, 0, false);
+        return 0;
+    case 0xE0:
+        kill_client(c, NULL);
+        return 0;
+    default:
+        return -1;
+    }
+}
+
+static void client_parse(struct mqtt_broker *b, struct bclient *c) {
+    size_t off = 0;
+    while (!c->dead && c->in_len - off >= 2) {
+        const uint8_t *p = c->in + off;
+        size_t avail = c->in_len - off;
+        size_t rem = 0;
+        size_t hdr = 1;
+        bool done = false;
+        while (!done && hdr < avail && hdr < 5) {
+            rem |= (size_t)(p[hdr] & 0x7F) << (7 * (hdr - 1));
+            done = !(p[hdr] & 0x80);
+            hdr++;
+        }
+        if (!done && hdr == 5) rem = MAX_PACKET + 1;
+        else if (!done) break;
+        if (rem > MAX_PACKET || (avail - hdr >= rem && on_packet(b, c, p[0], p + hdr, rem) < 0)) {
+            kill_client(c, &b->stats.errors);
+            return;
+        }
+        if (avail - hdr < rem) break;
+        off += hdr + rem;
+    }
+    if (off && !c->dead) {
+        memmove(c->in, c->in + off, c->in_len - off);
+        c->in_len -= off;
+    }
+}
+
+static void client_read(struct mqtt_broker *b, struct bclient *c) {
+    for (int i = 0; i < READS_PER_CALL && !c->dead; i++) {
+        if (c->in_len == c->in_cap) {
+            size_t cap = c->in_cap ? c->in_cap * 2 : 16384;
+            if (cap > MAX_PACKET + 5) cap = MAX_PACKET + 5;
+            uint8_t *p = realloc(c->in, cap);
+            if (!p) {
+                kill_client(c, &b->stats.errors);
+                return;
+            }
+            c->in = p;
+            c->in_cap = cap;
+        }
+        ssize_t n = recv(c->fd, c->in + c->in_len, c->in_cap - c->in_len, 0);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0 && (errno == EAGAIN || errno == EWOULDBLOCK)) return;
+        if (n <= 0) {
+            kill_client(c, NULL);
+            return;
+        }
+        c->in_len += (size_t)n;
+        b->stats.bytes_in += (uint64_t)n;
+        client_parse(b, c);
+    }
+}
+
+static void client_flush(struct mqtt_broker *b, struct bclient *c) {
+    while (c->out_off < c->out_len) {
+        ssize_t n = send(c->fd, c->out + c->out_off, c->out_len - c->out_off, MSG_NOSIGNAL);
+        if (n < 0 && errno == EINTR) continue;
+        if (n < 0) {
+            if (errno != EAGAIN && errno != EWOULDBLOCK) kill_client(c, NULL);
+            break;
+        }
+        c->out_off += (size_t)n;
+        b->stats.bytes_out += (uint64_t)n;
+    }
+    if (c->out_off == c->out_len) c->out_off = c->out_len = 0;
+    bool want = c->out_len > 0;
+    if (!c->dead && want != c->want_out) {
+        struct epoll_event ev = { .events = EPOLLIN | (want ? EPOLLOUT : 0), .data.ptr = c };
+        epoll_ctl(b->epfd, EPOLL_CTL_MOD, c->fd, &ev);
+        c->want_out = want;
+    }
+}
+
+// 关掉本轮标记的客户端
+static void sweep(struct mqtt_broker *b) {
+    unsigned k = 0;
+    for (unsigned i = 0; i < b->n_clients; i++) {
+        struct bclient *c = b->clients[i];
+        if (!c->dead) {
+            b->clients[k++] = c;
+            continue;
+        }
+        close(c->fd);
+        for (unsigned s = 0; s < c->n_subs; s++) free(c->subs[s].filter);
+        free(c->subs);
+        free(c->in);
+        free(c->out);
+        free(c);
+    }
+    b->n_clients = k;
+    b->stats.clients = k;
+}
+
+static void accept_all(struct mqtt_broker *b) {
+    for (;;) {
+        int fd = accept4(b->lfd, NULL, NULL, SOCK_NONBLOCK | SOCK_CLOEXEC);
+        if (fd < 0) return;
+        if (b->n_clients == b->cap) {
+            unsigned cap = b->cap ? b->cap * 2 : 16;
+            struct bclient **p = realloc(b->clients, cap * sizeof(*p));
+            if (!p) {
+                close(fd);
+                return;
+            }
+            b->clients = p;
+            b->cap = cap;
+        }
+        struct bclient *c = calloc(1, sizeof(*c));
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = c };
+        if (!c || epoll_ctl(b->epfd, EPOLL_CTL_ADD, fd, &ev) < 0) {
+            free(c);
+            close(fd);
+            continue;
+        }
+        int one = 1;
+        setsockopt(fd, IPPROTO_TCP, TCP_NODELAY, &one, sizeof(one));
+        c->fd = fd;
+        b->clients[b->n_clients++] = c;
+        b->stats.clients = b->n_clients;
+    }
+}
+
+struct mqtt_broker *broker_new(const char *addr, uint16_t port) {
+    struct mqtt_broker *b = calloc(1, sizeof(*b));
+    if (!b) return NULL;
+    struct sockaddr_in sa = { .sin_family = AF_INET, .sin_port = htons(port) };
+    if (addr && inet_pton(AF_INET, addr, &sa.sin_addr) != 1) {
+        fprintf(stderr, "[broker] bad address %s\n", addr);
+        free(b);
+        return NULL;
+    }
+    b->epfd = epoll_create1(EPOLL_CLOEXEC);
+    b->lfd = socket(AF_INET, SOCK_STREAM | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    int one = 1;
+    socklen_t len = sizeof(sa);
+    struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+    if (b->epfd < 0 || b->lfd < 0 ||
+        setsockopt(b->lfd, SOL_SOCKET, SO_REUSEADDR, &one, sizeof(one)) < 0 ||
+        bind(b->lfd, (const struct sockaddr *)&sa, sizeof(sa)) < 0 || listen(b->lfd, 64) < 0 ||
+        getsockname(b->lfd, (struct sockaddr *)&sa, &len) < 0 ||
+        epoll_ctl(b->epfd, EPOLL_CTL_ADD, b->lfd, &ev) < 0) {
+        perror("[broker] listen");
+        if (b->lfd >= 0) close(b->lfd);
+        if (b->epfd >= 0) close(b->epfd);
+        free(b);
+        return NULL;
+    }
+    b->port = ntohs(sa.sin_port);
+    return b;
+}
+
+void broker_free(struct mqtt_broker *b) {
+    if (!b) return;
+    for (unsigned i = 0; i < b->n_clients; i++) b->clients[i]->dead = true;
+    sweep(b);
+    free(b->clients);
+    close(b->lfd);
+    close(b->epfd);
+    free(b);
+}
+
+uint16_t broker_port(const struct mqtt_broker *b) {
+    return b->port;
+}
+
+int broker_fd(const struct mqtt_broker *b) {
+    return b->epfd;
+}
+
+int broker_run(struct mqtt_broker *b, int timeout_ms) {
+    struct epoll_event ev[MAX_EVENTS];
+    int n = epoll_wait(b->epfd, ev, MAX_EVENTS, timeout_ms);
+    if (n < 0) return errno == EINTR ? 0 : -1;
+    for (int i = 0; i < n; i++) {
+        struct bclient *c = ev[i].data.ptr;
+        if (!c) {
+            accept_all(b);
+        } else if (!c->dead && (ev[i].events & (EPOLLIN | EPOLLHUP | EPOLLERR))) {
+            client_read(b, c);
+        }
+    }
+    // 一轮的转发都排好后再统一写，多条发布合进一次 send
+    for (unsigned i = 0; i < b->n_clients; i++) {
+        struct bclient *c = b->clients[i];
+        if (!c->dead && (c->out_len || c->want_out)) client_flush(b, c);
+    }
+    sweep(b);
+    return n;
+}
+
+unsigned broker_kick(struct mqtt_broker *b, const char *client_id) {
+    unsigned n = 0;
+    for (unsigned i = 0; i < b->n_clients; i++) {
+        struct bclient *c = b->clients[i];
+        if (c->dead || (client_id && strcmp(c->id, client_id) != 0)) continue;
+        kill_client(c, &b->stats.kicked);
+        n++;
+    }
+    sweep(b);
+    return n;
+}
+
+void broker_get_stats(const struct mqtt_broker *b, struct broker_stats *out) {
+    *out = b->stats;
+}
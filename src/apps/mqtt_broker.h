@@ -0,0 +1,43 @@
+// SPDX-License-Identifier: MIT
+// mqtt_broker: 最小的 MQTT 3.1.1 broker，给 MQTT 适配器联调和自测用，不是生产 broker。
+// 单线程 epoll，可嵌进别的事件循环（broker_fd() 可读时调 broker_run(b, 0)）。
+// - 会话不持久（按 clean session 处理），没有保留消息，遗嘱和用户名密码解析后忽略
+// - 订阅支持 + 与 # 通配符；发布按 min(发布 QoS, 订阅 QoS) 转给每个匹配的客户端，
+//   一个客户端多个订阅匹配时只收一份；QoS 2 按协议错误断开
+// - QoS 1 收到即回 PUBACK；转发出去的 QoS 1 不等确认也不重传，连接断开即丢弃
+// - 发送缓冲超过 BROKER_MAX_OUT 的慢客户端直接断开
+// - broker_kick() 断开指定或全部客户端，模拟网络故障
+// 不依赖 ieee1905 库和 ubus，ezz_broker 与 bench_mqtt 链接本模块。
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define BROKER_MAX_OUT  (8 * 1024 * 1024)
+
+struct broker_stats {
+    uint64_t clients;          // 当前连接数
+    uint64_t connects;
+    uint64_t publishes_in;
+    uint64_t publishes_out;
+    uint64_t bytes_in;
+    uint64_t bytes_out;
+    uint64_t kicked;           // broker_kick() 断开的
+    uint64_t slow;             // 发送缓冲超限断开的
+    uint64_t errors;           // 协议错误断开的
+};
+
+struct mqtt_broker;
+
+// addr 为 NULL 时监听所有地址；port 为 0 时由内核选，见 broker_port()
+struct mqtt_broker *broker_new(const char *addr, uint16_t port);
+void broker_free(struct mqtt_broker *b);
+uint16_t broker_port(const struct mqtt_broker *b);
+int broker_fd(const struct mqtt_broker *b);
+// 处理就绪的连接，timeout_ms 同 epoll_wait；返回处理的事件数
+int broker_run(struct mqtt_broker *b, int timeout_ms);
+// client_id 为 NULL 时断开全部，返回断开的个数
+unsigned broker_kick(struct mqtt_broker *b, const char *client_id);
+void broker_get_stats(const struct mqtt_broker *b, struct broker_stats *out);
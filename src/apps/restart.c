@@ -0,0 +1,328 @@
+// SPDX-License-Identifier: MIT
+// restart: ieee1905d 快照与 socket 交接，见 restart.h。
+
+#define _GNU_SOURCE // MSG_CMSG_CLOEXEC
+#include "restart.h"
+
+#include <errno.h>
+#include <fcntl.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <sys/stat.h>
+#include <sys/uio.h>
+#include <sys/un.h>
+
+// 文件头之后依次是 dev[cap]、index[buckets]、free_slots[cap]、removed[]、links[n_links]，
+// 均为本机字节序和本次编译的结构体布局；布局变了（大小不符）就当作不匹配
+struct snap_hdr {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t hdr_size;
+    uint16_t dev_size;
+    uint16_t link_size;
+    uint16_t removed_size;
+    uint8_t  al_mac[6];
+    uint16_t message_id;
+    uint8_t  clean;
+    uint32_t cap;
+    uint32_t buckets;
+    uint32_t count;
+    uint32_t n_free;
+    uint32_t n_links;
+    uint32_t removed_next;
+    uint32_t delta_floor;
+    uint32_t gen;
+    uint32_t local;
+    uint32_t checksum;         // 正文的 FNV-1a
+    uint64_t saved_mono_ms;
+    uint64_t saved_real_ms;
+    uint64_t body_len;
+};
+
+struct handoff_msg {
+    uint32_t magic;
+    uint32_t n;
+    char names[I1905_MAX_INTERFACES][I1905_IFNAME_LEN];
+    uint32_t state[I1905_MAX_INTERFACES];
+};
+
+static uint64_t real_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static uint32_t fnv1a(uint32_t h, const void *p, size_t len) {
+    const uint8_t *b = p;
+    for (size_t i = 0; i < len; i++) h = (h ^ b[i]) * 16777619u;
+    return h;
+}
+
+// 正文各段，保存与载入共用同一顺序
+static unsigned body_parts(const struct topo_db *db, struct iovec *iov) {
+    iov[0] = (struct iovec){ db->dev, db->cap * sizeof(*db->dev) };
+    iov[1] = (struct iovec){ db->index, (db->index_mask + 1) * sizeof(*db->index) };
+    iov[2] = (struct iovec){ db->free_slots, db->cap * sizeof(*db->free_slots) };
+    iov[3] = (struct iovec){ (void *)db->removed, sizeof(db->removed) };
+    iov[4] = (struct iovec){ db->links, db->n_links * sizeof(*db->links) };
+    return 5;
+}
+
+int snapshot_save(const char *path, const struct topo_db *db, const uint8_t al_mac[6],
+                  uint16_t message_id, bool clean) {
+    struct snap_hdr h;
+    struct iovec iov[6];
+    memset(&h, 0, sizeof(h));
+    unsigned n = 1 + body_parts(db, iov + 1);
+    for (unsigned i = 1; i < n; i++) h.body_len += iov[i].iov_len;
+    h.checksum = 2166136261u;
+    for (unsigned i = 1; i < n; i++) h.checksum = fnv1a(h.checksum, iov[i].iov_base, iov[i].iov_len);
+    h.magic = SNAPSHOT_MAGIC;
+    h.version = SNAPSHOT_VERSION;
+    h.hdr_size = sizeof(h);
+    h.dev_size = sizeof(struct topo_device);
+    h.link_size = sizeof(struct topo_link);
+    h.removed_size = sizeof(struct topo_removed);
+    memcpy(h.al_mac, al_mac, 6);
+    h.message_id = message_id;
+    h.clean = clean;
+    h.cap = db->cap;
+    h.buckets = db->index_mask + 1;
+    h.count = db->count;
+    h.n_free = db->n_free;
+    h.n_links = db->n_links;
+    h.removed_next = db->removed_next;
+    h.delta_floor = db->delta_floor;
+    h.gen = db->gen;
+    h.local = db->local;
+    h.saved_mono_ms = i1905_now_ms();
+    h.saved_real_ms = real_ms();
+    iov[0] = (struct iovec){ &h, sizeof(h) };
+
+    char tmp[256];
+    if (snprintf(tmp, sizeof(tmp), "%s.tmp", path) >= (int)sizeof(tmp)) return -1;
+    int fd = open(tmp, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0600);
+    if (fd < 0) return -1;
+    // 普通文件的 writev 不会写一半，短写即视为失败（磁盘满等）
+    ssize_t w = writev(fd, iov, (int)n);
+    int rv = close(fd);
+    if (w != (ssize_t)(sizeof(h) + h.body_len) || rv < 0 || rename(tmp, path) < 0) {
+        unlink(tmp);
+        return -1;
+    }
+    return 0;
+}
+
+// 下标越界的快照不能用：校验和只防损坏，防不住同布局下的逻辑错误
+static bool snapshot_sane(const struct topo_db *db) {
+    if (db->local >= db->cap || !db->dev[db->local].used || !db->dev[db->local].local ||
+        db->n_free > db->cap || db->count + db->n_free != db->cap) {
+        return false;
+    }
+    for (uint32_t i = 0; i < db->cap; i++) {
+        if (db->dev[i].n_ifaces > TOPO_MAX_IFACES) return false;
+    }
+    for (uint32_t i = 0; i < db->n_free; i++) {
+        if (db->free_slots[i] >= db->cap || db->dev[db->free_slots[i]].used) return false;
+    }
+    for (uint32_t i = 0; i <= db->index_mask; i++) {
+        int32_t k = db->index[i];
+        if (k >= 0 && ((uint32_t)k >= db->cap || !db->dev[k].used)) return false;
+    }
+    for (uint32_t i = 0; i < db->n_links; i++) {
+        const struct topo_link *l = &db->links[i];
+        if (l->a >= db->cap || l->b >= db->cap || !db->dev[l->a].used || !db->dev[l->b].used) {
+            return false;
+        }
+    }
+    return true;
+}
+
+// 存的是旧单调时钟上的时间点：先换成写快照时的年龄，加上停机时长，再落到现在的
+// 单调时钟上。重启后单调时钟从零开始，年龄超过开机时长的只能记为 0
+static uint64_t rebase(uint64_t t, uint64_t saved_mono, uint64_t down, uint64_t now) {
+    uint64_t age = (t < saved_mono ? saved_mono - t : 0) + down;
+    return now > age ? now - age : 0;
+}
+
+int snapshot_load(const char *path, struct topo_db *db, uint32_t max_devices,
+                  struct snapshot_info *info) {
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    if (fd < 0) return errno == ENOENT ? 1 : -1;
+    struct stat st;
+    if (fstat(fd, &st) < 0 || (size_t)st.st_size < sizeof(struct snap_hdr)) {
+        close(fd);
+        return -1;
+    }
+    const uint8_t *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    close(fd);
+    if (map == MAP_FAILED) return -1;
+
+    struct snap_hdr h;
+    memcpy(&h, map, sizeof(h));
+    uint32_t buckets = 1;
+    while (buckets < max_devices * 2) buckets <<= 1;
+    uint64_t body = (uint64_t)max_devices * (sizeof(struct topo_device) + sizeof(uint32_t)) +
+                    (uint64_t)buckets * sizeof(int32_t) + sizeof(db->removed) +
+                    (uint64_t)h.n_links * sizeof(struct topo_link);
+    int rv = -1;
+    if (h.magic != SNAPSHOT_MAGIC || h.version != SNAPSHOT_VERSION || h.hdr_size != sizeof(h) ||
+        h.dev_size != sizeof(struct topo_device) || h.link_size != sizeof(struct topo_link) ||
+        h.removed_size != sizeof(struct topo_removed) || h.cap != max_devices ||
+        h.buckets != buckets || h.body_len != body || body != (uint64_t)st.st_size - sizeof(h) ||
+        fnv1a(2166136261u, map + sizeof(h), h.body_len) != h.checksum ||
+        topo_init(db, max_devices, h.al_mac) < 0) {
+        goto out;
+    }
+    if (h.n_links) {
+        db->links = malloc(h.n_links * sizeof(*db->links));
+        if (!db->links) {
+            topo_free(db);
+            goto out;
+        }
+        db->link_cap = h.n_links;
+    }
+    db->n_links = h.n_links;
+    struct iovec iov[5];
+    unsigned n = body_parts(db, iov);
+    const uint8_t *p = map + sizeof(h);
+    for (unsigned i = 0; i < n; i++) {
+        memcpy(iov[i].iov_base, p, iov[i].iov_len);
+        p += iov[i].iov_len;
+    }
+    db->count = h.count;
+    db->n_free = h.n_free;
+    db->removed_next = h.removed_next;
+    db->delta_floor = h.delta_floor;
+    db->gen = h.gen;
+    db->local = h.local;
+    if (!snapshot_sane(db)) {
+        topo_free(db);
+        goto out;
+    }
+
+    uint64_t now = i1905_now_ms(), real = real_ms();
+    uint64_t down = real > h.saved_real_ms ? real - h.saved_real_ms : 0;
+    for (uint32_t i = 0; i < db->cap; i++) {
+        struct topo_device *d = &db->dev[i];
+        if (d->used) d->last_seen_ms = rebase(d->last_seen_ms, h.saved_mono_ms, down, now);
+    }
+    for (uint32_t i = 0; i < db->n_links; i++) {
+        struct topo_link *l = &db->links[i];
+        l->last_seen_ms = rebase(l->last_seen_ms, h.saved_mono_ms, down, now);
+    }
+    memcpy(info->al_mac, h.al_mac, 6);
+    info->message_id = h.message_id;
+    info->clean = h.clean;
+    info->age_ms = down;
+    rv = 0;
+out:
+    munmap((void *)map, (size_t)st.st_size);
+    return rv;
+}
+
+static int unix_addr(const char *path, struct sockaddr_un *sa) {
+    memset(sa, 0, sizeof(*sa));
+    sa->sun_family = AF_UNIX;
+    if (strlen(path) >= sizeof(sa->sun_path)) return -1;
+    strcpy(sa->sun_path, path);
+    return 0;
+}
+
+int handoff_listen(const char *path) {
+    struct sockaddr_un sa;
+    if (unix_addr(path, &sa) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_NONBLOCK | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    unlink(path);
+    // 拿到 fd 就能收发整个 1905 网络的帧，只给本用户
+    if (bind(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0 || chmod(path, 0600) < 0 ||
+        listen(fd, 1) < 0) {
+        close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+int handoff_send(int conn, const struct i1905_handoff *h) {
+    struct handoff_msg m;
+    memset(&m, 0, sizeof(m));
+    m.magic = HANDOFF_MAGIC;
+    m.n = h->n;
+    memcpy(m.names, h->names, sizeof(m.names));
+    memcpy(m.state, h->state, sizeof(m.state));
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * I1905_MAX_INTERFACES)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { &m, sizeof(m) };
+    struct msghdr msg = { .msg_iov = &iov, .msg_iovlen = 1 };
+    if (h->n) {
+        memset(&ctl, 0, sizeof(ctl));
+        msg.msg_control = ctl.buf;
+        msg.msg_controllen = CMSG_SPACE(sizeof(int) * h->n);
+        struct cmsghdr *c = CMSG_FIRSTHDR(&msg);
+        c->cmsg_level = SOL_SOCKET;
+        c->cmsg_type = SCM_RIGHTS;
+        c->cmsg_len = CMSG_LEN(sizeof(int) * h->n);
+        memcpy(CMSG_DATA(c), h->fds, sizeof(int) * h->n);
+    }
+    return sendmsg(conn, &msg, MSG_NOSIGNAL) == (ssize_t)sizeof(m) ? 0 : -1;
+}
+
+int handoff_fetch(const char *path, struct i1905_handoff *out) {
+    struct sockaddr_un sa;
+    memset(out, 0, sizeof(*out));
+    if (unix_addr(path, &sa) < 0) return -1;
+    int fd = socket(AF_UNIX, SOCK_SEQPACKET | SOCK_CLOEXEC, 0);
+    if (fd < 0) return -1;
+    if (connect(fd, (struct sockaddr *)&sa, sizeof(sa)) < 0) {
+        int err = errno;
+        close(fd);
+        return err == ENOENT || err == ECONNREFUSED ? 1 : -1;
+    }
+    struct timeval tv = { HANDOFF_TIMEOUT_MS / 1000, HANDOFF_TIMEOUT_MS % 1000 * 1000 };
+    setsockopt(fd, SOL_SOCKET, SO_RCVTIMEO, &tv, sizeof(tv));
+
+    struct handoff_msg m;
+    union {
+        char buf[CMSG_SPACE(sizeof(int) * I1905_MAX_INTERFACES)];
+        struct cmsghdr align;
+    } ctl;
+    struct iovec iov = { &m, sizeof(m) };
+    struct msghdr msg = {
+        .msg_iov = &iov, .msg_iovlen = 1, .msg_control = ctl.buf, .msg_controllen = sizeof(ctl),
+    };
+    ssize_t r = recvmsg(fd, &msg, MSG_CMSG_CLOEXEC);
+    close(fd);
+    if (r < 0) return -1;
+    // 先把收到的 fd 全部接住，格式不对时才能一个不漏地关掉
+    for (struct cmsghdr *c = CMSG_FIRSTHDR(&msg); c; c = CMSG_NXTHDR(&msg, c)) {
+        if (c->cmsg_level != SOL_SOCKET || c->cmsg_type != SCM_RIGHTS) continue;
+        unsigned k = (unsigned)((c->cmsg_len - CMSG_LEN(0)) / sizeof(int));
+        for (unsigned i = 0; i < k; i++) {
+            int f;
+            memcpy(&f, CMSG_DATA(c) + i * sizeof(int), sizeof(int));
+            if (out->n < I1905_MAX_INTERFACES) {
+                out->fds[out->n++] = f;
+            } else {
+                close(f);
+            }
+        }
+    }
+    if (r != (ssize_t)sizeof(m) || (msg.msg_flags & (MSG_CTRUNC | MSG_TRUNC)) ||
+        m.magic != HANDOFF_MAGIC || m.n != out->n) {
+        for (unsigned i = 0; i < out->n; i++) close(out->fds[i]);
+        memset(out, 0, sizeof(*out));
+        return -1;
+    }
+    memcpy(out->names, m.names, sizeof(out->names));
+    memcpy(out->state, m.state, sizeof(out->state));
+    for (unsigned i = 0; i < out->n; i++) out->names[i][I1905_IFNAME_LEN - 1] = '\0';
+    return 0;
+}
@@ -0,0 +1,47 @@
+// SPDX-License-Identifier: MIT
+// restart: ieee1905d 的快速重启。
+// - 快照：AL MAC、最近发出的 message id 与 topo_db 原样平铺成一个文件（文件头 +
+//   设备数组、哈希索引、空闲栈、链路、墓碑环），启动时 mmap 校验后整块拷回，不重建
+//   哈希。写到 path.tmp 再 rename，任何时刻 path 都是完整的一份。last_seen 按单调
+//   时钟存，载入时按墙上时间补上停机的时长，换算到新进程（或重启后）的单调时钟
+// - 交接：旧进程在 UNIX socket（SOCK_SEQPACKET）上等新进程连上，经 SCM_RIGHTS 把
+//   各接口的 socket 连同传输层状态（i1905_handoff）交过去；换进程期间到的帧留在
+//   socket 里由新进程接着收
+// 快照不含挂起的 ubus 调用和事件环消费者：它们绑在旧进程的 ubus 连接和 eventfd 上，
+// 重启后调用方重试、重新 ring_open。
+
+#pragma once
+
+#include "ieee1905.h"
+#include "topo_db.h"
+
+#define SNAPSHOT_MAGIC    0x49313953u    // "I19S"
+#define SNAPSHOT_VERSION  2       // 2: topo_device 带对端地址
+#define HANDOFF_MAGIC     0x49313948u    // "I19H"
+#define HANDOFF_TIMEOUT_MS 5000
+
+struct snapshot_info {
+    uint8_t  al_mac[6];
+    uint16_t message_id;       // 写快照时最近发出的
+    bool     clean;            // 退出或交接时写的，之后没再发过消息
+    uint64_t age_ms;           // 写快照至今（墙上时间）
+};
+
+// 非 clean 的快照之后可能还发过消息，续用的 message id 跳过这么多，
+// 免得对端的 (AL MAC, message id) 去重把新消息当成重复
+#define SNAPSHOT_MID_SKIP 4096
+
+int snapshot_save(const char *path, const struct topo_db *db, const uint8_t al_mac[6],
+                  uint16_t message_id, bool clean);
+// db 未初始化；成功时按快照建好，容量须为 max_devices。文件不存在返回 1，
+// 损坏或不匹配返回 -1，两者 db 均未初始化
+int snapshot_load(const char *path, struct topo_db *db, uint32_t max_devices,
+                  struct snapshot_info *info);
+
+// 旧进程一侧：监听 path（先删掉残留的），返回非阻塞的监听 fd
+int handoff_listen(const char *path);
+// 在接受的连接上把 h 交出去，h 里的 fd 随后由调用方关闭
+int handoff_send(int conn, const struct i1905_handoff *h);
+// 新进程一侧：连上 path 取前任的 socket。没有前任返回 1，成功返回 0；
+// 前任拒绝（连接被关闭）或超时返回 -1
+int handoff_fetch(const char *path, struct i1905_handoff *out);
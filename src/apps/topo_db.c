@@ -0,0 +1,300 @@
+// SPDX-License-Identifier: MIT
+// topo_db: ieee1905d 拓扑库实现，见 topo_db.h。
+
+#include "topo_db.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+static uint32_t mac_hash(const uint8_t mac[6]) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ mac[i]) * 16777619u;
+    return h;
+}
+
+static void mac_str(const uint8_t mac[6], char out[18]) {
+    snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
+             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
+}
+
+int32_t topo_lookup(const struct topo_db *db, const uint8_t al_mac[6]) {
+    uint32_t i = mac_hash(al_mac) & db->index_mask;
+    while (db->index[i] >= 0) {
+        if (memcmp(db->dev[db->index[i]].al_mac, al_mac, 6) == 0) return db->index[i];
+        i = (i + 1) & db->index_mask;
+    }
+    return -1;
+}
+
+static void index_del(struct topo_db *db, const uint8_t al_mac[6]) {
+    uint32_t i = mac_hash(al_mac) & db->index_mask;
+    while (db->index[i] >= 0 && memcmp(db->dev[db->index[i]].al_mac, al_mac, 6) != 0) {
+        i = (i + 1) & db->index_mask;
+    }
+    if (db->index[i] < 0) return;
+    // 回移删除：把后续探测链上的元素前移，避免墓碑
+    uint32_t j = i;
+    while (1) {
+        j = (j + 1) & db->index_mask;
+        if (db->index[j] < 0) break;
+        uint32_t k = mac_hash(db->dev[db->index[j]].al_mac) & db->index_mask;
+        bool movable = (j > i) ? (k <= i || k > j) : (k <= i && k > j);
+        if (movable) {
+            db->index[i] = db->index[j];
+            i = j;
+        }
+    }
+    db->index[i] = -1;
+}
+
+static int32_t dev_get(struct topo_db *db, const uint8_t al_mac[6], bool *created) {
+    *created = false;
+    int32_t idx = topo_lookup(db, al_mac);
+    if (idx >= 0) return idx;
+    if (db->n_free == 0) return -1;
+
+    idx = (int32_t)db->free_slots[--db->n_free];
+    struct topo_device *d = &db->dev[idx];
+    memset(d, 0, sizeof(*d));
+    memcpy(d->al_mac, al_mac, 6);
+    d->used = true;
+    uint32_t i = mac_hash(al_mac) & db->index_mask;
+    while (db->index[i] >= 0) i = (i + 1) & db->index_mask;
+    db->index[i] = idx;
+    db->count++;
+    *created = true;
+    return idx;
+}
+
+int topo_init(struct topo_db *db, uint32_t max_devices, const uint8_t local_al[6]) {
+    memset(db, 0, sizeof(*db));
+    uint32_t buckets = 1;
+    while (buckets < max_devices * 2) buckets <<= 1;
+    db->dev = calloc(max_devices, sizeof(*db->dev));
+    db->free_slots = calloc(max_devices, sizeof(*db->free_slots));
+    db->index = malloc(buckets * sizeof(*db->index));
+    if (!db->dev || !db->free_slots || !db->index) {
+        topo_free(db);
+        return -1;
+    }
+    db->cap = max_devices;
+    db->index_mask = buckets - 1;
+    for (uint32_t i = 0; i < buckets; i++) db->index[i] = -1;
+    for (uint32_t i = 0; i < max_devices; i++) db->free_slots[i] = max_devices - 1 - i;
+    db->n_free = max_devices;
+
+    bool created;
+    int32_t self = dev_get(db, local_al, &created);
+    if (self < 0) {
+        topo_free(db);
+        return -1;
+    }
+    db->local = (uint32_t)self;
+    db->dev[self].local = true;
+    db->dev[self].gen = ++db->gen;
+    return 0;
+}
+
+void topo_free(struct topo_db *db) {
+    free(db->dev);
+    free(db->free_slots);
+    free(db->index);
+    free(db->links);
+    memset(db, 0, sizeof(*db));
+}
+
+static void log_removed(struct topo_db *db, const uint8_t a[6], const uint8_t *b) {
+    struct topo_removed *r = &db->removed[db->removed_next % TOPO_REMOVED_LOG];
+    // 覆盖旧墓碑后，比它更早的 since 无法再算出增量
+    if (db->removed_next >= TOPO_REMOVED_LOG) db->delta_floor = r->gen;
+    memcpy(r->a, a, 6);
+    r->is_link = b != NULL;
+    if (b) memcpy(r->b, b, 6);
+    r->gen = ++db->gen;
+    db->removed_next++;
+}
+
+// media 为 I1905_MEDIA_UNKNOWN 时只补上没见过的接口，不覆盖 device info 给出的介质
+static bool iface_set(struct topo_device *d, const uint8_t mac[6], uint16_t media) {
+    for (unsigned i = 0; i < d->n_ifaces; i++) {
+        if (memcmp(d->ifaces[i].mac, mac, 6) != 0) continue;
+        if (d->ifaces[i].media == media || media == I1905_MEDIA_UNKNOWN) return false;
+        d->ifaces[i].media = media;
+        return true;
+    }
+    if (d->n_ifaces == TOPO_MAX_IFACES) return false;
+    memcpy(d->ifaces[d->n_ifaces].mac, mac, 6);
+    d->ifaces[d->n_ifaces].media = media;
+    d->n_ifaces++;
+    return true;
+}
+
+static bool iface_has(const struct topo_device *d, const uint8_t mac[6]) {
+    for (unsigned i = 0; i < d->n_ifaces; i++) {
+        if (memcmp(d->ifaces[i].mac, mac, 6) == 0) return true;
+    }
+    return false;
+}
+
+static void link_touch(struct topo_db *db, uint32_t a, uint32_t b, uint64_t now_ms) {
+    // 链路只来自直连邻居的 discovery，数量与邻居数同阶，线性查找即可
+    for (uint32_t i = 0; i < db->n_links; i++) {
+        struct topo_link *l = &db->links[i];
+        if (l->a == a && l->b == b) {
+            l->last_seen_ms = now_ms;
+            return;
+        }
+    }
+    if (db->n_links == db->link_cap) {
+        uint32_t cap = db->link_cap ? db->link_cap * 2 : 16;
+        struct topo_link *links = realloc(db->links, cap * sizeof(*links));
+        if (!links) return;
+        db->links = links;
+        db->link_cap = cap;
+    }
+    db->links[db->n_links++] = (struct topo_link){
+        .a = a, .b = b, .last_seen_ms = now_ms, .gen = ++db->gen,
+    };
+}
+
+static void link_remove(struct topo_db *db, uint32_t i) {
+    struct topo_link *l = &db->links[i];
+    log_removed(db, db->dev[l->a].al_mac, db->dev[l->b].al_mac);
+    *l = db->links[--db->n_links];
+}
+
+void topo_update(struct topo_db *db, const struct i1905_cmdu_view *cmdu,
+                 const struct i1905_rx_info *rx, struct i1905_arena *arena, uint64_t now_ms) {
+    uint16_t type = cmdu->message_type;
+    if (type != I1905_MSG_TOPOLOGY_DISCOVERY && type != I1905_MSG_TOPOLOGY_NOTIFICATION &&
+        type != I1905_MSG_TOPOLOGY_RESPONSE) {
+        return;
+    }
+    // response 不带 AL MAC TLV，以 device info 里的 AL 为准
+    const uint8_t *al = rx->al_mac;
+    struct i1905_tlv_view t;
+    struct i1905_tlv_device_info info;
+    bool has_info = i1905_cmdu_view_find(cmdu, I1905_TLV_DEVICE_INFO, &t) == 0 &&
+                    i1905_tlv_device_info_decode(&info, &t, arena) == 0;
+    if (has_info) al = info.al_mac;
+
+    bool changed;
+    int32_t idx = dev_get(db, al, &changed);
+    if (idx < 0 || (uint32_t)idx == db->local) return;
+    struct topo_device *d = &db->dev[idx];
+    d->last_seen_ms = now_ms;
+
+    struct i1905_tlv_iter it;
+    struct i1905_tlv_mac_addr mac;
+    i1905_tlv_iter_init(&it, cmdu);
+    while (i1905_tlv_iter_next(&it, &t)) {
+        if (t.type == I1905_TLV_MAC_ADDR && i1905_tlv_mac_addr_decode(&mac, &t, NULL) == 0) {
+            changed |= iface_set(d, mac.mac, I1905_MEDIA_UNKNOWN);
+        }
+    }
+    for (size_t k = 0; has_info && k < info.interfaces_count; k++) {
+        changed |= iface_set(d, info.interfaces[k].mac, info.interfaces[k].media);
+    }
+    if (changed) d->gen = ++db->gen;
+    // discovery 与 response 都是对端直接发来的；notification 会被中继，
+    // 源 MAC 是它自己的 AL 或接口时才不是转发者
+    if (type != I1905_MSG_TOPOLOGY_NOTIFICATION || memcmp(rx->src.mac, al, 6) == 0 ||
+        iface_has(d, rx->src.mac)) {
+        d->addr = rx->src;
+        d->has_addr = true;
+    }
+    if (type == I1905_MSG_TOPOLOGY_DISCOVERY) link_touch(db, db->local, (uint32_t)idx, now_ms);
+}
+
+const struct i1905_addr *topo_addr(const struct topo_db *db, const uint8_t al_mac[6]) {
+    int32_t idx = topo_lookup(db, al_mac);
+    if (idx < 0 || !db->dev[idx].has_addr) return NULL;
+    return &db->dev[idx].addr;
+}
+
+unsigned topo_age(struct topo_db *db, uint64_t now_ms, uint64_t ttl_ms) {
+    unsigned removed = 0;
+    for (uint32_t i = 0; i < db->n_links;) {
+        struct topo_link *l = &db->links[i];
+        bool dead = now_ms - l->last_seen_ms > ttl_ms ||
+                    (!db->dev[l->a].local && now_ms - db->dev[l->a].last_seen_ms > ttl_ms) ||
+                    (!db->dev[l->b].local && now_ms - db->dev[l->b].last_seen_ms > ttl_ms);
+        if (dead) {
+            link_remove(db, i);
+            removed++;
+        } else {
+            i++;
+        }
+    }
+    for (uint32_t i = 0; i < db->cap; i++) {
+        struct topo_device *d = &db->dev[i];
+        if (!d->used || d->local || now_ms - d->last_seen_ms <= ttl_ms) continue;
+        log_removed(db, d->al_mac, NULL);
+        index_del(db, d->al_mac);
+        d->used = false;
+        db->free_slots[db->n_free++] = i;
+        db->count--;
+        removed++;
+    }
+    return removed;
+}
+
+void topo_dump(const struct topo_db *db, struct blob_buf *bb, uint32_t since, uint64_t now_ms) {
+    bool full = since == 0 || since < db->delta_floor;
+    char mac[18];
+    blobmsg_add_u32(bb, "gen", db->gen);
+    blobmsg_add_u8(bb, "full", full);
+
+    void *arr = blobmsg_open_array(bb, "devices");
+    for (uint32_t i = 0; i < db->cap; i++) {
+        const struct topo_device *d = &db->dev[i];
+        if (!d->used || (!full && d->gen <= since)) continue;
+        void *tbl = blobmsg_open_table(bb, NULL);
+        mac_str(d->al_mac, mac);
+        blobmsg_add_string(bb, "al_mac", mac);
+        blobmsg_add_u8(bb, "local", d->local);
+        if (!d->local) blobmsg_add_u32(bb, "age_ms", (uint32_t)(now_ms - d->last_seen_ms));
+        void *ifs = blobmsg_open_array(bb, "interfaces");
+        for (unsigned k = 0; k < d->n_ifaces; k++) {
+            void *it = blobmsg_open_table(bb, NULL);
+            mac_str(d->ifaces[k].mac, mac);
+            blobmsg_add_string(bb, "mac", mac);
+            blobmsg_add_u32(bb, "media", d->ifaces[k].media);
+            blobmsg_close_table(bb, it);
+        }
+        blobmsg_close_array(bb, ifs);
+        blobmsg_close_table(bb, tbl);
+    }
+    blobmsg_close_array(bb, arr);
+
+    arr = blobmsg_open_array(bb, "links");
+    for (uint32_t i = 0; i < db->n_links; i++) {
+        const struct topo_link *l = &db->links[i];
+        if (!full && l->gen <= since) continue;
+        void *tbl = blobmsg_open_table(bb, NULL);
+        mac_str(db->dev[l->a].al_mac, mac);
+        blobmsg_add_string(bb, "a", mac);
+        mac_str(db->dev[l->b].al_mac, mac);
+        blobmsg_add_string(bb, "b", mac);
+        blobmsg_close_table(bb, tbl);
+    }
+    blobmsg_close_array(bb, arr);
+
+    if (full) return;
+    arr = blobmsg_open_array(bb, "removed");
+    uint32_t n = db->removed_next < TOPO_REMOVED_LOG ? db->removed_next : TOPO_REMOVED_LOG;
+    for (uint32_t k = db->removed_next - n; k < db->removed_next; k++) {
+        const struct topo_removed *r = &db->removed[k % TOPO_REMOVED_LOG];
+        if (r->gen <= since) continue;
+        void *tbl = blobmsg_open_table(bb, NULL);
+        mac_str(r->a, mac);
+        blobmsg_add_string(bb, r->is_link ? "a" : "al_mac", mac);
+        if (r->is_link) {
+            mac_str(r->b, mac);
+            blobmsg_add_string(bb, "b", mac);
+        }
+        blobmsg_close_table(bb, tbl);
+    }
+    blobmsg_close_array(bb, arr);
+}
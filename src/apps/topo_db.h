@@ -0,0 +1,81 @@
+// SPDX-License-Identifier: MIT
+// topo_db: ieee1905d 内的拓扑库。
+// 设备按 AL MAC 存于开放寻址哈希（线性探测 + 回移删除），接口内联在设备里，
+// 链路是紧凑数组；每次变更打上递增的 generation，删除记入定长墓碑环，
+// 供 ubus `topology` 方法返回全量或 since 之后的增量。
+
+#pragma once
+
+#include "ieee1905.h"
+
+#include <libubox/blobmsg.h>
+
+#define TOPO_MAX_IFACES   8
+#define TOPO_REMOVED_LOG  256
+
+struct topo_iface {
+    uint8_t  mac[6];
+    uint16_t media;
+};
+
+struct topo_device {
+    uint8_t  al_mac[6];
+    bool     used;
+    bool     local;            // 本机 AL，不参与老化
+    uint8_t  n_ifaces;
+    struct topo_iface ifaces[TOPO_MAX_IFACES];
+    bool     has_addr;
+    struct i1905_addr addr;    // 最近一次直接（非转发）收到它的帧时的对端地址
+    uint64_t last_seen_ms;
+    uint32_t gen;              // 最近一次变更
+};
+
+struct topo_link {
+    uint32_t a, b;             // 设备槽位下标，a 为收到 discovery 的一端
+    uint64_t last_seen_ms;
+    uint32_t gen;
+};
+
+struct topo_removed {
+    uint8_t  a[6];
+    uint8_t  b[6];
+    bool     is_link;
+    uint32_t gen;
+};
+
+struct topo_db {
+    struct topo_device *dev;
+    uint32_t cap;
+    uint32_t count;
+    uint32_t *free_slots;      // 空闲设备槽位栈
+    uint32_t n_free;
+
+    int32_t *index;            // AL MAC -> 槽位，-1 为空
+    uint32_t index_mask;
+
+    struct topo_link *links;
+    uint32_t n_links;
+    uint32_t link_cap;
+
+    struct topo_removed removed[TOPO_REMOVED_LOG];
+    uint32_t removed_next;
+    uint32_t delta_floor;      // since 早于该值时只能给全量
+
+    uint32_t gen;
+    uint32_t local;            // 本机设备槽位
+};
+
+int topo_init(struct topo_db *db, uint32_t max_devices, const uint8_t local_al[6]);
+void topo_free(struct topo_db *db);
+
+// 用 topology discovery/notification/response 的 TLV 增量更新；
+// device info 的接口列表解码到 arena 上
+void topo_update(struct topo_db *db, const struct i1905_cmdu_view *cmdu,
+                 const struct i1905_rx_info *rx, struct i1905_arena *arena, uint64_t now_ms);
+// 清除 ttl_ms 内未再出现的设备与链路，返回删除条数
+unsigned topo_age(struct topo_db *db, uint64_t now_ms, uint64_t ttl_ms);
+
+int32_t topo_lookup(const struct topo_db *db, const uint8_t al_mac[6]);
+// 发往该设备的地址，设备未知或还没直接收到过它的帧返回 NULL
+const struct i1905_addr *topo_addr(const struct topo_db *db, const uint8_t al_mac[6]);
+void topo_dump(const struct topo_db *db, struct blob_buf *bb, uint32_t since, uint64_t now_ms);
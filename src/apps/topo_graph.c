@@ -0,0 +1,481 @@
+// SPDX-License-Identifier: MIT
+// topo_graph: 拓扑图与回程树的增量维护，见 topo_graph.h。
+
+#include "topo_graph.h"
+#include "ieee1905.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define KEY_INF      UINT64_MAX
+#define NOT_IN_HEAP  UINT32_MAX
+
+static uint32_t mac_hash(const uint8_t mac[6]) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ mac[i]) * 16777619u;
+    return h;
+}
+
+int32_t graph_lookup(const struct topo_graph *g, const uint8_t al_mac[6]) {
+    uint32_t i = mac_hash(al_mac) & g->index_mask;
+    while (g->index[i] >= 0) {
+        if (memcmp(g->nodes[g->index[i]].al_mac, al_mac, 6) == 0) return g->index[i];
+        i = (i + 1) & g->index_mask;
+    }
+    return GRAPH_NO_NODE;
+}
+
+static void index_del(struct topo_graph *g, const uint8_t al_mac[6]) {
+    uint32_t i = mac_hash(al_mac) & g->index_mask;
+    while (g->index[i] >= 0 && memcmp(g->nodes[g->index[i]].al_mac, al_mac, 6) != 0) {
+        i = (i + 1) & g->index_mask;
+    }
+    if (g->index[i] < 0) return;
+    // 回移删除，同 topo_db
+    uint32_t j = i;
+    while (1) {
+        j = (j + 1) & g->index_mask;
+        if (g->index[j] < 0) break;
+        uint32_t k = mac_hash(g->nodes[g->index[j]].al_mac) & g->index_mask;
+        bool movable = (j > i) ? (k <= i || k > j) : (k <= i && k > j);
+        if (movable) {
+            g->index[i] = g->index[j];
+            i = j;
+        }
+    }
+    g->index[i] = -1;
+}
+
+static void tree_reset(struct graph_node *n) {
+    n->key = KEY_INF;
+    n->parent = GRAPH_NO_NODE;
+    n->first_child = GRAPH_NO_NODE;
+    n->next_sib = GRAPH_NO_NODE;
+    n->prev_sib = GRAPH_NO_NODE;
+    n->heap_pos = NOT_IN_HEAP;
+}
+
+int32_t graph_node(struct topo_graph *g, const uint8_t al_mac[6]) {
+    int32_t idx = graph_lookup(g, al_mac);
+    if (idx >= 0) return idx;
+    if (g->n_free == 0) return GRAPH_NO_NODE;
+
+    idx = (int32_t)g->free_slots[--g->n_free];
+    struct graph_node *n = &g->nodes[idx];
+    memset(n, 0, sizeof(*n));
+    tree_reset(n);
+    memcpy(n->al_mac, al_mac, 6);
+    n->used = true;
+    uint32_t i = mac_hash(al_mac) & g->index_mask;
+    while (g->index[i] >= 0) i = (i + 1) & g->index_mask;
+    g->index[i] = idx;
+    g->count++;
+    return idx;
+}
+
+int graph_init(struct topo_graph *g, uint32_t max_nodes, const uint8_t root_al[6]) {
+    memset(g, 0, sizeof(*g));
+    uint32_t buckets = 1;
+    while (buckets < max_nodes * 2) buckets <<= 1;
+    g->nodes = calloc(max_nodes, sizeof(*g->nodes));
+    g->free_slots = calloc(max_nodes, sizeof(*g->free_slots));
+    g->index = malloc(buckets * sizeof(*g->index));
+    g->heap = calloc(max_nodes, sizeof(*g->heap));
+    g->stack = calloc(max_nodes, sizeof(*g->stack));
+    if (!g->nodes || !g->free_slots || !g->index || !g->heap || !g->stack) {
+        graph_free(g);
+        return -1;
+    }
+    g->cap = max_nodes;
+    g->index_mask = buckets - 1;
+    for (uint32_t i = 0; i < buckets; i++) g->index[i] = -1;
+    for (uint32_t i = 0; i < max_nodes; i++) g->free_slots[i] = max_nodes - 1 - i;
+    g->n_free = max_nodes;
+
+    int32_t root = graph_node(g, root_al);
+    if (root < 0) {
+        graph_free(g);
+        return -1;
+    }
+    g->root = (uint32_t)root;
+    g->nodes[root].key = 0;
+    return 0;
+}
+
+void graph_free(struct topo_graph *g) {
+    for (uint32_t i = 0; g->nodes && i < g->cap; i++) free(g->nodes[i].adj);
+    free(g->nodes);
+    free(g->free_slots);
+    free(g->index);
+    free(g->heap);
+    free(g->stack);
+    memset(g, 0, sizeof(*g));
+}
+
+// ---- 回程树的父子链表 ----
+
+static void set_parent(struct topo_graph *g, uint32_t x, int32_t p) {
+    struct graph_node *n = &g->nodes[x];
+    if (n->parent == p) return;
+    if (n->parent >= 0) {
+        if (n->prev_sib >= 0) g->nodes[n->prev_sib].next_sib = n->next_sib;
+        else g->nodes[n->parent].first_child = n->next_sib;
+        if (n->next_sib >= 0) g->nodes[n->next_sib].prev_sib = n->prev_sib;
+    }
+    n->parent = p;
+    n->prev_sib = GRAPH_NO_NODE;
+    n->next_sib = GRAPH_NO_NODE;
+    if (p >= 0) {
+        struct graph_node *pn = &g->nodes[p];
+        n->next_sib = pn->first_child;
+        if (pn->first_child >= 0) g->nodes[pn->first_child].prev_sib = (int32_t)x;
+        pn->first_child = (int32_t)x;
+    }
+    g->tree_gen++;
+}
+
+// ---- 按 key 的二叉最小堆，带下标以便 decrease-key ----
+
+static void heap_set(struct topo_graph *g, uint32_t pos, uint32_t x) {
+    g->heap[pos] = x;
+    g->nodes[x].heap_pos = pos;
+}
+
+static void sift_up(struct topo_graph *g, uint32_t pos) {
+    uint32_t x = g->heap[pos];
+    uint64_t key = g->nodes[x].key;
+    while (pos > 0) {
+        uint32_t up = (pos - 1) / 2;
+        if (g->nodes[g->heap[up]].key <= key) break;
+        heap_set(g, pos, g->heap[up]);
+        pos = up;
+    }
+    heap_set(g, pos, x);
+}
+
+static void sift_down(struct topo_graph *g, uint32_t pos) {
+    uint32_t x = g->heap[pos];
+    uint64_t key = g->nodes[x].key;
+    while (1) {
+        uint32_t c = 2 * pos + 1;
+        if (c >= g->heap_len) break;
+        if (c + 1 < g->heap_len && g->nodes[g->heap[c + 1]].key < g->nodes[g->heap[c]].key) c++;
+        if (key <= g->nodes[g->heap[c]].key) break;
+        heap_set(g, pos, g->heap[c]);
+        pos = c;
+    }
+    heap_set(g, pos, x);
+}
+
+// key 只会变小，入堆或上浮即可
+static void heap_update(struct topo_graph *g, uint32_t x) {
+    uint32_t pos = g->nodes[x].heap_pos;
+    if (pos == NOT_IN_HEAP) {
+        pos = g->heap_len++;
+        heap_set(g, pos, x);
+    }
+    sift_up(g, pos);
+}
+
+static uint32_t heap_pop(struct topo_graph *g) {
+    uint32_t x = g->heap[0];
+    g->nodes[x].heap_pos = NOT_IN_HEAP;
+    if (--g->heap_len) {
+        heap_set(g, 0, g->heap[g->heap_len]);
+        sift_down(g, 0);
+    }
+    return x;
+}
+
+// ---- 邻接 ----
+
+static struct graph_edge *adj_find(struct graph_node *n, uint32_t peer) {
+    for (uint32_t i = 0; i < n->n_adj; i++) {
+        if (n->adj[i].peer == peer) return &n->adj[i];
+    }
+    return NULL;
+}
+
+static struct graph_edge *adj_add(struct graph_node *n, uint32_t peer) {
+    if (n->n_adj == n->adj_cap) {
+        uint32_t cap = n->adj_cap ? n->adj_cap * 2 : 4;
+        struct graph_edge *adj = realloc(n->adj, cap * sizeof(*adj));
+        if (!adj) return NULL;
+        n->adj = adj;
+        n->adj_cap = cap;
+    }
+    struct graph_edge *e = &n->adj[n->n_adj++];
+    memset(e, 0, sizeof(*e));
+    e->peer = peer;
+    return e;
+}
+
+static void adj_del(struct graph_node *n, struct graph_edge *e) {
+    *e = n->adj[--n->n_adj];
+}
+
+// 任一端报告即存在，代价取较小者
+static uint16_t edge_cost(const struct graph_edge *e) {
+    if (!e->cost_own) return e->cost_peer;
+    if (!e->cost_peer) return e->cost_own;
+    return e->cost_own < e->cost_peer ? e->cost_own : e->cost_peer;
+}
+
+static uint64_t edge_key(uint16_t cost) {
+    return ((uint64_t)cost << 16) | 1;
+}
+
+// ---- 最短路径树修复 ----
+
+static void relax_from(struct topo_graph *g, uint32_t x) {
+    const struct graph_node *n = &g->nodes[x];
+    for (uint32_t i = 0; i < n->n_adj; i++) {
+        uint16_t cost = edge_cost(&n->adj[i]);
+        uint32_t y = n->adj[i].peer;
+        uint64_t cand = n->key + edge_key(cost);
+        if (!cost || cand >= g->nodes[y].key) continue;
+        g->nodes[y].key = cand;
+        set_parent(g, y, (int32_t)x);
+        heap_update(g, y);
+    }
+}
+
+static void run(struct topo_graph *g) {
+    while (g->heap_len) {
+        uint32_t x = heap_pop(g);
+        g->stats.touched++;
+        relax_from(g, x);
+    }
+}
+
+// c 的上行链路变差或消失：整棵子树失效，各自从子树外的邻居重新接入，
+// 再在子树内部传播；子树外节点的路径不经过该链路，不受影响
+static void invalidate(struct topo_graph *g, uint32_t c) {
+    uint32_t n = 0;
+    g->mark_gen++;
+    g->stack[n++] = c;
+    for (uint32_t i = 0; i < n; i++) {
+        struct graph_node *x = &g->nodes[g->stack[i]];
+        x->mark = g->mark_gen;
+        for (int32_t ch = x->first_child; ch >= 0; ch = g->nodes[ch].next_sib) {
+            g->stack[n++] = (uint32_t)ch;
+        }
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        g->nodes[g->stack[i]].key = KEY_INF;
+        set_parent(g, g->stack[i], GRAPH_NO_NODE);
+    }
+    for (uint32_t i = 0; i < n; i++) {
+        uint32_t x = g->stack[i];
+        struct graph_node *xn = &g->nodes[x];
+        for (uint32_t k = 0; k < xn->n_adj; k++) {
+            const struct graph_node *y = &g->nodes[xn->adj[k].peer];
+            uint16_t cost = edge_cost(&xn->adj[k]);
+            if (!cost || y->mark == g->mark_gen || !graph_reachable(y)) continue;
+            uint64_t cand = y->key + edge_key(cost);
+            if (cand >= xn->key) continue;
+            xn->key = cand;
+            set_parent(g, x, (int32_t)xn->adj[k].peer);
+        }
+        if (graph_reachable(xn)) heap_update(g, x);
+    }
+    run(g);
+}
+
+static void relax_pair(struct topo_graph *g, uint32_t u, uint32_t v, uint16_t cost) {
+    struct graph_node *un = &g->nodes[u];
+    struct graph_node *vn = &g->nodes[v];
+    if (graph_reachable(un) && un->key + edge_key(cost) < vn->key) {
+        vn->key = un->key + edge_key(cost);
+        set_parent(g, v, (int32_t)u);
+        heap_update(g, v);
+    } else if (graph_reachable(vn) && vn->key + edge_key(cost) < un->key) {
+        un->key = vn->key + edge_key(cost);
+        set_parent(g, u, (int32_t)v);
+        heap_update(g, u);
+    }
+    run(g);
+}
+
+static void link_changed(struct topo_graph *g, uint32_t u, uint32_t v,
+                         uint16_t old_cost, uint16_t new_cost) {
+    g->stats.updates++;
+    if (!new_cost || (old_cost && new_cost > old_cost)) {
+        if (g->nodes[v].parent == (int32_t)u) invalidate(g, v);
+        else if (g->nodes[u].parent == (int32_t)v) invalidate(g, u);
+    }
+    if (new_cost) relax_pair(g, u, v, new_cost);
+}
+
+void graph_report_link(struct topo_graph *g, uint32_t from, uint32_t to, uint16_t cost) {
+    if (from == to) return;
+    struct graph_node *fn = &g->nodes[from];
+    struct graph_node *tn = &g->nodes[to];
+    struct graph_edge *a = adj_find(fn, to);
+    struct graph_edge *b = a ? adj_find(tn, from) : NULL;
+    if (!a) {
+        if (!cost) return;
+        a = adj_add(fn, to);
+        if (!a) return;
+        b = adj_add(tn, from);
+        if (!b) {
+            adj_del(fn, a);
+            return;
+        }
+    }
+    uint16_t old_cost = edge_cost(a);
+    a->cost_own = cost;
+    b->cost_peer = cost;
+    uint16_t new_cost = edge_cost(a);
+    if (!new_cost) {
+        adj_del(fn, a);
+        adj_del(tn, b);
+    }
+    if (new_cost != old_cost) link_changed(g, from, to, old_cost, new_cost);
+}
+
+// 撤销 from 自己报告的链路，keep 中列出的对端除外
+static unsigned withdraw_reports(struct topo_graph *g, uint32_t from,
+                                 const struct graph_report *keep, unsigned n_keep) {
+    unsigned changed = 0;
+    struct graph_node *fn = &g->nodes[from];
+    for (uint32_t i = 0; i < fn->n_adj;) {
+        const struct graph_edge *e = &fn->adj[i];
+        uint32_t peer = e->peer;
+        bool kept = !e->cost_own;
+        for (unsigned k = 0; !kept && k < n_keep; k++) {
+            kept = memcmp(keep[k].al_mac, g->nodes[peer].al_mac, 6) == 0;
+        }
+        if (kept) {
+            i++;
+            continue;
+        }
+        graph_report_link(g, from, peer, 0);
+        changed++;
+        // 两端都不再报告时该项已被换成数组末尾的一项，原位再看一次
+        if (i < fn->n_adj && fn->adj[i].peer == peer) i++;
+    }
+    return changed;
+}
+
+unsigned graph_set_reports(struct topo_graph *g, uint32_t from,
+                           const struct graph_report *reports, unsigned n, uint64_t now_ms) {
+    g->nodes[from].last_report_ms = now_ms;
+    unsigned changed = withdraw_reports(g, from, reports, n);
+    for (unsigned k = 0; k < n; k++) {
+        int32_t to = graph_node(g, reports[k].al_mac);
+        if (to < 0 || (uint32_t)to == from) continue;
+        const struct graph_edge *e = adj_find(&g->nodes[from], (uint32_t)to);
+        if (e && e->cost_own == reports[k].cost) continue;
+        graph_report_link(g, from, (uint32_t)to, reports[k].cost);
+        changed++;
+    }
+    return changed;
+}
+
+// 链路代价按本端接口介质（IEEE 1905.1 表 6-12 的高字节）：有线优先，
+// 中间隔着 802.1 网桥的再加一
+static uint16_t media_cost(uint16_t media, uint8_t flags) {
+    uint16_t cost;
+    switch (media >> 8) {
+    case 0x00: cost = 1; break;    // 802.3
+    case 0x03: cost = 2; break;    // MoCA
+    case 0x02: cost = 3; break;    // 1901
+    default:   cost = 4; break;    // 802.11 及未知
+    }
+    return (flags & 0x80) ? cost + 1 : cost;
+}
+
+// 原始 TLV 链里的下一个 TLV，越界即停
+static bool tlv_next(const uint8_t **p, size_t *len, struct i1905_tlv_view *t) {
+    if (*len < 3) return false;
+    t->type = (*p)[0];
+    t->len = (uint16_t)(((*p)[1] << 8) | (*p)[2]);
+    if ((size_t)3 + t->len > *len) return false;
+    t->value = *p + 3;
+    *p += 3 + t->len;
+    *len -= 3 + (size_t)t->len;
+    return true;
+}
+
+int graph_feed_response(struct topo_graph *g, const uint8_t *tlv, size_t len,
+                        struct i1905_arena *arena, uint64_t now_ms, uint8_t from[6]) {
+    static struct graph_report reports[GRAPH_MAX_REPORTS];
+    struct i1905_tlv_view t;
+    struct i1905_tlv_device_info info;
+    const uint8_t *p = tlv;
+    size_t rem = len;
+    bool has_info = false;
+    while (!has_info && tlv_next(&p, &rem, &t)) {
+        has_info = t.type == I1905_TLV_DEVICE_INFO &&
+                   i1905_tlv_device_info_decode(&info, &t, arena) == 0;
+    }
+    if (!has_info) return -1;
+    if (from) memcpy(from, info.al_mac, 6);
+
+    unsigned n = 0;
+    struct i1905_tlv_neighbor_device nb;
+    p = tlv;
+    rem = len;
+    while (tlv_next(&p, &rem, &t)) {
+        if (t.type != I1905_TLV_NEIGHBOR_DEVICE ||
+            i1905_tlv_neighbor_device_decode(&nb, &t, arena) < 0) {
+            continue;
+        }
+        uint16_t media = I1905_MEDIA_UNKNOWN;
+        for (size_t k = 0; k < info.interfaces_count; k++) {
+            if (memcmp(info.interfaces[k].mac, nb.local_mac, 6) == 0) media = info.interfaces[k].media;
+        }
+        for (size_t k = 0; k < nb.neighbors_count; k++) {
+            uint16_t cost = media_cost(media, nb.neighbors[k].flags);
+            unsigned j = 0;
+            while (j < n && memcmp(reports[j].al_mac, nb.neighbors[k].al_mac, 6) != 0) j++;
+            if (j < n) {
+                if (cost < reports[j].cost) reports[j].cost = cost;
+            } else if (n < GRAPH_MAX_REPORTS) {
+                memcpy(reports[n].al_mac, nb.neighbors[k].al_mac, 6);
+                reports[n++].cost = cost;
+            }
+        }
+    }
+
+    int32_t idx = graph_node(g, info.al_mac);
+    if (idx < 0 || (uint32_t)idx == g->root) return -1;
+    return (int)graph_set_reports(g, (uint32_t)idx, reports, n, now_ms);
+}
+
+unsigned graph_age(struct topo_graph *g, uint64_t now_ms, uint64_t ttl_ms) {
+    unsigned removed = 0;
+    for (uint32_t i = 0; i < g->cap; i++) {
+        struct graph_node *n = &g->nodes[i];
+        if (!n->used || i == g->root || now_ms - n->last_report_ms <= ttl_ms) continue;
+        withdraw_reports(g, i, NULL, 0);
+    }
+    // 对端仍在报告的设备留着，直到对端也不再报告
+    for (uint32_t i = 0; i < g->cap; i++) {
+        struct graph_node *n = &g->nodes[i];
+        if (!n->used || i == g->root || n->n_adj || now_ms - n->last_report_ms <= ttl_ms) {
+            continue;
+        }
+        free(n->adj);
+        index_del(g, n->al_mac);
+        n->used = false;
+        n->adj = NULL;
+        g->free_slots[g->n_free++] = i;
+        g->count--;
+        removed++;
+    }
+    return removed;
+}
+
+void graph_rebuild(struct topo_graph *g) {
+    for (uint32_t i = 0; i < g->cap; i++) {
+        if (g->nodes[i].used) tree_reset(&g->nodes[i]);
+    }
+    g->heap_len = 0;
+    g->nodes[g->root].key = 0;
+    heap_update(g, g->root);
+    run(g);
+    g->tree_gen++;
+    g->stats.rebuilds++;
+}
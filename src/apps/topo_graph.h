@@ -0,0 +1,110 @@
+// SPDX-License-Identifier: MIT
+// topo_graph: ezz_controller 的网络拓扑图与回程树。
+// 设备按 AL MAC 存于开放寻址哈希（同 topo_db），每个设备带邻接数组；链路由两端的
+// topology response（1905 neighbor device TLV）各自报告，任一端报告即存在，
+// 代价取两端报告中较小者。回程树是以控制器为根的最短路径树，比较键为
+// (累计代价, 跳数)。链路变化时只修复受影响部分：变好只从该链路一端向外松弛，
+// 树边变差或消失只让其下方子树失效，再从子树外的邻居重新接入，不做全量重算。
+// 不依赖 ubus，bench_topo 直接链接本模块（TLV 解码用 ieee1905 库）。
+
+#pragma once
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#define GRAPH_NO_NODE   (-1)
+#define GRAPH_COST_MAX  0xFFFF       // 单条链路代价上限，0 表示无链路
+#define GRAPH_MAX_REPORTS 256        // 单个 response 里的邻居上限
+
+struct i1905_arena;
+
+struct graph_edge {
+    uint32_t peer;
+    uint16_t cost_own;         // 本端报告的代价，0 为未报告
+    uint16_t cost_peer;        // 对端报告的代价
+};
+
+struct graph_node {
+    uint8_t  al_mac[6];
+    bool     used;
+    struct graph_edge *adj;
+    uint32_t n_adj;
+    uint32_t adj_cap;
+    uint64_t last_report_ms;   // 最近一次自己的 topology response
+
+    // 回程树
+    uint64_t key;              // (累计代价 << 16) | 跳数，不可达为 UINT64_MAX
+    int32_t  parent;
+    int32_t  first_child;
+    int32_t  next_sib;
+    int32_t  prev_sib;
+    uint32_t heap_pos;         // 在堆中的下标，UINT32_MAX 为不在堆中
+    uint32_t mark;             // 等于 graph.mark_gen 时属于正在修复的子树
+};
+
+// 控制器读取的一条邻居报告：经 local_mac 所在接口看到 al_mac
+struct graph_report {
+    uint8_t  al_mac[6];
+    uint16_t cost;
+};
+
+struct graph_stats {
+    uint64_t updates;          // 代价实际变化的链路数
+    uint64_t touched;          // 修复时出堆的节点累计数
+    uint64_t rebuilds;         // graph_rebuild() 次数
+};
+
+struct topo_graph {
+    struct graph_node *nodes;
+    uint32_t cap;
+    uint32_t count;
+    uint32_t *free_slots;
+    uint32_t n_free;
+
+    int32_t *index;            // AL MAC -> 槽位，-1 为空
+    uint32_t index_mask;
+
+    uint32_t root;
+    uint32_t *heap;
+    uint32_t heap_len;
+    uint32_t *stack;           // 子树收集
+    uint32_t mark_gen;
+    uint32_t tree_gen;         // 树有任何父节点变化即递增
+    struct graph_stats stats;
+};
+
+int graph_init(struct topo_graph *g, uint32_t max_nodes, const uint8_t root_al[6]);
+void graph_free(struct topo_graph *g);
+
+int32_t graph_lookup(const struct topo_graph *g, const uint8_t al_mac[6]);
+// 查找或新建，满了返回 GRAPH_NO_NODE
+int32_t graph_node(struct topo_graph *g, const uint8_t al_mac[6]);
+
+// 设置 from 报告的一条链路，cost 0 为撤销；代价变化时增量修复回程树
+void graph_report_link(struct topo_graph *g, uint32_t from, uint32_t to, uint16_t cost);
+// 用 from 的完整邻居报告替换上一次的，只对差异链路做增量修复；返回变化链路数
+unsigned graph_set_reports(struct topo_graph *g, uint32_t from,
+                           const struct graph_report *reports, unsigned n, uint64_t now_ms);
+// 用一个 topology response 的 TLV 链（type(1) + len(2) + value，不含 end-of-message）
+// 替换上报者的邻居报告：device info 给出上报者和各接口介质，neighbor device 给出每个
+// 接口上看到的 1905 邻居，代价按本端接口介质，同一邻居经多个接口可达时取最小的一条。
+// 列表解码到 arena 上；上报者 AL MAC 写入 from（可为 NULL）。返回变化链路数，
+// 没有 device info、上报者是根或图已满时返回 -1
+int graph_feed_response(struct topo_graph *g, const uint8_t *tlv, size_t len,
+                        struct i1905_arena *arena, uint64_t now_ms, uint8_t from[6]);
+// 撤销 ttl_ms 内没有再报告的设备的报告，删除因此孤立的设备，返回删除个数
+unsigned graph_age(struct topo_graph *g, uint64_t now_ms, uint64_t ttl_ms);
+
+// 全量 Dijkstra，结果与增量维护一致，供对照与基准
+void graph_rebuild(struct topo_graph *g);
+
+static inline bool graph_reachable(const struct graph_node *n) {
+    return n->key != UINT64_MAX;
+}
+static inline uint32_t graph_cost(const struct graph_node *n) {
+    return (uint32_t)(n->key >> 16);
+}
+static inline uint16_t graph_hops(const struct graph_node *n) {
+    return (uint16_t)n->key;
+}
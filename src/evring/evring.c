@@ -0,0 +1,250 @@
+// SPDX-License-Identifier: MIT
+//
+// memfd event ring, see include/evring.h. Slots are guarded seqlock style:
+// the producer zeroes a slot's seq before rewriting it and stores the new
+// seq with release semantics afterwards; a consumer copies the record out
+// and accepts it only if seq was the expected value before and after.
+
+#define _GNU_SOURCE // memfd_create, F_ADD_SEALS
+#include "evring.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+#define MIN_SLOT_SIZE 256
+
+#ifndef F_SEAL_FUTURE_WRITE
+#define F_SEAL_FUTURE_WRITE 0x0010   // Linux 5.1, missing from older libc headers
+#endif
+
+// The geometry is kept here and never read back from the shared header:
+// consumers cannot write the memfd, but the producer does not rely on it.
+struct evring_producer {
+    struct evring_shm *shm;
+    uint8_t *slots;
+    size_t map_len;
+    int memfd;                 // read-only, handed to consumers
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint64_t head;
+    uint64_t oversize;
+};
+
+struct evring {
+    const struct evring_shm *shm;
+    const uint8_t *slots;
+    size_t map_len;
+    int efd;
+    uint32_t slot_size;
+    uint32_t slot_count;
+    uint64_t next;             // next record to read
+    uint64_t lost;
+    uint8_t *buf;              // copy of the last record, slot_size bytes
+};
+
+static uint32_t round_pow2(uint32_t v) {
+    uint32_t p = 1;
+    while (p < v) p <<= 1;
+    return p;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+struct evring_producer *evring_producer_new(uint32_t slot_count, uint32_t slot_size) {
+    slot_count = round_pow2(slot_count ? slot_count : 1);
+    slot_size = round_pow2(slot_size < MIN_SLOT_SIZE ? MIN_SLOT_SIZE : slot_size);
+    struct evring_producer *p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->memfd = -1;
+    p->slot_size = slot_size;
+    p->slot_count = slot_count;
+    p->map_len = EVRING_HDR_SIZE + (size_t)slot_count * slot_size;
+    int rw = memfd_create("ieee1905-evring", MFD_CLOEXEC | MFD_ALLOW_SEALING);
+    if (rw < 0 || ftruncate(rw, (off_t)p->map_len) < 0 ||
+        // consumers must not be able to shrink the file under our mapping
+        fcntl(rw, F_ADD_SEALS, F_SEAL_SHRINK | F_SEAL_GROW) < 0) {
+        perror("evring memfd");
+        goto fail;
+    }
+    void *map = mmap(NULL, p->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, rw, 0);
+    if (map == MAP_FAILED) {
+        perror("evring mmap");
+        goto fail;
+    }
+    p->shm = map;
+    // Only the mapping above stays writable: no later write() or writable
+    // mmap on any fd, and what consumers get is opened O_RDONLY besides.
+    char path[32];
+    snprintf(path, sizeof(path), "/proc/self/fd/%d", rw);
+    if (fcntl(rw, F_ADD_SEALS, F_SEAL_FUTURE_WRITE | F_SEAL_SEAL) < 0 ||
+        (p->memfd = open(path, O_RDONLY | O_CLOEXEC)) < 0) {
+        perror("evring seal");
+        munmap(map, p->map_len);
+        goto fail;
+    }
+    close(rw);
+    p->slots = (uint8_t *)map + EVRING_HDR_SIZE;
+    p->shm->magic = EVRING_MAGIC;
+    p->shm->version = EVRING_VERSION;
+    p->shm->slot_size = slot_size;
+    p->shm->slot_count = slot_count;
+    return p;
+
+fail:
+    if (rw >= 0) close(rw);
+    free(p);
+    return NULL;
+}
+
+void evring_producer_free(struct evring_producer *p) {
+    if (!p) return;
+    munmap(p->shm, p->map_len);
+    close(p->memfd);
+    free(p);
+}
+
+int evring_producer_fd(const struct evring_producer *p) {
+    return p->memfd;
+}
+
+uint64_t evring_producer_head(const struct evring_producer *p) {
+    return p->head;
+}
+
+int evring_publish(struct evring_producer *p, const struct evring_msg *msg) {
+    uint32_t slot_size = p->slot_size;
+    if (msg->tlv_len > slot_size - sizeof(struct evring_slot)) {
+        __atomic_store_n(&p->shm->oversize, ++p->oversize, __ATOMIC_RELAXED);
+        return -1;
+    }
+    struct evring_slot *s = (struct evring_slot *)
+        (p->slots + (size_t)(p->head & (p->slot_count - 1)) * slot_size);
+    __atomic_store_n(&s->seq, 0, __ATOMIC_RELAXED);
+    __atomic_thread_fence(__ATOMIC_RELEASE);
+    s->ts_ns = msg->ts_ns ? msg->ts_ns : now_ns();
+    s->tlv_len = (uint32_t)msg->tlv_len;
+    s->msg_type = msg->msg_type;
+    s->mid = msg->mid;
+    s->flags = msg->flags;
+    memcpy(s->src_mac, msg->src_mac, 6);
+    memcpy(s->al_mac, msg->al_mac, 6);
+    if (msg->tlv_len) memcpy(s->tlv, msg->tlv, msg->tlv_len);
+    p->head++;
+    __atomic_store_n(&s->seq, p->head, __ATOMIC_RELEASE);
+    __atomic_store_n(&p->shm->head, p->head, __ATOMIC_RELEASE);
+    return 0;
+}
+
+struct evring *evring_attach(int memfd, int efd) {
+    struct stat st;
+    if (fstat(memfd, &st) < 0 || (size_t)st.st_size < EVRING_HDR_SIZE) return NULL;
+    void *map = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, memfd, 0);
+    if (map == MAP_FAILED) return NULL;
+    const struct evring_shm *shm = map;
+    uint32_t size = shm->slot_size, count = shm->slot_count;
+    if (shm->magic != EVRING_MAGIC || shm->version != EVRING_VERSION ||
+        size < MIN_SLOT_SIZE || (size & (size - 1)) || !count || (count & (count - 1)) ||
+        EVRING_HDR_SIZE + (size_t)count * size != (size_t)st.st_size) {
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    struct evring *r = calloc(1, sizeof(*r));
+    uint8_t *buf = malloc(size);
+    if (!r || !buf) {
+        free(r);
+        free(buf);
+        munmap(map, (size_t)st.st_size);
+        return NULL;
+    }
+    r->shm = shm;
+    r->slots = (const uint8_t *)map + EVRING_HDR_SIZE;
+    r->map_len = (size_t)st.st_size;
+    r->efd = efd;
+    r->slot_size = size;
+    r->slot_count = count;
+    r->buf = buf;
+    r->next = __atomic_load_n(&shm->head, __ATOMIC_ACQUIRE);
+    close(memfd);
+    return r;
+}
+
+void evring_detach(struct evring *r) {
+    if (!r) return;
+    munmap((void *)r->shm, r->map_len);
+    if (r->efd >= 0) close(r->efd);
+    free(r->buf);
+    free(r);
+}
+
+int evring_fd(const struct evring *r) {
+    return r->efd;
+}
+
+void evring_ack(struct evring *r) {
+    uint64_t v;
+    ssize_t rv = read(r->efd, &v, sizeof(v));
+    (void)rv;
+}
+
+uint64_t evring_lost(const struct evring *r) {
+    return r->lost;
+}
+
+int evring_next(struct evring *r, struct evring_msg *msg) {
+    uint64_t head = __atomic_load_n(&r->shm->head, __ATOMIC_ACQUIRE);
+    while (r->next != head) {
+        if (head - r->next > r->slot_count) { // lapped: skip what was overwritten
+            r->lost += head - r->next - r->slot_count;
+            r->next = head - r->slot_count;
+        }
+        const struct evring_slot *s = (const struct evring_slot *)
+            (r->slots + (size_t)(r->next & (r->slot_count - 1)) * r->slot_size);
+        uint64_t want = r->next + 1;
+        r->next++;
+        if (__atomic_load_n(&s->seq, __ATOMIC_ACQUIRE) != want) {
+            r->lost++;  // already being rewritten
+            continue;
+        }
+        struct evring_slot *copy = (struct evring_slot *)r->buf;
+        memcpy(copy, s, sizeof(*s));
+        size_t len = copy->tlv_len;
+        if (len > r->slot_size - sizeof(*s)) len = 0; // torn header, seq check rejects it
+        memcpy(copy->tlv, s->tlv, len);
+        __atomic_thread_fence(__ATOMIC_ACQUIRE);
+        if (__atomic_load_n(&s->seq, __ATOMIC_RELAXED) != want) {
+            r->lost++;
+            continue;
+        }
+        msg->seq = want - 1;
+        msg->ts_ns = copy->ts_ns;
+        msg->msg_type = copy->msg_type;
+        msg->mid = copy->mid;
+        msg->flags = copy->flags;
+        memcpy(msg->src_mac, copy->src_mac, 6);
+        memcpy(msg->al_mac, copy->al_mac, 6);
+        msg->tlv = copy->tlv;
+        msg->tlv_len = len;
+        return 1;
+    }
+    return 0;
+}
+
+void evring_print_tlvs(const char *tag, const uint8_t *tlv, size_t len) {
+    while (len >= 3) {
+        size_t tlen = (size_t)((tlv[1] << 8) | tlv[2]);
+        if (3 + tlen > len) break;
+        printf("%s   tlv 0x%02x len %zu\n", tag, tlv[0], tlen);
+        tlv += 3 + tlen;
+        len -= 3 + tlen;
+    }
+}
@@ -0,0 +1,138 @@
+// SPDX-License-Identifier: MIT
+//
+// ubus side of an event ring consumer, see include/evring.h. The consumer
+// sends its eventfd with the ieee1905 "ring_open" call and gets the memfd
+// and its slot id back; ieee1905d cannot tell when a client goes away, so
+// every registered slot has to be given back with "ring_close".
+
+#include "evring.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+#include <libubus.h>
+#include <libubox/uloop.h>
+#include <libubox/blobmsg.h>
+
+#define CALL_TIMEOUT_MS 2000
+
+struct evring_consumer {
+    struct ubus_context *ubus;
+    uint32_t obj;
+    uint32_t id;
+    bool registered;           // the daemon handed out id
+    int memfd;
+    struct evring *ring;
+    struct uloop_fd ufd;
+    const struct evring_type *types;
+    size_t n_types;
+    evring_consumer_cb cb;
+    void *user;
+    uint64_t lost;             // already reported to cb
+};
+
+static void consumer_read(struct uloop_fd *u, unsigned int events) {
+    (void)events;
+    struct evring_consumer *c = container_of(u, struct evring_consumer, ufd);
+    struct evring_msg m;
+    evring_ack(c->ring);
+    while (evring_next(c->ring, &m) > 0) {
+        size_t i = 0;
+        while (i < c->n_types && c->types[i].type != m.msg_type) i++;
+        if (i == c->n_types) continue;
+        // records lost before a skipped one are reported with the next delivered
+        uint64_t lost = evring_lost(c->ring) - c->lost;
+        c->lost += lost;
+        c->cb(&m, &c->types[i], lost, c->user);
+    }
+}
+
+static void open_data_cb(struct ubus_request *req, int type, struct blob_attr *msg) {
+    (void)type;
+    struct evring_consumer *c = req->priv;
+    struct blob_attr *cur;
+    size_t rem;
+    blobmsg_for_each_attr(cur, msg, rem) {
+        if (strcmp(blobmsg_name(cur), "id") == 0) {
+            c->id = blobmsg_get_u32(cur);
+            c->registered = true;
+        }
+    }
+}
+
+static void open_fd_cb(struct ubus_request *req, int fd) {
+    struct evring_consumer *c = req->priv;
+    c->memfd = fd;
+}
+
+static void consumer_unregister(struct evring_consumer *c) {
+    struct blob_buf bb;
+    memset(&bb, 0, sizeof(bb));
+    blob_buf_init(&bb, 0);
+    blobmsg_add_u32(&bb, "id", c->id);
+    ubus_invoke(c->ubus, c->obj, "ring_close", bb.head, NULL, NULL, CALL_TIMEOUT_MS);
+    blob_buf_free(&bb);
+}
+
+struct evring_consumer *evring_consumer_open(struct ubus_context *ubus, uint32_t obj,
+                                             const struct evring_type *types, size_t n_types,
+                                             bool mute, evring_consumer_cb cb, void *user) {
+    struct evring_consumer *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->ubus = ubus;
+    c->obj = obj;
+    c->memfd = -1;
+    c->types = types;
+    c->n_types = n_types;
+    c->cb = cb;
+    c->user = user;
+    int efd = eventfd(0, EFD_CLOEXEC | EFD_NONBLOCK);
+    int efd_copy = efd >= 0 ? dup(efd) : -1;  // libubus closes the fd it sends
+    if (efd_copy < 0) {
+        if (efd >= 0) close(efd);
+        free(c);
+        return NULL;
+    }
+
+    struct blob_buf bb;
+    memset(&bb, 0, sizeof(bb));
+    blob_buf_init(&bb, 0);
+    void *arr = blobmsg_open_array(&bb, "types");
+    for (size_t i = 0; i < n_types; i++) blobmsg_add_string(&bb, NULL, types[i].name);
+    blobmsg_close_array(&bb, arr);
+    if (mute) blobmsg_add_u8(&bb, "mute", 1);
+    struct ubus_request req;
+    int rv = ubus_invoke_async_fd(ubus, obj, "ring_open", bb.head, &req, efd_copy);
+    blob_buf_free(&bb);
+    if (!rv) {
+        req.data_cb = open_data_cb;
+        req.fd_cb = open_fd_cb;
+        req.priv = c;
+        rv = ubus_complete_request(ubus, &req, CALL_TIMEOUT_MS);
+    }
+    if (rv || c->memfd < 0 || !(c->ring = evring_attach(c->memfd, efd))) {
+        // the daemon may have taken a slot even though the call failed here
+        if (c->registered) consumer_unregister(c);
+        if (c->memfd >= 0) close(c->memfd);
+        close(efd);
+        free(c);
+        return NULL;
+    }
+    c->ufd.fd = efd;
+    c->ufd.cb = consumer_read;
+    uloop_fd_add(&c->ufd, ULOOP_READ);
+    return c;
+}
+
+void evring_consumer_close(struct evring_consumer *c) {
+    if (!c) return;
+    consumer_unregister(c);
+    uloop_fd_delete(&c->ufd);
+    evring_detach(c->ring);
+    free(c);
+}
+
+uint32_t evring_consumer_id(const struct evring_consumer *c) {
+    return c->id;
+}
@@ -0,0 +1,120 @@
+// SPDX-License-Identifier: MIT
+//
+// Arena for owning CMDUs. Allocation bumps a pointer in the current chunk;
+// nothing is freed individually. A reset moves every chunk to a free list
+// that later allocations draw from, so once a workload's peak batch has
+// been seen the arena stops calling malloc. Requests larger than the chunk
+// size get a chunk of their own, which is recycled the same way.
+
+#include "i1905_priv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <stdalign.h>
+#include <stddef.h>
+
+#define ARENA_ALIGN alignof(max_align_t)
+
+struct arena_chunk {
+    struct arena_chunk *next;
+    size_t size;                // bytes at data
+    size_t used;
+    alignas(max_align_t) unsigned char data[];
+};
+
+struct i1905_arena {
+    struct arena_chunk *cur;    // in use, newest first
+    struct arena_chunk *free;
+    size_t chunk_size;
+    void *last;                 // most recent allocation, may grow in place
+    size_t last_size;
+};
+
+static size_t align_up(size_t n) {
+    return (n + ARENA_ALIGN - 1) & ~(ARENA_ALIGN - 1);
+}
+
+struct i1905_arena *i1905_arena_new(size_t chunk_size) {
+    struct i1905_arena *a = calloc(1, sizeof(*a));
+    if (!a) return NULL;
+    a->chunk_size = chunk_size ? align_up(chunk_size) : I1905_DEFAULT_ARENA_CHUNK;
+    return a;
+}
+
+static void chunks_free(struct arena_chunk *c) {
+    while (c) {
+        struct arena_chunk *next = c->next;
+        free(c);
+        c = next;
+    }
+}
+
+void i1905_arena_free(struct i1905_arena *a) {
+    if (!a) return;
+    chunks_free(a->cur);
+    chunks_free(a->free);
+    free(a);
+}
+
+void i1905_arena_reset(struct i1905_arena *a) {
+    if (!a) return;
+    while (a->cur) {
+        struct arena_chunk *c = a->cur;
+        a->cur = c->next;
+        c->used = 0;
+        c->next = a->free;
+        a->free = c;
+    }
+    a->last = NULL;
+    a->last_size = 0;
+}
+
+// A recycled chunk that fits, else a new one.
+static struct arena_chunk *chunk_get(struct i1905_arena *a, size_t need) {
+    for (struct arena_chunk **pp = &a->free; *pp; pp = &(*pp)->next) {
+        if ((*pp)->size >= need) {
+            struct arena_chunk *c = *pp;
+            *pp = c->next;
+            return c;
+        }
+    }
+    size_t size = need > a->chunk_size ? need : a->chunk_size;
+    struct arena_chunk *c = malloc(sizeof(*c) + size);
+    if (!c) return NULL;
+    c->size = size;
+    c->used = 0;
+    return c;
+}
+
+void *i1905_arena_alloc(struct i1905_arena *a, size_t size) {
+    if (!a) return NULL;
+    size = align_up(size ? size : 1);
+    struct arena_chunk *c = a->cur;
+    if (!c || c->size - c->used < size) {
+        c = chunk_get(a, size);
+        if (!c) return NULL;
+        c->next = a->cur;
+        a->cur = c;
+    }
+    void *p = c->data + c->used;
+    c->used += size;
+    a->last = p;
+    a->last_size = size;
+    return p;
+}
+
+void *i1905_arena_grow(struct i1905_arena *a, void *p, size_t old_size, size_t new_size) {
+    if (!p) return i1905_arena_alloc(a, new_size);
+    struct arena_chunk *c = a->cur;
+    if (p == a->last) {
+        size_t need = align_up(new_size);
+        if (c->used - a->last_size + need <= c->size) {
+            c->used += need - a->last_size;
+            a->last_size = need;
+            return p;
+        }
+    }
+    void *q = i1905_arena_alloc(a, new_size);
+    if (q) memcpy(q, p, old_size);
+    return q;
+}
@@ -0,0 +1,294 @@
+// SPDX-License-Identifier: MIT
+//
+// Frame capture. The context's thread copies each frame with a wall-clock
+// timestamp into a byte ring allocated when the capture starts and never
+// touches the file: a writer thread turns the records into pcapng blocks
+// and writes them out, woken when the ring passes half full and otherwise
+// every CAP_FLUSH_MS, so the file trails the traffic by that much. The ring
+// has one producer and one consumer, each owning one position, so the
+// hot path is a copy and a release store. A record that does not fit is
+// dropped and counted; capture never slows the context down.
+//
+// The file is one section with one Ethernet interface at nanosecond
+// resolution; each packet block carries the direction in epb_flags.
+
+#define _GNU_SOURCE // pthread_condattr_setclock, CLOCK_REALTIME
+#include "i1905_priv.h"
+
+#include <pthread.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define CAP_FLUSH_MS   50
+#define CAP_ALIGN      8
+#define CAP_MIN_RING   (64 * 1024)
+#define CAP_FILE_BUF   (256 * 1024)
+#define CAP_WRAP       0        // record dir: skip to the start of the ring
+
+struct cap_rec {
+    uint32_t size;              // whole record, CAP_ALIGN multiple
+    uint32_t caplen;
+    uint32_t origlen;
+    uint32_t dir;               // I1905_CAPTURE_IN / _OUT, CAP_WRAP
+    uint64_t ts_ns;             // CLOCK_REALTIME
+};
+
+struct i1905_capture {
+    uint8_t *ring;
+    size_t size;
+    uint64_t head;              // producer: bytes ever written
+    uint64_t tail;              // writer: bytes ever consumed
+    uint32_t snaplen;
+    struct i1905_stats *stats;
+    FILE *f;
+    uint8_t *out;               // writer: blocks are formatted here
+    size_t out_len;
+    bool failed;                // a write failed, records are discarded
+
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    bool stop;
+};
+
+static size_t align_up(size_t n, size_t a) {
+    return (n + a - 1) & ~(a - 1);
+}
+
+static int out_flush(struct i1905_capture *c) {
+    size_t n = c->out_len;
+    c->out_len = 0;
+    if (c->failed) return -1;
+    if (fwrite(c->out, 1, n, c->f) == n && fflush(c->f) == 0) return 0;
+    fprintf(stderr, "capture: %s\n", strerror(errno));
+    c->failed = true;
+    return -1;
+}
+
+// room for n more bytes in the output buffer, NULL once writing failed
+static uint8_t *out_reserve(struct i1905_capture *c, size_t n) {
+    if (c->out_len + n > CAP_FILE_BUF && out_flush(c) < 0) return NULL;
+    if (c->failed) return NULL;
+    uint8_t *p = c->out + c->out_len;
+    c->out_len += n;
+    return p;
+}
+
+// pcapng is written in host byte order
+static void put16(uint8_t *p, uint16_t v) {
+    memcpy(p, &v, 2);
+}
+
+static void put32(uint8_t *p, uint32_t v) {
+    memcpy(p, &v, 4);
+}
+
+// option header: code, value length
+static void put_opt(uint8_t *p, uint16_t code, uint16_t len) {
+    put16(p, code);
+    put16(p + 2, len);
+}
+
+static int write_header(struct i1905_capture *c) {
+    uint8_t *b = out_reserve(c, 28 + 32);
+    // section header: no options, section length unknown
+    put32(b, 0x0A0D0D0A);
+    put32(b + 4, 28);
+    put32(b + 8, 0x1A2B3C4D);
+    put32(b + 12, 1);           // version 1.0
+    memset(b + 16, 0xFF, 8);
+    put32(b + 24, 28);
+    // interface description: Ethernet, if_tsresol 9 (nanoseconds)
+    uint8_t *i = b + 28;
+    put32(i, 1);
+    put32(i + 4, 32);
+    put16(i + 8, 1);            // LINKTYPE_ETHERNET
+    put16(i + 10, 0);
+    put32(i + 12, c->snaplen);
+    put_opt(i + 16, 9, 1);
+    put32(i + 20, 0);
+    i[20] = 9;
+    put32(i + 24, 0);           // opt_endofopt
+    put32(i + 28, 32);
+    return out_flush(c);
+}
+
+static void write_packet(struct i1905_capture *c, const struct cap_rec *r) {
+    size_t pad = align_up(r->caplen, 4) - r->caplen;
+    uint32_t total = (uint32_t)(28 + r->caplen + pad + 12 + 4);
+    uint8_t *h = out_reserve(c, total);
+    if (!h) {
+        I1905_STAT_INC(c->stats->capture_errors);
+        return;
+    }
+    uint8_t *t = h + 28 + r->caplen;
+    memcpy(h + 28, r + 1, r->caplen);
+    memset(t, 0, pad);
+    t += pad;
+    put32(h, 6);                // enhanced packet block
+    put32(h + 4, total);
+    put32(h + 8, 0);            // interface 0
+    put32(h + 12, (uint32_t)(r->ts_ns >> 32));
+    put32(h + 16, (uint32_t)r->ts_ns);
+    put32(h + 20, r->caplen);
+    put32(h + 24, r->origlen);
+    put_opt(t, 2, 4);           // epb_flags
+    put32(t + 4, r->dir);
+    put32(t + 8, 0);            // opt_endofopt
+    put32(t + 12, total);
+}
+
+// Write out everything published so far, returning ring space as it goes.
+static void drain(struct i1905_capture *c) {
+    uint64_t head = __atomic_load_n(&c->head, __ATOMIC_ACQUIRE);
+    uint64_t tail = c->tail;
+    if (tail == head) return;
+    while (tail != head) {
+        size_t off = tail % c->size;
+        const struct cap_rec *r = (const void *)(c->ring + off);
+        if (c->size - off < sizeof(*r) || r->dir == CAP_WRAP) {
+            tail += c->size - off;
+        } else {
+            write_packet(c, r);
+            tail += r->size;
+        }
+        __atomic_store_n(&c->tail, tail, __ATOMIC_RELEASE);
+    }
+    out_flush(c);
+}
+
+static void *writer_main(void *arg) {
+    struct i1905_capture *c = arg;
+    pthread_mutex_lock(&c->lock);
+    while (1) {
+        bool stop = c->stop;
+        pthread_mutex_unlock(&c->lock);
+        // after stop was seen, the producer is done: this pass gets the rest
+        drain(c);
+        pthread_mutex_lock(&c->lock);
+        if (stop) break;
+        if (c->stop) continue;
+        struct timespec ts;
+        clock_gettime(CLOCK_MONOTONIC, &ts);
+        ts.tv_nsec += CAP_FLUSH_MS * 1000000L;
+        if (ts.tv_nsec >= 1000000000L) {
+            ts.tv_sec++;
+            ts.tv_nsec -= 1000000000L;
+        }
+        pthread_cond_timedwait(&c->cond, &c->lock, &ts);
+    }
+    pthread_mutex_unlock(&c->lock);
+    return NULL;
+}
+
+struct i1905_capture *i1905_capture_new(const char *path, size_t ring_size,
+                                        uint32_t snaplen, struct i1905_stats *stats) {
+    if (!path) return NULL;
+    if (!ring_size) ring_size = I1905_DEFAULT_CAPTURE_RING;
+    if (ring_size < CAP_MIN_RING) ring_size = CAP_MIN_RING;
+    struct i1905_capture *c = calloc(1, sizeof(*c));
+    if (!c) return NULL;
+    c->size = align_up(ring_size, CAP_ALIGN);
+    c->snaplen = snaplen && snaplen < UINT16_MAX ? snaplen : UINT16_MAX;
+    c->stats = stats;
+    c->ring = malloc(c->size);
+    c->out = malloc(CAP_FILE_BUF);
+    c->f = c->ring && c->out ? fopen(path, "wb") : NULL;
+    if (!c->f) {
+        if (c->ring && c->out) fprintf(stderr, "capture %s: %s\n", path, strerror(errno));
+        free(c->out);
+        free(c->ring);
+        free(c);
+        return NULL;
+    }
+    // touch the ring now rather than on the receive path
+    memset(c->ring, 0, c->size);
+    setvbuf(c->f, NULL, _IONBF, 0);
+
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&c->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    pthread_mutex_init(&c->lock, NULL);
+    int err = write_header(c) < 0 ? EIO : pthread_create(&c->thread, NULL, writer_main, c);
+    if (err) {
+        fprintf(stderr, "capture %s: %s\n", path, strerror(err));
+        pthread_cond_destroy(&c->cond);
+        pthread_mutex_destroy(&c->lock);
+        fclose(c->f);
+        free(c->out);
+        free(c->ring);
+        free(c);
+        return NULL;
+    }
+    return c;
+}
+
+void i1905_capture_free(struct i1905_capture *c) {
+    if (!c) return;
+    pthread_mutex_lock(&c->lock);
+    c->stop = true;
+    pthread_cond_signal(&c->cond);
+    pthread_mutex_unlock(&c->lock);
+    pthread_join(c->thread, NULL);
+    if (fclose(c->f) != 0 && !c->failed) fprintf(stderr, "capture: %s\n", strerror(errno));
+    pthread_cond_destroy(&c->cond);
+    pthread_mutex_destroy(&c->lock);
+    free(c->out);
+    free(c->ring);
+    free(c);
+}
+
+void i1905_capture_frame(struct i1905_capture *c, unsigned dir, const uint8_t *hdr,
+                         const uint8_t *data, size_t len) {
+    size_t origlen = len + (hdr ? I1905_ETH_HDR_LEN : 0);
+    size_t caplen = origlen < c->snaplen ? origlen : c->snaplen;
+    size_t need = align_up(sizeof(struct cap_rec) + caplen, CAP_ALIGN);
+    uint64_t head = c->head;
+    size_t used = (size_t)(head - __atomic_load_n(&c->tail, __ATOMIC_ACQUIRE));
+    size_t off = head % c->size;
+    size_t skip = c->size - off < need ? c->size - off : 0;
+    if (used + skip + need > c->size) {
+        I1905_STAT_INC(c->stats->capture_drops);
+        return;
+    }
+    if (skip) {
+        // too little room before the end: mark the rest as unused
+        if (skip >= sizeof(struct cap_rec)) {
+            struct cap_rec wrap = { .size = (uint32_t)skip, .dir = CAP_WRAP };
+            memcpy(c->ring + off, &wrap, sizeof(wrap));
+        }
+        off = 0;
+    }
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    struct cap_rec r = {
+        .size = (uint32_t)need,
+        .caplen = (uint32_t)caplen,
+        .origlen = (uint32_t)origlen,
+        .dir = dir,
+        .ts_ns = (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec,
+    };
+    uint8_t *p = c->ring + off;
+    memcpy(p, &r, sizeof(r));
+    p += sizeof(r);
+    if (hdr) {
+        size_t n = caplen < I1905_ETH_HDR_LEN ? caplen : I1905_ETH_HDR_LEN;
+        memcpy(p, hdr, n);
+        p += n;
+        caplen -= n;
+    }
+    memcpy(p, data, caplen);
+    __atomic_store_n(&c->head, head + skip + need, __ATOMIC_RELEASE);
+    I1905_STAT_INC(c->stats->capture_frames);
+    // wake the writer early once, when a burst fills half the ring
+    if (used < c->size / 2 && used + skip + need >= c->size / 2) {
+        pthread_mutex_lock(&c->lock);
+        pthread_cond_signal(&c->cond);
+        pthread_mutex_unlock(&c->lock);
+    }
+}
@@ -0,0 +1,76 @@
+// SPDX-License-Identifier: MIT
+//
+// Duplicate suppression for relayed multicast: a fixed-size open-addressed
+// table of (AL MAC, message id) with time-based expiry. Probing is bounded
+// to a small window, expired slots are reused in place and a full window
+// overwrites its oldest entry, so lookups never degrade past DEDUP_PROBE.
+
+#include "i1905_priv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define DEDUP_PROBE 8
+
+struct dedup_slot {
+    uint8_t  al_mac[6];
+    uint16_t mid;
+    uint64_t expires_ms;   // 0: never used
+};
+
+struct i1905_dedup {
+    unsigned mask;
+    uint32_t ttl_ms;
+    struct i1905_stats *stats;
+    struct dedup_slot slot[];
+};
+
+struct i1905_dedup *i1905_dedup_new(unsigned size, uint32_t ttl_ms,
+                                    struct i1905_stats *stats) {
+    unsigned n = DEDUP_PROBE;
+    while (n < size) n <<= 1;
+    struct i1905_dedup *d = calloc(1, sizeof(*d) + n * sizeof(d->slot[0]));
+    if (!d) return NULL;
+    d->mask = n - 1;
+    d->ttl_ms = ttl_ms;
+    d->stats = stats;
+    return d;
+}
+
+void i1905_dedup_free(struct i1905_dedup *d) {
+    free(d);
+}
+
+static unsigned dedup_hash(const uint8_t al_mac[6], uint16_t mid) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ al_mac[i]) * 16777619u;
+    h = (h ^ (mid & 0xFF)) * 16777619u;
+    h = (h ^ (mid >> 8)) * 16777619u;
+    return h;
+}
+
+bool i1905_dedup_check(struct i1905_dedup *d, const uint8_t al_mac[6], uint16_t mid,
+                       uint64_t now_ms) {
+    unsigned home = dedup_hash(al_mac, mid);
+    struct dedup_slot *victim = NULL;
+    for (unsigned i = 0; i < DEDUP_PROBE; i++) {
+        struct dedup_slot *s = &d->slot[(home + i) & d->mask];
+        bool live = s->expires_ms > now_ms;
+        if (live && s->mid == mid && memcmp(s->al_mac, al_mac, 6) == 0) {
+            I1905_STAT_INC(d->stats->dedup_hits);
+            return true;
+        }
+        if (!live) {
+            if (!victim || victim->expires_ms > now_ms) victim = s;
+        } else if (!victim || (victim->expires_ms > now_ms &&
+                               s->expires_ms < victim->expires_ms)) {
+            victim = s;
+        }
+    }
+    if (victim->expires_ms > now_ms) I1905_STAT_INC(d->stats->dedup_evictions);
+    memcpy(victim->al_mac, al_mac, 6);
+    victim->mid = mid;
+    victim->expires_ms = now_ms + d->ttl_ms;
+    I1905_STAT_INC(d->stats->dedup_misses);
+    return false;
+}
@@ -0,0 +1,206 @@
+// SPDX-License-Identifier: MIT
+//
+// Library-internal definitions shared between the CMDU core and the
+// transport backends. Not installed, not part of the public API.
+
+#pragma once
+
+#include "ieee1905.h"
+
+// One received L2 frame (Ethernet header + CMDU). For zero-copy backends
+// data points into the transport's ring and stays valid only until the
+// next rx_batch() call on the same transport.
+struct i1905_frame {
+    const uint8_t *data;
+    size_t len;
+    struct i1905_addr src;  // mac is filled by the core from the header
+    bool truncated;         // cut to len by the transport, dropped as oversize
+};
+
+// With hdr set, the frame is the I1905_ETH_HDR_LEN bytes at hdr followed by
+// data; fan-out sends share one CMDU buffer this way. Otherwise data starts
+// at the Ethernet header.
+struct i1905_tx_frame {
+    const uint8_t *data;
+    size_t len;             // bytes at data
+    const struct i1905_addr *dst;
+    const uint8_t *hdr;
+};
+
+static inline size_t i1905_tx_frame_len(const struct i1905_tx_frame *f) {
+    return f->len + (f->hdr ? I1905_ETH_HDR_LEN : 0);
+}
+
+struct i1905_transport;
+
+struct i1905_transport_ops {
+    const char *name;
+    int  (*open)(struct i1905_transport *tp, const char *ifname, uint16_t port);
+    int  (*get_fd)(const struct i1905_transport *tp);
+    // returns frames received (0 when drained) or -1 on error
+    int  (*rx_batch)(struct i1905_transport *tp, struct i1905_frame *frames, unsigned max);
+    // returns frames accepted for transmission or -1 on error
+    int  (*tx_batch)(struct i1905_transport *tp, const struct i1905_tx_frame *frames, unsigned n);
+    int  (*resolve)(struct i1905_transport *tp, const char *dst, uint16_t port,
+                    struct i1905_addr *out);
+    void (*close)(struct i1905_transport *tp);
+    // optional: stop using the socket, return the position a successor
+    // resumes at (its adopt_state)
+    uint32_t (*detach)(struct i1905_transport *tp);
+};
+
+struct i1905_transport {
+    const struct i1905_transport_ops *ops;
+    void *priv;
+    unsigned rx_batch;
+    uint8_t if_mac[6];      // source MAC stamped on transmitted frames
+    int ifindex;            // 0: not tied to one interface
+    // Threaded receive: with n_shards set, incoming frames are split by
+    // source MAC across n_shards sockets opened with shard 0..n_shards-1;
+    // shard -1 is the context's own socket, which then only transmits.
+    // shard_group identifies the AF_PACKET fanout group.
+    unsigned n_shards;
+    int shard;
+    uint16_t shard_group;
+    // With adopt set, open() takes over adopt_fd from a predecessor's
+    // detach() and clears adopt. A backend that cannot use the socket opens
+    // a new one and leaves adopt set; the core then closes adopt_fd.
+    bool adopt;
+    int adopt_fd;
+    uint32_t adopt_state;
+};
+
+// Statistics are written by the context's thread and its receive threads
+// and may be read from any other, so every update is a relaxed atomic: no
+// ordering, no torn values.
+#define I1905_STAT_ADD(field, n) __atomic_fetch_add(&(field), (uint64_t)(n), __ATOMIC_RELAXED)
+#define I1905_STAT_INC(field)    I1905_STAT_ADD(field, 1)
+
+// receive threads may race here, hence the compare-and-swap loop
+static inline void i1905_stat_max(uint64_t *field, uint64_t v) {
+    uint64_t cur = __atomic_load_n(field, __ATOMIC_RELAXED);
+    while (v > cur && !__atomic_compare_exchange_n(field, &cur, v, true,
+                                                   __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+    }
+}
+
+// Relaxed snapshot of a struct made only of uint64_t counters
+static inline void i1905_stats_copy(void *dst, const void *src, size_t size) {
+    uint64_t *d = dst;
+    const uint64_t *s = src;
+    for (size_t i = 0; i < size / sizeof(uint64_t); i++) d[i] = __atomic_load_n(&s[i], __ATOMIC_RELAXED);
+}
+
+extern const struct i1905_transport_ops i1905_udp_transport;
+extern const struct i1905_transport_ops i1905_packet_transport;
+extern const struct i1905_transport_ops i1905_loop_transport;
+
+extern const uint8_t i1905_multicast_mac[6];
+
+// version, reserved, message type, message id, fragment id, flags
+#define CMDU_HDR_LEN 7
+
+int i1905_parse_mac(const char *str, uint8_t mac[6]);
+
+// Validate and account a received batch in place (any thread): valid[i]
+// tells whether views[i] holds a well-formed CMDU; returns how many do.
+unsigned i1905_parse_batch(struct i1905_stats *stats, struct i1905_frame *frames,
+                           struct i1905_cmdu_view *views, bool *valid, unsigned n);
+
+// Threaded receive (rxq.c): worker threads on their own transport shards
+// parse frames and pass them to the context's thread through a bounded
+// lock-free MPSC queue whose eventfd replaces the socket in i1905_get_fd().
+typedef void (*i1905_rxq_fn)(void *user, const struct i1905_frame *f,
+                             const struct i1905_cmdu_view *view);
+struct i1905_rxq;
+// proto carries ops, rx_batch and the shard settings for the workers
+struct i1905_rxq *i1905_rxq_start(const struct i1905_transport *proto, const char *ifname,
+                                  uint16_t port, unsigned slots, struct i1905_stats *stats);
+void i1905_rxq_stop(struct i1905_rxq *q);
+int i1905_rxq_fd(const struct i1905_rxq *q);
+// hand up to budget queued frames to fn in queue order; returns the count
+unsigned i1905_rxq_drain(struct i1905_rxq *q, unsigned budget, i1905_rxq_fn fn, void *user);
+
+// Resize p, the arena's most recent allocation in place when possible,
+// otherwise by copying old_size bytes to a new block (arena.c)
+void *i1905_arena_grow(struct i1905_arena *a, void *p, size_t old_size, size_t new_size);
+
+// Token bucket in L2 bytes, rate 0: unlimited
+struct i1905_tx_bucket {
+    uint64_t rate;          // bytes per second
+    int64_t burst;
+    int64_t tokens;         // may run negative, see txq.c
+    uint64_t last_ns;
+    uint64_t blocked;       // drain pass that found it empty
+};
+
+void i1905_tx_bucket_set(struct i1905_tx_bucket *b, uint32_t rate, uint32_t burst);
+
+// Transmit scheduler (txq.c): per-class FIFOs in front of the transport,
+// shaped by the interface's bucket and the per-peer buckets passed with each
+// frame. One per interface; if_stats gets that interface's share.
+struct i1905_txq;
+struct i1905_txq *i1905_txq_new(struct i1905_transport *tp, struct i1905_wheel *wheel,
+                                unsigned limit, struct i1905_stats *stats,
+                                struct i1905_if_stats *if_stats);
+void i1905_txq_free(struct i1905_txq *q);
+void i1905_txq_set_class(struct i1905_txq *q, uint16_t type, i1905_tx_class cls);
+void i1905_txq_set_rate(struct i1905_txq *q, uint32_t rate, uint32_t burst);
+// classes, rate and capture of another interface's scheduler
+void i1905_txq_inherit(struct i1905_txq *q, const struct i1905_txq *from);
+// Send frames of one message type now or queue them. buckets (may be NULL)
+// and ok are per frame; ok[i] is true once frame i was sent or queued.
+// Returns how many were.
+unsigned i1905_txq_send(struct i1905_txq *q, const struct i1905_tx_frame *frames,
+                        struct i1905_tx_bucket *const *buckets, unsigned n, bool *ok);
+// the owner of bucket goes away; its queued frames stay, unshaped
+void i1905_txq_forget(struct i1905_txq *q, const struct i1905_tx_bucket *bucket);
+bool i1905_txq_want_write(const struct i1905_txq *q);
+// drain whatever the buckets allow; also the socket-writable handler
+void i1905_txq_flush(struct i1905_txq *q);
+struct i1905_capture;
+// frames handed to the transport from now on are captured too (NULL: stop)
+void i1905_txq_set_capture(struct i1905_txq *q, struct i1905_capture *cap);
+
+// Frame capture (capture.c): the context's thread copies frames into a
+// preallocated single-producer ring, a writer thread turns them into
+// pcapng blocks. Free writes out what is left before returning.
+enum { I1905_CAPTURE_IN = 1, I1905_CAPTURE_OUT = 2 };  // pcapng epb_flags
+struct i1905_capture *i1905_capture_new(const char *path, size_t ring_size,
+                                        uint32_t snaplen, struct i1905_stats *stats);
+void i1905_capture_free(struct i1905_capture *c);
+// hdr as in struct i1905_tx_frame: when set, the frame is the Ethernet
+// header at hdr followed by len bytes at data
+void i1905_capture_frame(struct i1905_capture *c, unsigned dir, const uint8_t *hdr,
+                         const uint8_t *data, size_t len);
+
+// Fragment reassembly (reasm.c)
+struct i1905_reasm;
+struct i1905_reasm *i1905_reasm_new(size_t budget, uint32_t timeout_ms,
+                                    struct i1905_stats *stats);
+void i1905_reasm_free(struct i1905_reasm *r);
+void i1905_reasm_expire(struct i1905_reasm *r, uint64_t now_ms);
+// deadline of the oldest partial message, 0 when nothing is buffered
+uint64_t i1905_reasm_next_deadline(const struct i1905_reasm *r);
+// 1: *out holds the completed message (valid until the next call),
+// 0: waiting for more fragments, -1: fragment dropped
+int i1905_reasm_input(struct i1905_reasm *r, const uint8_t src[6],
+                      const struct i1905_cmdu_view *frag, uint64_t now_ms,
+                      struct i1905_cmdu_view *out);
+
+// Relayed multicast duplicate cache (dedup.c); true when (al_mac, mid) was
+// already seen within the TTL, otherwise records it
+struct i1905_dedup;
+struct i1905_dedup *i1905_dedup_new(unsigned size, uint32_t ttl_ms,
+                                    struct i1905_stats *stats);
+void i1905_dedup_free(struct i1905_dedup *d);
+bool i1905_dedup_check(struct i1905_dedup *d, const uint8_t al_mac[6], uint16_t mid,
+                       uint64_t now_ms);
+
+// Hierarchical timer wheel (timer.c) behind the public i1905_timer API
+struct i1905_wheel *i1905_wheel_new(void);
+void i1905_wheel_free(struct i1905_wheel *w);
+int i1905_wheel_fd(const struct i1905_wheel *w);
+int i1905_wheel_arm(struct i1905_wheel *w, struct i1905_timer *t, uint32_t delay_ms);
+// fire everything due; returns the number of callbacks run
+unsigned i1905_wheel_run(struct i1905_wheel *w);
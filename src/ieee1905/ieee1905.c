@@ -1,387 +1,2000 @@
-// SPDX-License-Identifier: MIT
-#include "ieee1905.h"
-
-#include <stdio.h>
-#include <stdlib.h>
-#include <string.h>
-#include <time.h>
-#include <errno.h>
-#include <unistd.h>
-#include <arpa/inet.h>
-#include <fcntl.h>
-#include <sys/socket.h>
-#include <sys/select.h>
-
-struct i1905_ctx {
-    int sock;
-    uint16_t port;
-    i1905_role role;
-    uint8_t al_mac[6];
-    i1905_event_cb cb;
-    void *user_ctx;
-    uint16_t next_message_id;
-};
-
-static uint16_t next_id(struct i1905_ctx *ctx) {
-    ctx->next_message_id++;
-    if (ctx->next_message_id == 0) {
-        ctx->next_message_id = 1;
-    }
-    return ctx->next_message_id;
-}
-
-static int udp_open(uint16_t port) {
-    int sock = socket(AF_INET, SOCK_DGRAM, 0);
-    if (sock < 0) {
-        perror("socket");
-        return -1;
-    }
-    int opt = 1;
-    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
-
-    struct sockaddr_in addr = {
-        .sin_family = AF_INET,
-        .sin_port = htons(port),
-        .sin_addr.s_addr = htonl(INADDR_ANY),
-    };
-    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
-        perror("bind");
-        close(sock);
-        return -1;
-    }
-    // non-blocking for event-driven loops
-    int flags = fcntl(sock, F_GETFL, 0);
-    if (flags != -1) {
-        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
-    }
-    return sock;
-}
-
-static int tlv_append(struct i1905_cmdu *cmdu, const struct i1905_tlv *src) {
-    if (cmdu->tlv_count >= I1905_MAX_TLVS) return -1;
-    cmdu->tlvs[cmdu->tlv_count] = *src;
-    cmdu->tlv_count++;
-    return 0;
-}
-
-static int cmdu_pack(const struct i1905_cmdu *cmdu, uint8_t *buf, size_t buf_len) {
-    size_t pos = 0;
-    if (buf_len < 6) return -1;
-    buf[pos++] = 0x00; // message version/reserved
-    buf[pos++] = (cmdu->message_type >> 8) & 0xFF;
-    buf[pos++] = cmdu->message_type & 0xFF;
-    buf[pos++] = (cmdu->message_id >> 8) & 0xFF;
-    buf[pos++] = cmdu->message_id & 0xFF;
-    buf[pos++] = cmdu->fragment_id;
-    buf[pos++] = cmdu->last_fragment ? 0x80 : 0x00;
-
-    for (size_t i = 0; i < cmdu->tlv_count; i++) {
-        const struct i1905_tlv *t = &cmdu->tlvs[i];
-        if (pos + 3 + t->len > buf_len) return -1;
-        buf[pos++] = t->type;
-        buf[pos++] = (t->len >> 8) & 0xFF;
-        buf[pos++] = t->len & 0xFF;
-        memcpy(&buf[pos], t->value, t->len);
-        pos += t->len;
-    }
-    if (pos + 3 > buf_len) return -1;
-    buf[pos++] = I1905_TLV_END_OF_MESSAGE;
-    buf[pos++] = 0x00;
-    buf[pos++] = 0x00;
-    return (int)pos;
-}
-
-static int cmdu_unpack(const uint8_t *buf, size_t len, struct i1905_cmdu *out) {
-    if (len < 7) return -1;
-    size_t pos = 0;
-    pos++; // skip version/reserved
-    out->message_type = (buf[pos] << 8) | buf[pos + 1]; pos += 2;
-    out->message_id   = (buf[pos] << 8) | buf[pos + 1]; pos += 2;
-    out->fragment_id  = buf[pos++];
-    out->last_fragment = (buf[pos++] & 0x80) != 0;
-    out->tlv_count = 0;
-
-    while (pos + 3 <= len) {
-        uint8_t type = buf[pos++];
-        uint16_t tlen = (buf[pos] << 8) | buf[pos + 1];
-        pos += 2;
-        if (type == I1905_TLV_END_OF_MESSAGE) break;
-        if (out->tlv_count >= I1905_MAX_TLVS) return -1;
-        if (tlen > I1905_MAX_TLV_VALUE) return -1;
-        if (pos + tlen > len) return -1;
-        struct i1905_tlv *t = &out->tlvs[out->tlv_count++];
-        t->type = type;
-        t->len = tlen;
-        memcpy(t->value, &buf[pos], tlen);
-        pos += tlen;
-    }
-    return 0;
-}
-
-static int send_cmdu(struct i1905_ctx *ctx,
-                     const char *dst_ip,
-                     uint16_t dst_port,
-                     struct i1905_cmdu *cmdu) {
-    uint8_t frame[I1905_MAX_FRAME_SIZE];
-    cmdu->message_id = next_id(ctx);
-    int len = cmdu_pack(cmdu, frame, sizeof(frame));
-    if (len < 0) return -1;
-
-    struct sockaddr_in dst = {
-        .sin_family = AF_INET,
-        .sin_port = htons(dst_port),
-    };
-    if (inet_aton(dst_ip, &dst.sin_addr) == 0) {
-        fprintf(stderr, "invalid dst_ip %s\n", dst_ip);
-        return -1;
-    }
-    ssize_t sent = sendto(ctx->sock, frame, len, 0,
-                          (struct sockaddr *)&dst, sizeof(dst));
-    return (sent == len) ? 0 : -1;
-}
-
-static void random_mac(uint8_t mac[6]) {
-    for (int i = 0; i < 6; i++) {
-        mac[i] = (uint8_t)rand();
-    }
-    mac[0] &= 0xFE; // unicast
-    mac[0] |= 0x02; // locally administered
-}
-
-static void mac_to_str(const uint8_t mac[6], char out[18]) {
-    snprintf(out, 18, "%02x:%02x:%02x:%02x:%02x:%02x",
-             mac[0], mac[1], mac[2], mac[3], mac[4], mac[5]);
-}
-
-int i1905_init(struct i1905_ctx **out,
-               i1905_role role,
-               uint16_t listen_port,
-               const uint8_t al_mac[6],
-               i1905_event_cb cb,
-               void *user_ctx) {
-    if (!out) return -1;
-    struct i1905_ctx *ctx = calloc(1, sizeof(*ctx));
-    if (!ctx) return -1;
-    ctx->sock = udp_open(listen_port);
-    if (ctx->sock < 0) {
-        free(ctx);
-        return -1;
-    }
-    ctx->role = role;
-    if (al_mac) memcpy(ctx->al_mac, al_mac, 6);
-    else random_mac(ctx->al_mac);
-    ctx->cb = cb;
-    ctx->user_ctx = user_ctx;
-    ctx->next_message_id = (uint16_t)(rand() & 0xFFFF);
-    *out = ctx;
-    return 0;
-}
-
-void i1905_close(struct i1905_ctx *ctx) {
-    if (!ctx) return;
-    close(ctx->sock);
-    free(ctx);
-}
-
-int i1905_poll(struct i1905_ctx *ctx, int timeout_ms) {
-    fd_set rfds;
-    FD_ZERO(&rfds);
-    FD_SET(ctx->sock, &rfds);
-    struct timeval tv = {
-        .tv_sec = timeout_ms / 1000,
-        .tv_usec = (timeout_ms % 1000) * 1000,
-    };
-    int rv = select(ctx->sock + 1, &rfds, NULL, NULL, &tv);
-    if (rv <= 0) return rv; // timeout or error
-
-    uint8_t frame[I1905_MAX_FRAME_SIZE];
-    struct sockaddr_in from;
-    socklen_t from_len = sizeof(from);
-    ssize_t got = recvfrom(ctx->sock, frame, sizeof(frame), 0,
-                           (struct sockaddr *)&from, &from_len);
-    if (got <= 0) return -1;
-
-    struct i1905_cmdu cmdu;
-    if (cmdu_unpack(frame, (size_t)got, &cmdu) < 0) {
-        fprintf(stderr, "drop invalid CMDU\n");
-        return -1;
-    }
-
-    uint8_t src_mac[6];
-    random_mac(src_mac); // placeholder until real L2 integration
-    if (ctx->cb) ctx->cb(&cmdu, src_mac, ctx->user_ctx);
-    return 1;
-}
-
-int i1905_get_fd(const struct i1905_ctx *ctx) {
-    return ctx ? ctx->sock : -1;
-}
-
-int i1905_handle_readable(struct i1905_ctx *ctx) {
-    if (!ctx) return -1;
-    while (1) {
-        uint8_t frame[I1905_MAX_FRAME_SIZE];
-        struct sockaddr_in from;
-        socklen_t from_len = sizeof(from);
-        ssize_t got = recvfrom(ctx->sock, frame, sizeof(frame), 0,
-                               (struct sockaddr *)&from, &from_len);
-        if (got < 0) {
-            if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
-            return -1;
-        }
-        if (got == 0) return 0;
-
-        struct i1905_cmdu cmdu;
-        if (cmdu_unpack(frame, (size_t)got, &cmdu) < 0) {
-            fprintf(stderr, "drop invalid CMDU\n");
-            continue;
-        }
-        uint8_t src_mac[6];
-        random_mac(src_mac); // placeholder until real L2 integration
-        if (ctx->cb) ctx->cb(&cmdu, src_mac, ctx->user_ctx);
-    }
-}
-
-int i1905_tlv_set_mac(struct i1905_tlv *tlv, uint8_t type, const uint8_t mac[6]) {
-    if (!tlv || !mac) return -1;
-    tlv->type = type;
-    tlv->len = 6;
-    memcpy(tlv->value, mac, 6);
-    return 0;
-}
-
-int i1905_tlv_set_wsc(struct i1905_tlv *tlv, const uint8_t *payload, size_t len) {
-    if (!tlv || !payload || len > I1905_MAX_TLV_VALUE) return -1;
-    tlv->type = I1905_TLV_WSC;
-    tlv->len = (uint16_t)len;
-    memcpy(tlv->value, payload, len);
-    return 0;
-}
-
-int i1905_tlv_set_device_info(struct i1905_tlv *tlv,
-                              const uint8_t al_mac[6],
-                              const uint8_t iface_mac[6]) {
-    if (!tlv || !al_mac || !iface_mac) return -1;
-    tlv->type = I1905_TLV_DEVICE_INFO;
-    tlv->len = 1 + 6 + 6 + 2; // iface count + AL + iface mac + media type
-    uint8_t *p = tlv->value;
-    memcpy(p, al_mac, 6); p += 6;
-    *p++ = 1; // one interface
-    memcpy(p, iface_mac, 6); p += 6;
-    *p++ = 0x00; *p++ = 0x00; // generic media type
-    return 0;
-}
-
-static void build_cmdu_common(struct i1905_cmdu *cmdu, uint16_t type) {
-    memset(cmdu, 0, sizeof(*cmdu));
-    cmdu->message_type = type;
-    cmdu->fragment_id = 0;
-    cmdu->last_fragment = true;
-}
-
-int i1905_send_topology_discovery(struct i1905_ctx *ctx,
-                                  const char *dst_ip,
-                                  uint16_t dst_port,
-                                  const uint8_t iface_mac[6]) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_TOPOLOGY_DISCOVERY);
-    struct i1905_tlv al, mac;
-    i1905_tlv_set_mac(&al, I1905_TLV_AL_MAC, ctx->al_mac);
-    i1905_tlv_set_mac(&mac, I1905_TLV_MAC_ADDR, iface_mac);
-    tlv_append(&cmdu, &al);
-    tlv_append(&cmdu, &mac);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-int i1905_send_topology_query(struct i1905_ctx *ctx,
-                              const char *dst_ip,
-                              uint16_t dst_port) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_TOPOLOGY_QUERY);
-    struct i1905_tlv al;
-    i1905_tlv_set_mac(&al, I1905_TLV_AL_MAC, ctx->al_mac);
-    tlv_append(&cmdu, &al);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-int i1905_send_topology_response(struct i1905_ctx *ctx,
-                                 const char *dst_ip,
-                                 uint16_t dst_port,
-                                 const uint8_t iface_mac[6]) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_TOPOLOGY_RESPONSE);
-    struct i1905_tlv dev;
-    i1905_tlv_set_device_info(&dev, ctx->al_mac, iface_mac);
-    tlv_append(&cmdu, &dev);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-int i1905_send_topology_notification(struct i1905_ctx *ctx,
-                                     const char *dst_ip,
-                                     uint16_t dst_port,
-                                     const uint8_t iface_mac[6]) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_TOPOLOGY_NOTIFICATION);
-    struct i1905_tlv al, mac;
-    i1905_tlv_set_mac(&al, I1905_TLV_AL_MAC, ctx->al_mac);
-    i1905_tlv_set_mac(&mac, I1905_TLV_MAC_ADDR, iface_mac);
-    tlv_append(&cmdu, &al);
-    tlv_append(&cmdu, &mac);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-int i1905_send_ap_autoconfig_search(struct i1905_ctx *ctx,
-                                    const char *dst_ip,
-                                    uint16_t dst_port,
-                                    const uint8_t radio_id[6]) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_AP_AUTOCONFIG_SEARCH);
-    struct i1905_tlv mac, wsc;
-    i1905_tlv_set_mac(&mac, I1905_TLV_MAC_ADDR, radio_id);
-    const uint8_t placeholder[] = {0x10, 0x47, 0x00, 0x06, '1', '9', '0', '5', 'W', 'S'};
-    i1905_tlv_set_wsc(&wsc, placeholder, sizeof(placeholder));
-    tlv_append(&cmdu, &mac);
-    tlv_append(&cmdu, &wsc);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-int i1905_send_ap_autoconfig_response(struct i1905_ctx *ctx,
-                                      const char *dst_ip,
-                                      uint16_t dst_port,
-                                      const uint8_t radio_id[6]) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_AP_AUTOCONFIG_RESPONSE);
-    struct i1905_tlv mac;
-    i1905_tlv_set_mac(&mac, I1905_TLV_MAC_ADDR, radio_id);
-    tlv_append(&cmdu, &mac);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-int i1905_send_ap_autoconfig_wsc(struct i1905_ctx *ctx,
-                                 const char *dst_ip,
-                                 uint16_t dst_port,
-                                 const uint8_t *wsc, size_t wsc_len) {
-    struct i1905_cmdu cmdu;
-    build_cmdu_common(&cmdu, I1905_MSG_AP_AUTOCONFIG_WSC);
-    struct i1905_tlv t;
-    i1905_tlv_set_wsc(&t, wsc, wsc_len);
-    tlv_append(&cmdu, &t);
-    return send_cmdu(ctx, dst_ip, dst_port, &cmdu);
-}
-
-#ifdef I1905_STANDALONE_TEST
-int main(void) {
-    srand((unsigned)time(NULL));
-    struct i1905_ctx *ctx;
-    if (i1905_init(&ctx, I1905_ROLE_CONTROLLER, 19050, NULL, NULL, NULL) < 0) {
-        fprintf(stderr, "init failed\n");
-        return 1;
-    }
-    uint8_t mac[6] = {0xde, 0xad, 0xbe, 0xef, 0x00, 0x01};
-    i1905_send_topology_discovery(ctx, "127.0.0.1", 19050, mac);
-    i1905_close(ctx);
-    return 0;
-}
-#endif
-
-
+// SPDX-License-Identifier: MIT
+#define _GNU_SOURCE // clock_gettime
+#include "i1905_priv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <errno.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <poll.h>
+#include <arpa/inet.h>
+#include <sys/epoll.h>
+
+#define PENDING_BUCKETS 256
+
+// Outstanding request awaiting its reply, with a copy of the packed CMDU
+// for retransmission.
+struct i1905_pending {
+    struct i1905_pending *next;  // bucket chain
+    struct i1905_ctx *ctx;
+    struct i1905_timer timer;
+    struct i1905_addr peer;
+    uint16_t mid;
+    uint16_t reply_type;
+    uint32_t rto_ms;
+    unsigned retries;
+    i1905_reply_cb cb;
+    void *user;
+    size_t len;
+    uint8_t msg[];
+};
+
+#define PEER_BUCKETS    64
+#define TEMPLATE_SLOTS  (2 * I1905_MAX_INTERFACES)
+#define TEMPLATE_MAX    64   // periodic messages carry two MAC TLVs
+
+// Pre-resolved destination; one per address, shared by reference count.
+struct i1905_peer {
+    struct i1905_peer *next;     // bucket chain
+    struct i1905_ctx *ctx;
+    struct i1905_addr addr;
+    unsigned refs;
+    struct i1905_peer_stats stats;
+    struct i1905_tx_bucket bucket;   // opts.peer_tx_rate
+};
+
+// 1905 neighbor heard in a topology discovery, reported in topology responses
+struct i1905_seen {
+    uint8_t al_mac[6];
+    uint8_t local_mac[6];        // interface it was heard on
+    uint64_t last_ms;
+};
+
+// Packed frame of a periodic message; only message_id and the destination
+// MAC change between transmissions.
+struct tx_template {
+    bool used;
+    uint16_t type;
+    uint8_t iface_mac[6];
+    size_t len;                  // CMDU bytes after the Ethernet header
+    uint8_t frame[I1905_ETH_HDR_LEN + TEMPLATE_MAX];
+};
+
+// One endpoint of the context: a transport opened on one interface with
+// its own transmit scheduler, registered with the context's epoll set.
+struct i1905_iface {
+    struct i1905_transport tp;
+    struct i1905_txq *txq;
+    struct i1905_if_stats stats;
+    char name[I1905_IFNAME_LEN];
+    uint16_t media;             // I1905_MEDIA_*, i1905_set_if_media()
+    bool rx;                    // read here; not with threaded receive
+    uint32_t events;            // registered with ctx->epfd, 0: not at all
+};
+
+struct i1905_ctx {
+    struct i1905_iface *ifaces[I1905_MAX_INTERFACES];  // [0]: opened by init
+    unsigned n_ifaces;
+    int epfd;                   // i1905_get_fd()
+    bool in_rx;                 // inside i1905_handle_readable()
+    struct i1905_rxq *rxq;      // opts.rx_threads, NULL: receive inline
+    struct i1905_capture *capture;  // i1905_capture_start(), NULL: off
+    struct i1905_handoff handoff;   // opts.handoff; taken fds become -1
+    uint32_t peer_tx_rate;      // new peers' bucket
+    uint32_t peer_tx_burst;
+    unsigned tx_queue_len;      // per interface
+    uint16_t port;
+    i1905_role role;
+    uint8_t al_mac[6];
+    i1905_event_cb cb;
+    void *user_ctx;
+    uint16_t next_message_id;
+
+    // per-batch scratch, rx_batch entries each
+    struct i1905_frame *rx_frames;
+    struct i1905_cmdu_view *rx_views;
+    bool *rx_valid;
+
+    uint8_t *tx_msg;            // Ethernet headroom + packed CMDU
+    struct i1905_arena *arena;  // i1905_get_arena(), reset after each event
+    struct i1905_reasm *reasm;
+    struct i1905_dedup *dedup;
+    struct i1905_peer *neighbors[I1905_MAX_NEIGHBORS];
+    unsigned n_neighbors;
+    struct i1905_seen seen[I1905_MAX_NEIGHBORS];
+    unsigned n_seen;
+    struct i1905_peer *peers[PEER_BUCKETS];
+    unsigned n_peers;
+    struct tx_template templates[TEMPLATE_SLOTS];
+    unsigned template_next;
+
+    const struct i1905_addr *fanout;  // i1905_set_fanout(), next send only
+    unsigned fanout_n;
+    unsigned *fanout_sent;
+    struct i1905_tx_frame *fan_tx;    // grown to the largest fan-out seen
+    uint8_t *fan_hdr;
+    struct i1905_tx_bucket **fan_bucket;
+    bool *fan_ok;
+    unsigned fan_cap;
+
+    struct i1905_wheel *wheel;
+    struct i1905_timer reasm_timer;
+    struct i1905_timer discovery_timer;
+    uint32_t discovery_interval_ms;
+    bool validate;              // opts.validate
+    bool no_query_answer;       // opts.no_query_answer
+
+    uint16_t reply_mid;         // one-shot message_id for the next send
+    // last i1905_send_cmdu(), still in tx_msg, for i1905_expect_reply()
+    uint16_t last_tx_mid;
+    size_t last_tx_len;
+    struct i1905_addr last_tx_dst;
+    struct i1905_pending *pending[PENDING_BUCKETS];
+    unsigned n_pending;
+
+    struct i1905_stats stats;
+};
+
+const uint8_t i1905_multicast_mac[6] = {0x01, 0x80, 0xc2, 0x00, 0x00, 0x13};
+
+static uint16_t next_id(struct i1905_ctx *ctx) {
+    ctx->next_message_id++;
+    if (ctx->next_message_id == 0) {
+        ctx->next_message_id = 1;
+    }
+    return ctx->next_message_id;
+}
+
+uint64_t i1905_now_ms(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000 + (uint64_t)ts.tv_nsec / 1000000;
+}
+
+static int cmdu_pack(const struct i1905_cmdu *cmdu, uint8_t *buf, size_t buf_len) {
+    size_t pos = 0;
+    if (buf_len < 6) return -1;
+    buf[pos++] = 0x00; // message version/reserved
+    buf[pos++] = (cmdu->message_type >> 8) & 0xFF;
+    buf[pos++] = cmdu->message_type & 0xFF;
+    buf[pos++] = (cmdu->message_id >> 8) & 0xFF;
+    buf[pos++] = cmdu->message_id & 0xFF;
+    buf[pos++] = cmdu->fragment_id;
+    buf[pos++] = (cmdu->last_fragment ? 0x80 : 0x00) | (cmdu->relay ? 0x40 : 0x00);
+
+    for (size_t i = 0; i < cmdu->tlv_count; i++) {
+        const struct i1905_tlv *t = &cmdu->tlvs[i];
+        if (pos + 3 + t->len > buf_len) return -1;
+        buf[pos++] = t->type;
+        buf[pos++] = (t->len >> 8) & 0xFF;
+        buf[pos++] = t->len & 0xFF;
+        memcpy(&buf[pos], t->value, t->len);
+        pos += t->len;
+    }
+    if (pos + 3 > buf_len) return -1;
+    buf[pos++] = I1905_TLV_END_OF_MESSAGE;
+    buf[pos++] = 0x00;
+    buf[pos++] = 0x00;
+    return (int)pos;
+}
+
+int i1905_cmdu_view_parse(struct i1905_cmdu_view *view,
+                          const uint8_t *buf, size_t len) {
+    if (!view || !buf || len < 7) return -1;
+    size_t pos = 0;
+    pos++; // skip version/reserved
+    view->message_type = (buf[pos] << 8) | buf[pos + 1]; pos += 2;
+    view->message_id   = (buf[pos] << 8) | buf[pos + 1]; pos += 2;
+    view->fragment_id  = buf[pos++];
+    view->last_fragment = (buf[pos] & 0x80) != 0;
+    view->relay = (buf[pos++] & 0x40) != 0;
+    view->tlv_count = 0;
+    view->tlv_data = &buf[pos];
+
+    size_t start = pos;
+    size_t end = pos;
+    while (pos + 3 <= len) {
+        uint8_t type = buf[pos];
+        uint16_t tlen = (buf[pos + 1] << 8) | buf[pos + 2];
+        if (type == I1905_TLV_END_OF_MESSAGE) break;
+        pos += 3;
+        if (pos + tlen > len) return -1;
+        pos += tlen;
+        end = pos;
+        view->tlv_count++;
+    }
+    view->tlv_len = end - start;
+    return 0;
+}
+
+void i1905_tlv_iter_init(struct i1905_tlv_iter *it,
+                         const struct i1905_cmdu_view *view) {
+    it->pos = view->tlv_data;
+    it->end = view->tlv_data + view->tlv_len;
+}
+
+bool i1905_tlv_iter_next(struct i1905_tlv_iter *it, struct i1905_tlv_view *tlv) {
+    // chain was validated by i1905_cmdu_view_parse(), only the end needs checking
+    if (it->pos + 3 > it->end) return false;
+    tlv->type = it->pos[0];
+    tlv->len = (it->pos[1] << 8) | it->pos[2];
+    tlv->value = it->pos + 3;
+    it->pos += 3 + tlv->len;
+    return true;
+}
+
+int i1905_cmdu_view_find(const struct i1905_cmdu_view *view, uint8_t type,
+                         struct i1905_tlv_view *out) {
+    struct i1905_tlv_iter it;
+    struct i1905_tlv_view t;
+    i1905_tlv_iter_init(&it, view);
+    while (i1905_tlv_iter_next(&it, &t)) {
+        if (t.type != type) continue;
+        if (out) *out = t;
+        return 0;
+    }
+    return -1;
+}
+
+void i1905_cmdu_init(struct i1905_cmdu *cmdu, struct i1905_arena *arena,
+                     uint16_t message_type) {
+    memset(cmdu, 0, sizeof(*cmdu));
+    cmdu->message_type = message_type;
+    cmdu->last_fragment = true;
+    cmdu->arena = arena;
+}
+
+// Grow the value area; descriptors into it follow when it moves.
+static int cmdu_reserve_payload(struct i1905_cmdu *cmdu, size_t need) {
+    if (cmdu->payload_len + need <= cmdu->payload_cap) return 0;
+    size_t cap = cmdu->payload_cap ? cmdu->payload_cap * 2 : 64;
+    while (cap < cmdu->payload_len + need) cap *= 2;
+    uint8_t *old = cmdu->payload;
+    uint8_t *p = i1905_arena_grow(cmdu->arena, old, cmdu->payload_len, cap);
+    if (!p) return -1;
+    if (p != old) {
+        for (size_t i = 0; i < cmdu->tlv_count; i++) {
+            struct i1905_tlv *t = &cmdu->tlvs[i];
+            if (t->value >= old && t->value < old + cmdu->payload_len) {
+                t->value = p + (t->value - old);
+            }
+        }
+    }
+    cmdu->payload = p;
+    cmdu->payload_cap = cap;
+    return 0;
+}
+
+uint8_t *i1905_cmdu_add_tlv(struct i1905_cmdu *cmdu, uint8_t type,
+                            const void *value, uint16_t len) {
+    if (!cmdu || !cmdu->arena) return NULL;
+    if (cmdu->tlv_count == cmdu->tlv_cap) {
+        size_t cap = cmdu->tlv_cap ? cmdu->tlv_cap * 2 : 4;
+        struct i1905_tlv *tlvs = i1905_arena_grow(cmdu->arena, cmdu->tlvs,
+                                                  cmdu->tlv_count * sizeof(*tlvs),
+                                                  cap * sizeof(*tlvs));
+        if (!tlvs) return NULL;
+        cmdu->tlvs = tlvs;
+        cmdu->tlv_cap = cap;
+    }
+    if (cmdu_reserve_payload(cmdu, len) < 0) return NULL;
+    uint8_t *v = cmdu->payload + cmdu->payload_len;
+    if (value) memcpy(v, value, len);
+    else memset(v, 0, len);
+    cmdu->payload_len += len;
+    cmdu->tlvs[cmdu->tlv_count++] = (struct i1905_tlv){ .type = type, .len = len, .value = v };
+    return v;
+}
+
+// Sized from the view up front: one descriptor array, one value area.
+int i1905_cmdu_from_view(struct i1905_cmdu *out, struct i1905_arena *arena,
+                         const struct i1905_cmdu_view *view) {
+    if (!out || !arena || !view) return -1;
+    i1905_cmdu_init(out, arena, view->message_type);
+    out->message_id = view->message_id;
+    out->fragment_id = view->fragment_id;
+    out->last_fragment = view->last_fragment;
+    out->relay = view->relay;
+    if (!view->tlv_count) return 0;
+    size_t values = view->tlv_len - 3 * view->tlv_count;
+    out->tlvs = i1905_arena_alloc(arena, view->tlv_count * sizeof(*out->tlvs));
+    out->payload = i1905_arena_alloc(arena, values);
+    if (!out->tlvs || !out->payload) return -1;
+    out->tlv_cap = view->tlv_count;
+    out->payload_cap = values;
+
+    struct i1905_tlv_iter it;
+    struct i1905_tlv_view t;
+    i1905_tlv_iter_init(&it, view);
+    while (i1905_tlv_iter_next(&it, &t)) {
+        uint8_t *v = out->payload + out->payload_len;
+        memcpy(v, t.value, t.len);
+        out->payload_len += t.len;
+        out->tlvs[out->tlv_count++] = (struct i1905_tlv){
+            .type = t.type, .len = t.len, .value = v,
+        };
+    }
+    return 0;
+}
+
+// Frames leave through the interface the destination was resolved or
+// received on, anything else through the first one.
+static struct i1905_iface *iface_for(const struct i1905_ctx *ctx, const struct i1905_addr *dst) {
+    if (ctx->n_ifaces > 1 && dst->ifindex) {
+        for (unsigned i = 1; i < ctx->n_ifaces; i++) {
+            if (ctx->ifaces[i]->tp.ifindex == dst->ifindex) return ctx->ifaces[i];
+        }
+    }
+    return ctx->ifaces[0];
+}
+
+static struct i1905_iface *iface_by_name(const struct i1905_ctx *ctx, const char *name) {
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+        if (strcmp(ctx->ifaces[i]->name, name) == 0) return ctx->ifaces[i];
+    }
+    return NULL;
+}
+
+// Keep the epoll registration in line with what the interface waits for:
+// input unless a receive thread reads it, output while its scheduler holds
+// frames for a full socket.
+static int iface_sync(struct i1905_ctx *ctx, struct i1905_iface *ifc) {
+    uint32_t want = (ifc->rx ? EPOLLIN : 0) | (i1905_txq_want_write(ifc->txq) ? EPOLLOUT : 0);
+    if (want == ifc->events) return 0;
+    struct epoll_event ev = { .events = want, .data.ptr = ifc };
+    int op = !ifc->events ? EPOLL_CTL_ADD : !want ? EPOLL_CTL_DEL : EPOLL_CTL_MOD;
+    if (epoll_ctl(ctx->epfd, op, ifc->tp.ops->get_fd(&ifc->tp), &ev) < 0) {
+        perror("epoll_ctl");
+        return -1;
+    }
+    ifc->events = want;
+    return 0;
+}
+
+static void iface_sync_all(struct i1905_ctx *ctx) {
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) iface_sync(ctx, ctx->ifaces[i]);
+}
+
+static void put_eth_hdr(const struct i1905_iface *ifc, uint8_t *frame,
+                        const struct i1905_addr *dst) {
+    memcpy(frame, dst->mac, 6);
+    memcpy(frame + 6, ifc->tp.if_mac, 6);
+    frame[12] = (I1905_ETHERTYPE >> 8) & 0xFF;
+    frame[13] = I1905_ETHERTYPE & 0xFF;
+}
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+}
+
+static void hist_add(uint64_t *hist, uint64_t ns) {
+    unsigned bucket = 0;
+    while ((ns >> (bucket + 1)) && bucket + 1 < I1905_LAT_HIST_BUCKETS) bucket++;
+    I1905_STAT_INC(hist[bucket]);
+}
+
+// Peers are keyed the way the transport addresses them: IPv4/port for UDP,
+// port for loopback, MAC and ifindex for AF_PACKET.
+static bool peer_addr_eq(const struct i1905_addr *a, const struct i1905_addr *b) {
+    if (a->ip || a->port || b->ip || b->port) return a->ip == b->ip && a->port == b->port;
+    return a->ifindex == b->ifindex && memcmp(a->mac, b->mac, 6) == 0;
+}
+
+static unsigned peer_hash(const struct i1905_addr *a) {
+    uint32_t h = 2166136261u;
+    if (a->ip || a->port) {
+        h = (h ^ a->ip) * 16777619u;
+        h = (h ^ a->port) * 16777619u;
+    } else {
+        for (int i = 0; i < 6; i++) h = (h ^ a->mac[i]) * 16777619u;
+        h = (h ^ (uint32_t)a->ifindex) * 16777619u;
+    }
+    return (h ^ (h >> 16)) % PEER_BUCKETS;
+}
+
+static struct i1905_peer *peer_find(const struct i1905_ctx *ctx, const struct i1905_addr *a) {
+    if (!ctx->n_peers) return NULL;
+    for (struct i1905_peer *p = ctx->peers[peer_hash(a)]; p; p = p->next) {
+        if (peer_addr_eq(&p->addr, a)) return p;
+    }
+    return NULL;
+}
+
+static struct i1905_tx_bucket *peer_bucket(const struct i1905_ctx *ctx,
+                                           const struct i1905_addr *dst) {
+    struct i1905_peer *p = peer_find(ctx, dst);
+    return p ? &p->bucket : NULL;
+}
+
+// Frames go through the transmit scheduler, which also accounts them.
+static int tx_one(struct i1905_ctx *ctx, struct i1905_iface *ifc, const struct i1905_addr *dst,
+                  const uint8_t *frame, size_t len) {
+    struct i1905_tx_frame tx = { .data = frame, .len = len, .dst = dst };
+    struct i1905_tx_bucket *bucket = peer_bucket(ctx, dst);
+    bool ok;
+    i1905_txq_send(ifc->txq, &tx, &bucket, 1, &ok);
+    iface_sync(ctx, ifc);
+    return ok ? 0 : -1;
+}
+
+static void account_tx(struct i1905_ctx *ctx, const struct i1905_addr *dst, size_t len, int rv) {
+    struct i1905_peer *p = peer_find(ctx, dst);
+    if (!p) return;
+    if (rv < 0) {
+        I1905_STAT_INC(p->stats.tx_errors);
+        return;
+    }
+    I1905_STAT_INC(p->stats.tx_msgs);
+    I1905_STAT_ADD(p->stats.tx_bytes, len);
+}
+
+// Send a packed CMDU that sits at ctx->tx_msg + I1905_ETH_HDR_LEN. Messages
+// above I1905_MTU are split at TLV boundaries; only the last fragment
+// carries the end-of-message TLV.
+static int send_fragments(struct i1905_ctx *ctx, struct i1905_iface *ifc,
+                          const struct i1905_addr *dst, size_t len);
+
+static int send_message(struct i1905_ctx *ctx, const struct i1905_addr *dst, size_t len) {
+    struct i1905_iface *ifc = iface_for(ctx, dst);
+    int rv;
+    if (len <= I1905_MTU) {
+        put_eth_hdr(ifc, ctx->tx_msg, dst);
+        rv = tx_one(ctx, ifc, dst, ctx->tx_msg, len + I1905_ETH_HDR_LEN);
+    } else {
+        rv = send_fragments(ctx, ifc, dst, len);
+    }
+    account_tx(ctx, dst, len, rv);
+    return rv;
+}
+
+static int send_fragments(struct i1905_ctx *ctx, struct i1905_iface *ifc,
+                          const struct i1905_addr *dst, size_t len) {
+    uint8_t *msg = ctx->tx_msg + I1905_ETH_HDR_LEN;
+
+    size_t pos = CMDU_HDR_LEN;
+    size_t end = len - 3; // end-of-message TLV
+    unsigned frag = 0;
+    while (pos < end) {
+        uint8_t frame[I1905_MAX_FRAME_SIZE];
+        size_t start = pos;
+        while (pos < end) {
+            size_t tlen = 3 + (size_t)((msg[pos + 1] << 8) | msg[pos + 2]);
+            if (CMDU_HDR_LEN + (pos - start) + tlen + 3 > I1905_MTU) break;
+            pos += tlen;
+        }
+        if (pos == start || frag >= I1905_MAX_FRAGMENTS) return -1; // TLV larger than MTU
+        bool last = pos == end;
+
+        uint8_t *p = frame + I1905_ETH_HDR_LEN;
+        put_eth_hdr(ifc, frame, dst);
+        memcpy(p, msg, CMDU_HDR_LEN);
+        p[5] = (uint8_t)frag;
+        p[6] = (msg[6] & 0x7F) | (last ? 0x80 : 0x00);
+        p += CMDU_HDR_LEN;
+        memcpy(p, msg + start, pos - start);
+        p += pos - start;
+        if (last) {
+            *p++ = I1905_TLV_END_OF_MESSAGE;
+            *p++ = 0x00;
+            *p++ = 0x00;
+        }
+        if (tx_one(ctx, ifc, dst, frame, (size_t)(p - frame)) < 0) return -1;
+        I1905_STAT_INC(ctx->stats.tx_fragments);
+        frag++;
+    }
+    return 0;
+}
+
+static void set_mid(uint8_t *msg, uint16_t mid) {
+    msg[3] = (mid >> 8) & 0xFF;
+    msg[4] = mid & 0xFF;
+}
+
+static uint16_t take_mid(struct i1905_ctx *ctx) {
+    uint16_t mid = ctx->reply_mid ? ctx->reply_mid : next_id(ctx);
+    ctx->reply_mid = 0;
+    return mid;
+}
+
+// Drop the one-shot overrides when a send fails before transmitting.
+static void clear_next(struct i1905_ctx *ctx) {
+    ctx->reply_mid = 0;
+    ctx->fanout = NULL;
+    ctx->fanout_n = 0;
+    ctx->fanout_sent = NULL;
+}
+
+static int fanout_reserve(struct i1905_ctx *ctx, unsigned n) {
+    if (n <= ctx->fan_cap) return 0;
+    struct i1905_tx_frame *tx = realloc(ctx->fan_tx, n * sizeof(*tx));
+    if (!tx) return -1;
+    ctx->fan_tx = tx;
+    uint8_t *hdr = realloc(ctx->fan_hdr, (size_t)n * I1905_ETH_HDR_LEN);
+    if (!hdr) return -1;
+    ctx->fan_hdr = hdr;
+    struct i1905_tx_bucket **bucket = realloc(ctx->fan_bucket, n * sizeof(*bucket));
+    if (!bucket) return -1;
+    ctx->fan_bucket = bucket;
+    bool *ok = realloc(ctx->fan_ok, n * sizeof(*ok));
+    if (!ok) return -1;
+    ctx->fan_ok = ok;
+    ctx->fan_cap = n;
+    return 0;
+}
+
+// Transmit the CMDU at msg, message_id already set, to every pending fan-out
+// destination. All frames share msg and differ only in their Ethernet
+// header, so the fan-out is one tx_batch() call per interface unless the
+// transmit scheduler holds some of it back. Returns how many destinations
+// it took.
+static unsigned send_fanout(struct i1905_ctx *ctx, const uint8_t *msg, size_t len) {
+    const struct i1905_addr *dsts = ctx->fanout;
+    unsigned n = ctx->fanout_n;
+    unsigned *sent = ctx->fanout_sent;
+    clear_next(ctx);
+    ctx->last_tx_len = 0;
+
+    unsigned done = 0;
+    if (len > I1905_MTU) {
+        // fragments are built per destination anyway; msg is ctx->tx_msg here
+        for (unsigned i = 0; i < n; i++) {
+            if (send_message(ctx, &dsts[i], len) == 0) done++;
+        }
+    } else if (fanout_reserve(ctx, n) == 0) {
+        // grouped by interface, every destination has one
+        unsigned m = 0;
+        for (unsigned k = 0; k < ctx->n_ifaces && m < n; k++) {
+            struct i1905_iface *ifc = ctx->ifaces[k];
+            unsigned first = m;
+            for (unsigned i = 0; i < n; i++) {
+                if (iface_for(ctx, &dsts[i]) != ifc) continue;
+                uint8_t *hdr = ctx->fan_hdr + (size_t)m * I1905_ETH_HDR_LEN;
+                put_eth_hdr(ifc, hdr, &dsts[i]);
+                ctx->fan_tx[m] = (struct i1905_tx_frame){
+                    .data = msg, .len = len, .dst = &dsts[i], .hdr = hdr,
+                };
+                ctx->fan_bucket[m++] = peer_bucket(ctx, &dsts[i]);
+            }
+            if (m == first) continue;
+            done += i1905_txq_send(ifc->txq, ctx->fan_tx + first, ctx->fan_bucket + first,
+                                   m - first, ctx->fan_ok + first);
+            iface_sync(ctx, ifc);
+        }
+        for (unsigned i = 0; i < m; i++) {
+            account_tx(ctx, ctx->fan_tx[i].dst, len, ctx->fan_ok[i] ? 0 : -1);
+        }
+    }
+    if (sent) *sent = done;
+    return done;
+}
+
+// "dst%ifname" resolves dst on that interface and ties the address to it;
+// an empty dst is the transport's default (the multicast group on
+// AF_PACKET).
+static int resolve_addr(struct i1905_ctx *ctx, const char *dst, uint16_t port,
+                        struct i1905_addr *out) {
+    const char *sep = dst ? strchr(dst, '%') : NULL;
+    struct i1905_iface *ifc = ctx->ifaces[0];
+    char host[64];
+    if (sep) {
+        size_t n = (size_t)(sep - dst);
+        ifc = iface_by_name(ctx, sep + 1);
+        if (!ifc || n >= sizeof(host)) {
+            fprintf(stderr, "unknown interface in %s\n", dst);
+            return -1;
+        }
+        memcpy(host, dst, n);
+        host[n] = '\0';
+        dst = n ? host : NULL;
+    }
+    if (ifc->tp.ops->resolve(&ifc->tp, dst, port, out) < 0) return -1;
+    if (sep) out->ifindex = ifc->tp.ifindex;
+    return 0;
+}
+
+// With a fan-out pending the destination of a send is ignored.
+static int resolve_dst(struct i1905_ctx *ctx, const char *dst_ip, uint16_t dst_port,
+                       struct i1905_addr *out) {
+    if (ctx->fanout) {
+        memset(out, 0, sizeof(*out));
+        return 0;
+    }
+    if (resolve_addr(ctx, dst_ip, dst_port, out) == 0) return 0;
+    clear_next(ctx);
+    return -1;
+}
+
+// Assign the message_id of the CMDU packed at ctx->tx_msg + I1905_ETH_HDR_LEN
+// and send it, remembering it for i1905_expect_reply().
+static int send_packed_to(struct i1905_ctx *ctx, const struct i1905_addr *dst, size_t len) {
+    uint16_t mid = take_mid(ctx);
+    set_mid(ctx->tx_msg + I1905_ETH_HDR_LEN, mid);
+    if (ctx->fanout) {
+        // a fan-out to one destination can still be waited on
+        const struct i1905_addr *one = ctx->fanout_n == 1 ? ctx->fanout : NULL;
+        if (!send_fanout(ctx, ctx->tx_msg + I1905_ETH_HDR_LEN, len)) return -1;
+        if (!one) return mid;
+        dst = one;
+    } else {
+        ctx->last_tx_len = 0;
+        if (send_message(ctx, dst, len) < 0) return -1;
+    }
+    ctx->last_tx_mid = mid;
+    ctx->last_tx_len = len;
+    ctx->last_tx_dst = *dst;
+    return mid;
+}
+
+static int send_packed(struct i1905_ctx *ctx, const char *dst_ip, uint16_t dst_port,
+                       size_t len) {
+    struct i1905_addr dst;
+    if (resolve_dst(ctx, dst_ip, dst_port, &dst) < 0) return -1;
+    return send_packed_to(ctx, &dst, len);
+}
+
+static int pack_into_tx(struct i1905_ctx *ctx, const struct i1905_cmdu *cmdu) {
+    int len = cmdu_pack(cmdu, ctx->tx_msg + I1905_ETH_HDR_LEN,
+                        I1905_MAX_MSG_SIZE - I1905_ETH_HDR_LEN);
+    if (len < 0) clear_next(ctx);
+    return len;
+}
+
+int i1905_send_cmdu(struct i1905_ctx *ctx,
+                    const char *dst_ip,
+                    uint16_t dst_port,
+                    struct i1905_cmdu *cmdu) {
+    if (!ctx || !cmdu) return -1;
+    int len = pack_into_tx(ctx, cmdu);
+    if (len < 0) return -1;
+    int mid = send_packed(ctx, dst_ip, dst_port, (size_t)len);
+    if (mid > 0) cmdu->message_id = (uint16_t)mid;
+    return mid;
+}
+
+int i1905_peer_send_cmdu(struct i1905_peer *peer, struct i1905_cmdu *cmdu) {
+    if (!peer || !cmdu) return -1;
+    int len = pack_into_tx(peer->ctx, cmdu);
+    if (len < 0) return -1;
+    int mid = send_packed_to(peer->ctx, &peer->addr, (size_t)len);
+    if (mid > 0) cmdu->message_id = (uint16_t)mid;
+    return mid;
+}
+
+static void builder_start(struct i1905_builder *b, uint8_t *buf, size_t cap, uint16_t type) {
+    b->buf = buf;
+    b->cap = cap;
+    b->len = CMDU_HDR_LEN;
+    b->tlv_count = 0;
+    b->finished = false;
+    b->error = !buf || cap < CMDU_HDR_LEN + 3;
+    if (b->error) return;
+    buf[0] = 0x00; // message version/reserved
+    buf[1] = (type >> 8) & 0xFF;
+    buf[2] = type & 0xFF;
+    buf[3] = 0;    // message_id, assigned at send time
+    buf[4] = 0;
+    buf[5] = 0;    // fragment_id
+    buf[6] = 0x80; // last fragment
+}
+
+void i1905_builder_begin(struct i1905_builder *b, struct i1905_ctx *ctx, uint16_t message_type) {
+    builder_start(b, ctx ? ctx->tx_msg + I1905_ETH_HDR_LEN : NULL,
+                  I1905_MAX_MSG_SIZE - I1905_ETH_HDR_LEN, message_type);
+}
+
+void i1905_builder_begin_buf(struct i1905_builder *b, uint8_t *buf, size_t cap,
+                             uint16_t message_type) {
+    builder_start(b, buf, cap, message_type);
+}
+
+void i1905_builder_set_relay(struct i1905_builder *b, bool relay) {
+    if (b->error) return;
+    b->buf[6] = relay ? (b->buf[6] | 0x40) : (b->buf[6] & ~0x40);
+}
+
+uint8_t *i1905_builder_reserve(struct i1905_builder *b, uint8_t type, uint16_t len) {
+    // always keep room for the end-of-message TLV
+    if (b->error || b->finished || b->len + 3 + (size_t)len + 3 > b->cap) {
+        b->error = true;
+        return NULL;
+    }
+    uint8_t *p = b->buf + b->len;
+    p[0] = type;
+    p[1] = (len >> 8) & 0xFF;
+    p[2] = len & 0xFF;
+    b->len += 3 + (size_t)len;
+    b->tlv_count++;
+    return p + 3;
+}
+
+int i1905_builder_put_tlv(struct i1905_builder *b, uint8_t type,
+                          const void *value, uint16_t len) {
+    uint8_t *p = i1905_builder_reserve(b, type, len);
+    if (!p) return -1;
+    if (len) memcpy(p, value, len);
+    return 0;
+}
+
+int i1905_builder_put_mac(struct i1905_builder *b, uint8_t type, const uint8_t mac[6]) {
+    return i1905_builder_put_tlv(b, type, mac, 6);
+}
+
+int i1905_builder_finish(struct i1905_builder *b) {
+    if (b->error) return -1;
+    if (!b->finished) {
+        uint8_t *p = b->buf + b->len;
+        p[0] = I1905_TLV_END_OF_MESSAGE;
+        p[1] = 0x00;
+        p[2] = 0x00;
+        b->len += 3;
+        b->finished = true;
+    }
+    return (int)b->len;
+}
+
+// Finish and make sure the CMDU sits in ctx->tx_msg; returns its length.
+static int builder_to_tx(struct i1905_builder *b, struct i1905_ctx *ctx) {
+    int len = i1905_builder_finish(b);
+    if (!ctx) return -1;
+    uint8_t *msg = ctx->tx_msg + I1905_ETH_HDR_LEN;
+    if (len < 0 || (b->buf != msg && (size_t)len > I1905_MAX_MSG_SIZE - I1905_ETH_HDR_LEN)) {
+        clear_next(ctx);
+        return -1;
+    }
+    if (b->buf != msg) memcpy(msg, b->buf, (size_t)len); // caller-owned buffer
+    return len;
+}
+
+int i1905_builder_send(struct i1905_builder *b, struct i1905_ctx *ctx,
+                       const char *dst_ip, uint16_t dst_port) {
+    int len = builder_to_tx(b, ctx);
+    if (len < 0) return -1;
+    return send_packed(ctx, dst_ip, dst_port, (size_t)len);
+}
+
+int i1905_builder_send_peer(struct i1905_builder *b, struct i1905_peer *peer) {
+    int len = peer ? builder_to_tx(b, peer->ctx) : -1;
+    if (len < 0) return -1;
+    return send_packed_to(peer->ctx, &peer->addr, (size_t)len);
+}
+
+static struct tx_template *template_get(struct i1905_ctx *ctx, uint16_t type,
+                                        const uint8_t iface_mac[6]) {
+    for (unsigned i = 0; i < TEMPLATE_SLOTS; i++) {
+        struct tx_template *t = &ctx->templates[i];
+        if (t->used && t->type == type && memcmp(t->iface_mac, iface_mac, 6) == 0) return t;
+    }
+    if (type != I1905_MSG_TOPOLOGY_DISCOVERY && type != I1905_MSG_TOPOLOGY_NOTIFICATION) {
+        return NULL;
+    }
+    // few interfaces per AL entity, round-robin replacement is enough
+    struct tx_template *t = &ctx->templates[ctx->template_next++ % TEMPLATE_SLOTS];
+    struct i1905_builder b;
+    i1905_builder_begin_buf(&b, t->frame + I1905_ETH_HDR_LEN, TEMPLATE_MAX, type);
+    i1905_builder_set_relay(&b, type == I1905_MSG_TOPOLOGY_NOTIFICATION);
+    i1905_builder_put_mac(&b, I1905_TLV_AL_MAC, ctx->al_mac);
+    i1905_builder_put_mac(&b, I1905_TLV_MAC_ADDR, iface_mac);
+    int len = i1905_builder_finish(&b);
+    t->used = len > 0;
+    if (!t->used) return NULL;
+    t->type = type;
+    memcpy(t->iface_mac, iface_mac, 6);
+    t->len = (size_t)len;
+    return t;
+}
+
+// Transmit a periodic message from its cached frame. It never touches
+// tx_msg, so it cannot be followed by i1905_expect_reply().
+static int send_template(struct i1905_ctx *ctx, const struct i1905_addr *dst,
+                         uint16_t type, const uint8_t iface_mac[6], uint16_t mid) {
+    struct tx_template *t = template_get(ctx, type, iface_mac);
+    if (!t) return -1;
+    struct i1905_iface *ifc = iface_for(ctx, dst);
+    set_mid(t->frame + I1905_ETH_HDR_LEN, mid);
+    put_eth_hdr(ifc, t->frame, dst);
+    int rv = tx_one(ctx, ifc, dst, t->frame, I1905_ETH_HDR_LEN + t->len);
+    account_tx(ctx, dst, t->len, rv);
+    return rv;
+}
+
+static int send_periodic(struct i1905_ctx *ctx, const struct i1905_addr *dst,
+                         uint16_t type, const uint8_t iface_mac[6]) {
+    uint16_t mid = take_mid(ctx);
+    ctx->last_tx_len = 0;
+    if (ctx->fanout) {
+        struct tx_template *t = template_get(ctx, type, iface_mac);
+        if (!t) {
+            clear_next(ctx);
+            return -1;
+        }
+        set_mid(t->frame + I1905_ETH_HDR_LEN, mid);
+        return send_fanout(ctx, t->frame + I1905_ETH_HDR_LEN, t->len) ? mid : -1;
+    }
+    return send_template(ctx, dst, type, iface_mac, mid) == 0 ? mid : -1;
+}
+
+int i1905_peer_send_periodic(struct i1905_peer *peer, uint16_t message_type,
+                             const uint8_t iface_mac[6]) {
+    if (!peer || !iface_mac) return -1;
+    return send_periodic(peer->ctx, &peer->addr, message_type, iface_mac);
+}
+
+struct i1905_peer *i1905_peer_open(struct i1905_ctx *ctx, const char *dst, uint16_t port) {
+    struct i1905_addr a;
+    if (!ctx || resolve_addr(ctx, dst, port, &a) < 0) return NULL;
+    struct i1905_peer *p = peer_find(ctx, &a);
+    if (p) {
+        p->refs++;
+        return p;
+    }
+    p = calloc(1, sizeof(*p));
+    if (!p) return NULL;
+    p->ctx = ctx;
+    p->addr = a;
+    p->refs = 1;
+    i1905_tx_bucket_set(&p->bucket, ctx->peer_tx_rate, ctx->peer_tx_burst);
+    unsigned h = peer_hash(&a);
+    p->next = ctx->peers[h];
+    ctx->peers[h] = p;
+    ctx->n_peers++;
+    return p;
+}
+
+void i1905_peer_close(struct i1905_peer *peer) {
+    if (!peer || --peer->refs) return;
+    struct i1905_ctx *ctx = peer->ctx;
+    struct i1905_peer **pp = &ctx->peers[peer_hash(&peer->addr)];
+    while (*pp != peer) pp = &(*pp)->next;
+    *pp = peer->next;
+    ctx->n_peers--;
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) i1905_txq_forget(ctx->ifaces[i]->txq, &peer->bucket);
+    free(peer);
+}
+
+const struct i1905_addr *i1905_peer_addr(const struct i1905_peer *peer) {
+    return peer ? &peer->addr : NULL;
+}
+
+int i1905_peer_get_stats(const struct i1905_peer *peer, struct i1905_peer_stats *out) {
+    if (!peer || !out) return -1;
+    i1905_stats_copy(out, &peer->stats, sizeof(*out));
+    return 0;
+}
+
+int i1905_peer_set_tx_rate(struct i1905_peer *peer, uint32_t bytes_per_s, uint32_t burst) {
+    if (!peer) return -1;
+    i1905_tx_bucket_set(&peer->bucket, bytes_per_s, burst);
+    return 0;
+}
+
+static void peers_free_all(struct i1905_ctx *ctx) {
+    for (unsigned i = 0; i < PEER_BUCKETS; i++) {
+        while (ctx->peers[i]) {
+            struct i1905_peer *p = ctx->peers[i];
+            ctx->peers[i] = p->next;
+            free(p);
+        }
+    }
+    ctx->n_peers = 0;
+    ctx->n_neighbors = 0;
+}
+
+// Device information TLV with a single interface of generic media type,
+// same as i1905_cmdu_add_device_info().
+static void device_info_one(struct i1905_tlv_device_info *info, struct i1905_iface_info *iface,
+                            const uint8_t al_mac[6], const uint8_t iface_mac[6]) {
+    memcpy(info->al_mac, al_mac, 6);
+    memcpy(iface->mac, iface_mac, 6);
+    iface->media = 0x0000;
+    info->interfaces = iface;
+    info->interfaces_count = 1;
+}
+
+static int builder_put_device_info(struct i1905_builder *b, const uint8_t al_mac[6],
+                                   const uint8_t iface_mac[6]) {
+    struct i1905_tlv_device_info info;
+    struct i1905_iface_info iface;
+    device_info_one(&info, &iface, al_mac, iface_mac);
+    return i1905_tlv_device_info_put(b, &info);
+}
+
+// The context's own device information: one entry per distinct interface
+// MAC (UDP and loopback interfaces all stamp the AL MAC).
+static int builder_put_local_info(struct i1905_builder *b, const struct i1905_ctx *ctx) {
+    struct i1905_iface_info ifaces[I1905_MAX_INTERFACES];
+    struct i1905_tlv_device_info info = { .interfaces = ifaces };
+    memcpy(info.al_mac, ctx->al_mac, 6);
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+        const uint8_t *mac = ctx->ifaces[i]->tp.if_mac;
+        size_t k = 0;
+        while (k < info.interfaces_count && memcmp(ifaces[k].mac, mac, 6) != 0) k++;
+        if (k < info.interfaces_count) continue;
+        memcpy(ifaces[k].mac, mac, 6);
+        ifaces[k].media = ctx->ifaces[i]->media;
+        info.interfaces_count++;
+    }
+    return i1905_tlv_device_info_put(b, &info);
+}
+
+// Remember the sender of a topology discovery as a neighbor on the interface
+// it arrived on; a full table gives up its stalest entry.
+static void seen_update(struct i1905_ctx *ctx, const uint8_t local_mac[6],
+                        const uint8_t al_mac[6], uint64_t now_ms) {
+    if (memcmp(al_mac, ctx->al_mac, 6) == 0) return;
+    struct i1905_seen *e = NULL;
+    for (unsigned i = 0; i < ctx->n_seen && !e; i++) {
+        struct i1905_seen *s = &ctx->seen[i];
+        if (memcmp(s->al_mac, al_mac, 6) == 0 && memcmp(s->local_mac, local_mac, 6) == 0) e = s;
+    }
+    if (!e && ctx->n_seen < I1905_MAX_NEIGHBORS) e = &ctx->seen[ctx->n_seen++];
+    if (!e) {
+        e = &ctx->seen[0];
+        for (unsigned i = 1; i < ctx->n_seen; i++) {
+            if (ctx->seen[i].last_ms < e->last_ms) e = &ctx->seen[i];
+        }
+    }
+    memcpy(e->al_mac, al_mac, 6);
+    memcpy(e->local_mac, local_mac, 6);
+    e->last_ms = now_ms;
+}
+
+// One neighbor device TLV per interface that heard a neighbor lately; aged
+// entries are dropped on the way.
+static void builder_put_neighbors(struct i1905_builder *b, struct i1905_ctx *ctx,
+                                  uint64_t now_ms) {
+    for (unsigned i = 0; i < ctx->n_seen;) {
+        if (now_ms - ctx->seen[i].last_ms > I1905_NEIGHBOR_TTL_MS) {
+            ctx->seen[i] = ctx->seen[--ctx->n_seen];
+        } else {
+            i++;
+        }
+    }
+    struct i1905_neighbor_info nbs[I1905_MAX_NEIGHBORS];
+    bool done[I1905_MAX_NEIGHBORS] = {false};
+    for (unsigned i = 0; i < ctx->n_seen; i++) {
+        if (done[i]) continue;
+        struct i1905_tlv_neighbor_device nd = { .neighbors = nbs };
+        memcpy(nd.local_mac, ctx->seen[i].local_mac, 6);
+        for (unsigned j = i; j < ctx->n_seen; j++) {
+            if (done[j] || memcmp(ctx->seen[j].local_mac, nd.local_mac, 6) != 0) continue;
+            done[j] = true;
+            memcpy(nbs[nd.neighbors_count].al_mac, ctx->seen[j].al_mac, 6);
+            nbs[nd.neighbors_count++].flags = 0;
+        }
+        i1905_tlv_neighbor_device_put(b, &nd);
+    }
+}
+
+void i1905_set_reply_mid(struct i1905_ctx *ctx, uint16_t mid) {
+    if (ctx) ctx->reply_mid = mid;
+}
+
+int i1905_set_fanout(struct i1905_ctx *ctx, const struct i1905_addr *dsts, unsigned n,
+                     unsigned *sent) {
+    if (!ctx || !dsts || !n) return -1;
+    ctx->fanout = dsts;
+    ctx->fanout_n = n;
+    ctx->fanout_sent = sent;
+    if (sent) *sent = 0;
+    return 0;
+}
+
+static void random_mac(uint8_t mac[6]) {
+    for (int i = 0; i < 6; i++) {
+        mac[i] = (uint8_t)rand();
+    }
+    mac[0] &= 0xFE; // unicast
+    mac[0] |= 0x02; // locally administered
+}
+
+int i1905_parse_mac(const char *str, uint8_t mac[6]) {
+    unsigned v[6];
+    char tail;
+    if (!str || sscanf(str, "%x:%x:%x:%x:%x:%x%c",
+                       &v[0], &v[1], &v[2], &v[3], &v[4], &v[5], &tail) != 6) {
+        return -1;
+    }
+    for (int i = 0; i < 6; i++) {
+        if (v[i] > 0xFF) return -1;
+        mac[i] = (uint8_t)v[i];
+    }
+    return 0;
+}
+
+static const struct i1905_transport_ops *transport_ops(i1905_transport_type type) {
+    switch (type) {
+    case I1905_TRANSPORT_UDP:    return &i1905_udp_transport;
+    case I1905_TRANSPORT_PACKET: return &i1905_packet_transport;
+    case I1905_TRANSPORT_LOOP:   return &i1905_loop_transport;
+    }
+    return NULL;
+}
+
+static const char *const drop_names[I1905_DROP_REASONS] = {
+    [I1905_DROP_SHORT_FRAME]   = "short_frame",
+    [I1905_DROP_ETHERTYPE]     = "ethertype",
+    [I1905_DROP_TLV_OVERFLOW]  = "tlv_overflow",
+    [I1905_DROP_TOO_MANY_TLVS] = "too_many_tlvs",
+    [I1905_DROP_OWN_RELAY]     = "own_relay",
+    [I1905_DROP_OVERSIZE]      = "oversize",
+    [I1905_DROP_SCHEMA]        = "schema",
+};
+
+const char *i1905_drop_reason_name(enum i1905_drop_reason reason) {
+    return (unsigned)reason < I1905_DROP_REASONS ? drop_names[reason] : NULL;
+}
+
+static const char *const tx_class_names[I1905_TX_CLASSES] = {
+    [I1905_TX_CONTROL]  = "control",
+    [I1905_TX_TOPOLOGY] = "topology",
+    [I1905_TX_BULK]     = "bulk",
+};
+
+const char *i1905_tx_class_name(i1905_tx_class cls) {
+    return (unsigned)cls < I1905_TX_CLASSES ? tx_class_names[cls] : NULL;
+}
+
+static void drop(struct i1905_ctx *ctx, enum i1905_drop_reason reason) {
+    I1905_STAT_INC(ctx->stats.rx_drops[reason]);
+}
+
+// Validate the Ethernet header and the TLV chain in place. Touches nothing
+// but the frame, the view and (atomically) the counters, so receive threads
+// call it too.
+static int parse_frame(struct i1905_stats *stats, struct i1905_frame *f,
+                       struct i1905_cmdu_view *view) {
+    if (f->truncated) {
+        I1905_STAT_INC(stats->rx_drops[I1905_DROP_OVERSIZE]);
+        return -1;
+    }
+    if (f->len < I1905_ETH_HDR_LEN + CMDU_HDR_LEN) {
+        I1905_STAT_INC(stats->rx_drops[I1905_DROP_SHORT_FRAME]);
+        return -1;
+    }
+    if (((f->data[12] << 8) | f->data[13]) != I1905_ETHERTYPE) {
+        I1905_STAT_INC(stats->rx_drops[I1905_DROP_ETHERTYPE]);
+        return -1;
+    }
+    memcpy(f->src.mac, f->data + 6, 6);
+    if (i1905_cmdu_view_parse(view, f->data + I1905_ETH_HDR_LEN,
+                              f->len - I1905_ETH_HDR_LEN) < 0) {
+        // only failure left once the header fits
+        I1905_STAT_INC(stats->rx_drops[I1905_DROP_TLV_OVERFLOW]);
+        return -1;
+    }
+    if (view->tlv_count > I1905_MAX_FRAME_TLVS) {
+        I1905_STAT_INC(stats->rx_drops[I1905_DROP_TOO_MANY_TLVS]);
+        return -1;
+    }
+    unsigned slot = I1905_STATS_TYPE_SLOT(view->message_type);
+    I1905_STAT_INC(stats->rx_type_frames[slot]);
+    I1905_STAT_ADD(stats->rx_type_bytes[slot], f->len);
+    return 0;
+}
+
+// A unicast request must be answered by the peer it was sent to; requests
+// sent to the multicast group accept the first matching reply.
+static bool peer_match(const struct i1905_addr *peer, const struct i1905_addr *src) {
+    if (peer->ip || peer->port) return peer->ip == src->ip && peer->port == src->port;
+    return (peer->mac[0] & 0x01) || memcmp(peer->mac, src->mac, 6) == 0;
+}
+
+static void pending_unlink(struct i1905_ctx *ctx, struct i1905_pending *p) {
+    struct i1905_pending **pp = &ctx->pending[p->mid % PENDING_BUCKETS];
+    while (*pp != p) pp = &(*pp)->next;
+    *pp = p->next;
+    ctx->n_pending--;
+}
+
+// Hand a reply to the call waiting for it; false when none is.
+static bool complete_pending(struct i1905_ctx *ctx, const struct i1905_cmdu_view *view,
+                             const struct i1905_rx_info *rx) {
+    for (struct i1905_pending *p = ctx->pending[view->message_id % PENDING_BUCKETS]; p;
+         p = p->next) {
+        if (p->mid != view->message_id || p->reply_type != view->message_type ||
+            !peer_match(&p->peer, &rx->src)) {
+            continue;
+        }
+        pending_unlink(ctx, p);
+        i1905_timer_cancel(&p->timer);
+        I1905_STAT_INC(ctx->stats.req_replies);
+        p->cb(view, rx, p->user);
+        free(p);
+        return true;
+    }
+    return false;
+}
+
+static void pending_timer_cb(struct i1905_timer *t, void *user) {
+    struct i1905_pending *p = user;
+    struct i1905_ctx *ctx = p->ctx;
+    if (p->retries) {
+        p->retries--;
+        p->rto_ms *= 2;
+        memcpy(ctx->tx_msg + I1905_ETH_HDR_LEN, p->msg, p->len);
+        ctx->last_tx_len = 0;
+        send_message(ctx, &p->peer, p->len);
+        I1905_STAT_INC(ctx->stats.req_retransmits);
+        i1905_timer_arm(ctx, t, p->rto_ms);
+        return;
+    }
+    pending_unlink(ctx, p);
+    I1905_STAT_INC(ctx->stats.req_timeouts);
+    p->cb(NULL, NULL, p->user);
+    free(p);
+}
+
+int i1905_expect_reply(struct i1905_ctx *ctx, uint16_t mid, uint16_t reply_type,
+                       uint32_t timeout_ms, unsigned retries,
+                       i1905_reply_cb cb, void *user) {
+    if (!ctx || !cb || !ctx->last_tx_len || ctx->last_tx_mid != mid ||
+        ctx->n_pending >= I1905_MAX_PENDING) {
+        return -1;
+    }
+    struct i1905_pending *p = malloc(sizeof(*p) + ctx->last_tx_len);
+    if (!p) return -1;
+    p->ctx = ctx;
+    p->peer = ctx->last_tx_dst;
+    p->mid = mid;
+    p->reply_type = reply_type;
+    p->rto_ms = timeout_ms ? timeout_ms : I1905_DEFAULT_REPLY_TIMEOUT_MS;
+    p->retries = retries;
+    p->cb = cb;
+    p->user = user;
+    p->len = ctx->last_tx_len;
+    memcpy(p->msg, ctx->tx_msg + I1905_ETH_HDR_LEN, p->len);
+    i1905_timer_init(&p->timer, pending_timer_cb, p);
+    i1905_timer_arm(ctx, &p->timer, p->rto_ms);
+    p->next = ctx->pending[mid % PENDING_BUCKETS];
+    ctx->pending[mid % PENDING_BUCKETS] = p;
+    ctx->n_pending++;
+    return 0;
+}
+
+static void pending_free_all(struct i1905_ctx *ctx) {
+    for (unsigned i = 0; i < PENDING_BUCKETS; i++) {
+        while (ctx->pending[i]) {
+            struct i1905_pending *p = ctx->pending[i];
+            ctx->pending[i] = p->next;
+            i1905_timer_cancel(&p->timer);
+            free(p);
+        }
+    }
+    ctx->n_pending = 0;
+}
+
+// The AL entity answers topology queries itself, echoing the query's
+// message_id so the requester can correlate the response.
+static void answer_topology_query(struct i1905_ctx *ctx, const struct i1905_addr *src,
+                                  const struct i1905_cmdu_view *query) {
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_TOPOLOGY_RESPONSE);
+    builder_put_local_info(&b, ctx);
+    builder_put_neighbors(&b, ctx, i1905_now_ms());
+    int len = i1905_builder_finish(&b);
+    if (len > 0) set_mid(b.buf, query->message_id);
+    ctx->last_tx_len = 0;
+    if (len > 0 && send_message(ctx, src, (size_t)len) == 0) I1905_STAT_INC(ctx->stats.queries_answered);
+}
+
+static void dispatch_view(struct i1905_ctx *ctx, const struct i1905_frame *f,
+                          const struct i1905_cmdu_view *view) {
+    struct i1905_rx_info rx;
+    rx.src = f->src;
+    memcpy(rx.dst_mac, f->data, 6);
+    struct i1905_tlv_view al;
+    if (i1905_cmdu_view_find(view, I1905_TLV_AL_MAC, &al) == 0 && al.len >= 6) {
+        memcpy(rx.al_mac, al.value, 6);
+    } else {
+        memcpy(rx.al_mac, f->src.mac, 6);
+    }
+    struct i1905_peer *peer = peer_find(ctx, &rx.src);
+    if (peer) {
+        I1905_STAT_INC(peer->stats.rx_msgs);
+        I1905_STAT_ADD(peer->stats.rx_bytes, CMDU_HDR_LEN + view->tlv_len + 3);
+        __atomic_store_n(&peer->stats.last_rx_ms, i1905_now_ms(), __ATOMIC_RELAXED);
+    }
+    if (view->message_type == I1905_MSG_TOPOLOGY_DISCOVERY) {
+        seen_update(ctx, iface_for(ctx, &rx.src)->tp.if_mac, rx.al_mac, i1905_now_ms());
+    }
+    if (view->message_type == I1905_MSG_TOPOLOGY_QUERY && !ctx->no_query_answer) {
+        answer_topology_query(ctx, &rx.src, view);
+    }
+    if (complete_pending(ctx, view, &rx)) return;
+    if (ctx->cb) {
+        uint64_t t0 = now_ns();
+        ctx->cb(view, &rx, ctx->user_ctx);
+        hist_add(ctx->stats.cb_ns_hist, now_ns() - t0);
+    }
+}
+
+static bool same_link(const struct i1905_addr *a, const struct i1905_addr *b) {
+    if (a->ip || a->port || b->ip || b->port) return a->ip == b->ip && a->port == b->port;
+    return a->ifindex == b->ifindex;
+}
+
+// Re-serialise a relayed message and pass it on to every other neighbor,
+// and on AF_PACKET to the multicast group of every other interface. The
+// CMDU keeps its originator's message_id and TLVs, only the frame source
+// MAC changes.
+static void forward_relayed(struct i1905_ctx *ctx, const struct i1905_frame *f,
+                            const struct i1905_cmdu_view *view) {
+    size_t len = CMDU_HDR_LEN + view->tlv_len + 3;
+    bool l2 = ctx->ifaces[0]->tp.ops == &i1905_packet_transport;
+    if ((ctx->n_neighbors == 0 && !(l2 && ctx->n_ifaces > 1)) ||
+        len + I1905_ETH_HDR_LEN > I1905_MAX_MSG_SIZE) {
+        return;
+    }
+    ctx->last_tx_len = 0;
+    uint8_t *p = ctx->tx_msg + I1905_ETH_HDR_LEN;
+    *p++ = 0x00;
+    *p++ = (view->message_type >> 8) & 0xFF;
+    *p++ = view->message_type & 0xFF;
+    *p++ = (view->message_id >> 8) & 0xFF;
+    *p++ = view->message_id & 0xFF;
+    *p++ = 0;
+    *p++ = 0x80 | 0x40;
+    memcpy(p, view->tlv_data, view->tlv_len);
+    p += view->tlv_len;
+    *p++ = I1905_TLV_END_OF_MESSAGE;
+    *p++ = 0x00;
+    *p++ = 0x00;
+
+    bool sent = false;
+    for (unsigned i = 0; i < ctx->n_neighbors; i++) {
+        const struct i1905_addr *to = &ctx->neighbors[i]->addr;
+        if (same_link(to, &f->src)) continue;
+        if (send_message(ctx, to, len) == 0) {
+            I1905_STAT_INC(ctx->stats.fwd_frames);
+            sent = true;
+        }
+    }
+    for (unsigned i = 0; l2 && i < ctx->n_ifaces; i++) {
+        struct i1905_iface *ifc = ctx->ifaces[i];
+        struct i1905_addr group;
+        if (ifc->tp.ifindex == f->src.ifindex ||
+            ifc->tp.ops->resolve(&ifc->tp, NULL, 0, &group) < 0) {
+            continue;
+        }
+        if (send_message(ctx, &group, len) == 0) {
+            I1905_STAT_INC(ctx->stats.fwd_frames);
+            sent = true;
+        }
+    }
+    if (sent) I1905_STAT_INC(ctx->stats.fwd_messages);
+}
+
+static void deliver_message(struct i1905_ctx *ctx, const struct i1905_frame *f,
+                            const struct i1905_cmdu_view *view) {
+    if (ctx->validate && i1905_cmdu_view_validate(view) < 0) {
+        drop(ctx, I1905_DROP_SCHEMA);
+        return;
+    }
+    if (view->relay) {
+        uint8_t al_mac[6];
+        struct i1905_tlv_view al;
+        if (i1905_cmdu_view_find(view, I1905_TLV_AL_MAC, &al) == 0 && al.len >= 6) {
+            memcpy(al_mac, al.value, 6);
+        } else {
+            memcpy(al_mac, f->src.mac, 6);
+        }
+        // our own relayed multicast coming back, or a copy via another path
+        if (memcmp(al_mac, ctx->al_mac, 6) == 0) {
+            drop(ctx, I1905_DROP_OWN_RELAY);
+            return;
+        }
+        if (i1905_dedup_check(ctx->dedup, al_mac, view->message_id, i1905_now_ms())) return;
+        forward_relayed(ctx, f, view);
+    }
+    dispatch_view(ctx, f, view);
+}
+
+static void deliver(struct i1905_ctx *ctx, const struct i1905_frame *f,
+                    const struct i1905_cmdu_view *view) {
+    if (view->fragment_id == 0 && view->last_fragment) {
+        deliver_message(ctx, f, view);
+        return;
+    }
+    struct i1905_cmdu_view whole;
+    int rv = i1905_reasm_input(ctx->reasm, f->src.mac, view, i1905_now_ms(), &whole);
+    if (rv == 1) {
+        deliver_message(ctx, f, &whole);
+    } else if (rv == 0 && !i1905_timer_pending(&ctx->reasm_timer)) {
+        uint64_t now = i1905_now_ms();
+        uint64_t deadline = i1905_reasm_next_deadline(ctx->reasm);
+        i1905_timer_arm(ctx, &ctx->reasm_timer, deadline > now ? (uint32_t)(deadline - now) : 0);
+    }
+}
+
+// Reassembly timeouts: one timer tracks the oldest partial message.
+static void reasm_timer_cb(struct i1905_timer *t, void *user) {
+    struct i1905_ctx *ctx = user;
+    uint64_t now = i1905_now_ms();
+    i1905_reasm_expire(ctx->reasm, now);
+    uint64_t deadline = i1905_reasm_next_deadline(ctx->reasm);
+    if (deadline) i1905_timer_arm(ctx, t, deadline > now ? (uint32_t)(deadline - now) : 0);
+}
+
+// Periodic topology discovery advertising the sending interface's MAC: to
+// the 1905 multicast group of every interface on AF_PACKET, otherwise once
+// per neighbor.
+static void discovery_timer_cb(struct i1905_timer *t, void *user) {
+    struct i1905_ctx *ctx = user;
+    uint16_t mid = next_id(ctx);
+    if (ctx->ifaces[0]->tp.ops == &i1905_packet_transport) {
+        for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+            struct i1905_iface *ifc = ctx->ifaces[i];
+            struct i1905_addr group;
+            if (ifc->tp.ops->resolve(&ifc->tp, NULL, 0, &group) == 0 &&
+                send_template(ctx, &group, I1905_MSG_TOPOLOGY_DISCOVERY, ifc->tp.if_mac,
+                              mid) == 0) {
+                I1905_STAT_INC(ctx->stats.discovery_sent);
+            }
+        }
+    } else {
+        for (unsigned i = 0; i < ctx->n_neighbors; i++) {
+            const struct i1905_addr *to = &ctx->neighbors[i]->addr;
+            if (send_template(ctx, to, I1905_MSG_TOPOLOGY_DISCOVERY,
+                              iface_for(ctx, to)->tp.if_mac, mid) == 0) {
+                I1905_STAT_INC(ctx->stats.discovery_sent);
+            }
+        }
+    }
+    i1905_timer_arm(ctx, t, ctx->discovery_interval_ms);
+}
+
+static void ctx_buffers_free(struct i1905_ctx *ctx) {
+    free(ctx->rx_frames);
+    free(ctx->rx_views);
+    free(ctx->rx_valid);
+    free(ctx->tx_msg);
+    free(ctx->fan_tx);
+    free(ctx->fan_hdr);
+    free(ctx->fan_bucket);
+    free(ctx->fan_ok);
+    i1905_arena_free(ctx->arena);
+    i1905_reasm_free(ctx->reasm);
+    i1905_dedup_free(ctx->dedup);
+    i1905_wheel_free(ctx->wheel);
+}
+
+static int ctx_buffers_alloc(struct i1905_ctx *ctx, unsigned batch,
+                            const struct i1905_opts *opts) {
+    size_t budget = (opts && opts->reasm_budget) ? opts->reasm_budget
+                                                 : I1905_DEFAULT_REASM_BUDGET;
+    uint32_t timeout = (opts && opts->reasm_timeout_ms) ? opts->reasm_timeout_ms
+                                                        : I1905_DEFAULT_REASM_TIMEOUT_MS;
+    ctx->rx_frames = calloc(batch, sizeof(*ctx->rx_frames));
+    ctx->rx_views = calloc(batch, sizeof(*ctx->rx_views));
+    ctx->rx_valid = calloc(batch, sizeof(*ctx->rx_valid));
+    ctx->tx_msg = malloc(I1905_MAX_MSG_SIZE);
+    ctx->reasm = i1905_reasm_new(budget, timeout, &ctx->stats);
+    ctx->dedup = i1905_dedup_new(
+        (opts && opts->dedup_size) ? opts->dedup_size : I1905_DEFAULT_DEDUP_SIZE,
+        (opts && opts->dedup_ttl_ms) ? opts->dedup_ttl_ms : I1905_DEFAULT_DEDUP_TTL_MS,
+        &ctx->stats);
+    ctx->wheel = i1905_wheel_new();
+    ctx->arena = i1905_arena_new(0);
+    if (!ctx->rx_frames || !ctx->rx_views || !ctx->rx_valid ||
+        !ctx->tx_msg || !ctx->reasm || !ctx->dedup || !ctx->wheel || !ctx->arena) {
+        ctx_buffers_free(ctx);
+        return -1;
+    }
+    return 0;
+}
+
+static void iface_close(struct i1905_ctx *ctx, struct i1905_iface *ifc) {
+    if (ifc->events) epoll_ctl(ctx->epfd, EPOLL_CTL_DEL, ifc->tp.ops->get_fd(&ifc->tp), NULL);
+    i1905_txq_free(ifc->txq);   // before the wheel its timer is on
+    ifc->tp.ops->close(&ifc->tp);
+    free(ifc);
+}
+
+static void handoff_close(const struct i1905_handoff *h) {
+    for (unsigned i = 0; i < h->n && i < I1905_MAX_INTERFACES; i++) {
+        if (h->fds[i] >= 0) close(h->fds[i]);
+    }
+}
+
+// Offer the predecessor's socket for this interface to the transport.
+// Threaded receive leaves it alone: its shards bind a new reuseport group.
+static void handoff_take(struct i1905_ctx *ctx, struct i1905_iface *ifc) {
+    struct i1905_handoff *h = &ctx->handoff;
+    for (unsigned i = 0; i < h->n && !ifc->tp.n_shards; i++) {
+        if (h->fds[i] < 0 || strncmp(h->names[i], ifc->name, I1905_IFNAME_LEN) != 0) continue;
+        ifc->tp.adopt = true;
+        ifc->tp.adopt_fd = h->fds[i];
+        ifc->tp.adopt_state = h->state[i];
+        h->fds[i] = -1;
+        return;
+    }
+}
+
+// Media type of a network device as far as sysfs tells: the link speed of
+// a wired one. 802.11 standard and band are not in sysfs, so wireless
+// devices and everything else stay unknown until i1905_set_if_media().
+static uint16_t if_media(const char *ifname) {
+    char path[64];
+    snprintf(path, sizeof(path), "/sys/class/net/%s/wireless", ifname);
+    if (access(path, F_OK) == 0) return I1905_MEDIA_UNKNOWN;
+    snprintf(path, sizeof(path), "/sys/class/net/%s/speed", ifname);
+    FILE *f = fopen(path, "r");
+    int mbps = 0;
+    if (f) {
+        if (fscanf(f, "%d", &mbps) != 1) mbps = 0;
+        fclose(f);
+    }
+    if (mbps <= 0) return I1905_MEDIA_UNKNOWN;
+    return mbps < 1000 ? I1905_MEDIA_ETH_100 : I1905_MEDIA_ETH_1000;
+}
+
+// Open an endpoint on ifname (NULL: the transport's default) and add it to
+// the epoll set; proto carries ops, rx_batch and the threaded receive
+// settings.
+static struct i1905_iface *iface_open(struct i1905_ctx *ctx, const struct i1905_transport *proto,
+                                      const char *ifname) {
+    struct i1905_iface *ifc = calloc(1, sizeof(*ifc));
+    if (!ifc) return NULL;
+    ifc->tp = *proto;
+    memcpy(ifc->tp.if_mac, ctx->al_mac, 6); // L2 backends override with the real one
+    if (ifname) {
+        snprintf(ifc->name, sizeof(ifc->name), "%s", ifname);
+    } else if (ifc->tp.ops == &i1905_loop_transport) {
+        snprintf(ifc->name, sizeof(ifc->name), "%u", (unsigned)ctx->port);
+    } else {
+        snprintf(ifc->name, sizeof(ifc->name), "any");
+    }
+    ifc->media = ifname ? if_media(ifname) : I1905_MEDIA_UNKNOWN;
+    handoff_take(ctx, ifc);
+    ifc->txq = i1905_txq_new(&ifc->tp, ctx->wheel, ctx->tx_queue_len, &ctx->stats, &ifc->stats);
+    int rv = ifc->txq ? ifc->tp.ops->open(&ifc->tp, ifname, ctx->port) : -1;
+    if (ifc->tp.adopt) {
+        close(ifc->tp.adopt_fd);
+        ifc->tp.adopt = false;
+    }
+    if (rv < 0) {
+        i1905_txq_free(ifc->txq);
+        free(ifc);
+        return NULL;
+    }
+    ifc->rx = !ifc->tp.n_shards;
+    if (iface_sync(ctx, ifc) < 0) {
+        iface_close(ctx, ifc);
+        return NULL;
+    }
+    return ifc;
+}
+
+static void account_batch(struct i1905_stats *stats, unsigned n) {
+    unsigned bucket = 0;
+    while ((n >> (bucket + 1)) && bucket + 1 < I1905_BATCH_HIST_BUCKETS) bucket++;
+    I1905_STAT_ADD(stats->rx_frames, n);
+    I1905_STAT_INC(stats->rx_batches);
+    I1905_STAT_INC(stats->rx_batch_hist[bucket]);
+    i1905_stat_max(&stats->rx_batch_max, n);
+}
+
+// Drops are counted per reason instead of logged.
+unsigned i1905_parse_batch(struct i1905_stats *stats, struct i1905_frame *frames,
+                           struct i1905_cmdu_view *views, bool *valid, unsigned n) {
+    unsigned ok = 0;
+    account_batch(stats, n);
+    uint64_t t0 = now_ns();
+    for (unsigned i = 0; i < n; i++) {
+        valid[i] = parse_frame(stats, &frames[i], &views[i]) == 0;
+        ok += valid[i];
+    }
+    hist_add(stats->parse_ns_hist, (now_ns() - t0) / n);
+    return ok;
+}
+
+int i1905_init(struct i1905_ctx **out,
+               i1905_role role,
+               uint16_t listen_port,
+               const uint8_t al_mac[6],
+               i1905_event_cb cb,
+               void *user_ctx) {
+    return i1905_init_ex(out, role, listen_port, al_mac, cb, user_ctx, NULL);
+}
+
+int i1905_init_ex(struct i1905_ctx **out,
+                  i1905_role role,
+                  uint16_t listen_port,
+                  const uint8_t al_mac[6],
+                  i1905_event_cb cb,
+                  void *user_ctx,
+                  const struct i1905_opts *opts) {
+    unsigned batch = (opts && opts->rx_batch) ? opts->rx_batch : I1905_DEFAULT_RX_BATCH;
+    if (batch > I1905_MAX_RX_BATCH) batch = I1905_MAX_RX_BATCH;
+
+    const struct i1905_transport_ops *ops = transport_ops(opts ? opts->transport
+                                                               : I1905_TRANSPORT_UDP);
+    struct i1905_ctx *ctx = out && ops ? calloc(1, sizeof(*ctx)) : NULL;
+    if (!ctx) {
+        if (opts && opts->handoff) handoff_close(opts->handoff);
+        return -1;
+    }
+    if (opts && opts->handoff) {
+        ctx->handoff = *opts->handoff;
+        if (ctx->handoff.n > I1905_MAX_INTERFACES) ctx->handoff.n = I1905_MAX_INTERFACES;
+    }
+    ctx->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ctx->epfd < 0 || ctx_buffers_alloc(ctx, batch, opts) < 0) {
+        if (ctx->epfd >= 0) close(ctx->epfd);
+        handoff_close(&ctx->handoff);
+        free(ctx);
+        return -1;
+    }
+    if (al_mac) memcpy(ctx->al_mac, al_mac, 6);
+    else random_mac(ctx->al_mac);
+    ctx->port = listen_port;
+    ctx->tx_queue_len = opts ? opts->tx_queue_len : 0;
+
+    struct i1905_transport proto = { .ops = ops, .rx_batch = batch, .shard = -1 };
+    if (opts && opts->rx_threads) {
+        static unsigned groups;
+        proto.n_shards = opts->rx_threads < I1905_MAX_RX_THREADS ? opts->rx_threads
+                                                                 : I1905_MAX_RX_THREADS;
+        proto.shard_group = (uint16_t)(getpid() + groups++);
+    }
+    struct i1905_iface *ifc = iface_open(ctx, &proto, opts ? opts->ifname : NULL);
+    if (!ifc) {
+        i1905_close(ctx);
+        return -1;
+    }
+    ctx->ifaces[ctx->n_ifaces++] = ifc;
+    if (proto.n_shards) {
+        // the shards bind after the transmit socket, see transport_udp.c
+        ctx->rxq = i1905_rxq_start(&ifc->tp, opts->ifname, listen_port,
+                                   opts->rx_queue_len ? opts->rx_queue_len
+                                                      : I1905_DEFAULT_RX_QUEUE,
+                                   &ctx->stats);
+        struct epoll_event ev = { .events = EPOLLIN, .data.ptr = NULL };
+        if (!ctx->rxq || epoll_ctl(ctx->epfd, EPOLL_CTL_ADD, i1905_rxq_fd(ctx->rxq), &ev) < 0) {
+            i1905_close(ctx);
+            return -1;
+        }
+    }
+    ctx->role = role;
+    ctx->cb = cb;
+    ctx->user_ctx = user_ctx;
+    ctx->next_message_id = opts && opts->message_id ? opts->message_id
+                                                    : (uint16_t)(rand() & 0xFFFF);
+    i1905_timer_init(&ctx->reasm_timer, reasm_timer_cb, ctx);
+    i1905_timer_init(&ctx->discovery_timer, discovery_timer_cb, ctx);
+    ctx->discovery_interval_ms = opts ? opts->discovery_interval_ms : 0;
+    if (opts) {
+        i1905_txq_set_rate(ifc->txq, opts->tx_rate, opts->tx_burst);
+        ctx->peer_tx_rate = opts->peer_tx_rate;
+        ctx->peer_tx_burst = opts->peer_tx_burst;
+        ctx->validate = opts->validate;
+        ctx->no_query_answer = opts->no_query_answer;
+    }
+    if (ctx->discovery_interval_ms) {
+        // first round on the next tick, once the caller added its neighbors
+        i1905_timer_arm(ctx, &ctx->discovery_timer, 0);
+    }
+    *out = ctx;
+    return 0;
+}
+
+void i1905_close(struct i1905_ctx *ctx) {
+    if (!ctx) return;
+    i1905_rxq_stop(ctx->rxq);
+    i1905_capture_stop(ctx);
+    while (ctx->n_ifaces) iface_close(ctx, ctx->ifaces[--ctx->n_ifaces]);
+    pending_free_all(ctx);
+    peers_free_all(ctx);
+    ctx_buffers_free(ctx);
+    handoff_close(&ctx->handoff);
+    close(ctx->epfd);
+    free(ctx);
+}
+
+void i1905_get_al_mac(const struct i1905_ctx *ctx, uint8_t al_mac[6]) {
+    memcpy(al_mac, ctx->al_mac, 6);
+}
+
+uint16_t i1905_get_message_id(const struct i1905_ctx *ctx) {
+    return ctx ? ctx->next_message_id : 0;
+}
+
+_Static_assert(sizeof(struct i1905_stats) % sizeof(uint64_t) == 0, "counters only");
+_Static_assert(sizeof(struct i1905_peer_stats) % sizeof(uint64_t) == 0, "counters only");
+
+int i1905_get_stats(const struct i1905_ctx *ctx, struct i1905_stats *out) {
+    if (!ctx || !out) return -1;
+    i1905_stats_copy(out, &ctx->stats, sizeof(*out));
+    return 0;
+}
+
+// Two fds whatever the number of interfaces: the epoll set and the wheel.
+int i1905_poll(struct i1905_ctx *ctx, int timeout_ms) {
+    if (!ctx) return -1;
+    struct pollfd pfd[2] = {
+        { .fd = ctx->epfd, .events = POLLIN },
+        { .fd = i1905_wheel_fd(ctx->wheel), .events = POLLIN },
+    };
+    int rv = poll(pfd, 2, timeout_ms);
+    if (rv <= 0) return rv; // timeout or error
+
+    if (pfd[1].revents & POLLIN) i1905_handle_timers(ctx);
+    if ((pfd[0].revents & POLLIN) && i1905_handle_readable(ctx) < 0) return -1;
+    return 1;
+}
+
+int i1905_get_fd(const struct i1905_ctx *ctx) {
+    return ctx ? ctx->epfd : -1;
+}
+
+int i1905_get_timer_fd(const struct i1905_ctx *ctx) {
+    return ctx ? i1905_wheel_fd(ctx->wheel) : -1;
+}
+
+struct i1905_arena *i1905_get_arena(struct i1905_ctx *ctx) {
+    return ctx ? ctx->arena : NULL;
+}
+
+int i1905_set_tx_class(struct i1905_ctx *ctx, uint16_t message_type, i1905_tx_class cls) {
+    if (!ctx || (unsigned)cls >= I1905_TX_CLASSES) return -1;
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+        i1905_txq_set_class(ctx->ifaces[i]->txq, message_type, cls);
+    }
+    return 0;
+}
+
+int i1905_set_tx_rate(struct i1905_ctx *ctx, uint32_t bytes_per_s, uint32_t burst) {
+    if (!ctx) return -1;
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+        i1905_txq_set_rate(ctx->ifaces[i]->txq, bytes_per_s, burst);
+    }
+    return 0;
+}
+
+int i1905_handle_timers(struct i1905_ctx *ctx) {
+    if (!ctx) return -1;
+    I1905_STAT_ADD(ctx->stats.timers_fired, i1905_wheel_run(ctx->wheel));
+    i1905_arena_reset(ctx->arena);
+    iface_sync_all(ctx);        // scheduler timers may have met a full socket
+    return 0;
+}
+
+int i1905_add_interface(struct i1905_ctx *ctx, const char *ifname) {
+    if (!ctx || !ifname || !*ifname || strlen(ifname) >= I1905_IFNAME_LEN) return -1;
+    if (iface_by_name(ctx, ifname)) return 0;
+    if (ctx->rxq || ctx->n_ifaces >= I1905_MAX_INTERFACES) return -1;
+    struct i1905_iface *first = ctx->ifaces[0];
+    struct i1905_transport proto = {
+        .ops = first->tp.ops, .rx_batch = first->tp.rx_batch, .shard = -1,
+    };
+    struct i1905_iface *ifc = iface_open(ctx, &proto, ifname);
+    if (!ifc) return -1;
+    i1905_txq_inherit(ifc->txq, first->txq);
+    ctx->ifaces[ctx->n_ifaces++] = ifc;
+    return 0;
+}
+
+int i1905_del_interface(struct i1905_ctx *ctx, const char *ifname) {
+    if (!ctx || !ifname || ctx->in_rx) return -1;
+    for (unsigned i = 1; i < ctx->n_ifaces; i++) {
+        if (strcmp(ctx->ifaces[i]->name, ifname) != 0) continue;
+        iface_close(ctx, ctx->ifaces[i]);
+        ctx->ifaces[i] = ctx->ifaces[--ctx->n_ifaces];
+        return 0;
+    }
+    return -1;
+}
+
+int i1905_get_if_stats(const struct i1905_ctx *ctx, unsigned i, char *name,
+                       struct i1905_if_stats *out) {
+    if (!ctx || i >= ctx->n_ifaces) return -1;
+    const struct i1905_iface *ifc = ctx->ifaces[i];
+    if (name) memcpy(name, ifc->name, I1905_IFNAME_LEN);
+    if (out) i1905_stats_copy(out, &ifc->stats, sizeof(*out));
+    return 0;
+}
+
+int i1905_set_if_media(struct i1905_ctx *ctx, const char *ifname, uint16_t media) {
+    if (!ctx) return -1;
+    struct i1905_iface *ifc = ifname ? iface_by_name(ctx, ifname) : ctx->ifaces[0];
+    if (!ifc) return -1;
+    ifc->media = media;
+    return 0;
+}
+
+// The fds are duplicated before anything is detached, so a failure leaves
+// the context as it was.
+int i1905_handoff(struct i1905_ctx *ctx, struct i1905_handoff *out) {
+    if (!ctx || !out || ctx->rxq || ctx->in_rx ||
+        ctx->ifaces[0]->tp.ops == &i1905_loop_transport) {
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+        const struct i1905_transport *tp = &ctx->ifaces[i]->tp;
+        int fd = fcntl(tp->ops->get_fd(tp), F_DUPFD_CLOEXEC, 0);
+        if (fd < 0) {
+            handoff_close(out);
+            return -1;
+        }
+        out->fds[out->n++] = fd;
+    }
+    i1905_timer_cancel(&ctx->discovery_timer);
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) {
+        struct i1905_iface *ifc = ctx->ifaces[i];
+        i1905_txq_flush(ifc->txq);
+        ifc->rx = false;
+        iface_sync(ctx, ifc);
+        memcpy(out->names[i], ifc->name, I1905_IFNAME_LEN);
+        out->state[i] = ifc->tp.ops->detach ? ifc->tp.ops->detach(&ifc->tp) : 0;
+    }
+    return (int)out->n;
+}
+
+int i1905_timer_arm(struct i1905_ctx *ctx, struct i1905_timer *t, uint32_t delay_ms) {
+    if (!ctx || !t) return -1;
+    return i1905_wheel_arm(ctx->wheel, t, delay_ms);
+}
+
+int i1905_resolve(struct i1905_ctx *ctx, const char *dst, uint16_t port,
+                  struct i1905_addr *out) {
+    if (!ctx || !out) return -1;
+    return resolve_addr(ctx, dst, port, out);
+}
+
+static int neighbor_find(const struct i1905_ctx *ctx, const struct i1905_peer *p) {
+    for (unsigned i = 0; i < ctx->n_neighbors; i++) {
+        if (ctx->neighbors[i] == p) return (int)i;
+    }
+    return -1;
+}
+
+// Neighbors hold a peer reference, so they get per-peer counters too.
+int i1905_add_neighbor(struct i1905_ctx *ctx, const char *dst, uint16_t port) {
+    struct i1905_peer *p = i1905_peer_open(ctx, dst, port);
+    if (!p) return -1;
+    bool known = neighbor_find(ctx, p) >= 0;
+    if (known || ctx->n_neighbors >= I1905_MAX_NEIGHBORS) {
+        i1905_peer_close(p);
+        return known ? 0 : -1;
+    }
+    ctx->neighbors[ctx->n_neighbors++] = p;
+    return 0;
+}
+
+int i1905_del_neighbor(struct i1905_ctx *ctx, const char *dst, uint16_t port) {
+    struct i1905_addr a;
+    if (i1905_resolve(ctx, dst, port, &a) < 0) return -1;
+    struct i1905_peer *p = peer_find(ctx, &a);
+    int i = p ? neighbor_find(ctx, p) : -1;
+    if (i < 0) return -1;
+    ctx->neighbors[i] = ctx->neighbors[--ctx->n_neighbors];
+    i1905_peer_close(p);
+    return 0;
+}
+
+// Threaded receive has a single interface; its workers only pass on valid
+// frames, so those are all it counts.
+static void deliver_queued(void *user, const struct i1905_frame *f,
+                           const struct i1905_cmdu_view *view) {
+    struct i1905_ctx *ctx = user;
+    I1905_STAT_INC(ctx->ifaces[0]->stats.rx_frames);
+    I1905_STAT_ADD(ctx->ifaces[0]->stats.rx_bytes, f->len);
+    if (ctx->capture) i1905_capture_frame(ctx->capture, I1905_CAPTURE_IN, NULL, f->data, f->len);
+    deliver(ctx, f, view);
+}
+
+static int iface_drain(struct i1905_ctx *ctx, struct i1905_iface *ifc) {
+    while (1) {
+        int n = ifc->tp.ops->rx_batch(&ifc->tp, ctx->rx_frames, ifc->tp.rx_batch);
+        if (n <= 0) return n;
+        size_t bytes = 0;
+        for (int i = 0; i < n; i++) {
+            bytes += ctx->rx_frames[i].len;
+            if (ctx->capture) {
+                i1905_capture_frame(ctx->capture, I1905_CAPTURE_IN, NULL,
+                                    ctx->rx_frames[i].data, ctx->rx_frames[i].len);
+            }
+        }
+        I1905_STAT_ADD(ifc->stats.rx_frames, n);
+        I1905_STAT_ADD(ifc->stats.rx_bytes, bytes);
+
+        // parse the whole batch first, then hand it to the callback
+        i1905_parse_batch(&ctx->stats, ctx->rx_frames, ctx->rx_views, ctx->rx_valid, (unsigned)n);
+        for (int i = 0; i < n; i++) {
+            if (ctx->rx_valid[i]) deliver(ctx, &ctx->rx_frames[i], &ctx->rx_views[i]);
+        }
+        i1905_arena_reset(ctx->arena);
+    }
+}
+
+static int iface_ready(struct i1905_ctx *ctx, struct i1905_iface *ifc, uint32_t events) {
+    if ((events & EPOLLOUT) && (ifc->events & EPOLLOUT)) i1905_txq_flush(ifc->txq);
+    if (!ifc->rx || !(events & (EPOLLIN | EPOLLERR | EPOLLHUP))) return 0;
+    return iface_drain(ctx, ifc);
+}
+
+int i1905_handle_readable(struct i1905_ctx *ctx) {
+    if (!ctx) return -1;
+    int rv = 0;
+    ctx->in_rx = true;
+    if (ctx->n_ifaces == 1 && !ctx->rxq && ctx->ifaces[0]->events == EPOLLIN) {
+        // the set holds this one socket for input only, no need to ask it
+        rv = iface_drain(ctx, ctx->ifaces[0]);
+    } else {
+        struct epoll_event ev[I1905_MAX_INTERFACES + 1];
+        int n = epoll_wait(ctx->epfd, ev, I1905_MAX_INTERFACES + 1, 0);
+        if (n < 0 && errno != EINTR) rv = -1;
+        for (int i = 0; i < n; i++) {
+            if (!ev[i].data.ptr) {
+                // bounded so sends and timers get their turn under a flood;
+                // the queue re-arms its eventfd when frames are left over
+                i1905_rxq_drain(ctx->rxq, I1905_MAX_RX_BATCH, deliver_queued, ctx);
+                i1905_arena_reset(ctx->arena);
+            } else if (iface_ready(ctx, ev[i].data.ptr, ev[i].events) < 0) {
+                rv = -1;
+            }
+        }
+    }
+    ctx->in_rx = false;
+    iface_sync_all(ctx);
+    return rv;
+}
+
+int i1905_inject_frame(struct i1905_ctx *ctx, const uint8_t *frame, size_t len,
+                       const struct i1905_addr *src) {
+    if (!ctx || !frame) return -1;
+    struct i1905_frame f = { .data = frame, .len = len };
+    if (src) f.src = *src;
+    struct i1905_cmdu_view view;
+    bool valid;
+    // a batch of one, so the counters look as if it had been received
+    i1905_parse_batch(&ctx->stats, &f, &view, &valid, 1);
+    if (valid) deliver(ctx, &f, &view);
+    i1905_arena_reset(ctx->arena);
+    return valid ? 0 : -1;
+}
+
+int i1905_capture_start(struct i1905_ctx *ctx, const char *path, size_t ring_size,
+                        uint32_t snaplen) {
+    if (!ctx || !path) return -1;
+    struct i1905_capture *c = i1905_capture_new(path, ring_size, snaplen, &ctx->stats);
+    if (!c) return -1;
+    i1905_capture_stop(ctx);
+    ctx->capture = c;
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) i1905_txq_set_capture(ctx->ifaces[i]->txq, c);
+    return 0;
+}
+
+int i1905_capture_stop(struct i1905_ctx *ctx) {
+    if (!ctx) return -1;
+    if (!ctx->capture) return 0;
+    for (unsigned i = 0; i < ctx->n_ifaces; i++) i1905_txq_set_capture(ctx->ifaces[i]->txq, NULL);
+    i1905_capture_free(ctx->capture);
+    ctx->capture = NULL;
+    return 0;
+}
+
+bool i1905_capture_active(const struct i1905_ctx *ctx) {
+    return ctx && ctx->capture;
+}
+
+int i1905_cmdu_add_mac(struct i1905_cmdu *cmdu, uint8_t type, const uint8_t mac[6]) {
+    if (!mac) return -1;
+    return i1905_cmdu_add_tlv(cmdu, type, mac, 6) ? 0 : -1;
+}
+
+int i1905_cmdu_add_wsc(struct i1905_cmdu *cmdu, const uint8_t *payload, size_t len) {
+    if (!payload || len > UINT16_MAX) return -1;
+    struct i1905_tlv_wsc wsc = { .frame = payload, .frame_len = (uint16_t)len };
+    return i1905_tlv_wsc_encode(cmdu, &wsc);
+}
+
+int i1905_cmdu_add_device_info(struct i1905_cmdu *cmdu,
+                               const uint8_t al_mac[6],
+                               const uint8_t iface_mac[6]) {
+    if (!al_mac || !iface_mac) return -1;
+    struct i1905_tlv_device_info info;
+    struct i1905_iface_info iface;
+    device_info_one(&info, &iface, al_mac, iface_mac);
+    return i1905_tlv_device_info_encode(cmdu, &info);
+}
+
+int i1905_send_topology_discovery(struct i1905_ctx *ctx,
+                                  const char *dst_ip,
+                                  uint16_t dst_port,
+                                  const uint8_t iface_mac[6]) {
+    if (!ctx || !iface_mac) return -1;
+    struct i1905_addr dst;
+    if (resolve_dst(ctx, dst_ip, dst_port, &dst) < 0) return -1;
+    return send_periodic(ctx, &dst, I1905_MSG_TOPOLOGY_DISCOVERY, iface_mac);
+}
+
+int i1905_send_topology_query(struct i1905_ctx *ctx,
+                              const char *dst_ip,
+                              uint16_t dst_port) {
+    if (!ctx) return -1;
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_TOPOLOGY_QUERY);
+    i1905_builder_put_mac(&b, I1905_TLV_AL_MAC, ctx->al_mac);
+    return i1905_builder_send(&b, ctx, dst_ip, dst_port);
+}
+
+int i1905_send_topology_response(struct i1905_ctx *ctx,
+                                 const char *dst_ip,
+                                 uint16_t dst_port,
+                                 const uint8_t iface_mac[6]) {
+    if (!ctx || !iface_mac) return -1;
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_TOPOLOGY_RESPONSE);
+    builder_put_device_info(&b, ctx->al_mac, iface_mac);
+    return i1905_builder_send(&b, ctx, dst_ip, dst_port);
+}
+
+int i1905_send_topology_notification(struct i1905_ctx *ctx,
+                                     const char *dst_ip,
+                                     uint16_t dst_port,
+                                     const uint8_t iface_mac[6]) {
+    if (!ctx || !iface_mac) return -1;
+    struct i1905_addr dst;
+    if (resolve_dst(ctx, dst_ip, dst_port, &dst) < 0) return -1;
+    return send_periodic(ctx, &dst, I1905_MSG_TOPOLOGY_NOTIFICATION, iface_mac);
+}
+
+int i1905_send_ap_autoconfig_search(struct i1905_ctx *ctx,
+                                    const char *dst_ip,
+                                    uint16_t dst_port,
+                                    const uint8_t radio_id[6]) {
+    if (!ctx || !radio_id) return -1;
+    static const uint8_t placeholder[] = {0x10, 0x47, 0x00, 0x06, '1', '9', '0', '5', 'W', 'S'};
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_AP_AUTOCONFIG_SEARCH);
+    i1905_builder_set_relay(&b, true);
+    i1905_builder_put_mac(&b, I1905_TLV_MAC_ADDR, radio_id);
+    i1905_builder_put_tlv(&b, I1905_TLV_WSC, placeholder, sizeof(placeholder));
+    return i1905_builder_send(&b, ctx, dst_ip, dst_port);
+}
+
+int i1905_send_ap_autoconfig_response(struct i1905_ctx *ctx,
+                                      const char *dst_ip,
+                                      uint16_t dst_port,
+                                      const uint8_t radio_id[6]) {
+    if (!ctx || !radio_id) return -1;
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_AP_AUTOCONFIG_RESPONSE);
+    i1905_builder_put_mac(&b, I1905_TLV_MAC_ADDR, radio_id);
+    return i1905_builder_send(&b, ctx, dst_ip, dst_port);
+}
+
+int i1905_send_ap_autoconfig_wsc(struct i1905_ctx *ctx,
+                                 const char *dst_ip,
+                                 uint16_t dst_port,
+                                 const uint8_t *wsc, size_t wsc_len) {
+    if (!ctx || !wsc || wsc_len > UINT16_MAX) return -1;
+    struct i1905_builder b;
+    i1905_builder_begin(&b, ctx, I1905_MSG_AP_AUTOCONFIG_WSC);
+    i1905_builder_put_tlv(&b, I1905_TLV_WSC, wsc, (uint16_t)wsc_len);
+    return i1905_builder_send(&b, ctx, dst_ip, dst_port);
+}
+
+#ifdef I1905_STANDALONE_TEST
+int main(void) {
+    srand((unsigned)time(NULL));
+    struct i1905_ctx *ctx;
+    if (i1905_init(&ctx, I1905_ROLE_CONTROLLER, 19050, NULL, NULL, NULL) < 0) {
+        fprintf(stderr, "init failed\n");
+        return 1;
+    }
+    uint8_t mac[6] = {0xde, 0xad, 0xbe, 0xef, 0x00, 0x01};
+    i1905_send_topology_discovery(ctx, "127.0.0.1", 19050, mac);
+    i1905_close(ctx);
+    return 0;
+}
+#endif
+
+
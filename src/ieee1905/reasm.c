@@ -0,0 +1,243 @@
+// SPDX-License-Identifier: MIT
+//
+// CMDU fragment reassembly with a fixed memory budget. The budget is carved
+// into frame-sized chunks up front; each buffered fragment holds one chunk
+// and each partial message one entry. Entries are found through a chained
+// hash on (source MAC, message id) and kept on an age list, so lookup,
+// insert, timeout and eviction are all O(1) per fragment.
+
+#include "i1905_priv.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#define REASM_CHUNK     I1905_MAX_FRAME_SIZE
+#define REASM_NONE      (-1)
+
+struct reasm_entry {
+    uint8_t  src[6];
+    uint16_t mid;
+    uint16_t message_type;
+    uint8_t  nfrags;        // 0 until the last fragment arrived
+    bool     relay;
+    uint64_t have;          // bit per received fragment id
+    uint64_t deadline_ms;
+    size_t   total;
+    int16_t  chunk[I1905_MAX_FRAGMENTS];
+    uint16_t len[I1905_MAX_FRAGMENTS];
+    int hnext;              // hash chain / free list
+    int prev, next;         // age list, oldest first
+};
+
+struct i1905_reasm {
+    uint32_t timeout_ms;
+    struct i1905_stats *stats;
+
+    struct reasm_entry *entries;
+    unsigned n_entries;
+    int free_entry;
+    int oldest, newest;
+
+    int *bucket;
+    unsigned bucket_mask;
+
+    uint8_t (*chunks)[REASM_CHUNK];
+    int16_t *chunk_next;
+    int free_chunk;
+
+    uint8_t out[I1905_MAX_MSG_SIZE]; // last completed message
+};
+
+static unsigned reasm_hash(const struct i1905_reasm *r, const uint8_t src[6], uint16_t mid) {
+    uint32_t h = 2166136261u;
+    for (int i = 0; i < 6; i++) h = (h ^ src[i]) * 16777619u;
+    h = (h ^ (mid & 0xFF)) * 16777619u;
+    h = (h ^ (mid >> 8)) * 16777619u;
+    return h & r->bucket_mask;
+}
+
+struct i1905_reasm *i1905_reasm_new(size_t budget, uint32_t timeout_ms,
+                                    struct i1905_stats *stats) {
+    unsigned n = (unsigned)(budget / REASM_CHUNK);
+    if (n < 2) n = 2;
+    if (n > INT16_MAX) n = INT16_MAX;
+    unsigned buckets = 1;
+    while (buckets < n * 2) buckets <<= 1;
+
+    struct i1905_reasm *r = calloc(1, sizeof(*r));
+    if (!r) return NULL;
+    r->entries = calloc(n, sizeof(*r->entries));
+    r->bucket = malloc(buckets * sizeof(*r->bucket));
+    r->chunks = malloc((size_t)n * REASM_CHUNK);
+    r->chunk_next = malloc(n * sizeof(*r->chunk_next));
+    if (!r->entries || !r->bucket || !r->chunks || !r->chunk_next) {
+        i1905_reasm_free(r);
+        return NULL;
+    }
+    r->timeout_ms = timeout_ms;
+    r->stats = stats;
+    r->n_entries = n;
+    r->bucket_mask = buckets - 1;
+    for (unsigned i = 0; i < buckets; i++) r->bucket[i] = REASM_NONE;
+    for (unsigned i = 0; i < n; i++) {
+        r->entries[i].hnext = (i + 1 < n) ? (int)i + 1 : REASM_NONE;
+        r->chunk_next[i] = (i + 1 < n) ? (int16_t)(i + 1) : REASM_NONE;
+    }
+    r->free_entry = 0;
+    r->free_chunk = 0;
+    r->oldest = r->newest = REASM_NONE;
+    return r;
+}
+
+void i1905_reasm_free(struct i1905_reasm *r) {
+    if (!r) return;
+    free(r->entries);
+    free(r->bucket);
+    free(r->chunks);
+    free(r->chunk_next);
+    free(r);
+}
+
+static void age_unlink(struct i1905_reasm *r, int idx) {
+    struct reasm_entry *e = &r->entries[idx];
+    if (e->prev != REASM_NONE) r->entries[e->prev].next = e->next;
+    else r->oldest = e->next;
+    if (e->next != REASM_NONE) r->entries[e->next].prev = e->prev;
+    else r->newest = e->prev;
+}
+
+static void entry_release(struct i1905_reasm *r, int idx) {
+    struct reasm_entry *e = &r->entries[idx];
+    for (unsigned i = 0; i < I1905_MAX_FRAGMENTS; i++) {
+        if (!(e->have & (1ULL << i))) continue;
+        r->chunk_next[e->chunk[i]] = (int16_t)r->free_chunk;
+        r->free_chunk = e->chunk[i];
+    }
+    // hash chains are short, unlink by walking the bucket
+    int *pp = &r->bucket[reasm_hash(r, e->src, e->mid)];
+    while (*pp != idx) pp = &r->entries[*pp].hnext;
+    *pp = e->hnext;
+    age_unlink(r, idx);
+    e->hnext = r->free_entry;
+    r->free_entry = idx;
+}
+
+void i1905_reasm_expire(struct i1905_reasm *r, uint64_t now_ms) {
+    // entries are aged in arrival order, so expired ones sit at the head
+    while (r->oldest != REASM_NONE && r->entries[r->oldest].deadline_ms <= now_ms) {
+        entry_release(r, r->oldest);
+        I1905_STAT_INC(r->stats->reasm_timeouts);
+    }
+}
+
+uint64_t i1905_reasm_next_deadline(const struct i1905_reasm *r) {
+    return r->oldest != REASM_NONE ? r->entries[r->oldest].deadline_ms : 0;
+}
+
+static bool evict_oldest(struct i1905_reasm *r, int keep) {
+    int victim = r->oldest;
+    if (victim == keep) victim = r->entries[victim].next;
+    if (victim == REASM_NONE) return false;
+    entry_release(r, victim);
+    I1905_STAT_INC(r->stats->reasm_evictions);
+    return true;
+}
+
+static int entry_get(struct i1905_reasm *r, const uint8_t src[6], uint16_t mid,
+                     uint16_t type, uint64_t now_ms) {
+    unsigned h = reasm_hash(r, src, mid);
+    for (int i = r->bucket[h]; i != REASM_NONE; i = r->entries[i].hnext) {
+        struct reasm_entry *e = &r->entries[i];
+        if (e->mid == mid && memcmp(e->src, src, 6) == 0) return i;
+    }
+    if (r->free_entry == REASM_NONE && !evict_oldest(r, REASM_NONE)) return REASM_NONE;
+    int idx = r->free_entry;
+    struct reasm_entry *e = &r->entries[idx];
+    r->free_entry = e->hnext;
+    memcpy(e->src, src, 6);
+    e->mid = mid;
+    e->message_type = type;
+    e->relay = false;
+    e->nfrags = 0;
+    e->have = 0;
+    e->total = 0;
+    e->deadline_ms = now_ms + r->timeout_ms;
+    e->hnext = r->bucket[h];
+    r->bucket[h] = idx;
+    e->prev = r->newest;
+    e->next = REASM_NONE;
+    if (r->newest != REASM_NONE) r->entries[r->newest].next = idx;
+    else r->oldest = idx;
+    r->newest = idx;
+    return idx;
+}
+
+int i1905_reasm_input(struct i1905_reasm *r, const uint8_t src[6],
+                      const struct i1905_cmdu_view *frag, uint64_t now_ms,
+                      struct i1905_cmdu_view *out) {
+    i1905_reasm_expire(r, now_ms);
+    if (frag->fragment_id >= I1905_MAX_FRAGMENTS || frag->tlv_len > REASM_CHUNK) {
+        I1905_STAT_INC(r->stats->reasm_drops);
+        return -1;
+    }
+    int idx = entry_get(r, src, frag->message_id, frag->message_type, now_ms);
+    if (idx == REASM_NONE) {
+        I1905_STAT_INC(r->stats->reasm_drops);
+        return -1;
+    }
+    struct reasm_entry *e = &r->entries[idx];
+    uint64_t bit = 1ULL << frag->fragment_id;
+    if ((e->have & bit) || e->message_type != frag->message_type) {
+        I1905_STAT_INC(r->stats->reasm_drops); // duplicate or conflicting fragment
+        return -1;
+    }
+    while (r->free_chunk == REASM_NONE) {
+        if (!evict_oldest(r, idx)) {
+            entry_release(r, idx);
+            I1905_STAT_INC(r->stats->reasm_drops);
+            return -1;
+        }
+    }
+    int c = r->free_chunk;
+    r->free_chunk = r->chunk_next[c];
+    memcpy(r->chunks[c], frag->tlv_data, frag->tlv_len);
+    e->chunk[frag->fragment_id] = (int16_t)c;
+    e->len[frag->fragment_id] = (uint16_t)frag->tlv_len;
+    e->have |= bit;
+    e->total += frag->tlv_len;
+    e->relay |= frag->relay;
+    if (frag->last_fragment) e->nfrags = frag->fragment_id + 1;
+
+    if (!e->nfrags) return 0;
+    uint64_t full = (e->nfrags == 64) ? ~0ULL : ((1ULL << e->nfrags) - 1);
+    if ((e->have & full) != full) return 0;
+    if ((e->have & ~full) || CMDU_HDR_LEN + e->total + 3 > sizeof(r->out)) {
+        entry_release(r, idx); // fragments past the last one, or too large
+        I1905_STAT_INC(r->stats->reasm_drops);
+        return -1;
+    }
+
+    // rebuild one unfragmented CMDU and validate it like any received frame
+    uint8_t *p = r->out;
+    *p++ = 0x00;
+    *p++ = (e->message_type >> 8) & 0xFF;
+    *p++ = e->message_type & 0xFF;
+    *p++ = (e->mid >> 8) & 0xFF;
+    *p++ = e->mid & 0xFF;
+    *p++ = 0;
+    *p++ = 0x80 | (e->relay ? 0x40 : 0x00);
+    for (unsigned i = 0; i < e->nfrags; i++) {
+        memcpy(p, r->chunks[e->chunk[i]], e->len[i]);
+        p += e->len[i];
+    }
+    *p++ = I1905_TLV_END_OF_MESSAGE;
+    *p++ = 0x00;
+    *p++ = 0x00;
+    entry_release(r, idx);
+    if (i1905_cmdu_view_parse(out, r->out, (size_t)(p - r->out)) < 0) {
+        I1905_STAT_INC(r->stats->reasm_drops);
+        return -1;
+    }
+    I1905_STAT_INC(r->stats->reasm_complete);
+    return 1;
+}
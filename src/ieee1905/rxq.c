@@ -0,0 +1,223 @@
+// SPDX-License-Identifier: MIT
+//
+// Threaded receive. Each worker owns one transport shard (the kernel picks
+// the shard by source MAC), drains it in batches, parses the frames and
+// copies the valid ones into a bounded MPSC queue. The queue is the
+// Vyukov array design: a producer claims a cell by advancing the shared
+// enqueue position with compare-and-swap and publishes it by storing the
+// cell's sequence number; the single consumer reads cells strictly in
+// position order. A worker's frames therefore leave the queue in the order
+// it received them, which together with the sharding keeps every source in
+// order. An eventfd, kicked once per worker batch, wakes the consumer.
+// A worker that finds the queue full waits for space instead of dropping,
+// so bursts back up into the socket buffer or packet ring and the kernel's
+// own drop accounting applies.
+
+#define _GNU_SOURCE // pthread, eventfd
+#include "i1905_priv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <pthread.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define RXQ_WAIT_MS 1           // re-check interval while the queue is full
+
+struct rxq_cell {
+    uint64_t seq;               // == pos + 1: filled, == pos: free for lap pos
+    struct i1905_frame f;
+    struct i1905_cmdu_view view;
+    uint8_t data[I1905_MAX_FRAME_SIZE];
+};
+
+struct rx_worker {
+    struct i1905_rxq *q;
+    struct i1905_transport tp;
+    pthread_t thread;
+    bool running;
+    struct i1905_frame *frames;
+    struct i1905_cmdu_view *views;
+    bool *valid;
+};
+
+struct i1905_rxq {
+    // producers hammer enq_pos; keep it off the consumer's line
+    _Alignas(64) uint64_t enq_pos;
+    _Alignas(64) uint64_t deq_pos;
+    struct rxq_cell *cells;
+    uint64_t mask;
+    int efd;                    // consumer wakeup
+    int stop_fd;                // readable once the workers must exit
+    struct i1905_stats *stats;
+    unsigned n_workers;
+    struct rx_worker workers[I1905_MAX_RX_THREADS];
+};
+
+static void kick(int fd) {
+    uint64_t one = 1;
+    ssize_t rv = write(fd, &one, sizeof(one)); // fails only when the count is saturated
+    (void)rv;
+}
+
+// Copy one parsed frame into the queue; false when it is full.
+static bool rxq_push(struct i1905_rxq *q, const struct i1905_frame *f,
+                     const struct i1905_cmdu_view *view) {
+    uint64_t pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+    struct rxq_cell *c;
+    for (;;) {
+        c = &q->cells[pos & q->mask];
+        uint64_t seq = __atomic_load_n(&c->seq, __ATOMIC_ACQUIRE);
+        if (seq == pos) {
+            if (__atomic_compare_exchange_n(&q->enq_pos, &pos, pos + 1, true,
+                                            __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+                break;
+            }
+        } else if (seq < pos) {
+            return false;       // consumer still holds the previous lap
+        } else {
+            pos = __atomic_load_n(&q->enq_pos, __ATOMIC_RELAXED);
+        }
+    }
+    memcpy(c->data, f->data, f->len);
+    c->f = *f;
+    c->f.data = c->data;
+    c->view = *view;
+    c->view.tlv_data = c->data + (view->tlv_data - f->data);
+    __atomic_store_n(&c->seq, pos + 1, __ATOMIC_RELEASE);
+    return true;
+}
+
+// false: the context is closing
+static bool rxq_push_wait(struct i1905_rxq *q, const struct i1905_frame *f,
+                          const struct i1905_cmdu_view *view) {
+    if (rxq_push(q, f, view)) return true;
+    I1905_STAT_INC(q->stats->rx_queue_waits);
+    struct pollfd stop = { .fd = q->stop_fd, .events = POLLIN };
+    do {
+        kick(q->efd);
+        if (poll(&stop, 1, RXQ_WAIT_MS) > 0) return false;
+    } while (!rxq_push(q, f, view));
+    return true;
+}
+
+static void *worker_main(void *arg) {
+    struct rx_worker *w = arg;
+    struct i1905_rxq *q = w->q;
+    struct pollfd pfd[2] = {
+        { .fd = w->tp.ops->get_fd(&w->tp), .events = POLLIN },
+        { .fd = q->stop_fd, .events = POLLIN },
+    };
+    for (;;) {
+        if (poll(pfd, 2, -1) < 0 && errno != EINTR) break;
+        if (pfd[1].revents) break;
+        bool queued = false;
+        int n;
+        while ((n = w->tp.ops->rx_batch(&w->tp, w->frames, w->tp.rx_batch)) > 0) {
+            i1905_parse_batch(q->stats, w->frames, w->views, w->valid, (unsigned)n);
+            for (int i = 0; i < n; i++) {
+                if (!w->valid[i]) continue;
+                if (w->frames[i].len > sizeof(q->cells[0].data)) {
+                    I1905_STAT_INC(q->stats->rx_drops[I1905_DROP_OVERSIZE]);
+                    continue;
+                }
+                if (!rxq_push_wait(q, &w->frames[i], &w->views[i])) return NULL;
+                queued = true;
+            }
+        }
+        if (queued) kick(q->efd);
+    }
+    return NULL;
+}
+
+static void worker_free(struct rx_worker *w) {
+    if (w->tp.priv) w->tp.ops->close(&w->tp);
+    free(w->frames);
+    free(w->views);
+    free(w->valid);
+}
+
+struct i1905_rxq *i1905_rxq_start(const struct i1905_transport *proto, const char *ifname,
+                                  uint16_t port, unsigned slots, struct i1905_stats *stats) {
+    uint64_t n = 1;
+    while (n < slots) n <<= 1;
+    size_t size = (sizeof(struct i1905_rxq) + 63) & ~(size_t)63;
+    struct i1905_rxq *q = aligned_alloc(64, size);
+    if (!q) return NULL;
+    memset(q, 0, size);
+    q->efd = q->stop_fd = -1;
+    q->stats = stats;
+    q->mask = n - 1;
+    q->cells = malloc(n * sizeof(*q->cells));
+    q->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    q->stop_fd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (!q->cells || q->efd < 0 || q->stop_fd < 0) goto fail;
+    for (uint64_t i = 0; i < n; i++) q->cells[i].seq = i;
+
+    for (unsigned i = 0; i < proto->n_shards; i++) {
+        struct rx_worker *w = &q->workers[i];
+        w->q = q;
+        w->tp = *proto;
+        w->tp.priv = NULL;
+        w->tp.shard = (int)i;
+        w->frames = calloc(proto->rx_batch, sizeof(*w->frames));
+        w->views = calloc(proto->rx_batch, sizeof(*w->views));
+        w->valid = calloc(proto->rx_batch, sizeof(*w->valid));
+        q->n_workers++;
+        if (!w->frames || !w->views || !w->valid ||
+            w->tp.ops->open(&w->tp, ifname, port) < 0) {
+            goto fail;
+        }
+    }
+    for (unsigned i = 0; i < q->n_workers; i++) {
+        struct rx_worker *w = &q->workers[i];
+        int err = pthread_create(&w->thread, NULL, worker_main, w);
+        if (err) {
+            fprintf(stderr, "rx thread %u: %s\n", i, strerror(err));
+            goto fail;
+        }
+        w->running = true;
+    }
+    return q;
+
+fail:
+    i1905_rxq_stop(q);
+    return NULL;
+}
+
+void i1905_rxq_stop(struct i1905_rxq *q) {
+    if (!q) return;
+    if (q->stop_fd >= 0) kick(q->stop_fd);
+    for (unsigned i = 0; i < q->n_workers; i++) {
+        if (q->workers[i].running) pthread_join(q->workers[i].thread, NULL);
+        worker_free(&q->workers[i]);
+    }
+    if (q->efd >= 0) close(q->efd);
+    if (q->stop_fd >= 0) close(q->stop_fd);
+    free(q->cells);
+    free(q);
+}
+
+int i1905_rxq_fd(const struct i1905_rxq *q) {
+    return q->efd;
+}
+
+unsigned i1905_rxq_drain(struct i1905_rxq *q, unsigned budget, i1905_rxq_fn fn, void *user) {
+    uint64_t v;
+    ssize_t rv = read(q->efd, &v, sizeof(v));
+    (void)rv;
+    unsigned n = 0;
+    for (; n < budget; n++) {
+        struct rxq_cell *c = &q->cells[q->deq_pos & q->mask];
+        if (__atomic_load_n(&c->seq, __ATOMIC_ACQUIRE) != q->deq_pos + 1) break;
+        fn(user, &c->f, &c->view);
+        __atomic_store_n(&c->seq, q->deq_pos + q->mask + 1, __ATOMIC_RELEASE);
+        q->deq_pos++;
+    }
+    // out of budget: stay readable so the event loop comes back
+    if (n == budget) kick(q->efd);
+    return n;
+}
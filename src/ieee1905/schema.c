@@ -0,0 +1,342 @@
+// SPDX-License-Identifier: MIT
+//
+// TLV codecs and message validation generated from ieee1905_schema.def.
+// Every TLV gets a length check, a decoder and a writer expanded from its
+// field list; records (list entries) are fixed size, so a list is checked
+// with one multiplication. Validation looks each TLV up in a table indexed
+// by type and folds what it saw into a bitmask that is compared with the
+// message's required and allowed sets at the end.
+
+#include "i1905_priv.h"
+
+#include <string.h>
+
+struct rd {
+    const uint8_t *p;
+    size_t left;
+};
+
+static int rd_skip(struct rd *r, size_t n) {
+    if (r->left < n) return -1;
+    r->p += n;
+    r->left -= n;
+    return 0;
+}
+
+static int rd_mac(struct rd *r, uint8_t out[6]) {
+    if (r->left < 6) return -1;
+    memcpy(out, r->p, 6);
+    return rd_skip(r, 6);
+}
+
+static int rd_u8(struct rd *r, uint8_t *out) {
+    if (r->left < 1) return -1;
+    *out = r->p[0];
+    return rd_skip(r, 1);
+}
+
+static int rd_u16(struct rd *r, uint16_t *out) {
+    if (r->left < 2) return -1;
+    *out = (uint16_t)((r->p[0] << 8) | r->p[1]);
+    return rd_skip(r, 2);
+}
+
+// Entries of a list, NULL with n == 0
+static void *list_alloc(struct i1905_arena *a, size_t n, size_t size, int *err) {
+    if (!n) return NULL;
+    void *p = i1905_arena_alloc(a, n * size);
+    if (!p) *err = -1;
+    return p;
+}
+
+// Record sizes, REC_SIZE_<name>
+#define I1905_F_MAC(f)   + 6
+#define I1905_F_U8(f)    + 1
+#define I1905_F_U16(f)   + 2
+#define I1905_REC(name, fields) REC_SIZE_##name = 0 fields,
+enum {
+#include "ieee1905_schema.def"
+};
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+
+// Bit of each TLV in the validation masks, TLV_IDX_<name>
+#define I1905_TLV(ID, name, type, fields) TLV_IDX_##name,
+enum {
+#include "ieee1905_schema.def"
+    TLV_IDX_COUNT
+};
+_Static_assert(TLV_IDX_COUNT <= 64, "validation masks hold 64 TLVs");
+
+// Record decode and write
+#define I1905_F_MAC(f)   if (rd_mac(r, o->f) < 0) return -1;
+#define I1905_F_U8(f)    if (rd_u8(r, &o->f) < 0) return -1;
+#define I1905_F_U16(f)   if (rd_u16(r, &o->f) < 0) return -1;
+#define I1905_REC(name, fields)                                                 \
+    static int rec_##name##_decode(struct rd *r, struct i1905_##name *o) {      \
+        fields                                                                  \
+        return 0;                                                               \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+
+#define I1905_F_MAC(f)   memcpy(p, o->f, 6); p += 6;
+#define I1905_F_U8(f)    *p++ = o->f;
+#define I1905_F_U16(f)   *p++ = (uint8_t)(o->f >> 8); *p++ = (uint8_t)o->f;
+#define I1905_REC(name, fields)                                                 \
+    static uint8_t *rec_##name##_write(uint8_t *p, const struct i1905_##name *o) { \
+        fields                                                                  \
+        return p;                                                               \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+
+// TLV length check: walks the fields without storing anything
+#define I1905_F_MAC(f)   if (rd_skip(r, 6) < 0) return -1;
+#define I1905_F_U8(f)    if (rd_skip(r, 1) < 0) return -1;
+#define I1905_F_U16(f)   if (rd_skip(r, 2) < 0) return -1;
+#define I1905_F_BYTES(f) r->left = 0;
+#define I1905_F_LIST8(f, rec)                                                   \
+    { uint8_t n_;                                                               \
+      if (rd_u8(r, &n_) < 0 || rd_skip(r, (size_t)n_ * REC_SIZE_##rec) < 0) return -1; }
+#define I1905_F_LIST(f, rec)                                                    \
+    if (r->left % REC_SIZE_##rec) return -1;                                    \
+    r->left = 0;
+#define I1905_TLV(ID, name, type, fields)                                       \
+    static int tlv_##name##_check(struct rd *r) {                               \
+        fields                                                                  \
+        return 0;                                                               \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST8
+#undef I1905_F_LIST
+
+// TLV decode
+#define I1905_F_MAC(f)   if (rd_mac(r, o->f) < 0) return -1;
+#define I1905_F_U8(f)    if (rd_u8(r, &o->f) < 0) return -1;
+#define I1905_F_U16(f)   if (rd_u16(r, &o->f) < 0) return -1;
+#define I1905_F_BYTES(f)                                                        \
+    o->f = r->p;                                                                \
+    o->f##_len = (uint16_t)r->left;                                             \
+    r->left = 0;
+#define I1905_F_LIST_BODY(f, rec, n)                                            \
+    { int err_ = 0;                                                             \
+      o->f = list_alloc(arena, n, sizeof(*o->f), &err_);                        \
+      if (err_) return -1;                                                      \
+      o->f##_count = n;                                                         \
+      for (size_t i_ = 0; i_ < o->f##_count; i_++) {                            \
+          if (rec_##rec##_decode(r, &o->f[i_]) < 0) return -1;                  \
+      } }
+#define I1905_F_LIST8(f, rec)                                                   \
+    { uint8_t n_;                                                               \
+      if (rd_u8(r, &n_) < 0 || r->left < (size_t)n_ * REC_SIZE_##rec) return -1; \
+      I1905_F_LIST_BODY(f, rec, n_) }
+#define I1905_F_LIST(f, rec)                                                    \
+    if (r->left % REC_SIZE_##rec) return -1;                                    \
+    I1905_F_LIST_BODY(f, rec, r->left / REC_SIZE_##rec)
+#define I1905_TLV(ID, name, type, fields)                                       \
+    int i1905_tlv_##name##_decode(struct i1905_tlv_##name *out,                 \
+                                  const struct i1905_tlv_view *tlv,             \
+                                  struct i1905_arena *arena) {                  \
+        if (!out || !tlv) return -1;                                            \
+        struct rd rd = { tlv->value, tlv->len };                                \
+        struct rd *r = &rd;                                                     \
+        struct i1905_tlv_##name *o = out;                                       \
+        (void)arena;                                                            \
+        memset(o, 0, sizeof(*o));                                               \
+        fields                                                                  \
+        return 0;                                                               \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST_BODY
+#undef I1905_F_LIST8
+#undef I1905_F_LIST
+
+// Encoded value length, -1 when it does not fit a TLV
+#define I1905_F_MAC(f)   n += 6;
+#define I1905_F_U8(f)    n += 1;
+#define I1905_F_U16(f)   n += 2;
+#define I1905_F_BYTES(f)                                                        \
+    if (o->f##_len && !o->f) return -1;                                         \
+    n += o->f##_len;
+#define I1905_F_LIST8(f, rec)                                                   \
+    if (o->f##_count > UINT8_MAX || (o->f##_count && !o->f)) return -1;         \
+    n += 1 + o->f##_count * REC_SIZE_##rec;
+#define I1905_F_LIST(f, rec)                                                    \
+    if (o->f##_count > UINT16_MAX || (o->f##_count && !o->f)) return -1;       \
+    n += o->f##_count * REC_SIZE_##rec;
+#define I1905_TLV(ID, name, type, fields)                                       \
+    static int tlv_##name##_size(const struct i1905_tlv_##name *o) {            \
+        size_t n = 0;                                                           \
+        (void)o;                                                                \
+        fields                                                                  \
+        return n <= UINT16_MAX ? (int)n : -1;                                   \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST8
+#undef I1905_F_LIST
+
+// TLV write into a value area of tlv_<name>_size() bytes, then the public
+// encode/put on top of it
+#define I1905_F_MAC(f)   memcpy(p, o->f, 6); p += 6;
+#define I1905_F_U8(f)    *p++ = o->f;
+#define I1905_F_U16(f)   *p++ = (uint8_t)(o->f >> 8); *p++ = (uint8_t)o->f;
+#define I1905_F_BYTES(f)                                                        \
+    if (o->f##_len) memcpy(p, o->f, o->f##_len);                                \
+    p += o->f##_len;
+#define I1905_F_LIST8(f, rec)                                                   \
+    *p++ = (uint8_t)o->f##_count;                                               \
+    for (size_t i_ = 0; i_ < o->f##_count; i_++) p = rec_##rec##_write(p, &o->f[i_]);
+#define I1905_F_LIST(f, rec)                                                    \
+    for (size_t i_ = 0; i_ < o->f##_count; i_++) p = rec_##rec##_write(p, &o->f[i_]);
+#define I1905_TLV(ID, name, type, fields)                                       \
+    static void tlv_##name##_write(uint8_t *p, const struct i1905_tlv_##name *o) { \
+        fields                                                                  \
+    }                                                                           \
+    int i1905_tlv_##name##_encode(struct i1905_cmdu *cmdu,                      \
+                                  const struct i1905_tlv_##name *in) {          \
+        int len = in ? tlv_##name##_size(in) : -1;                              \
+        if (len < 0) return -1;                                                 \
+        uint8_t *p = i1905_cmdu_add_tlv(cmdu, type, NULL, (uint16_t)len);       \
+        if (!p) return -1;                                                      \
+        tlv_##name##_write(p, in);                                              \
+        return 0;                                                               \
+    }                                                                           \
+    int i1905_tlv_##name##_put(struct i1905_builder *b,                         \
+                               const struct i1905_tlv_##name *in) {             \
+        int len = in ? tlv_##name##_size(in) : -1;                              \
+        if (len < 0) {                                                          \
+            if (b) b->error = true;                                             \
+            return -1;                                                          \
+        }                                                                       \
+        uint8_t *p = i1905_builder_reserve(b, type, (uint16_t)len);             \
+        if (!p) return -1;                                                      \
+        tlv_##name##_write(p, in);                                              \
+        return 0;                                                               \
+    }
+#include "ieee1905_schema.def"
+#undef I1905_F_MAC
+#undef I1905_F_U8
+#undef I1905_F_U16
+#undef I1905_F_BYTES
+#undef I1905_F_LIST8
+#undef I1905_F_LIST
+
+// Per-type lookup for validation; zeroed slots are TLVs the schema does
+// not describe
+static const struct {
+    const char *name;
+    int (*check)(struct rd *r);
+    uint64_t bit;
+} tlv_schema[256] = {
+#define I1905_TLV(ID, name, type, fields) \
+    [type] = { #name, tlv_##name##_check, UINT64_C(1) << TLV_IDX_##name },
+#include "ieee1905_schema.def"
+};
+
+#define I1905_T(name) | (UINT64_C(1) << TLV_IDX_##name)
+
+static const struct {
+    uint16_t type;
+    const char *name;
+    uint64_t required;
+    uint64_t allowed;
+} msg_schema[] = {
+#define I1905_MSG(ID, name, type, required, optional) \
+    { type, name, 0 required, 0 required optional },
+#include "ieee1905_schema.def"
+};
+
+#undef I1905_T
+
+#define N_MSG_SCHEMA (sizeof(msg_schema) / sizeof(msg_schema[0]))
+
+// Fold one TLV into the seen mask, -1 when it is malformed
+static int check_tlv(uint8_t type, const uint8_t *value, uint16_t len, uint64_t *seen) {
+    if (!tlv_schema[type].check) return 0;
+    struct rd r = { value, len };
+    if (tlv_schema[type].check(&r) < 0) return -1;
+    *seen |= tlv_schema[type].bit;
+    return 0;
+}
+
+static int check_msg(uint16_t type, uint64_t seen) {
+    for (size_t i = 0; i < N_MSG_SCHEMA; i++) {
+        if (msg_schema[i].type != type) continue;
+        if ((seen & msg_schema[i].required) != msg_schema[i].required) return -1;
+        return (seen & ~msg_schema[i].allowed) ? -1 : 0;
+    }
+    return 0;
+}
+
+int i1905_cmdu_view_validate(const struct i1905_cmdu_view *view) {
+    if (!view) return -1;
+    struct i1905_tlv_iter it;
+    struct i1905_tlv_view t;
+    uint64_t seen = 0;
+    i1905_tlv_iter_init(&it, view);
+    while (i1905_tlv_iter_next(&it, &t)) {
+        if (check_tlv(t.type, t.value, t.len, &seen) < 0) return -1;
+    }
+    return check_msg(view->message_type, seen);
+}
+
+int i1905_cmdu_validate(const struct i1905_cmdu *cmdu) {
+    if (!cmdu) return -1;
+    uint64_t seen = 0;
+    for (size_t i = 0; i < cmdu->tlv_count; i++) {
+        const struct i1905_tlv *t = &cmdu->tlvs[i];
+        if (check_tlv(t->type, t->value, t->len, &seen) < 0) return -1;
+    }
+    return check_msg(cmdu->message_type, seen);
+}
+
+const char *i1905_tlv_type_name(uint8_t type) {
+    return tlv_schema[type].name;
+}
+
+int i1905_tlv_type_from_name(const char *name, uint8_t *type) {
+    if (!name || !type) return -1;
+    for (unsigned i = 0; i < 256; i++) {
+        if (tlv_schema[i].name && strcmp(tlv_schema[i].name, name) == 0) {
+            *type = (uint8_t)i;
+            return 0;
+        }
+    }
+    return -1;
+}
+
+const char *i1905_msg_type_name(uint16_t type) {
+    for (size_t i = 0; i < N_MSG_SCHEMA; i++) {
+        if (msg_schema[i].type == type) return msg_schema[i].name;
+    }
+    return NULL;
+}
+
+int i1905_msg_type_from_name(const char *name, uint16_t *type) {
+    if (!name || !type) return -1;
+    for (size_t i = 0; i < N_MSG_SCHEMA; i++) {
+        if (strcmp(msg_schema[i].name, name) == 0) {
+            *type = msg_schema[i].type;
+            return 0;
+        }
+    }
+    return -1;
+}
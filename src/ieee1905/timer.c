@@ -0,0 +1,212 @@
+// SPDX-License-Identifier: MIT
+//
+// Hierarchical timer wheel: TIMER_LEVELS wheels of TIMER_SLOTS slots with a
+// I1905_TIMER_TICK_MS tick. Arm and cancel are O(1) list operations; timers
+// beyond level 0 are cascaded down when the lower wheel wraps. A timerfd is
+// kept programmed for the earliest tick that needs attention so the wheel
+// can be driven from select()/uloop without a periodic wakeup.
+
+#define _GNU_SOURCE
+#include "i1905_priv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/timerfd.h>
+
+#define TIMER_BITS    6
+#define TIMER_SLOTS   (1u << TIMER_BITS)
+#define TIMER_MASK    (TIMER_SLOTS - 1)
+#define TIMER_LEVELS  4
+#define TIMER_MAX_TICKS ((1ull << (TIMER_BITS * TIMER_LEVELS)) - 1)
+
+struct i1905_wheel {
+    uint64_t now;        // last processed tick
+    uint64_t armed;      // tick the timerfd is programmed for, 0: disarmed
+    unsigned pending;
+    int tfd;
+    struct i1905_timer slot[TIMER_LEVELS][TIMER_SLOTS]; // list heads
+};
+
+static uint64_t now_tick(void) {
+    return i1905_now_ms() / I1905_TIMER_TICK_MS;
+}
+
+static void list_init(struct i1905_timer *head) {
+    head->next = head->prev = head;
+}
+
+static void list_unlink(struct i1905_timer *t) {
+    t->prev->next = t->next;
+    t->next->prev = t->prev;
+    t->next = t->prev = NULL;
+}
+
+static void wheel_place(struct i1905_wheel *w, struct i1905_timer *t) {
+    uint64_t delta = t->expires > w->now ? t->expires - w->now : 1;
+    struct i1905_timer *head = NULL;
+    for (unsigned lvl = 0; lvl < TIMER_LEVELS; lvl++) {
+        if (delta < (1ull << (TIMER_BITS * (lvl + 1))) || lvl == TIMER_LEVELS - 1) {
+            head = &w->slot[lvl][(t->expires >> (TIMER_BITS * lvl)) & TIMER_MASK];
+            break;
+        }
+    }
+    t->prev = head->prev;
+    t->next = head;
+    head->prev->next = t;
+    head->prev = t;
+}
+
+// Earliest tick after w->now at which a slot fires or a cascade is due. A
+// cascade can precede a level 0 expiry, so every level is consulted.
+static uint64_t wheel_next(const struct i1905_wheel *w) {
+    uint64_t next = 0;
+    for (uint64_t i = 1; i <= TIMER_SLOTS; i++) {
+        const struct i1905_timer *head = &w->slot[0][(w->now + i) & TIMER_MASK];
+        if (head->next != head) {
+            next = w->now + i;
+            break;
+        }
+    }
+    for (unsigned lvl = 1; lvl < TIMER_LEVELS; lvl++) {
+        unsigned shift = TIMER_BITS * lvl;
+        for (uint64_t i = 1; i <= TIMER_SLOTS; i++) {
+            uint64_t at = ((w->now >> shift) + i) << shift;
+            if (next && at >= next) break;
+            const struct i1905_timer *head = &w->slot[lvl][(at >> shift) & TIMER_MASK];
+            if (head->next != head) {
+                next = at;
+                break;
+            }
+        }
+    }
+    return next;
+}
+
+static void wheel_program(struct i1905_wheel *w) {
+    uint64_t next = w->pending ? wheel_next(w) : 0;
+    if (next == w->armed) return;
+    w->armed = next;
+    struct itimerspec its;
+    memset(&its, 0, sizeof(its));
+    if (next) {
+        uint64_t ms = next * I1905_TIMER_TICK_MS;
+        its.it_value.tv_sec = (time_t)(ms / 1000);
+        its.it_value.tv_nsec = (long)(ms % 1000) * 1000000;
+    }
+    timerfd_settime(w->tfd, TFD_TIMER_ABSTIME, &its, NULL);
+}
+
+struct i1905_wheel *i1905_wheel_new(void) {
+    struct i1905_wheel *w = calloc(1, sizeof(*w));
+    if (!w) return NULL;
+    w->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC);
+    if (w->tfd < 0) {
+        perror("timerfd_create");
+        free(w);
+        return NULL;
+    }
+    for (unsigned lvl = 0; lvl < TIMER_LEVELS; lvl++) {
+        for (unsigned i = 0; i < TIMER_SLOTS; i++) list_init(&w->slot[lvl][i]);
+    }
+    w->now = now_tick();
+    return w;
+}
+
+void i1905_wheel_free(struct i1905_wheel *w) {
+    if (!w) return;
+    // detach whatever is still armed so late cancels stay harmless
+    for (unsigned lvl = 0; lvl < TIMER_LEVELS; lvl++) {
+        for (unsigned i = 0; i < TIMER_SLOTS; i++) {
+            struct i1905_timer *head = &w->slot[lvl][i];
+            while (head->next != head) {
+                struct i1905_timer *t = head->next;
+                list_unlink(t);
+                t->wheel = NULL;
+            }
+        }
+    }
+    close(w->tfd);
+    free(w);
+}
+
+int i1905_wheel_fd(const struct i1905_wheel *w) {
+    return w->tfd;
+}
+
+unsigned i1905_wheel_run(struct i1905_wheel *w) {
+    unsigned fired = 0;
+    uint64_t target = now_tick();
+    uint64_t expirations;
+    ssize_t rv = read(w->tfd, &expirations, sizeof(expirations));
+    (void)rv;
+    w->armed = 0;
+
+    while (w->now < target) {
+        if (!w->pending) {
+            w->now = target; // nothing armed, skip the idle ticks
+            break;
+        }
+        w->now++;
+        // cascade higher levels whose lower wheel just wrapped
+        for (unsigned lvl = 1; lvl < TIMER_LEVELS; lvl++) {
+            if (w->now & ((1ull << (TIMER_BITS * lvl)) - 1)) break;
+            struct i1905_timer *head =
+                &w->slot[lvl][(w->now >> (TIMER_BITS * lvl)) & TIMER_MASK];
+            while (head->next != head) {
+                struct i1905_timer *t = head->next;
+                list_unlink(t);
+                wheel_place(w, t);
+            }
+        }
+        struct i1905_timer *head = &w->slot[0][w->now & TIMER_MASK];
+        while (head->next != head) {
+            struct i1905_timer *t = head->next;
+            list_unlink(t);
+            if (t->expires > w->now) { // clamped long timer, not due yet
+                wheel_place(w, t);
+                continue;
+            }
+            t->wheel = NULL;
+            w->pending--;
+            fired++;
+            t->cb(t, t->user);
+        }
+    }
+    wheel_program(w);
+    return fired;
+}
+
+void i1905_timer_init(struct i1905_timer *t, i1905_timer_cb cb, void *user) {
+    memset(t, 0, sizeof(*t));
+    t->cb = cb;
+    t->user = user;
+}
+
+int i1905_wheel_arm(struct i1905_wheel *w, struct i1905_timer *t, uint32_t delay_ms) {
+    if (!t->cb) return -1;
+    i1905_timer_cancel(t);
+    // round up so a timer never fires before delay_ms has elapsed
+    uint64_t at = i1905_now_ms() + delay_ms;
+    uint64_t expires = (at + I1905_TIMER_TICK_MS - 1) / I1905_TIMER_TICK_MS;
+    if (expires <= w->now) expires = w->now + 1;
+    if (expires - w->now > TIMER_MAX_TICKS) expires = w->now + TIMER_MAX_TICKS;
+    t->expires = expires;
+    t->wheel = w;
+    wheel_place(w, t);
+    w->pending++;
+    if (!w->armed || t->expires < w->armed) wheel_program(w);
+    return 0;
+}
+
+void i1905_timer_cancel(struct i1905_timer *t) {
+    if (!t->wheel) return;
+    list_unlink(t);
+    t->wheel->pending--;
+    t->wheel = NULL;
+}
+
+bool i1905_timer_pending(const struct i1905_timer *t) {
+    return t->wheel != NULL;
+}
@@ -0,0 +1,181 @@
+// SPDX-License-Identifier: MIT
+//
+// In-memory loopback transport. Every context opened with it in the same
+// process joins one bus; endpoints are addressed by port and port 0 (or a
+// multicast destination MAC without port) reaches every other endpoint.
+// Readiness is signalled through an eventfd so uloop/poll loops work as with
+// sockets. An interface name, when given, is the endpoint's port instead of
+// the context's, and the port doubles as ifindex, so one context can hold
+// several endpoints. Single-threaded by design: all contexts must live on
+// one thread.
+
+#define _GNU_SOURCE
+#include "i1905_priv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/eventfd.h>
+
+#define LOOP_SLOTS 256
+
+struct loop_priv {
+    struct loop_priv *next;
+    uint16_t port;
+    int efd;
+    unsigned head;      // oldest queued frame
+    unsigned count;     // queued frames, including the ones handed out
+    unsigned handed;    // frames returned by the last rx_batch()
+    uint64_t dropped;   // queue full
+    uint16_t len[LOOP_SLOTS];
+    uint16_t src_port[LOOP_SLOTS];
+    uint8_t slot[LOOP_SLOTS][I1905_MAX_FRAME_SIZE];
+};
+
+static struct loop_priv *loop_bus;
+// Unicast lookup by port; the list above is only walked for multicast.
+// Zero-filled BSS, so only pages for ports in use are touched.
+static struct loop_priv *loop_ports[UINT16_MAX + 1];
+
+static struct loop_priv *loop_find(uint16_t port) {
+    return loop_ports[port];
+}
+
+static int loop_tp_open(struct i1905_transport *tp, const char *ifname, uint16_t port) {
+    if (tp->n_shards) {
+        fprintf(stderr, "loop transport: no threaded receive\n");
+        return -1;
+    }
+    if (ifname) {
+        char *end;
+        unsigned long v = strtoul(ifname, &end, 10);
+        if (*end || v > UINT16_MAX) {
+            fprintf(stderr, "loop transport: interface %s is not a port\n", ifname);
+            return -1;
+        }
+        port = (uint16_t)v;
+    }
+    if (port == 0 || loop_find(port)) {
+        fprintf(stderr, "loop transport: port %u unavailable\n", port);
+        return -1;
+    }
+    struct loop_priv *p = calloc(1, sizeof(*p));
+    if (!p) return -1;
+    p->efd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+    if (p->efd < 0) {
+        perror("eventfd");
+        free(p);
+        return -1;
+    }
+    p->port = port;
+    p->next = loop_bus;
+    loop_bus = p;
+    loop_ports[port] = p;
+    tp->ifindex = port;
+    tp->priv = p;
+    return 0;
+}
+
+static int loop_tp_get_fd(const struct i1905_transport *tp) {
+    const struct loop_priv *p = tp->priv;
+    return p->efd;
+}
+
+static void loop_deliver(struct loop_priv *to, const struct i1905_tx_frame *f, uint16_t from) {
+    size_t len = i1905_tx_frame_len(f);
+    if (to->count == LOOP_SLOTS || len > I1905_MAX_FRAME_SIZE) {
+        to->dropped++;
+        return;
+    }
+    unsigned idx = (to->head + to->count) % LOOP_SLOTS;
+    uint8_t *p = to->slot[idx];
+    if (f->hdr) {
+        memcpy(p, f->hdr, I1905_ETH_HDR_LEN);
+        p += I1905_ETH_HDR_LEN;
+    }
+    memcpy(p, f->data, f->len);
+    to->len[idx] = (uint16_t)len;
+    to->src_port[idx] = from;
+    to->count++;
+    uint64_t one = 1;
+    ssize_t rv = write(to->efd, &one, sizeof(one));
+    (void)rv;
+}
+
+static int loop_tp_rx_batch(struct i1905_transport *tp, struct i1905_frame *frames,
+                            unsigned max) {
+    struct loop_priv *p = tp->priv;
+    p->head = (p->head + p->handed) % LOOP_SLOTS;
+    p->count -= p->handed;
+    p->handed = 0;
+    if (p->count == 0) {
+        uint64_t v;
+        ssize_t rv = read(p->efd, &v, sizeof(v)); // re-arm readiness
+        (void)rv;
+        return 0;
+    }
+    unsigned n = p->count < max ? p->count : max;
+    for (unsigned i = 0; i < n; i++) {
+        unsigned idx = (p->head + i) % LOOP_SLOTS;
+        frames[i].data = p->slot[idx];
+        frames[i].len = p->len[idx];
+        frames[i].truncated = false;
+        memset(&frames[i].src, 0, sizeof(frames[i].src));
+        frames[i].src.port = p->src_port[idx];
+        frames[i].src.ifindex = tp->ifindex;
+    }
+    p->handed = n;
+    return (int)n;
+}
+
+static int loop_tp_tx_batch(struct i1905_transport *tp, const struct i1905_tx_frame *frames,
+                            unsigned n) {
+    struct loop_priv *self = tp->priv;
+    for (unsigned i = 0; i < n; i++) {
+        const struct i1905_tx_frame *f = &frames[i];
+        if (f->dst->port == 0) {
+            for (struct loop_priv *p = loop_bus; p; p = p->next) {
+                if (p != self) loop_deliver(p, f, self->port);
+            }
+            continue;
+        }
+        struct loop_priv *to = loop_find(f->dst->port);
+        if (to) loop_deliver(to, f, self->port);
+    }
+    return (int)n;
+}
+
+static int loop_tp_resolve(struct i1905_transport *tp, const char *dst, uint16_t port,
+                           struct i1905_addr *out) {
+    (void)tp; (void)dst;
+    memset(out, 0, sizeof(*out));
+    memcpy(out->mac, i1905_multicast_mac, 6);
+    out->port = port;
+    return 0;
+}
+
+static void loop_tp_close(struct i1905_transport *tp) {
+    struct loop_priv *p = tp->priv;
+    if (!p) return;
+    for (struct loop_priv **pp = &loop_bus; *pp; pp = &(*pp)->next) {
+        if (*pp == p) {
+            *pp = p->next;
+            break;
+        }
+    }
+    loop_ports[p->port] = NULL;
+    close(p->efd);
+    free(p);
+    tp->priv = NULL;
+}
+
+const struct i1905_transport_ops i1905_loop_transport = {
+    .name = "loop",
+    .open = loop_tp_open,
+    .get_fd = loop_tp_get_fd,
+    .rx_batch = loop_tp_rx_batch,
+    .tx_batch = loop_tp_tx_batch,
+    .resolve = loop_tp_resolve,
+    .close = loop_tp_close,
+};
@@ -0,0 +1,415 @@
+// SPDX-License-Identifier: MIT
+//
+// AF_PACKET transport for real 1905 L2 frames. RX and TX use TPACKET_V3
+// mmap rings; received frames are handed to the core as pointers into the
+// RX ring and the block is returned to the kernel on the next rx_batch().
+// A classic BPF program keeps everything but ethertype 0x893A, and the
+// frames the interface sends, out of the ring.
+//
+// Threaded receive joins the shards to a PACKET_FANOUT_CBPF group whose
+// program picks the member by source MAC; the context's own socket keeps
+// only its TX ring busy and filters every frame out.
+//
+// A socket handed over by a predecessor keeps its filter, membership and
+// rings, frames that arrived in between included; the successor maps the
+// rings again and resumes at the RX block and TX slot the predecessor
+// stopped at, which detach() packs into the handoff state.
+
+#define _GNU_SOURCE
+#include "i1905_priv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <net/if.h>
+#include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/socket.h>
+#include <linux/filter.h>
+#include <linux/if_ether.h>
+#include <linux/if_packet.h>
+
+#define PKT_BLOCK_SIZE   (1 << 16)
+#define PKT_FRAME_SIZE   2048
+#define PKT_RX_BLOCK_NR  8
+#define PKT_TX_BLOCK_NR  2
+#define PKT_RX_RETIRE_MS 10
+
+struct pkt_priv {
+    int sock;
+    uint8_t *map;
+    size_t map_len;
+
+    uint8_t *rx_ring;
+    unsigned rx_block;                  // block currently owned or polled
+    struct tpacket_block_desc *held;    // block handed to the core
+    uint8_t *next_pkt;
+    unsigned pkts_left;
+
+    uint8_t *tx_ring;                   // NULL: fall back to sendto()
+    unsigned tx_frame_nr;
+    unsigned tx_idx;
+};
+
+// A packet socket also sees every frame sent on its interface, its own
+// included. PACKET_IGNORE_OUTGOING (Linux 4.20) keeps them from reaching
+// the socket at all; the packet type test covers kernels without it.
+static int pkt_attach_filter(int sock) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_H | BPF_ABS, 12),                   // ethertype
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, I1905_ETHERTYPE, 0, 3),
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_AD_OFF + SKF_AD_PKTTYPE),
+        BPF_JUMP(BPF_JMP | BPF_JEQ | BPF_K, PACKET_OUTGOING, 1, 0),
+        BPF_STMT(BPF_RET | BPF_K, 0xFFFF),
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+#ifdef PACKET_IGNORE_OUTGOING
+    int one = 1;
+    setsockopt(sock, SOL_PACKET, PACKET_IGNORE_OUTGOING, &one, sizeof(one));
+#endif
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+static int pkt_attach_drop_all(int sock) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_RET | BPF_K, 0),
+    };
+    struct sock_fprog prog = { .len = 1, .filter = code };
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_FILTER, &prog, sizeof(prog));
+}
+
+// Fanout programs run before the MAC header is pushed back, hence SKF_LL_OFF;
+// the kernel takes the result modulo the group size.
+static int pkt_join_fanout(int sock, uint16_t group) {
+    int arg = group | (PACKET_FANOUT_CBPF << 16);
+    if (setsockopt(sock, SOL_PACKET, PACKET_FANOUT, &arg, sizeof(arg)) < 0) return -1;
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, SKF_LL_OFF + 8),  // source MAC bytes 2..5
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+    return setsockopt(sock, SOL_PACKET, PACKET_FANOUT_DATA, &prog, sizeof(prog));
+}
+
+// The length must be exactly that of the rings set up on the socket.
+static int pkt_map(struct pkt_priv *p, size_t rx_len, size_t tx_len) {
+    p->map_len = rx_len + tx_len;
+    p->map = mmap(NULL, p->map_len, PROT_READ | PROT_WRITE,
+                  MAP_SHARED | MAP_LOCKED, p->sock, 0);
+    if (p->map == MAP_FAILED) {
+        // MAP_LOCKED may exceed RLIMIT_MEMLOCK, retry unlocked
+        p->map = mmap(NULL, p->map_len, PROT_READ | PROT_WRITE, MAP_SHARED, p->sock, 0);
+    }
+    if (p->map == MAP_FAILED) {
+        p->map = NULL;
+        return -1;
+    }
+    p->rx_ring = p->map;
+    p->tx_ring = tx_len ? p->map + rx_len : NULL;
+    return 0;
+}
+
+static int pkt_setup_rings(struct pkt_priv *p) {
+    int ver = TPACKET_V3;
+    if (setsockopt(p->sock, SOL_PACKET, PACKET_VERSION, &ver, sizeof(ver)) < 0) {
+        perror("PACKET_VERSION");
+        return -1;
+    }
+    struct tpacket_req3 rx = {
+        .tp_block_size = PKT_BLOCK_SIZE,
+        .tp_block_nr = PKT_RX_BLOCK_NR,
+        .tp_frame_size = PKT_FRAME_SIZE,
+        .tp_frame_nr = (PKT_BLOCK_SIZE / PKT_FRAME_SIZE) * PKT_RX_BLOCK_NR,
+        .tp_retire_blk_tov = PKT_RX_RETIRE_MS,
+    };
+    if (setsockopt(p->sock, SOL_PACKET, PACKET_RX_RING, &rx, sizeof(rx)) < 0) {
+        perror("PACKET_RX_RING");
+        return -1;
+    }
+    size_t rx_len = (size_t)PKT_BLOCK_SIZE * PKT_RX_BLOCK_NR;
+    size_t tx_len = 0;
+    struct tpacket_req3 tx = {
+        .tp_block_size = PKT_BLOCK_SIZE,
+        .tp_block_nr = PKT_TX_BLOCK_NR,
+        .tp_frame_size = PKT_FRAME_SIZE,
+        .tp_frame_nr = (PKT_BLOCK_SIZE / PKT_FRAME_SIZE) * PKT_TX_BLOCK_NR,
+    };
+    // TX_RING with TPACKET_V3 needs a recent kernel; sendto() is the fallback
+    if (setsockopt(p->sock, SOL_PACKET, PACKET_TX_RING, &tx, sizeof(tx)) == 0) {
+        tx_len = (size_t)PKT_BLOCK_SIZE * PKT_TX_BLOCK_NR;
+        p->tx_frame_nr = tx.tp_frame_nr;
+    }
+    if (pkt_map(p, rx_len, tx_len) < 0) {
+        perror("mmap");
+        return -1;
+    }
+    return 0;
+}
+
+static int pkt_if_lookup(struct i1905_transport *tp, int sock, const char *ifname) {
+    struct ifreq ifr;
+    memset(&ifr, 0, sizeof(ifr));
+    snprintf(ifr.ifr_name, sizeof(ifr.ifr_name), "%s", ifname);
+    tp->ifindex = (int)if_nametoindex(ifname);
+    if (tp->ifindex == 0 || ioctl(sock, SIOCGIFHWADDR, &ifr) < 0) return -1;
+    memcpy(tp->if_mac, ifr.ifr_hwaddr.sa_data, 6);
+    return 0;
+}
+
+// Whether the TX ring exists shows only in the length mmap() accepts.
+static int pkt_adopt(struct i1905_transport *tp, struct pkt_priv *p) {
+    int domain = 0, ver = 0;
+    socklen_t len = sizeof(domain);
+    getsockopt(tp->adopt_fd, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+    len = sizeof(ver);
+    getsockopt(tp->adopt_fd, SOL_PACKET, PACKET_VERSION, &ver, &len);
+    struct sockaddr_ll sll;
+    len = sizeof(sll);
+    if (domain != AF_PACKET || ver != TPACKET_V3 ||
+        getsockname(tp->adopt_fd, (struct sockaddr *)&sll, &len) < 0 ||
+        sll.sll_ifindex != tp->ifindex) {
+        return -1;
+    }
+    p->sock = tp->adopt_fd;
+    size_t rx_len = (size_t)PKT_BLOCK_SIZE * PKT_RX_BLOCK_NR;
+    size_t tx_len = (size_t)PKT_BLOCK_SIZE * PKT_TX_BLOCK_NR;
+    if (pkt_map(p, rx_len, tx_len) == 0) {
+        p->tx_frame_nr = (PKT_BLOCK_SIZE / PKT_FRAME_SIZE) * PKT_TX_BLOCK_NR;
+        p->tx_idx = (tp->adopt_state >> 16) % p->tx_frame_nr;
+    } else if (pkt_map(p, rx_len, 0) < 0) {
+        return -1;
+    }
+    p->rx_block = (tp->adopt_state & 0xFFFF) % PKT_RX_BLOCK_NR;
+    tp->adopt = false;
+    return 0;
+}
+
+static int pkt_tp_open(struct i1905_transport *tp, const char *ifname, uint16_t port) {
+    (void)port;
+    if (!ifname || !*ifname) {
+        fprintf(stderr, "packet transport needs an interface name\n");
+        return -1;
+    }
+    struct pkt_priv *p = calloc(1, sizeof(*p));
+    if (!p) return -1;
+    if (tp->adopt) {
+        if (pkt_if_lookup(tp, tp->adopt_fd, ifname) == 0 && pkt_adopt(tp, p) == 0) {
+            tp->priv = p;
+            return 0;
+        }
+        fprintf(stderr, "handed-over socket for %s does not match, opening a new one\n", ifname);
+    }
+    p->sock = socket(AF_PACKET, SOCK_RAW | SOCK_NONBLOCK | SOCK_CLOEXEC,
+                     htons(I1905_ETHERTYPE));
+    if (p->sock < 0) {
+        perror("socket(AF_PACKET)");
+        free(p);
+        return -1;
+    }
+
+    if (pkt_if_lookup(tp, p->sock, ifname) < 0) {
+        fprintf(stderr, "unknown interface %s\n", ifname);
+        goto fail;
+    }
+
+    bool tx_only = tp->n_shards && tp->shard < 0;
+    if ((tx_only ? pkt_attach_drop_all(p->sock) : pkt_attach_filter(p->sock)) < 0) {
+        perror("SO_ATTACH_FILTER");
+        goto fail;
+    }
+    if (pkt_setup_rings(p) < 0) goto fail;
+
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(I1905_ETHERTYPE),
+        .sll_ifindex = tp->ifindex,
+    };
+    if (bind(p->sock, (struct sockaddr *)&sll, sizeof(sll)) < 0) {
+        perror("bind(AF_PACKET)");
+        goto fail;
+    }
+    struct packet_mreq mreq = {
+        .mr_ifindex = tp->ifindex,
+        .mr_type = PACKET_MR_MULTICAST,
+        .mr_alen = 6,
+    };
+    memcpy(mreq.mr_address, i1905_multicast_mac, 6);
+    setsockopt(p->sock, SOL_PACKET, PACKET_ADD_MEMBERSHIP, &mreq, sizeof(mreq));
+    if (tp->n_shards && tp->shard >= 0 && pkt_join_fanout(p->sock, tp->shard_group) < 0) {
+        perror("PACKET_FANOUT");
+        goto fail;
+    }
+
+    tp->priv = p;
+    return 0;
+
+fail:
+    if (p->map) munmap(p->map, p->map_len);
+    close(p->sock);
+    free(p);
+    return -1;
+}
+
+static int pkt_tp_get_fd(const struct i1905_transport *tp) {
+    const struct pkt_priv *p = tp->priv;
+    return p->sock;
+}
+
+static void pkt_release_block(struct pkt_priv *p) {
+    __atomic_store_n(&p->held->hdr.bh1.block_status, TP_STATUS_KERNEL, __ATOMIC_RELEASE);
+    p->held = NULL;
+    p->rx_block = (p->rx_block + 1) % PKT_RX_BLOCK_NR;
+}
+
+static int pkt_tp_rx_batch(struct i1905_transport *tp, struct i1905_frame *frames,
+                           unsigned max) {
+    struct pkt_priv *p = tp->priv;
+    // frames from the previous batch are no longer referenced by the core
+    if (p->held && p->pkts_left == 0) pkt_release_block(p);
+
+    while (!p->held) {
+        struct tpacket_block_desc *bd =
+            (struct tpacket_block_desc *)(p->rx_ring + (size_t)p->rx_block * PKT_BLOCK_SIZE);
+        uint32_t status = __atomic_load_n(&bd->hdr.bh1.block_status, __ATOMIC_ACQUIRE);
+        if (!(status & TP_STATUS_USER)) return 0;
+        p->held = bd;
+        p->pkts_left = bd->hdr.bh1.num_pkts;
+        p->next_pkt = (uint8_t *)bd + bd->hdr.bh1.offset_to_first_pkt;
+        if (p->pkts_left == 0) pkt_release_block(p);
+    }
+
+    unsigned n = 0;
+    while (n < max && p->pkts_left) {
+        struct tpacket3_hdr *h = (struct tpacket3_hdr *)p->next_pkt;
+        const struct sockaddr_ll *sll =
+            (const struct sockaddr_ll *)((uint8_t *)h + TPACKET_ALIGN(sizeof(*h)));
+        struct i1905_frame *f = &frames[n++];
+        f->data = (uint8_t *)h + h->tp_mac;
+        f->len = h->tp_snaplen;
+        f->truncated = h->tp_snaplen < h->tp_len;
+        memset(&f->src, 0, sizeof(f->src));
+        f->src.ifindex = sll->sll_ifindex;
+        p->next_pkt += h->tp_next_offset;
+        p->pkts_left--;
+    }
+    return (int)n;
+}
+
+static int pkt_sendto(struct pkt_priv *p, const struct i1905_tx_frame *f, int ifindex) {
+    struct sockaddr_ll sll = {
+        .sll_family = AF_PACKET,
+        .sll_protocol = htons(I1905_ETHERTYPE),
+        .sll_ifindex = f->dst->ifindex ? f->dst->ifindex : ifindex,
+        .sll_halen = 6,
+    };
+    memcpy(sll.sll_addr, f->dst->mac, 6);
+    struct iovec iov[2];
+    unsigned k = 0;
+    if (f->hdr) iov[k++] = (struct iovec){ (void *)f->hdr, I1905_ETH_HDR_LEN };
+    iov[k++] = (struct iovec){ (void *)f->data, f->len };
+    struct msghdr mh = {
+        .msg_name = &sll,
+        .msg_namelen = sizeof(sll),
+        .msg_iov = iov,
+        .msg_iovlen = k,
+    };
+    ssize_t sent = sendmsg(p->sock, &mh, 0);
+    return sent == (ssize_t)i1905_tx_frame_len(f) ? 0 : -1;
+}
+
+static int pkt_tp_tx_batch(struct i1905_transport *tp, const struct i1905_tx_frame *frames,
+                           unsigned n) {
+    struct pkt_priv *p = tp->priv;
+    unsigned done = 0;
+    if (!p->tx_ring) {
+        while (done < n && pkt_sendto(p, &frames[done], tp->ifindex) == 0) done++;
+        return done ? (int)done : -1;
+    }
+
+    const size_t data_off = TPACKET3_HDRLEN - sizeof(struct sockaddr_ll);
+    for (; done < n; done++) {
+        const struct i1905_tx_frame *f = &frames[done];
+        size_t len = i1905_tx_frame_len(f);
+        if (len > PKT_FRAME_SIZE - data_off) {
+            errno = EMSGSIZE;
+            break;
+        }
+        // frames never straddle a block: PKT_BLOCK_SIZE is a multiple of PKT_FRAME_SIZE
+        struct tpacket3_hdr *h =
+            (struct tpacket3_hdr *)(p->tx_ring + (size_t)p->tx_idx * PKT_FRAME_SIZE);
+        if (__atomic_load_n(&h->tp_status, __ATOMIC_ACQUIRE) != TP_STATUS_AVAILABLE) {
+            errno = EAGAIN;     // ring full, POLLOUT once the kernel frees a slot
+            break;
+        }
+        uint8_t *dst = (uint8_t *)h + data_off;
+        if (f->hdr) {
+            memcpy(dst, f->hdr, I1905_ETH_HDR_LEN);
+            dst += I1905_ETH_HDR_LEN;
+        }
+        memcpy(dst, f->data, f->len);
+        h->tp_len = (uint32_t)len;
+        h->tp_next_offset = 0;
+        __atomic_store_n(&h->tp_status, TP_STATUS_SEND_REQUEST, __ATOMIC_RELEASE);
+        p->tx_idx = (p->tx_idx + 1) % p->tx_frame_nr;
+    }
+    // one syscall kicks every frame queued above
+    if (done && send(p->sock, NULL, 0, MSG_DONTWAIT) < 0 &&
+        errno != EAGAIN && errno != ENOBUFS) {
+        return -1;
+    }
+    return done ? (int)done : -1;
+}
+
+static int pkt_tp_resolve(struct i1905_transport *tp, const char *dst, uint16_t port,
+                          struct i1905_addr *out) {
+    (void)port;
+    memset(out, 0, sizeof(*out));
+    out->ifindex = tp->ifindex;
+    if (!dst || !*dst) {
+        memcpy(out->mac, i1905_multicast_mac, 6);
+        return 0;
+    }
+    if (i1905_parse_mac(dst, out->mac) < 0) {
+        fprintf(stderr, "invalid dst mac %s\n", dst);
+        return -1;
+    }
+    return 0;
+}
+
+// The core drains the ring before a handoff, so the block it last held is
+// finished with and goes back to the kernel here.
+static uint32_t pkt_tp_detach(struct i1905_transport *tp) {
+    struct pkt_priv *p = tp->priv;
+    if (p->held && p->pkts_left == 0) pkt_release_block(p);
+    return (uint32_t)p->tx_idx << 16 | p->rx_block;
+}
+
+static void pkt_tp_close(struct i1905_transport *tp) {
+    struct pkt_priv *p = tp->priv;
+    if (!p) return;
+    if (p->map) munmap(p->map, p->map_len);
+    close(p->sock);
+    free(p);
+    tp->priv = NULL;
+}
+
+const struct i1905_transport_ops i1905_packet_transport = {
+    .name = "packet",
+    .open = pkt_tp_open,
+    .get_fd = pkt_tp_get_fd,
+    .rx_batch = pkt_tp_rx_batch,
+    .tx_batch = pkt_tp_tx_batch,
+    .resolve = pkt_tp_resolve,
+    .close = pkt_tp_close,
+    .detach = pkt_tp_detach,
+};
@@ -0,0 +1,286 @@
+// SPDX-License-Identifier: MIT
+//
+// UDP transport: each datagram carries a complete 1905 L2 frame (Ethernet
+// header + CMDU), so the source MAC survives the IP placeholder transport.
+//
+// Threaded receive binds one SO_REUSEPORT socket per shard after the
+// context's own socket, which attaches a classic BPF program to the group:
+// it picks shard 1 + (source MAC bytes 2..5 % shards), so the transmit
+// socket at index 0 is never chosen and each source sticks to one shard.
+//
+// With an interface name the sockets are bound to that device, so several
+// contexts' interfaces share the port and replies leave where requests
+// came in.
+//
+// A socket handed over by a predecessor is taken as it is when it is a UDP
+// socket bound to the same port and device; datagrams that queued up in
+// the meantime are simply the next ones read.
+
+#define _GNU_SOURCE // recvmmsg/sendmmsg
+#include "i1905_priv.h"
+
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <unistd.h>
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <net/if.h>
+#include <sys/socket.h>
+#include <sys/uio.h>
+#include <linux/filter.h>
+
+#define UDP_TX_CHUNK 32
+
+struct udp_priv {
+    int sock;
+    bool drained;   // last recvmmsg() came back short
+    // RX batch ring: rx_batch preallocated frame slots filled by recvmmsg()
+    uint8_t (*ring)[I1905_MAX_FRAME_SIZE];
+    struct mmsghdr *msgs;
+    struct iovec *iov;
+    struct sockaddr_in *from;
+};
+
+// Reuseport programs see the UDP payload, i.e. our Ethernet header.
+static int udp_attach_shard_filter(int sock, unsigned shards) {
+    struct sock_filter code[] = {
+        BPF_STMT(BPF_LD | BPF_W | BPF_ABS, 8),     // source MAC bytes 2..5
+        BPF_STMT(BPF_ALU | BPF_MOD | BPF_K, shards),
+        BPF_STMT(BPF_ALU | BPF_ADD | BPF_K, 1),
+        BPF_STMT(BPF_RET | BPF_A, 0),
+    };
+    struct sock_fprog prog = {
+        .len = sizeof(code) / sizeof(code[0]),
+        .filter = code,
+    };
+    return setsockopt(sock, SOL_SOCKET, SO_ATTACH_REUSEPORT_CBPF, &prog, sizeof(prog));
+}
+
+static int udp_open(const struct i1905_transport *tp, const char *ifname, uint16_t port) {
+    int sock = socket(AF_INET, SOCK_DGRAM, 0);
+    if (sock < 0) {
+        perror("socket");
+        return -1;
+    }
+    int opt = 1;
+    setsockopt(sock, SOL_SOCKET, SO_REUSEADDR, &opt, sizeof(opt));
+    if (ifname && setsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, ifname,
+                             (socklen_t)strlen(ifname) + 1) < 0) {
+        fprintf(stderr, "SO_BINDTODEVICE %s: %s\n", ifname, strerror(errno));
+        close(sock);
+        return -1;
+    }
+    if (tp->n_shards) {
+        if (setsockopt(sock, SOL_SOCKET, SO_REUSEPORT, &opt, sizeof(opt)) < 0 ||
+            (tp->shard < 0 && udp_attach_shard_filter(sock, tp->n_shards) < 0)) {
+            perror("SO_REUSEPORT");
+            close(sock);
+            return -1;
+        }
+        if (tp->shard < 0) {
+            // only frames too short for the program land here; nobody reads them
+            int small = 0;
+            setsockopt(sock, SOL_SOCKET, SO_RCVBUF, &small, sizeof(small));
+        }
+    }
+
+    struct sockaddr_in addr = {
+        .sin_family = AF_INET,
+        .sin_port = htons(port),
+        .sin_addr.s_addr = htonl(INADDR_ANY),
+    };
+    if (bind(sock, (struct sockaddr *)&addr, sizeof(addr)) < 0) {
+        perror("bind");
+        close(sock);
+        return -1;
+    }
+    // non-blocking for event-driven loops
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags != -1) {
+        fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    }
+    return sock;
+}
+
+static int udp_adopt(const struct i1905_transport *tp, const char *ifname, uint16_t port) {
+    int sock = tp->adopt_fd;
+    int domain = 0, type = 0;
+    socklen_t len = sizeof(domain);
+    getsockopt(sock, SOL_SOCKET, SO_DOMAIN, &domain, &len);
+    len = sizeof(type);
+    getsockopt(sock, SOL_SOCKET, SO_TYPE, &type, &len);
+    struct sockaddr_in addr;
+    len = sizeof(addr);
+    if (domain != AF_INET || type != SOCK_DGRAM ||
+        getsockname(sock, (struct sockaddr *)&addr, &len) < 0 || ntohs(addr.sin_port) != port) {
+        return -1;
+    }
+    char dev[IFNAMSIZ] = "";
+    len = sizeof(dev);
+    getsockopt(sock, SOL_SOCKET, SO_BINDTODEVICE, dev, &len);
+    if (strncmp(dev, ifname ? ifname : "", sizeof(dev)) != 0) return -1;
+    int flags = fcntl(sock, F_GETFL, 0);
+    if (flags != -1) fcntl(sock, F_SETFL, flags | O_NONBLOCK);
+    return sock;
+}
+
+static void udp_free(struct udp_priv *p) {
+    free(p->ring);
+    free(p->msgs);
+    free(p->iov);
+    free(p->from);
+    free(p);
+}
+
+static int udp_tp_open(struct i1905_transport *tp, const char *ifname, uint16_t port) {
+    unsigned batch = tp->rx_batch;
+    struct udp_priv *p = calloc(1, sizeof(*p));
+    if (!p) return -1;
+    p->ring = calloc(batch, sizeof(*p->ring));
+    p->msgs = calloc(batch, sizeof(*p->msgs));
+    p->iov = calloc(batch, sizeof(*p->iov));
+    p->from = calloc(batch, sizeof(*p->from));
+    if (!p->ring || !p->msgs || !p->iov || !p->from) {
+        udp_free(p);
+        return -1;
+    }
+    for (unsigned i = 0; i < batch; i++) {
+        p->iov[i].iov_base = p->ring[i];
+        p->iov[i].iov_len = I1905_MAX_FRAME_SIZE;
+        p->msgs[i].msg_hdr.msg_iov = &p->iov[i];
+        p->msgs[i].msg_hdr.msg_iovlen = 1;
+        p->msgs[i].msg_hdr.msg_name = &p->from[i];
+        p->msgs[i].msg_hdr.msg_namelen = sizeof(p->from[i]);
+    }
+    p->sock = tp->adopt ? udp_adopt(tp, ifname, port) : -1;
+    if (p->sock >= 0) {
+        tp->adopt = false;
+    } else {
+        if (tp->adopt) {
+            fprintf(stderr, "handed-over socket for %s:%u does not match, opening a new one\n",
+                    ifname ? ifname : "any", port);
+        }
+        p->sock = udp_open(tp, ifname, port);
+    }
+    if (p->sock < 0) {
+        udp_free(p);
+        return -1;
+    }
+    tp->ifindex = ifname ? (int)if_nametoindex(ifname) : 0;
+    tp->priv = p;
+    return 0;
+}
+
+static int udp_tp_get_fd(const struct i1905_transport *tp) {
+    const struct udp_priv *p = tp->priv;
+    return p->sock;
+}
+
+static int udp_tp_rx_batch(struct i1905_transport *tp, struct i1905_frame *frames,
+                           unsigned max) {
+    struct udp_priv *p = tp->priv;
+    if (p->drained) {
+        // a short batch means the socket queue was empty, skip the EAGAIN round trip
+        p->drained = false;
+        return 0;
+    }
+    if (max > tp->rx_batch) max = tp->rx_batch;
+    int n;
+    do {
+        n = recvmmsg(p->sock, p->msgs, max, MSG_DONTWAIT, NULL);
+    } while (n < 0 && errno == EINTR);
+    if (n < 0) {
+        if (errno == EAGAIN || errno == EWOULDBLOCK) return 0;
+        return -1;
+    }
+    for (int i = 0; i < n; i++) {
+        struct i1905_frame *f = &frames[i];
+        f->data = p->ring[i];
+        f->len = p->msgs[i].msg_len;
+        memset(&f->src, 0, sizeof(f->src));
+        f->src.ip = p->from[i].sin_addr.s_addr;
+        f->src.port = ntohs(p->from[i].sin_port);
+        f->src.ifindex = tp->ifindex;
+        // a datagram larger than the slot arrives cut short but looks complete
+        f->truncated = p->msgs[i].msg_hdr.msg_flags & MSG_TRUNC;
+        p->msgs[i].msg_hdr.msg_namelen = sizeof(p->from[i]);
+    }
+    p->drained = (unsigned)n < max;
+    return n;
+}
+
+static int udp_tp_tx_batch(struct i1905_transport *tp, const struct i1905_tx_frame *frames,
+                           unsigned n) {
+    struct udp_priv *p = tp->priv;
+    unsigned done = 0;
+    while (done < n) {
+        struct mmsghdr msgs[UDP_TX_CHUNK];
+        struct iovec iov[UDP_TX_CHUNK][2];
+        struct sockaddr_in dst[UDP_TX_CHUNK];
+        unsigned chunk = n - done;
+        if (chunk > UDP_TX_CHUNK) chunk = UDP_TX_CHUNK;
+        memset(msgs, 0, sizeof(msgs[0]) * chunk);
+        for (unsigned i = 0; i < chunk; i++) {
+            const struct i1905_tx_frame *f = &frames[done + i];
+            dst[i] = (struct sockaddr_in){
+                .sin_family = AF_INET,
+                .sin_port = htons(f->dst->port),
+                .sin_addr.s_addr = f->dst->ip,
+            };
+            unsigned k = 0;
+            if (f->hdr) {
+                iov[i][k].iov_base = (void *)f->hdr;
+                iov[i][k++].iov_len = I1905_ETH_HDR_LEN;
+            }
+            iov[i][k].iov_base = (void *)f->data;
+            iov[i][k++].iov_len = f->len;
+            msgs[i].msg_hdr.msg_iov = iov[i];
+            msgs[i].msg_hdr.msg_iovlen = k;
+            msgs[i].msg_hdr.msg_name = &dst[i];
+            msgs[i].msg_hdr.msg_namelen = sizeof(dst[i]);
+        }
+        int sent = sendmmsg(p->sock, msgs, chunk, 0);
+        if (sent < 0) {
+            if (errno == EINTR) continue;
+            return done ? (int)done : -1;
+        }
+        done += (unsigned)sent;
+        if ((unsigned)sent < chunk) break;
+    }
+    return (int)done;
+}
+
+static int udp_tp_resolve(struct i1905_transport *tp, const char *dst, uint16_t port,
+                          struct i1905_addr *out) {
+    (void)tp;
+    struct in_addr in;
+    if (!dst || inet_aton(dst, &in) == 0) {
+        fprintf(stderr, "invalid dst_ip %s\n", dst ? dst : "(null)");
+        return -1;
+    }
+    memset(out, 0, sizeof(*out));
+    memcpy(out->mac, i1905_multicast_mac, 6); // peer MAC is unknown over IP
+    out->ip = in.s_addr;
+    out->port = port;
+    return 0;
+}
+
+static void udp_tp_close(struct i1905_transport *tp) {
+    struct udp_priv *p = tp->priv;
+    if (!p) return;
+    close(p->sock);
+    udp_free(p);
+    tp->priv = NULL;
+}
+
+const struct i1905_transport_ops i1905_udp_transport = {
+    .name = "udp",
+    .open = udp_tp_open,
+    .get_fd = udp_tp_get_fd,
+    .rx_batch = udp_tp_rx_batch,
+    .tx_batch = udp_tp_tx_batch,
+    .resolve = udp_tp_resolve,
+    .close = udp_tp_close,
+};
@@ -0,0 +1,419 @@
+// SPDX-License-Identifier: MIT
+//
+// Transmit scheduling. A frame goes straight to the transport while nothing
+// of its priority class or above is queued ahead of it and the token
+// buckets allow; otherwise it is copied into its class FIFO. The FIFOs
+// drain strictly by class, control first, in coalesced tx_batch() calls
+// whenever a bucket refills (wheel timer) or the socket, full before,
+// becomes writable again (i1905_txq_flush()).
+//
+// Buckets count L2 bytes. Control frames are charged to them but never held
+// back, so bulk traffic pays for whatever control traffic used and cannot
+// starve it. A queued frame whose peer bucket is empty is skipped together
+// with every later frame of that peer, which keeps each peer in order while
+// other peers go ahead.
+
+#define _POSIX_C_SOURCE 200809L // clock_gettime
+#include "i1905_priv.h"
+
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+
+#define TXQ_BATCH 32            // frames per tx_batch() while draining
+#define NS_PER_S  1000000000ull
+
+struct txq_entry {
+    struct txq_entry *next;
+    struct i1905_tx_bucket *bucket;  // the peer's, NULL when it has none
+    struct i1905_addr dst;
+    size_t len;
+    uint8_t frame[];            // Ethernet header + CMDU
+};
+
+struct i1905_txq {
+    struct i1905_transport *tp;
+    struct i1905_wheel *wheel;
+    struct i1905_stats *stats;
+    struct i1905_if_stats *if_stats;
+    struct i1905_capture *capture;
+    struct i1905_timer timer;   // next bucket refill worth draining for
+    uint64_t timer_at;
+    struct i1905_tx_bucket bucket;
+    uint8_t cls[I1905_STATS_MSG_TYPES];
+    struct txq_entry *head[I1905_TX_CLASSES];
+    struct txq_entry *tail[I1905_TX_CLASSES];
+    unsigned depth;
+    unsigned limit;
+    bool want_write;            // the transport refused a frame for space
+    uint64_t gen;               // drain pass, see i1905_tx_bucket.blocked
+};
+
+static uint64_t now_ns(void) {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * NS_PER_S + (uint64_t)ts.tv_nsec;
+}
+
+void i1905_tx_bucket_set(struct i1905_tx_bucket *b, uint32_t rate, uint32_t burst) {
+    memset(b, 0, sizeof(*b));
+    if (!rate) return;
+    if (!burst) burst = rate / 10;
+    if (burst < I1905_MAX_FRAME_SIZE) burst = I1905_MAX_FRAME_SIZE;
+    b->rate = rate;
+    b->burst = burst;
+    b->tokens = burst;
+    b->last_ns = now_ns();
+}
+
+static void bucket_refill(struct i1905_tx_bucket *b, uint64_t now) {
+    if (!b->rate) return;
+    uint64_t dt = now - b->last_ns;
+    if (dt >= NS_PER_S) {
+        // idle long enough for any sane burst, and dt * rate cannot overflow below
+        b->tokens = b->burst;
+        b->last_ns = now;
+        return;
+    }
+    uint64_t add = dt * b->rate / NS_PER_S;
+    if (!add) return;           // keep the time for the next call
+    b->last_ns += add * NS_PER_S / b->rate;
+    b->tokens += (int64_t)add;
+    if (b->tokens > b->burst) b->tokens = b->burst;
+}
+
+static bool bucket_ready(const struct i1905_tx_bucket *b) {
+    return !b->rate || b->tokens > 0;
+}
+
+// the balance may go negative: a frame is admitted on any credit
+static void bucket_take(struct i1905_tx_bucket *b, size_t len) {
+    if (b && b->rate) b->tokens -= (int64_t)len;
+}
+
+static uint64_t bucket_wait_ns(const struct i1905_tx_bucket *b) {
+    return (uint64_t)(1 - b->tokens) * NS_PER_S / b->rate + 1;
+}
+
+static void wait_min(uint64_t *wait, const struct i1905_tx_bucket *b) {
+    uint64_t w = bucket_wait_ns(b);
+    if (!*wait || w < *wait) *wait = w;
+}
+
+static const uint8_t *frame_msg(const struct i1905_tx_frame *f) {
+    return f->hdr ? f->data : f->data + I1905_ETH_HDR_LEN;
+}
+
+static unsigned frame_slot(const struct i1905_tx_frame *f) {
+    const uint8_t *m = frame_msg(f);
+    return I1905_STATS_TYPE_SLOT((m[1] << 8) | m[2]);
+}
+
+static void account(struct i1905_txq *q, const struct i1905_tx_frame *f, bool ok) {
+    if (!ok) {
+        I1905_STAT_INC(q->stats->tx_errors);
+        I1905_STAT_INC(q->if_stats->tx_errors);
+        return;
+    }
+    if (q->capture) i1905_capture_frame(q->capture, I1905_CAPTURE_OUT, f->hdr, f->data, f->len);
+    unsigned slot = frame_slot(f);
+    size_t len = i1905_tx_frame_len(f);
+    I1905_STAT_INC(q->stats->tx_type_frames[slot]);
+    I1905_STAT_ADD(q->stats->tx_type_bytes[slot], len);
+    I1905_STAT_INC(q->if_stats->tx_frames);
+    I1905_STAT_ADD(q->if_stats->tx_bytes, len);
+}
+
+// The context's depth counter sums the queues of all its interfaces.
+static void set_depth(struct i1905_txq *q, unsigned depth) {
+    uint64_t delta = (uint64_t)depth - q->depth;   // wraps when shrinking
+    uint64_t total = I1905_STAT_ADD(q->stats->tx_queue_depth, delta) + delta;
+    q->depth = depth;
+    i1905_stat_max(&q->stats->tx_queue_max, total);
+}
+
+// Hand frames to the transport. Returns how many were dealt with, sent or
+// failed for good (ok[i], if given, tells which); the rest met a full
+// socket and remain the caller's, with want_write set.
+static unsigned txq_xmit(struct i1905_txq *q, const struct i1905_tx_frame *f, unsigned n,
+                         bool *ok) {
+    unsigned done = 0;
+    while (done < n) {
+        errno = 0;
+        int rv = q->tp->ops->tx_batch(q->tp, f + done, n - done);
+        if (rv > 0) {
+            for (unsigned i = done; i < done + (unsigned)rv; i++) {
+                account(q, &f[i], true);
+                if (ok) ok[i] = true;
+            }
+            done += (unsigned)rv;
+            continue;
+        }
+        if (errno == EAGAIN || errno == EWOULDBLOCK || errno == ENOBUFS) {
+            I1905_STAT_INC(q->stats->tx_write_waits);
+            q->want_write = true;
+            break;
+        }
+        account(q, &f[done], false);
+        if (ok) ok[done] = false;
+        done++;
+    }
+    return done;
+}
+
+// Make room by dropping the newest frame of the lowest class below cls.
+static bool txq_evict(struct i1905_txq *q, unsigned cls) {
+    for (unsigned c = I1905_TX_CLASSES - 1; c > cls; c--) {
+        if (!q->head[c]) continue;
+        struct txq_entry *prev = NULL, *e = q->head[c];
+        while (e->next) {
+            prev = e;
+            e = e->next;
+        }
+        if (prev) prev->next = NULL;
+        else q->head[c] = NULL;
+        q->tail[c] = prev;
+        free(e);
+        set_depth(q, q->depth - 1);
+        I1905_STAT_INC(q->stats->tx_queue_drops[c]);
+        return true;
+    }
+    return false;
+}
+
+static bool txq_push(struct i1905_txq *q, unsigned cls, const struct i1905_tx_frame *f,
+                     struct i1905_tx_bucket *bucket) {
+    if (q->depth >= q->limit && !txq_evict(q, cls)) {
+        I1905_STAT_INC(q->stats->tx_queue_drops[cls]);
+        return false;
+    }
+    size_t len = i1905_tx_frame_len(f);
+    struct txq_entry *e = malloc(sizeof(*e) + len);
+    if (!e) {
+        I1905_STAT_INC(q->stats->tx_queue_drops[cls]);
+        return false;
+    }
+    e->next = NULL;
+    e->bucket = bucket;
+    e->dst = *f->dst;
+    e->len = len;
+    uint8_t *p = e->frame;
+    if (f->hdr) {
+        memcpy(p, f->hdr, I1905_ETH_HDR_LEN);
+        p += I1905_ETH_HDR_LEN;
+    }
+    memcpy(p, f->data, f->len);
+    if (q->tail[cls]) q->tail[cls]->next = e;
+    else q->head[cls] = e;
+    q->tail[cls] = e;
+    set_depth(q, q->depth + 1);
+    I1905_STAT_INC(q->stats->tx_queued);
+    return true;
+}
+
+static void txq_timer_cb(struct i1905_timer *t, void *user) {
+    (void)t;
+    i1905_txq_flush(user);
+}
+
+struct i1905_txq *i1905_txq_new(struct i1905_transport *tp, struct i1905_wheel *wheel,
+                                unsigned limit, struct i1905_stats *stats,
+                                struct i1905_if_stats *if_stats) {
+    struct i1905_txq *q = calloc(1, sizeof(*q));
+    if (!q) return NULL;
+    q->tp = tp;
+    q->wheel = wheel;
+    q->stats = stats;
+    q->if_stats = if_stats;
+    q->limit = limit ? limit : I1905_DEFAULT_TX_QUEUE;
+    i1905_timer_init(&q->timer, txq_timer_cb, q);
+    for (unsigned i = 0; i < I1905_STATS_MSG_TYPES; i++) q->cls[i] = I1905_TX_BULK;
+    q->cls[I1905_MSG_TOPOLOGY_QUERY] = I1905_TX_CONTROL;
+    q->cls[I1905_MSG_TOPOLOGY_RESPONSE] = I1905_TX_CONTROL;
+    q->cls[I1905_MSG_AP_AUTOCONFIG_SEARCH] = I1905_TX_CONTROL;
+    q->cls[I1905_MSG_AP_AUTOCONFIG_RESPONSE] = I1905_TX_CONTROL;
+    q->cls[I1905_MSG_TOPOLOGY_DISCOVERY] = I1905_TX_TOPOLOGY;
+    q->cls[I1905_MSG_TOPOLOGY_NOTIFICATION] = I1905_TX_TOPOLOGY;
+    return q;
+}
+
+void i1905_txq_free(struct i1905_txq *q) {
+    if (!q) return;
+    i1905_timer_cancel(&q->timer);
+    for (unsigned c = 0; c < I1905_TX_CLASSES; c++) {
+        while (q->head[c]) {
+            struct txq_entry *e = q->head[c];
+            q->head[c] = e->next;
+            free(e);
+            I1905_STAT_INC(q->stats->tx_queue_drops[c]);
+        }
+    }
+    set_depth(q, 0);
+    free(q);
+}
+
+void i1905_txq_set_class(struct i1905_txq *q, uint16_t type, i1905_tx_class cls) {
+    q->cls[I1905_STATS_TYPE_SLOT(type)] = (uint8_t)cls;
+}
+
+void i1905_txq_set_rate(struct i1905_txq *q, uint32_t rate, uint32_t burst) {
+    i1905_tx_bucket_set(&q->bucket, rate, burst);
+}
+
+void i1905_txq_inherit(struct i1905_txq *q, const struct i1905_txq *from) {
+    memcpy(q->cls, from->cls, sizeof(q->cls));
+    i1905_tx_bucket_set(&q->bucket, (uint32_t)from->bucket.rate, (uint32_t)from->bucket.burst);
+    q->capture = from->capture;
+}
+
+void i1905_txq_set_capture(struct i1905_txq *q, struct i1905_capture *cap) {
+    q->capture = cap;
+}
+
+void i1905_txq_forget(struct i1905_txq *q, const struct i1905_tx_bucket *bucket) {
+    for (unsigned c = 0; c < I1905_TX_CLASSES; c++) {
+        for (struct txq_entry *e = q->head[c]; e; e = e->next) {
+            if (e->bucket == bucket) e->bucket = NULL;
+        }
+    }
+}
+
+bool i1905_txq_want_write(const struct i1905_txq *q) {
+    return q->want_write;
+}
+
+// Something of class cls or above is waiting, or the socket is full.
+static bool txq_busy(const struct i1905_txq *q, unsigned cls) {
+    if (q->want_write) return true;
+    for (unsigned c = 0; c <= cls; c++) {
+        if (q->head[c]) return true;
+    }
+    return false;
+}
+
+// Drain again once the first empty bucket has credit; only ever moves the
+// timer earlier.
+static void txq_arm(struct i1905_txq *q, uint64_t wait_ns) {
+    if (!q->depth || q->want_write || !wait_ns) return;
+    uint64_t at = now_ns() + wait_ns;
+    if (i1905_timer_pending(&q->timer) && q->timer_at <= at) return;
+    q->timer_at = at;
+    i1905_wheel_arm(q->wheel, &q->timer, (uint32_t)((wait_ns + 999999) / 1000000));
+}
+
+unsigned i1905_txq_send(struct i1905_txq *q, const struct i1905_tx_frame *frames,
+                        struct i1905_tx_bucket *const *buckets, unsigned n, bool *ok) {
+    if (!n) return 0;
+    unsigned cls = q->cls[frame_slot(&frames[0])];
+    unsigned i = 0;
+    uint64_t wait = 0;
+    if (!txq_busy(q, cls)) {
+        uint64_t now = now_ns();
+        bucket_refill(&q->bucket, now);
+        unsigned k = 0;
+        for (; k < n; k++) {
+            struct i1905_tx_bucket *b = buckets ? buckets[k] : NULL;
+            if (b) bucket_refill(b, now);
+            if (cls != I1905_TX_CONTROL) {
+                if (!bucket_ready(&q->bucket)) {
+                    wait_min(&wait, &q->bucket);
+                    break;
+                }
+                if (b && !bucket_ready(b)) {
+                    wait_min(&wait, b);
+                    break;
+                }
+            }
+            size_t len = i1905_tx_frame_len(&frames[k]);
+            bucket_take(&q->bucket, len);
+            bucket_take(b, len);
+        }
+        i = txq_xmit(q, frames, k, ok);
+    }
+    unsigned accepted = 0;
+    if (ok) {
+        for (unsigned j = 0; j < i; j++) accepted += ok[j];
+    } else {
+        accepted = i;           // without ok[] failures are only counted
+    }
+    for (; i < n; i++) {
+        bool queued = txq_push(q, cls, &frames[i], buckets ? buckets[i] : NULL);
+        if (ok) ok[i] = queued;
+        accepted += queued;
+    }
+    txq_arm(q, wait);
+    return accepted;
+}
+
+// Transmit a drained batch; what met a full socket goes back to the front.
+static void txq_flush_batch(struct i1905_txq *q, unsigned c, struct txq_entry **batch,
+                            unsigned n) {
+    struct i1905_tx_frame frames[TXQ_BATCH];
+    for (unsigned i = 0; i < n; i++) {
+        frames[i] = (struct i1905_tx_frame){
+            .data = batch[i]->frame, .len = batch[i]->len, .dst = &batch[i]->dst,
+        };
+    }
+    unsigned done = txq_xmit(q, frames, n, NULL);
+    for (unsigned i = 0; i < done; i++) free(batch[i]);
+    set_depth(q, q->depth - done);
+    for (unsigned i = n; i-- > done;) {
+        // refund, the frame did not leave
+        q->bucket.tokens += q->bucket.rate ? (int64_t)batch[i]->len : 0;
+        if (batch[i]->bucket && batch[i]->bucket->rate) {
+            batch[i]->bucket->tokens += (int64_t)batch[i]->len;
+        }
+        batch[i]->next = q->head[c];
+        q->head[c] = batch[i];
+    }
+}
+
+void i1905_txq_flush(struct i1905_txq *q) {
+    q->want_write = false;
+    if (!q->depth) return;
+    uint64_t now = now_ns();
+    uint64_t wait = 0;
+    bucket_refill(&q->bucket, now);
+    q->gen++;
+    for (unsigned c = 0; c < I1905_TX_CLASSES && !q->want_write; c++) {
+        bool shaped = c != I1905_TX_CONTROL;
+        struct txq_entry *batch[TXQ_BATCH];
+        unsigned nb = 0;
+        struct txq_entry **pp = &q->head[c];
+        while (*pp) {
+            struct txq_entry *e = *pp;
+            struct i1905_tx_bucket *b = e->bucket;
+            if (b && b->blocked == q->gen) {
+                pp = &e->next;  // an earlier frame of this peer is waiting
+                continue;
+            }
+            if (b) bucket_refill(b, now);
+            if (shaped && !bucket_ready(&q->bucket)) {
+                wait_min(&wait, &q->bucket);
+                break;
+            }
+            if (shaped && b && !bucket_ready(b)) {
+                b->blocked = q->gen;
+                wait_min(&wait, b);
+                pp = &e->next;
+                continue;
+            }
+            bucket_take(&q->bucket, e->len);
+            bucket_take(b, e->len);
+            *pp = e->next;
+            batch[nb++] = e;
+            if (nb == TXQ_BATCH) {
+                txq_flush_batch(q, c, batch, nb);
+                nb = 0;
+                if (q->want_write) break;
+            }
+        }
+        if (nb) txq_flush_batch(q, c, batch, nb);
+        q->tail[c] = NULL;
+        for (struct txq_entry *e = q->head[c]; e; e = e->next) q->tail[c] = e;
+        // lower classes wait while the shared budget is spent
+        if (shaped && !bucket_ready(&q->bucket)) break;
+    }
+    txq_arm(q, wait);
+}